@@ -35,6 +35,7 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include <memory>
@@ -43,6 +44,7 @@
 #include "utils/constants.hxx"
 #include "utils/Hub.hxx"
 #include "utils/GcTcpHub.hxx"
+#include "utils/ShardedHub.hxx"
 #include "utils/ClientConnection.hxx"
 #include "executor/Executor.hxx"
 #include "executor/Service.hxx"
@@ -63,11 +65,15 @@ const char *upstream_host = nullptr;
 bool timestamped = false;
 bool export_mdns = false;
 const char* mdns_name = "openmrn_hub";
+unsigned num_workers = 1;
+/// Upper limit for -w. Each worker is a separate executor thread.
+static const long MAX_WORKERS = 64;
 
 void usage(const char *e)
 {
     fprintf(stderr, "Usage: %s [-p port] [-d device_path] [-u upstream_host] "
-                    "[-q upstream_port] [-m] [-n mdns_name] [-t]\n\n",
+                    "[-q upstream_port] [-m] [-n mdns_name] [-t] "
+                    "[-w num_workers]\n\n",
             e);
     fprintf(stderr, "GridConnect CAN HUB.\nListens to a specific TCP port, "
                     "reads CAN packets from the incoming connections using "
@@ -85,6 +91,9 @@ void usage(const char *e)
             "\t-q upstream_port   is the port number for the upstream hub.\n");
     fprintf(stderr,
             "\t-t prints timestamps for each packet.\n");
+    fprintf(stderr,
+            "\t-w num_workers   spreads the TCP connections across this many "
+            "threads (1 to %ld). Default is 1.\n", MAX_WORKERS);
 #ifdef HAVE_AVAHI_CLIENT
     fprintf(stderr,
             "\t-m exports the current service on mDNS.\n");
@@ -97,7 +106,7 @@ void usage(const char *e)
 void parse_args(int argc, char *argv[])
 {
     int opt;
-    while ((opt = getopt(argc, argv, "hp:d:u:q:tmn:")) >= 0)
+    while ((opt = getopt(argc, argv, "hp:d:u:q:tmn:w:")) >= 0)
     {
         switch (opt)
         {
@@ -126,6 +135,18 @@ void parse_args(int argc, char *argv[])
                 mdns_name = optarg;
                 export_mdns = true;
                 break;
+            case 'w':
+            {
+                char *end;
+                long w = strtol(optarg, &end, 10);
+                if (end == optarg || *end || w < 1 || w > MAX_WORKERS)
+                {
+                    fprintf(stderr, "Invalid number of workers: %s\n", optarg);
+                    usage(argv[0]);
+                }
+                num_workers = w;
+                break;
+            }
             default:
                 fprintf(stderr, "Unknown option %c\n", opt);
                 usage(argv[0]);
@@ -142,7 +163,17 @@ int appl_main(int argc, char *argv[])
 {
     parse_args(argc, argv);
     GcPacketPrinter packet_printer(&can_hub0, timestamped);
-    GcTcpHub hub(&can_hub0, port);
+    std::unique_ptr<ShardedCanHub> sharded_hub;
+    std::unique_ptr<GcTcpHub> hub;
+    if (num_workers > 1)
+    {
+        sharded_hub.reset(new ShardedCanHub(&can_hub0, num_workers));
+        hub.reset(new GcTcpHub(sharded_hub.get(), port));
+    }
+    else
+    {
+        hub.reset(new GcTcpHub(&can_hub0, port));
+    }
     vector<std::unique_ptr<ConnectionClient>> connections;
 
 #ifdef HAVE_AVAHI_CLIENT
@@ -23,6 +23,20 @@ CFLAGS = $(CSHAREDFLAGS) -std=gnu99
 CXXFLAGS = $(CSHAREDFLAGS) -std=c++1y -D__STDC_FORMAT_MACROS \
            -D__STDC_LIMIT_MACROS #-D__LINEAR_MAP__
 
+# Same executor backend as the linux targets. Set EXECUTOR_EPOLL=0 to test the
+# portable pselect() based executor loop.
+EXECUTOR_EPOLL ?= 1
+ifeq ($(EXECUTOR_EPOLL),1)
+CXXFLAGS += -DEXECUTOR_EPOLL
+endif
+
+# Set EXECUTOR_PROFILE=1 to build the tests with the executor profiler (see
+# ExecutorProfiler). Off by default to test the production configuration.
+EXECUTOR_PROFILE ?= 0
+ifeq ($(EXECUTOR_PROFILE),1)
+CXXFLAGS += -DEXECUTOR_PROFILE
+endif
+
 LDFLAGS = $(ARCHOPTIMIZATION) -pg -Wl,-Map="$(@:%=%.map)"
 SYSLIB_SUBDIRS +=
 SYSLIBRARIES = -lrt -lpthread -lgcov -lavahi-client -lavahi-common $(SYSLIBRARIESEXTRA)
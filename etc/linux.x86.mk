@@ -32,6 +32,27 @@ CFLAGS = $(CSHAREDFLAGS) -std=gnu99
 CXXFLAGS = $(CSHAREDFLAGS) -std=c++0x -D__STDC_FORMAT_MACROS \
            -D__STDC_LIMIT_MACROS #-D__LINEAR_MAP__
 
+# Set EXECUTOR_EPOLL=0 to fall back to the portable pselect() based executor
+# loop.
+EXECUTOR_EPOLL ?= 1
+ifeq ($(EXECUTOR_EPOLL),1)
+CXXFLAGS += -DEXECUTOR_EPOLL
+endif
+
+# Set EXECUTOR_PROFILE=1 to collect per-executable run time statistics in the
+# executors (see ExecutorProfiler).
+EXECUTOR_PROFILE ?= 0
+ifeq ($(EXECUTOR_PROFILE),1)
+CXXFLAGS += -DEXECUTOR_PROFILE
+endif
+
+# Set ASYNC_LOGGING=1 to let LOG() calls in C++ code capture their arguments
+# into the AsyncLogger when one is instantiated (see AsyncLogging.hxx).
+ASYNC_LOGGING ?= 0
+ifeq ($(ASYNC_LOGGING),1)
+CXXFLAGS += -DASYNC_LOGGING
+endif
+
 LDFLAGS = $(ARCHOPTIMIZATION) -pg -Wl,-Map="$(@:%=%.map)" -Wl,--undefined=ignore_fn
 
 SYSLIB_SUBDIRS +=
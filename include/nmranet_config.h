@@ -78,6 +78,14 @@ DECLARE_CONST(executor_select_prescaler);
  */
 DECLARE_CONST(executor_max_sleep_msec);
 
+/** Number of executables that get separate counters in the executor profiler
+ * (when compiled with -DEXECUTOR_PROFILE). */
+DECLARE_CONST(executor_profile_entries);
+
+/** Size in bytes of the ring buffer each thread gets in the asynchronous
+ * logger (AsyncLogger). Must be a power of two. */
+DECLARE_CONST(async_log_ring_size);
+
 /** Number of packets to queue in the CANbus device driver for send. Each packet
  * takes 16 bytes of RAM. */
 DECLARE_CONST(can_tx_buffer_size);
@@ -118,6 +126,10 @@ DECLARE_CONST(remote_alias_cache_size);
 /** Number of entries in the local alias cache */
 DECLARE_CONST(local_alias_cache_size);
 
+/** Number of node aliases the CAN interface keeps reserved ahead of demand.
+ * Each of them takes an entry in the local alias cache. */
+DECLARE_CONST(reserved_alias_pool_size);
+
 /** Maximum number of local nodes */
 DECLARE_CONST(local_nodes_count);
 
@@ -129,6 +141,10 @@ DECLARE_CONST(num_datagram_registry_entries);
  * happen concurrently. */
 DECLARE_CONST(num_datagram_clients);
 
+/** Number of incoming multi-frame datagrams that can be reassembled at the
+ * same time on a CAN interface. */
+DECLARE_CONST(datagram_reassembly_slots);
+
 /** Maximum number of memory spaces that can be registered for the MemoryConfig
  * datagram handler. */
 DECLARE_CONST(num_memory_spaces);
@@ -142,5 +158,22 @@ DECLARE_CONST(enable_all_memory_space);
  * standard. */
 DECLARE_CONST(node_init_identify);
 
+/** Set to CONSTANT_TRUE to use the hash-based event registry, which is faster
+ * for nodes with thousands of registered events. */
+DECLARE_CONST(event_registry_use_hash);
+
+/** Set to CONSTANT_TRUE to have the event service collect the responses to
+ * Identify Events messages, and merge contiguous events in unknown state into
+ * producer / consumer range identified messages. */
+DECLARE_CONST(event_identify_coalesce);
+
+/** Maximum rate (messages per second) of the collected Identify Events
+ * responses on each interface. Zero means unlimited. */
+DECLARE_CONST(event_identify_rate);
+
+/** How many collected Identify Events responses may be sent back-to-back
+ * before the event_identify_rate limit applies. */
+DECLARE_CONST(event_identify_burst);
+
 
 #endif /* _nmranet_config_h_ */
@@ -0,0 +1,118 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file ProfilerCommands.hxx
+ *
+ * Console commands for reporting the executor profiler statistics.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#ifndef _CONSOLE_PROFILERCOMMANDS_HXX_
+#define _CONSOLE_PROFILERCOMMANDS_HXX_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "console/Console.hxx"
+#include "executor/ExecutorProfiler.hxx"
+
+/// Adds the "profile" command to a console, which prints, clears or saves the
+/// statistics of an executor profiler.
+///
+/// Usage (the executor needs to be compiled with -DEXECUTOR_PROFILE):
+/// @code
+///   ProfilerCommands profiler_commands(&console, executor.profiler());
+/// @endcode
+class ProfilerCommands
+{
+public:
+    /// Constructor.
+    /// @param console console instance to add the commands to
+    /// @param profiler statistics to report
+    ProfilerCommands(Console *console, ExecutorProfiler *profiler)
+    {
+        console->add_command("profile", profile_command, profiler);
+    }
+
+private:
+    /// Reports the executor statistics.
+    /// @param fp file pointer to console
+    /// @param argc number of arguments including the command itself
+    /// @param argv array of arguments starting with the command itself
+    /// @param context the ExecutorProfiler
+    /// @return COMMAND_OK on success, COMMAND_ERROR on bad arguments or if
+    /// the snapshot could not be written
+    static Console::CommandStatus profile_command(FILE *fp, int argc,
+                                                  const char *argv[],
+                                                  void *context)
+    {
+        if (argc == 0)
+        {
+            fprintf(fp, "print executor statistics\n"
+                        "%sprofile [N] | profile reset | profile save <file>\n",
+                    argv[1]);
+            return Console::COMMAND_OK;
+        }
+
+        ExecutorProfiler *profiler = static_cast<ExecutorProfiler *>(context);
+        if (argc == 1)
+        {
+            profiler->print(fp);
+            return Console::COMMAND_OK;
+        }
+        if (argc == 2 && !strcmp(argv[1], "reset"))
+        {
+            profiler->reset();
+            return Console::COMMAND_OK;
+        }
+        if (argc == 3 && !strcmp(argv[1], "save"))
+        {
+            if (!profiler->write_snapshot(argv[2]))
+            {
+                fprintf(fp, "%s: %s: cannot write file\n", argv[0], argv[2]);
+                return Console::COMMAND_ERROR;
+            }
+            return Console::COMMAND_OK;
+        }
+        if (argc == 2)
+        {
+            int count = atoi(argv[1]);
+            if (count > 0)
+            {
+                profiler->print(fp, count);
+                return Console::COMMAND_OK;
+            }
+        }
+        return Console::COMMAND_ERROR;
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(ProfilerCommands);
+};
+
+#endif // _CONSOLE_PROFILERCOMMANDS_HXX_
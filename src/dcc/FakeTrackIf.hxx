@@ -51,9 +51,12 @@ public:
     ///
     /// @param service defines which executor *this should be running on.
     /// @param pool_size how many packets we should generate ahead of time.
-    FakeTrackIf(Service *service, int pool_size)
+    /// @param packet_nsec how long it takes to "send" one packet.
+    FakeTrackIf(Service *service, int pool_size,
+        long long packet_nsec = MSEC_TO_NSEC(10))
         : StateFlow<Buffer<dcc::Packet>, QList<1>>(service)
         , pool_(sizeof(Buffer<dcc::Packet>), pool_size)
+        , packetNsec_(packet_nsec)
     {
     }
 
@@ -65,7 +68,7 @@ public:
 protected:
     Action entry() OVERRIDE
     {
-        return sleep_and_call(&timer_, MSEC_TO_NSEC(10), STATE(finish));
+        return sleep_and_call(&timer_, packetNsec_, STATE(finish));
     }
 
     /// Do nothing. @return next action.
@@ -76,6 +79,8 @@ protected:
 
     /// Pool of unallocated packets.
     FixedPool pool_;
+    /// Simulated time on the track for a single packet.
+    long long packetNsec_;
     /// Helper object for timing.
     StateFlowTimer timer_{this};
 };
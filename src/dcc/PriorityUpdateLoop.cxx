@@ -0,0 +1,330 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file PriorityUpdateLoop.cxx
+ *
+ * Control flow central to the command station: it decides which train gets
+ * the next packet slot, serving recent changes before the background refresh.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+#include "dcc/PriorityUpdateLoop.hxx"
+
+#include <algorithm>
+#include <string.h>
+
+#include "dcc/Packet.hxx"
+#include "dcc/PacketSource.hxx"
+
+namespace dcc
+{
+
+PriorityUpdateLoop::PriorityUpdateLoop(
+    Service *service, PacketFlowInterface *track_send)
+    : StateFlow(service)
+    , trackSend_(track_send)
+{
+    for (unsigned i = 0; i < NUM_CLASSES; ++i)
+    {
+        credit_[i] = 0;
+    }
+}
+
+PriorityUpdateLoop::~PriorityUpdateLoop()
+{
+    for (auto &it : entries_)
+    {
+        delete it.second;
+    }
+}
+
+void PriorityUpdateLoop::list_push_back(List *l, Hook Entry::*h, Entry *e)
+{
+    (e->*h).prev = l->tail;
+    (e->*h).next = nullptr;
+    if (l->tail)
+    {
+        (l->tail->*h).next = e;
+    }
+    else
+    {
+        l->head = e;
+    }
+    l->tail = e;
+    ++l->size;
+}
+
+void PriorityUpdateLoop::list_remove(List *l, Hook Entry::*h, Entry *e)
+{
+    Hook &hk = e->*h;
+    if (hk.prev)
+    {
+        (hk.prev->*h).next = hk.next;
+    }
+    else
+    {
+        l->head = hk.next;
+    }
+    if (hk.next)
+    {
+        (hk.next->*h).prev = hk.prev;
+    }
+    else
+    {
+        l->tail = hk.prev;
+    }
+    hk.prev = hk.next = nullptr;
+    --l->size;
+}
+
+bool PriorityUpdateLoop::add_refresh_source(
+    dcc::PacketSource *source, unsigned priority)
+{
+    AtomicHolder h(this);
+    if (entries_.find(source) != entries_.end())
+    {
+        return true;
+    }
+    Entry *e = new Entry;
+    e->source = source;
+    e->priority = priority;
+    entries_[source] = e;
+    if (priority >= EXCLUSIVE_MIN_PRIORITY)
+    {
+        exclusive_.push_back(e);
+        if (activeExclusive_ && activeExclusive_->priority > priority)
+        {
+            return false;
+        }
+        activeExclusive_ = e;
+        return true;
+    }
+    list_push_back(&classes_[class_of(priority)], &Entry::refresh, e);
+    return activeExclusive_ == nullptr;
+}
+
+void PriorityUpdateLoop::remove_refresh_source(dcc::PacketSource *source)
+{
+    AtomicHolder h(this);
+    auto it = entries_.find(source);
+    if (it == entries_.end())
+    {
+        return;
+    }
+    Entry *e = it->second;
+    entries_.erase(it);
+    if (e->numPending)
+    {
+        list_remove(&urgent_, &Entry::urgent, e);
+    }
+    if (e->priority >= EXCLUSIVE_MIN_PRIORITY)
+    {
+        exclusive_.erase(std::remove(exclusive_.begin(), exclusive_.end(), e),
+            exclusive_.end());
+        if (activeExclusive_ == e)
+        {
+            activeExclusive_ = nullptr;
+            for (Entry *x : exclusive_)
+            {
+                if (!activeExclusive_ ||
+                    x->priority > activeExclusive_->priority)
+                {
+                    activeExclusive_ = x;
+                }
+            }
+        }
+    }
+    else
+    {
+        unsigned c = class_of(e->priority);
+        list_remove(&classes_[c], &Entry::refresh, e);
+        if (!classes_[c].size)
+        {
+            credit_[c] = 0;
+        }
+    }
+    delete e;
+}
+
+void PriorityUpdateLoop::notify_update(PacketSource *source, unsigned code)
+{
+    AtomicHolder h(this);
+    auto it = entries_.find(source);
+    if (it == entries_.end())
+    {
+        return;
+    }
+    Entry *e = it->second;
+    for (unsigned i = 0; i < e->numPending; ++i)
+    {
+        if (e->pending[i] == code)
+        {
+            // Already queued; the packet will carry the latest state anyway.
+            return;
+        }
+    }
+    if (e->numPending == 0)
+    {
+        list_push_back(&urgent_, &Entry::urgent, e);
+    }
+    else if (e->numPending == MAX_PENDING)
+    {
+        // Drops the oldest update. The background refresh will repeat it.
+        memmove(e->pending, e->pending + 1,
+            (MAX_PENDING - 1) * sizeof(e->pending[0]));
+        --e->numPending;
+    }
+    e->pending[e->numPending++] = code;
+}
+
+PriorityUpdateLoop::Entry *PriorityUpdateLoop::pick_urgent(
+    long long now, unsigned *code)
+{
+    // Skips over (at most a few) sources that got a packet very recently.
+    Entry *e = urgent_.head;
+    for (unsigned i = 0; e && i < MAX_URGENT_BURST; ++i, e = e->urgent.next)
+    {
+        if (now - e->lastSent < MIN_PACKET_SPACING_NSEC)
+        {
+            continue;
+        }
+        *code = e->pending[0];
+        --e->numPending;
+        memmove(e->pending, e->pending + 1,
+            e->numPending * sizeof(e->pending[0]));
+        list_remove(&urgent_, &Entry::urgent, e);
+        if (e->numPending)
+        {
+            // Other sources' updates go first.
+            list_push_back(&urgent_, &Entry::urgent, e);
+        }
+        return e;
+    }
+    return nullptr;
+}
+
+PriorityUpdateLoop::Entry *PriorityUpdateLoop::pick_refresh(long long now)
+{
+    // Smooth weighted round-robin between the classes: each class earns
+    // credit in proportion to its total weight, and the richest class pays
+    // for the slot.
+    int total = 0;
+    int best = -1;
+    for (unsigned c = 0; c < NUM_CLASSES; ++c)
+    {
+        if (!classes_[c].size)
+        {
+            continue;
+        }
+        int w = classes_[c].size << c;
+        credit_[c] += w;
+        total += w;
+        if (best < 0 || credit_[c] > credit_[best])
+        {
+            best = c;
+        }
+    }
+    if (best < 0)
+    {
+        return nullptr;
+    }
+    credit_[best] -= total;
+    Entry *e = classes_[best].head;
+    if (now - e->lastSent < MIN_PACKET_SPACING_NSEC)
+    {
+        return nullptr;
+    }
+    return e;
+}
+
+void PriorityUpdateLoop::mark_sent(Entry *e, long long now)
+{
+    e->lastSent = now;
+    if (e->priority < EXCLUSIVE_MIN_PRIORITY)
+    {
+        List *l = &classes_[class_of(e->priority)];
+        list_remove(l, &Entry::refresh, e);
+        list_push_back(l, &Entry::refresh, e);
+    }
+}
+
+StateFlowBase::Action PriorityUpdateLoop::entry()
+{
+    long long now = os_get_time_monotonic();
+    PacketSource *source = nullptr;
+    unsigned code = 0;
+    {
+        AtomicHolder h(this);
+        Entry *e = nullptr;
+        if (activeExclusive_)
+        {
+            e = activeExclusive_;
+        }
+        else
+        {
+            bool refresh_first = urgentBurst_ >= MAX_URGENT_BURST;
+            if (refresh_first)
+            {
+                e = pick_refresh(now);
+            }
+            if (!e && (e = pick_urgent(now, &code)) != nullptr)
+            {
+                ++urgentBurst_;
+            }
+            else if (!e && !refresh_first)
+            {
+                e = pick_refresh(now);
+            }
+            if (e && !code)
+            {
+                urgentBurst_ = 0;
+            }
+            if (e)
+            {
+                mark_sent(e, now);
+            }
+        }
+        if (e)
+        {
+            source = e->source;
+        }
+    }
+    if (source)
+    {
+        source->get_next_packet(code, message()->data());
+    }
+    else
+    {
+        // Nothing to send, or every candidate got a packet too recently.
+        message()->data()->set_dcc_idle();
+    }
+    trackSend_->send(transfer_message());
+    return exit();
+}
+
+} // namespace dcc
@@ -0,0 +1,182 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file PriorityUpdateLoop.hxx
+ *
+ * Control flow central to the command station: it decides which train gets
+ * the next packet slot, serving recent changes before the background refresh.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+#ifndef _DCC_PRIORITYUPDATELOOP_HXX_
+#define _DCC_PRIORITYUPDATELOOP_HXX_
+
+#include <unordered_map>
+#include <vector>
+
+#include "dcc/UpdateLoop.hxx"
+#include "executor/StateFlow.hxx"
+
+namespace dcc
+{
+
+/// Implementation of a command station update loop with prioritization.
+///
+/// - Sources that call notify_update() are put on an urgent queue and get
+/// the next packet slot, in FIFO order. Every MAX_URGENT_BURST urgent
+/// packets one background refresh packet is sent, so that a stream of
+/// updates cannot starve the refresh.
+///
+/// - The background refresh is a weighted round-robin. The priority of a
+/// source selects one of NUM_CLASSES classes, and class c refreshes each of
+/// its members 2^c times as often as class 0. Within a class, a source that
+/// just got a packet (urgent or refresh) goes to the end of the line.
+///
+/// - Sources with priority at least EXCLUSIVE_MIN_PRIORITY (e.g. estop,
+/// programming track) receive all packet slots while they are registered;
+/// only the highest such source is polled.
+///
+/// - No source gets two packets within MIN_PACKET_SPACING_NSEC; idle packets
+/// are sent instead.
+///
+/// Adding, removing and notifying sources is O(1).
+///
+/// Usage is the same as @ref SimpleUpdateLoop.
+class PriorityUpdateLoop : public StateFlow<Buffer<dcc::Packet>, QList<1>>,
+                           private UpdateLoopBase
+{
+public:
+    /// Constructor.
+    /// @param service defines which executor this flow will run on.
+    /// @param track_send is where the filled packets are forwarded to.
+    PriorityUpdateLoop(Service *service, PacketFlowInterface *track_send);
+    ~PriorityUpdateLoop();
+
+    /// Number of weight classes of the background refresh.
+    static constexpr unsigned NUM_CLASSES = 4;
+    /// How many urgent packets we send before a background refresh packet.
+    static constexpr unsigned MAX_URGENT_BURST = 4;
+    /// How many update codes we remember per source.
+    static constexpr unsigned MAX_PENDING = 4;
+    /// Minimum time between two packets sent to the same source.
+    static constexpr long long MIN_PACKET_SPACING_NSEC = MSEC_TO_NSEC(5);
+
+    bool add_refresh_source(
+        dcc::PacketSource *source, unsigned priority) override;
+
+    void remove_refresh_source(dcc::PacketSource *source) override;
+
+    void notify_update(PacketSource *source, unsigned code) override;
+
+    // Entry to the state flow -- when a new packet needs to be sent.
+    Action entry() override;
+
+private:
+    struct Entry;
+
+    /// Intrusive doubly linked list membership of an Entry.
+    struct Hook
+    {
+        Entry *prev{nullptr};
+        Entry *next{nullptr};
+    };
+
+    /// Intrusive doubly linked list of Entries.
+    struct List
+    {
+        Entry *head{nullptr};
+        Entry *tail{nullptr};
+        unsigned size{0};
+    };
+
+    /// Book-keeping of one packet source.
+    struct Entry
+    {
+        PacketSource *source;
+        unsigned priority;
+        /// os time when we last sent a packet to this source.
+        long long lastSent{0};
+        /// Membership in a background refresh class.
+        Hook refresh;
+        /// Membership in the urgent queue.
+        Hook urgent;
+        /// Number of valid entries in pending.
+        uint8_t numPending{0};
+        /// Update codes waiting to be sent, oldest first.
+        unsigned pending[MAX_PENDING];
+    };
+
+    /// Appends an entry to the end of a list.
+    static void list_push_back(List *l, Hook Entry::*h, Entry *e);
+    /// Removes an entry from a list.
+    static void list_remove(List *l, Hook Entry::*h, Entry *e);
+
+    /// @return which background refresh class a priority belongs to.
+    static unsigned class_of(unsigned priority)
+    {
+        unsigned c = priority >> 6;
+        return c < NUM_CLASSES ? c : NUM_CLASSES - 1;
+    }
+
+    /// Picks the next urgent update to send. Must be called with the lock
+    /// held. @param now is the current os time. @param code will be set to
+    /// the update code. @return the entry, or nullptr if there is nothing to
+    /// send.
+    Entry *pick_urgent(long long now, unsigned *code);
+
+    /// Picks the next background refresh entry. Must be called with the lock
+    /// held. @param now is the current os time. @return the entry, or
+    /// nullptr if an idle packet should be sent.
+    Entry *pick_refresh(long long now);
+
+    /// Records that a packet was sent to an entry. Must be called with the
+    /// lock held.
+    void mark_sent(Entry *e, long long now);
+
+    /// Place where we forward the packets filled in.
+    PacketFlowInterface *trackSend_;
+
+    /// Lookup from packet source to its book-keeping entry.
+    std::unordered_map<PacketSource *, Entry *> entries_;
+    /// Background refresh lists, by weight class.
+    List classes_[NUM_CLASSES];
+    /// Smooth weighted round-robin accumulator for each class.
+    int credit_[NUM_CLASSES];
+    /// Sources with a pending update, in order of notification.
+    List urgent_;
+    /// Registered exclusive sources (priority >= EXCLUSIVE_MIN_PRIORITY).
+    std::vector<Entry *> exclusive_;
+    /// The exclusive source with the highest priority, or nullptr.
+    Entry *activeExclusive_{nullptr};
+    /// Number of urgent packets sent since the last background refresh.
+    unsigned urgentBurst_{0};
+};
+
+} // namespace dcc
+
+#endif // _DCC_PRIORITYUPDATELOOP_HXX_
@@ -35,6 +35,8 @@
 #ifndef _EXECUTOR_DISPATCHER_HXX_
 #define _EXECUTOR_DISPATCHER_HXX_
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 
 #include "executor/Notifiable.hxx"
@@ -46,6 +48,15 @@
    invoked.
 
    Handlers are called in no particular order.
+
+   The register and unregister calls only edit a list of registrations under
+   a lock and mark it as changed. The flow keeps its own lookup index, in
+   which the handlers are grouped by mask and sorted by the masked
+   identifier, so the matching handlers are found with a binary search per
+   distinct mask instead of testing every registration. The index is rebuilt
+   when the next message arrives after a change, thus any number of
+   registration changes between two messages cost one rebuild, and messages
+   are dispatched without taking the lock when nothing changed.
  */
 template <int NUM_PRIO>
 class DispatchFlowBase : public UntypedStateFlow<QList<NUM_PRIO>>
@@ -101,15 +112,24 @@ protected:
     /// Returns the current message's ID.
     virtual ID get_message_id() = 0;
 
-    /** Allocates an entry from lastHandlerToCall_, invoking clone() when done:
-     *  return allocate_and_call(lastHandlerToCall_, STATE(clone));
+    /** Allocates an entry from last_handler(), invoking clone() when done:
+     *  return allocate_and_call(last_handler(), STATE(clone));
      */
     virtual Action allocate_and_clone() = 0;
 
-    /** Sends the current message to lastHandlerToCall, transferring ownership.
+    /** Sends the current message to last_handler(), transferring ownership.
      */
     virtual void send_transfer() = 0;
 
+    /// @return the handler we still need to call, or nullptr if there is none
+    /// or it got unregistered since it was found.
+    UntypedHandler *last_handler()
+    {
+        return lastHandlerToCall_ ? lastHandlerToCall_->handler.load(
+                                        std::memory_order_acquire)
+                                  : nullptr;
+    }
+
     /*typedef typename StateFlow<MessageType, QList<NUM_PRIO>>::Callback Callback;
     using StateFlow<MessageType, QList<NUM_PRIO>>::again;
     using StateFlow<MessageType, QList<NUM_PRIO>>::allocate_and_call;
@@ -145,16 +165,25 @@ private:
     friend class GenericHubFlow;
 
     /// Internal information we store about each registered handler:
-    /// identifier, mask, handler pointer.
+    /// identifier, mask, handler pointer. The lookup index of the flow points
+    /// to these objects.
     struct HandlerInfo
     {
-        HandlerInfo() : handler(nullptr)
+        /// Constructor.
+        /// @param id bits that this handler is registered for
+        /// @param mask mask to apply for the bits check
+        /// @param handler handler to call
+        HandlerInfo(ID id, ID mask, UntypedHandler *handler)
+            : id(id)
+            , mask(mask)
+            , handler(handler)
         {
         }
         ID id; ///< Bits that this handler is registered for.
         ID mask; ///< Mask that should be applied for the bits check.
-        /// Handler to call. NULL if the handler has been removed.
-        UntypedHandler *handler;
+        /// Handler to call. NULL if the handler has been removed; the index
+        /// of a message being dispatched may still refer to this entry.
+        std::atomic<UntypedHandler *> handler;
 
         /// Equality comparison function on the handlers. Used for remove()
         /// calls.
@@ -168,21 +197,91 @@ private:
         bool Equals(ID id, ID mask, UntypedHandler *handler)
         {
             return (this->id == id && this->mask == mask &&
-                    this->handler == handler);
+                    this->handler.load(std::memory_order_relaxed) == handler);
         }
     };
 
-    /// Registered handlers.
-    vector<HandlerInfo> handlers_;
+    /// One entry of the lookup index.
+    struct IndexEntry
+    {
+        /// Registered id & mask.
+        ID key;
+        /// Registration this entry belongs to.
+        HandlerInfo *info;
+
+        /// Sorting order within a group. @param o other entry @return true
+        /// if this should come before o.
+        bool operator<(const IndexEntry &o) const
+        {
+            return key < o.key;
+        }
+    };
 
-    /// Index of the next handler to look at.
-    size_t currentIndex_;
+    /// Registrations sharing the same mask.
+    struct MaskGroup
+    {
+        /// Mask of all handlers in this group.
+        ID mask;
+        /// First entry of the group in index_.
+        unsigned begin;
+        /// One past the last entry of the group in index_.
+        unsigned end;
+    };
 
-protected:
-    /// If non-NULL we still need to call this handler.
-    UntypedHandler *lastHandlerToCall_;
-private:
-    /// Protects handler add / remove against iteration.
+    /// Takes a registration off the list. Must be called with lock_ held.
+    /// @param info registration to remove, already taken off handlers_.
+    void retire(HandlerInfo *info);
+
+    /// Recomputes groups_ and index_ from handlers_. Called from the flow
+    /// only, with lock_ held.
+    void rebuild_index();
+
+    /// Finds the next handler matching the current message.
+    /// @param id identifier of the current message.
+    /// @return next matching registration, or nullptr when done.
+    HandlerInfo *next_match(ID id);
+
+    /// All registrations in the order of registering. Guarded by lock_.
+    vector<HandlerInfo *> handlers_;
+    /// Removed registrations that the flow may still be looking at. They
+    /// become free when the index is rebuilt. Guarded by lock_.
+    vector<HandlerInfo *> dead_;
+    /// Removed registrations that nothing refers to anymore. Reused by
+    /// register_handler. Guarded by lock_.
+    vector<HandlerInfo *> free_;
+    /// true if handlers_ changed since the index was built.
+    std::atomic<bool> dirty_;
+    /// true while the flow is dispatching a message (and thus might be
+    /// looking at the index).
+    std::atomic<bool> dispatching_;
+
+    /// One entry per distinct mask. Owned by the flow.
+    vector<MaskGroup> groups_;
+    /// Registrations sorted by group, then by the masked identifier. Owned
+    /// by the flow.
+    vector<IndexEntry> index_;
+
+    /// Group index of the current message being looked at; -1 before the
+    /// first group.
+    int currentGroup_;
+    /// Next index entry to look at.
+    unsigned currentPos_;
+    /// End of the index range being looked at.
+    unsigned currentEnd_;
+    /// When negating the match: start of the range of the next part of the
+    /// group to look at.
+    unsigned skipEnd_;
+    /// When negating the match: end of the current group, if we still need
+    /// to look at the entries after the excluded range; otherwise zero.
+    unsigned groupEnd_;
+
+    /// Registration that will receive the message after lastHandlerToCall_.
+    HandlerInfo *nextHandler_;
+    /// If non-NULL we still need to call this registration. Owned by the
+    /// flow; unregistering clears the handler inside.
+    HandlerInfo *lastHandlerToCall_;
+
+    /// Serializes the handler add / remove calls.
     OSMutex lock_;
 };
 
@@ -268,19 +367,19 @@ protected:
 
     /// Requests allocating a new buffer for sending off a clone.
     Action allocate_and_clone() OVERRIDE {
-        if (!this->lastHandlerToCall_) {
+        HandlerType* h = static_cast<HandlerType *>(this->last_handler());
+        if (!h) {
             // got unregistered.
             return call_immediately(STATE(clone_done));
         }
-        HandlerType* h = static_cast<HandlerType *>(this->lastHandlerToCall_);
         return allocate_and_call(h, STATE(clone));
     }
 
     /// Takes the allocated new buffer, copies the message into it and sends
     /// off to the clone target. @return next action.
     Action clone() {
-        HandlerType* h = static_cast<HandlerType *>(this->lastHandlerToCall_);
-        if (!this->lastHandlerToCall_) {  // got unregistered
+        HandlerType* h = static_cast<HandlerType *>(this->last_handler());
+        if (!h) {  // got unregistered
             BufferBase* b;
             this->cast_allocation_result(&b);
             if (b) this->get_allocation_result(h)->unref();
@@ -294,9 +393,9 @@ protected:
     }
 
     /// Takes the existing buffer and sends off to the target flow. Only used
-    /// as the last action. Requires: lastHandlerToCall != nullptr.
+    /// as the last action. Requires: last_handler() != nullptr.
     void send_transfer() OVERRIDE {
-        HandlerType* h = static_cast<HandlerType *>(this->lastHandlerToCall_);
+        HandlerType* h = static_cast<HandlerType *>(this->last_handler());
         h->send(this->transfer_message());
     }
 };
@@ -308,6 +407,9 @@ template <int NUM_PRIO>
 DispatchFlowBase<NUM_PRIO>::DispatchFlowBase(Service *service)
     : UntypedStateFlow<QList<NUM_PRIO>>(service)
     , negateMatch_(false)
+    , dirty_(false)
+    , dispatching_(false)
+    , nextHandler_(nullptr)
     , lastHandlerToCall_(nullptr)
 {
 }
@@ -316,21 +418,72 @@ template<int NUM_PRIO>
 DispatchFlowBase<NUM_PRIO>::~DispatchFlowBase()
 {
     HASSERT(this->is_waiting());
+    for (auto *v : {&handlers_, &dead_, &free_})
+    {
+        for (HandlerInfo *h : *v)
+        {
+            delete h;
+        }
+    }
 }
 
 template<int NUM_PRIO>
-size_t DispatchFlowBase<NUM_PRIO>::size()
+void DispatchFlowBase<NUM_PRIO>::rebuild_index()
 {
-    OSMutexLock h(&lock_);
-    size_t ret = 0;
-    for (auto &h : handlers_)
+    dirty_.store(false, std::memory_order_relaxed);
+    // The old index is not used anymore, thus nothing refers to the removed
+    // registrations.
+    free_.insert(free_.end(), dead_.begin(), dead_.end());
+    dead_.clear();
+    index_.clear();
+    groups_.clear();
+    for (HandlerInfo *h : handlers_)
     {
-        if (h.handler)
+        index_.push_back({h->id & h->mask, h});
+    }
+    // Orders by mask first, so that each mask forms a contiguous group.
+    std::sort(index_.begin(), index_.end(),
+        [](const IndexEntry &a, const IndexEntry &b) {
+            if (a.info->mask != b.info->mask)
+            {
+                return a.info->mask < b.info->mask;
+            }
+            return a.key < b.key;
+        });
+    for (unsigned i = 0; i < index_.size(); ++i)
+    {
+        if (groups_.empty() || groups_.back().mask != index_[i].info->mask)
         {
-            ++ret;
+            groups_.push_back({index_[i].info->mask, i, i});
         }
+        groups_.back().end = i + 1;
+    }
+}
+
+template<int NUM_PRIO>
+void DispatchFlowBase<NUM_PRIO>::retire(HandlerInfo *info)
+{
+    info->handler.store(nullptr, std::memory_order_release);
+    // Pairs with entry(): either the flow sees dirty_ and rebuilds its index
+    // before looking at it again, or we see that it is dispatching.
+    dirty_.store(true);
+    if (dispatching_.load())
+    {
+        dead_.push_back(info);
+        return;
     }
-    return ret;
+    // No message is being dispatched, so the index will not be looked at
+    // before it is rebuilt.
+    free_.insert(free_.end(), dead_.begin(), dead_.end());
+    dead_.clear();
+    free_.push_back(info);
+}
+
+template<int NUM_PRIO>
+size_t DispatchFlowBase<NUM_PRIO>::size()
+{
+    OSMutexLock h(&lock_);
+    return handlers_.size();
 }
 
 template<int NUM_PRIO>
@@ -338,18 +491,21 @@ void DispatchFlowBase<NUM_PRIO>::register_handler(UntypedHandler *handler,
                                                   ID id, ID mask)
 {
     OSMutexLock h(&lock_);
-    size_t idx = 0;
-    while (idx < handlers_.size() && handlers_[idx].handler)
+    HandlerInfo *info;
+    if (free_.empty())
     {
-        ++idx;
+        info = new HandlerInfo(id, mask, handler);
     }
-    if (idx >= handlers_.size())
+    else
     {
-        handlers_.resize(handlers_.size() + 1);
+        info = free_.back();
+        free_.pop_back();
+        info->id = id;
+        info->mask = mask;
+        info->handler.store(handler, std::memory_order_relaxed);
     }
-    handlers_[idx].handler = handler;
-    handlers_[idx].id = id;
-    handlers_[idx].mask = mask;
+    handlers_.push_back(info);
+    dirty_.store(true, std::memory_order_relaxed);
 }
 
 template<int NUM_PRIO>
@@ -358,23 +514,18 @@ DispatchFlowBase<NUM_PRIO>::unregister_handler(UntypedHandler *handler,
                                                ID id, ID mask)
 {
     OSMutexLock h(&lock_);
-    /// @todo(balazs.racz) optimize by looking at the current index - 1.
     size_t idx = 0;
-    while (idx < handlers_.size() && !handlers_[idx].Equals(id, mask, handler))
+    while (idx < handlers_.size() &&
+           !handlers_[idx]->Equals(id, mask, handler))
     {
         ++idx;
     }
     // Checks that we found the thing to unregister.
     HASSERT(idx < handlers_.size() &&
             "Tried to unregister a handler not previously registered.");
-    if (lastHandlerToCall_ == handlers_[idx].handler) {
-        lastHandlerToCall_ = nullptr;
-    }
-    handlers_[idx].handler = nullptr;
-    if (idx == handlers_.size() - 1)
-    {
-        handlers_.resize(handlers_.size() - 1);
-    }
+    HandlerInfo *info = handlers_[idx];
+    handlers_.erase(handlers_.begin() + idx);
+    retire(info);
 }
 
 template<int NUM_PRIO>
@@ -382,84 +533,129 @@ void DispatchFlowBase<NUM_PRIO>::unregister_handler_all(
     UntypedHandler *handler)
 {
     OSMutexLock h(&lock_);
+    size_t dst = 0;
     for (size_t i = 0; i < handlers_.size(); ++i)
     {
-        if (handlers_[i].handler == handler)
+        HandlerInfo *info = handlers_[i];
+        if (info->handler.load(std::memory_order_relaxed) == handler)
         {
-            handlers_[i].handler = nullptr;
+            retire(info);
+        }
+        else
+        {
+            handlers_[dst++] = info;
         }
     }
-    while (!handlers_.empty() && handlers_.back().handler == nullptr)
-    {
-        handlers_.pop_back();
-    }
+    handlers_.resize(dst);
 }
 
 template<int NUM_PRIO>
 StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::entry()
 {
-    currentIndex_ = 0;
+    // Pairs with retire(). Both sides write their own flag and then read the
+    // other one's.
+    dispatching_.store(true);
+    if (dirty_.load())
+    {
+        OSMutexLock h(&lock_);
+        rebuild_index();
+    }
+    currentGroup_ = -1;
+    currentPos_ = currentEnd_ = 0;
+    groupEnd_ = 0;
     lastHandlerToCall_ = nullptr;
     return call_immediately(STATE(iterate));
 }
 
 template<int NUM_PRIO>
-StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::iterate()
+typename DispatchFlowBase<NUM_PRIO>::HandlerInfo *
+DispatchFlowBase<NUM_PRIO>::next_match(ID id)
 {
-    ID id = get_message_id();
+    while (true)
     {
-        // @todo(balazs.racz) make the registered handlers structure for the
-        // dispatcher lock-free. This mutex here is very expensive.
-        OSMutexLock l(&lock_);
-        for (; currentIndex_ < handlers_.size(); ++currentIndex_)
+        while (currentPos_ < currentEnd_)
         {
-            auto &h = handlers_[currentIndex_];
-            if (!h.handler)
+            HandlerInfo *info = index_[currentPos_++].info;
+            if (info->handler.load(std::memory_order_relaxed))
             {
-                continue;
+                return info;
             }
-            if (negateMatch_ && (id & h.mask) == (h.id & h.mask))
-            {
-                continue;
-            }
-            if ((!negateMatch_) && (id & h.mask) != (h.id & h.mask))
-            {
-                continue;
-            }
-            // At this point: we have another handler.
-            if (!lastHandlerToCall_)
-            {
-                // This was the first we found.
-                lastHandlerToCall_ = handlers_[currentIndex_].handler;
-                continue;
-            }            
-            break;
+        }
+        if (groupEnd_)
+        {
+            // Negated match: continue after the excluded range.
+            currentPos_ = skipEnd_;
+            currentEnd_ = groupEnd_;
+            groupEnd_ = 0;
+            continue;
+        }
+        if (++currentGroup_ >= (int)groups_.size())
+        {
+            return nullptr;
+        }
+        const MaskGroup &g = groups_[currentGroup_];
+        IndexEntry key{id & g.mask, nullptr};
+        auto range = std::equal_range(
+            index_.begin() + g.begin, index_.begin() + g.end, key);
+        unsigned lo = range.first - index_.begin();
+        unsigned hi = range.second - index_.begin();
+        if (negateMatch_)
+        {
+            currentPos_ = g.begin;
+            currentEnd_ = lo;
+            skipEnd_ = hi;
+            groupEnd_ = g.end;
+        }
+        else
+        {
+            currentPos_ = lo;
+            currentEnd_ = hi;
         }
     }
-    if (currentIndex_ >= handlers_.size())
+}
+
+template<int NUM_PRIO>
+StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::iterate()
+{
+    ID id = get_message_id();
+    HandlerInfo *info;
+    while ((info = next_match(id)) != nullptr)
+    {
+        // At this point: we have another handler.
+        if (!lastHandlerToCall_)
+        {
+            // This was the first we found.
+            lastHandlerToCall_ = info;
+            continue;
+        }
+        break;
+    }
+    if (!info)
     {
         return iteration_done();
     }
     // Now: we have at least two different handler. We need to clone the
     // message. We use the pool of the last handler to call by default.
+    nextHandler_ = info;
     return allocate_and_clone();
 }
 
 template<int NUM_PRIO>
 StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::clone_done()
 {
-    lastHandlerToCall_ = handlers_[currentIndex_].handler;
-    ++currentIndex_;
+    lastHandlerToCall_ = nextHandler_;
     return call_immediately(STATE(iterate));
 }
 
 template<int NUM_PRIO>
 StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::iteration_done()
 {
-    if (lastHandlerToCall_)
+    if (last_handler())
     {
         send_transfer();
     }
+    lastHandlerToCall_ = nullptr;
+    dispatching_.store(false);
     return release_and_exit();
 }
 
@@ -64,6 +64,12 @@ public:
     {
         HASSERT(0 && "unexpected call to alloc_result");
     }
+
+#ifdef EXECUTOR_PROFILE
+    /// When this executable was last added to an executor queue, or zero if
+    /// unknown. Used for measuring the queue wait time.
+    long long profileEnqueueNsec_{0};
+#endif
 };
 
 #endif // _EXECUTOR_EXECUTABLE_HXX_
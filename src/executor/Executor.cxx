@@ -43,6 +43,10 @@
 #include <sys/select.h>
 #endif
 
+#ifdef EXECUTOR_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #endif
@@ -70,14 +74,22 @@ Executable::~Executable() {
 ExecutorBase::ExecutorBase()
     : name_(NULL) /** @todo (Stuart Baker) is "name" still in use? */
     , activeTimers_(this)
+#ifdef EXECUTOR_PROFILE
+    , profiler_(config_executor_profile_entries())
+#endif
     , done_(0)
     , started_(0)
     , selectPrescaler_(0)
 {
+#ifdef EXECUTOR_EPOLL
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    HASSERT(epollFd_ >= 0);
+#else
     FD_ZERO(&selectRead_);
     FD_ZERO(&selectWrite_);
     FD_ZERO(&selectExcept_);
     selectNFds_ = 0;
+#endif
 }
 
 /** Lookup an executor by its name.
@@ -174,9 +186,7 @@ bool ExecutorBase::loop_once()
         done_ = 1;
         return false;
     }
-    current_ = msg;
-    msg->run();
-    current_ = nullptr;
+    run_executable(msg);
     return true;
 }
 
@@ -197,9 +207,7 @@ long long ICACHE_FLASH_ATTR  ExecutorBase::loop_some() {
         }
         if (msg != NULL)
         {
-            current_ = msg;
-            msg->run();
-            current_ = nullptr;
+            run_executable(msg);
         }
     }
     // Still stuff pending to run.
@@ -281,6 +289,15 @@ void *ExecutorBase::entry()
     started_ = 1;
     sequence_ = 0;
     selectHelper_.lock_to_thread();
+#ifdef EXECUTOR_EPOLL
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = selectHelper_.wakeup_fd();
+        HASSERT(
+            !epoll_ctl(epollFd_, EPOLL_CTL_ADD, selectHelper_.wakeup_fd(), &ev));
+    }
+#endif
     /* wait for messages to process */
     for (; /* forever */;)
     {
@@ -306,15 +323,139 @@ void *ExecutorBase::entry()
         if (msg != NULL)
         {
             ++sequence_;
-            current_ = msg;
-            msg->run();
-            current_ = nullptr;
+            run_executable(msg);
         }
     }
 
     return NULL;
 }
 
+#ifdef EXECUTOR_EPOLL
+
+/// Maps a select type to the epoll event flag. Indexed by SelectType - 1.
+static const uint32_t EPOLL_EVENT_FOR_TYPE[3] = {EPOLLIN, EPOLLOUT, EPOLLPRI};
+
+void ExecutorBase::epoll_update(int fd)
+{
+    EpollSlot &slot = epollSlots_[fd];
+    uint32_t events = 0;
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        if (slot.jobs[i])
+        {
+            events |= EPOLL_EVENT_FOR_TYPE[i];
+        }
+    }
+    if (events == slot.events)
+    {
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = events | EPOLLONESHOT;
+    ev.data.fd = fd;
+    slot.events = events;
+    if (!events)
+    {
+        // The fd may have been closed already, which removed it from the
+        // epoll set implicitly.
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, &ev);
+        return;
+    }
+    // A disarmed fd usually stays in the epoll set, so we re-arm it with a
+    // single MOD. If it was closed and the number got reused, it is gone from
+    // the set and needs to be added again.
+    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev) && errno == ENOENT)
+    {
+        HASSERT(!epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev));
+    }
+}
+
+void ExecutorBase::select(Selectable *job)
+{
+    Selectable **slot = epoll_slot(job);
+    if (*slot)
+    {
+        LOG(FATAL,
+            "Multiple Selectables are waiting for the same fd %d type %u",
+            (int)job->fd_, job->selectType_);
+    }
+    *slot = job;
+    epoll_update(job->fd_);
+}
+
+bool ExecutorBase::is_selected(Selectable *job)
+{
+    return *epoll_slot(job) != nullptr;
+}
+
+void ExecutorBase::unselect(Selectable *job)
+{
+    Selectable **slot = epoll_slot(job);
+    if (!*slot)
+    {
+        LOG(FATAL, "Tried to remove a non-active selectable: fd %d type %u",
+            (int)job->fd_, job->selectType_);
+    }
+    *slot = nullptr;
+    epoll_update(job->fd_);
+}
+
+void ExecutorBase::wait_with_select(long long wait_length)
+{
+    /// How many ready fds we process in one round of the loop.
+    static constexpr int MAX_EVENTS = 64;
+    struct epoll_event events[MAX_EVENTS];
+    if (!empty())
+    {
+        wait_length = 0;
+    }
+    long long max_sleep = MSEC_TO_NSEC(config_executor_max_sleep_msec());
+    if (wait_length > max_sleep)
+    {
+        wait_length = max_sleep;
+    }
+#ifdef EXECUTOR_PROFILE
+    long long start = ExecutorProfiler::now();
+#endif
+    int ret =
+        selectHelper_.epoll_wait(epollFd_, events, MAX_EVENTS, wait_length);
+#ifdef EXECUTOR_PROFILE
+    profiler_.record_select(ExecutorProfiler::now() - start);
+#endif
+    for (int i = 0; i < ret; ++i)
+    {
+        int fd = events[i].data.fd;
+        uint32_t ev = events[i].events;
+        if ((unsigned)fd >= epollSlots_.size())
+        {
+            continue;
+        }
+        EpollSlot &slot = epollSlots_[fd];
+        // All fds are registered with EPOLLONESHOT, so the kernel has
+        // disarmed this fd now.
+        slot.events = 0;
+        for (unsigned t = 0; t < 3; ++t)
+        {
+            Selectable *job = slot.jobs[t];
+            if (!job)
+            {
+                continue;
+            }
+            // Errors and hangups are reported to every waiter, same as
+            // select() would mark the fd as ready in all sets.
+            if (ev & (EPOLL_EVENT_FOR_TYPE[t] | EPOLLERR | EPOLLHUP))
+            {
+                add(job->wakeup_, job->priority_);
+                slot.jobs[t] = nullptr;
+            }
+        }
+        // Re-arms for the waiters that did not trigger.
+        epoll_update(fd);
+    }
+}
+
+#else
+
 void ExecutorBase::select(Selectable *job)
 {
     fd_set *s = get_select_set(job->type());
@@ -380,7 +521,13 @@ void ExecutorBase::wait_with_select(long long wait_length)
     {
         wait_length = max_sleep;
     }
+#ifdef EXECUTOR_PROFILE
+    long long start = ExecutorProfiler::now();
+#endif
     int ret = selectHelper_.select(selectNFds_, &fd_r, &fd_w, &fd_x, wait_length);
+#ifdef EXECUTOR_PROFILE
+    profiler_.record_select(ExecutorProfiler::now() - start);
+#endif
     if (ret <= 0) {
         return; // nothing to do
     }
@@ -405,6 +552,8 @@ void ExecutorBase::wait_with_select(long long wait_length)
     selectNFds_ = max_fd;
 }
 
+#endif // EXECUTOR_EPOLL
+
 #endif
 
 void ExecutorBase::shutdown()
@@ -423,4 +572,7 @@ ExecutorBase::~ExecutorBase()
     {
         shutdown();
     }
+#ifdef EXECUTOR_EPOLL
+    ::close(epollFd_);
+#endif
 }
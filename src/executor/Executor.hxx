@@ -37,8 +37,14 @@
 #define _EXECUTOR_EXECUTOR_HXX_
 
 #include <functional>
+#ifdef EXECUTOR_EPOLL
+#include <vector>
+#endif
 
 #include "executor/Executable.hxx"
+#ifdef EXECUTOR_PROFILE
+#include "executor/ExecutorProfiler.hxx"
+#endif
 #include "executor/Notifiable.hxx"
 #include "executor/Selectable.hxx"
 #include "executor/Timer.hxx"
@@ -159,6 +165,14 @@ public:
     /// @return a number that gets incremented by one every time an executable
     /// runs.
     virtual uint32_t sequence() = 0;
+
+#ifdef EXECUTOR_PROFILE
+    /// @return the run time statistics of this executor.
+    ExecutorProfiler *profiler()
+    {
+        return &profiler_;
+    }
+#endif
     
 protected:
     /** Thread entry point.
@@ -178,6 +192,28 @@ private:
      */
     virtual Executable *next(unsigned *priority) = 0;
 
+    /** Runs an executable taken from the queue, and accounts it in the
+     * profiler if enabled. @param msg the executable to run. */
+    void run_executable(Executable *msg)
+    {
+        current_ = msg;
+#ifdef EXECUTOR_PROFILE
+        long long start = ExecutorProfiler::now();
+        ExecutorProfiler::Entry *entry = profiler_.find(msg);
+        long long wait = -1;
+        if (msg->profileEnqueueNsec_)
+        {
+            wait = start - msg->profileEnqueueNsec_;
+            msg->profileEnqueueNsec_ = 0;
+        }
+        msg->run();
+        profiler_.record_run(entry, wait, ExecutorProfiler::now() - start);
+#else
+        msg->run();
+#endif
+        current_ = nullptr;
+    }
+
     /** Executes a select call, and schedules any necessary executables based
      * on the return. Will not sleep at all if not empty, otherwise sleeps at
      * most next_timer_nsec nanoseconds (from now).
@@ -185,6 +221,34 @@ private:
      * @param next_timer_nsec is the maximum time to sleep in nanoseconds. */
     void wait_with_select(long long next_timer_nsec);
 
+#ifdef EXECUTOR_EPOLL
+    /// Bookkeeping for one file descriptor registered with epoll.
+    struct EpollSlot
+    {
+        /// Selectables waiting on this fd, indexed by SelectType - 1.
+        Selectable *jobs[3];
+        /// Event mask currently armed in the kernel for this fd.
+        uint32_t events;
+    };
+
+    /// Brings the kernel's epoll registration of an fd in sync with the
+    /// selectables waiting for it. @param fd file descriptor to update.
+    void epoll_update(int fd);
+
+    /// @param job a selectable. @return the slot where this selectable is to
+    /// be stored, allocating the slot if necessary.
+    Selectable **epoll_slot(Selectable *job)
+    {
+        int fd = job->fd_;
+        if ((unsigned)fd >= epollSlots_.size())
+        {
+            epollSlots_.resize(
+                fd + 1, EpollSlot{{nullptr, nullptr, nullptr}, 0});
+        }
+        HASSERT(job->selectType_ >= Selectable::READ);
+        return &epollSlots_[fd].jobs[job->selectType_ - 1];
+    }
+#else
     /// Helper function.
     ///
     /// @param type a select type: READ, WRITE or EXCEPT
@@ -202,6 +266,7 @@ private:
         LOG(FATAL, "Unexpected select type %d", type);
         return nullptr;
     }
+#endif
 
     /** name of this Executor */
     const char *name_;
@@ -212,6 +277,17 @@ private:
     /** List of active timers. */
     ActiveTimers activeTimers_;
 
+#ifdef EXECUTOR_PROFILE
+    /** Run time statistics. */
+    ExecutorProfiler profiler_;
+#endif
+
+#ifdef EXECUTOR_EPOLL
+    /** epoll instance watching all selected fds and the wakeup eventfd. */
+    int epollFd_;
+    /** Selectables waiting for each fd, indexed by the fd. */
+    std::vector<EpollSlot> epollSlots_;
+#else
     /** fd to select for read. */
     fd_set selectRead_;
     /** fd to select for write. */
@@ -222,6 +298,7 @@ private:
     int selectNFds_;
     /** Head of the linked list for the select calls. */
     TypedQueue<Selectable> selectables_;
+#endif
 
     /** Set to 1 when the executor thread has exited and it is safe to delete
      * *this. */
@@ -298,6 +375,9 @@ public:
      */
     void add(Executable *msg, unsigned priority = UINT_MAX) OVERRIDE
     {
+#ifdef EXECUTOR_PROFILE
+        msg->profileEnqueueNsec_ = ExecutorProfiler::now();
+#endif
         queue_.insert(
             msg, priority >= NUM_PRIO ? NUM_PRIO - 1 : priority);
 #ifdef ESP_NONOS
@@ -316,6 +396,11 @@ public:
      */
     void add_from_isr(Executable *msg, unsigned priority = UINT_MAX) override
     {
+#ifdef EXECUTOR_PROFILE
+        // The clock cannot be read from an ISR; the wait time of this run
+        // will not be accounted.
+        msg->profileEnqueueNsec_ = 0;
+#endif
         queue_.insert_locked(
             msg, priority >= NUM_PRIO ? NUM_PRIO - 1 : priority);
         selectHelper_.wakeup_from_isr();
@@ -0,0 +1,292 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file ExecutorProfiler.cxx
+ *
+ * Runtime statistics about what an executor thread spends its time on.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#include "executor/ExecutorProfiler.hxx"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#ifdef __GXX_RTTI
+#include <cxxabi.h>
+#include <typeinfo>
+#endif
+
+#include "executor/Executable.hxx"
+
+constexpr unsigned ExecutorProfiler::NUM_BUCKETS;
+constexpr uint32_t ExecutorProfiler::SNAPSHOT_MAGIC;
+constexpr uint32_t ExecutorProfiler::SNAPSHOT_VERSION;
+
+uint32_t ExecutorProfiler::Histogram::count() const
+{
+    uint32_t ret = 0;
+    for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+    {
+        ret += buckets[i].load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+void ExecutorProfiler::Histogram::clear()
+{
+    for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+    {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+ExecutorProfiler::ExecutorProfiler(unsigned size)
+{
+    size_ = 1;
+    while (size_ < size)
+    {
+        size_ <<= 1;
+    }
+    entries_.reset(new Entry[size_ + 1]);
+    for (unsigned i = 0; i <= size_; ++i)
+    {
+        entries_[i].key.store(nullptr, std::memory_order_relaxed);
+        entries_[i].name = nullptr;
+    }
+    reset();
+}
+
+ExecutorProfiler::Entry *ExecutorProfiler::find(const Executable *e)
+{
+    uint64_t h = (uintptr_t)e;
+    h = (h ^ (h >> 17)) * 0x9E3779B97F4A7C15ULL;
+    unsigned mask = size_ - 1;
+    for (unsigned i = (h >> 32) & mask;; i = (i + 1) & mask)
+    {
+        Entry *entry = &entries_[i];
+        const Executable *k = entry->key.load(std::memory_order_relaxed);
+        if (k == e)
+        {
+            return entry;
+        }
+        if (k)
+        {
+            continue;
+        }
+        // Empty slot. We keep a quarter of the table free so that the probe
+        // sequences stay short.
+        if ((used_ + 1) * 4 > size_ * 3)
+        {
+            return &entries_[size_];
+        }
+        ++used_;
+#ifdef __GXX_RTTI
+        entry->name = typeid(*e).name();
+#endif
+        entry->key.store(e, std::memory_order_release);
+        return entry;
+    }
+}
+
+void ExecutorProfiler::reset()
+{
+    for (unsigned i = 0; i <= size_; ++i)
+    {
+        Entry *e = &entries_[i];
+        e->runs.store(0, std::memory_order_relaxed);
+        e->runNsec.store(0, std::memory_order_relaxed);
+        e->maxRunNsec.store(0, std::memory_order_relaxed);
+        e->waitNsec.store(0, std::memory_order_relaxed);
+        e->maxWaitNsec.store(0, std::memory_order_relaxed);
+    }
+    runHistogram_.clear();
+    waitHistogram_.clear();
+    selectHistogram_.clear();
+    timerHistogram_.clear();
+    selectNsec_.store(0, std::memory_order_relaxed);
+}
+
+const char *ExecutorProfiler::entry_name(
+    const Entry &e, char *buf, size_t len)
+{
+    if (!e.key.load(std::memory_order_acquire))
+    {
+        return "(other)";
+    }
+    if (!e.name)
+    {
+        return "?";
+    }
+#ifdef __GXX_RTTI
+    int status = -1;
+    char *demangled = abi::__cxa_demangle(e.name, nullptr, nullptr, &status);
+    if (demangled)
+    {
+        strncpy(buf, demangled, len - 1);
+        buf[len - 1] = 0;
+        free(demangled);
+        return buf;
+    }
+#endif
+    return e.name;
+}
+
+/// Prints one histogram line. @param fp output. @param label line title.
+/// @param h histogram to print.
+static void print_histogram(
+    FILE *fp, const char *label, const ExecutorProfiler::Histogram &h)
+{
+    fprintf(fp, "%-7s", label);
+    for (unsigned i = 0; i < ExecutorProfiler::NUM_BUCKETS; ++i)
+    {
+        fprintf(fp, " %6u", (unsigned)h.buckets[i].load());
+    }
+    fprintf(fp, "\n");
+}
+
+void ExecutorProfiler::print(FILE *fp, unsigned max_entries)
+{
+    fprintf(fp, "select wait %llu usec\n",
+        (unsigned long long)(select_nsec() / 1000));
+    fprintf(fp, "usec   %7s", "<1");
+    for (unsigned i = 1; i < NUM_BUCKETS - 1; ++i)
+    {
+        fprintf(fp, " %6u", 1u << i);
+    }
+    fprintf(fp, "   more\n");
+    print_histogram(fp, "run", runHistogram_);
+    print_histogram(fp, "wait", waitHistogram_);
+    print_histogram(fp, "select", selectHistogram_);
+    print_histogram(fp, "timer", timerHistogram_);
+
+    std::vector<const Entry *> sorted;
+    for (unsigned i = 0; i < size(); ++i)
+    {
+        if (entries_[i].runs.load(std::memory_order_relaxed))
+        {
+            sorted.push_back(&entries_[i]);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Entry *a, const Entry *b) {
+        return a->runNsec.load(std::memory_order_relaxed) >
+            b->runNsec.load(std::memory_order_relaxed);
+    });
+    if (sorted.size() > max_entries)
+    {
+        sorted.resize(max_entries);
+    }
+    fprintf(fp, "%10s %10s %8s %10s %8s  %s\n", "runs", "run_us", "max_us",
+        "wait_us", "maxw_us", "executable");
+    char buf[80];
+    for (const Entry *e : sorted)
+    {
+        fprintf(fp, "%10llu %10llu %8llu %10llu %8llu  %s %p\n",
+            (unsigned long long)e->runs.load(),
+            (unsigned long long)e->runNsec.load() / 1000,
+            (unsigned long long)e->maxRunNsec.load() / 1000,
+            (unsigned long long)e->waitNsec.load() / 1000,
+            (unsigned long long)e->maxWaitNsec.load() / 1000,
+            entry_name(*e, buf, sizeof(buf)), (const void *)e->key.load());
+    }
+}
+
+/// Writes a buffer fully. @param fd destination. @param data bytes to write.
+/// @param len number of bytes. @return true on success.
+static bool write_all(int fd, const void *data, size_t len)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (len)
+    {
+        ssize_t ret = ::write(fd, p, len);
+        if (ret <= 0)
+        {
+            return false;
+        }
+        p += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+bool ExecutorProfiler::write_snapshot(int fd)
+{
+    SnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SNAPSHOT_MAGIC;
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.num_buckets = NUM_BUCKETS;
+    hdr.select_nsec = select_nsec();
+    const Histogram *hists[4] = {
+        &runHistogram_, &waitHistogram_, &selectHistogram_, &timerHistogram_};
+    for (unsigned h = 0; h < 4; ++h)
+    {
+        for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+        {
+            hdr.histograms[h][i] = hists[h]->buckets[i].load();
+        }
+    }
+    std::vector<SnapshotEntry> out;
+    for (unsigned i = 0; i < size(); ++i)
+    {
+        const Entry &e = entries_[i];
+        if (!e.runs.load(std::memory_order_relaxed))
+        {
+            continue;
+        }
+        out.emplace_back();
+        SnapshotEntry *s = &out.back();
+        memset(s, 0, sizeof(*s));
+        s->key = (uintptr_t)e.key.load();
+        s->runs = e.runs.load();
+        s->run_nsec = e.runNsec.load();
+        s->max_run_nsec = e.maxRunNsec.load();
+        s->wait_nsec = e.waitNsec.load();
+        s->max_wait_nsec = e.maxWaitNsec.load();
+        char buf[sizeof(s->name)];
+        strncpy(s->name, entry_name(e, buf, sizeof(buf)), sizeof(s->name) - 1);
+    }
+    hdr.num_entries = out.size();
+    return write_all(fd, &hdr, sizeof(hdr)) &&
+        write_all(fd, out.data(), out.size() * sizeof(SnapshotEntry));
+}
+
+bool ExecutorProfiler::write_snapshot(const char *path)
+{
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ret = write_snapshot(fd);
+    ::close(fd);
+    return ret;
+}
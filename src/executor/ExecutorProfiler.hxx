@@ -0,0 +1,318 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file ExecutorProfiler.hxx
+ *
+ * Runtime statistics about what an executor thread spends its time on.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#ifndef _EXECUTOR_EXECUTORPROFILER_HXX_
+#define _EXECUTOR_EXECUTORPROFILER_HXX_
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#if defined(__linux__)
+#include <time.h>
+#endif
+
+#include "os/os.h"
+#include "utils/macros.h"
+
+class Executable;
+
+/// Collects statistics about the executables running on one executor: how
+/// many times each executable ran, for how long, and how long it waited in
+/// the executor queue. In addition it keeps histograms of the run time, queue
+/// wait, select (idle) time and timer lateness.
+///
+/// The executor instantiates this class when compiled with
+/// -DEXECUTOR_PROFILE; see ExecutorBase::profiler(). All record_* functions
+/// must be called on the executor's own thread, which is the only writer. The
+/// counters are atomics, so the reporting functions may be called from any
+/// thread without taking a lock. Executables are identified by their address;
+/// if an object is deleted and another one is allocated at the same address,
+/// they share the entry.
+class ExecutorProfiler
+{
+public:
+    /// Number of histogram buckets. Bucket 0 counts durations below 1 usec,
+    /// bucket i durations in [2^(i-1), 2^i) usec, the last bucket everything
+    /// that is longer.
+    static constexpr unsigned NUM_BUCKETS = 16;
+
+    /// Log2-scale histogram of durations.
+    struct Histogram
+    {
+        std::atomic<uint32_t> buckets[NUM_BUCKETS];
+
+        /// Adds one sample. @param nsec is the duration.
+        void add(long long nsec)
+        {
+            auto *b = &buckets[bucket_of(nsec)];
+            b->store(b->load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+        }
+
+        /// @return total number of samples.
+        uint32_t count() const;
+
+        /// Clears all buckets.
+        void clear();
+    };
+
+    /// Counters of one executable.
+    struct Entry
+    {
+        /// The executable, or nullptr for the overflow entry.
+        std::atomic<const Executable *> key;
+        /// Type name of the executable (mangled), or nullptr if unknown.
+        const char *name;
+        /// Number of times run() was called.
+        std::atomic<uint64_t> runs;
+        /// Total time spent in run().
+        std::atomic<uint64_t> runNsec;
+        /// Longest time spent in one run() call.
+        std::atomic<uint64_t> maxRunNsec;
+        /// Total time spent in the executor queue before running.
+        std::atomic<uint64_t> waitNsec;
+        /// Longest time spent in the executor queue.
+        std::atomic<uint64_t> maxWaitNsec;
+    };
+
+    /// Header of the binary snapshot file, followed by num_entries
+    /// SnapshotEntry structures. All fields are in host byte order.
+    struct SnapshotHeader
+    {
+        /// Always SNAPSHOT_MAGIC.
+        uint32_t magic;
+        /// Always SNAPSHOT_VERSION.
+        uint32_t version;
+        /// Equals to NUM_BUCKETS.
+        uint32_t num_buckets;
+        /// Number of SnapshotEntry structures following.
+        uint32_t num_entries;
+        /// Total time spent waiting in select.
+        uint64_t select_nsec;
+        /// The run, wait, select and timer histograms.
+        uint32_t histograms[4][NUM_BUCKETS];
+    };
+
+    /// One executable in the binary snapshot file.
+    struct SnapshotEntry
+    {
+        uint64_t key;
+        uint64_t runs;
+        uint64_t run_nsec;
+        uint64_t max_run_nsec;
+        uint64_t wait_nsec;
+        uint64_t max_wait_nsec;
+        /// Demangled type name, zero terminated and truncated as needed.
+        char name[80];
+    };
+
+    /// Value of SnapshotHeader::magic ("EXPF").
+    static constexpr uint32_t SNAPSHOT_MAGIC = 0x46505845;
+    /// Value of SnapshotHeader::version.
+    static constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+    /// Constructor. @param size is the maximum number of executables that get
+    /// separate counters; the rest are accounted together in one extra entry.
+    ExecutorProfiler(unsigned size);
+
+    /// @return the current time for the measurements. Cheaper than
+    /// os_get_time_monotonic() because it does not take a lock.
+    static long long now()
+    {
+#if defined(__linux__)
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ((long long)ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+#else
+        return os_get_time_monotonic();
+#endif
+    }
+
+    /// @return the histogram bucket for a duration. @param nsec duration.
+    static unsigned bucket_of(long long nsec)
+    {
+        uint64_t usec = nsec > 0 ? nsec / 1000 : 0;
+        if (!usec)
+        {
+            return 0;
+        }
+        unsigned b = 64 - __builtin_clzll(usec);
+        return b < NUM_BUCKETS ? b : NUM_BUCKETS - 1;
+    }
+
+    /// Finds or creates the entry of an executable. Must be called before the
+    /// executable runs, because it might delete itself.
+    /// @param e the executable about to run.
+    /// @return entry to pass to record_run.
+    Entry *find(const Executable *e);
+
+    /// Accounts one run of an executable.
+    /// @param entry the result of find() for the executable.
+    /// @param wait_nsec time the executable spent in the queue, or negative
+    /// if it is not known (e.g. the executable was queued from an ISR).
+    /// @param run_nsec time spent in run().
+    void record_run(Entry *entry, long long wait_nsec, long long run_nsec)
+    {
+        inc(&entry->runs, 1);
+        inc(&entry->runNsec, run_nsec);
+        update_max(&entry->maxRunNsec, run_nsec);
+        runHistogram_.add(run_nsec);
+        if (wait_nsec >= 0)
+        {
+            inc(&entry->waitNsec, wait_nsec);
+            update_max(&entry->maxWaitNsec, wait_nsec);
+            waitHistogram_.add(wait_nsec);
+        }
+    }
+
+    /// Accounts the time the executor was blocked waiting for work.
+    /// @param nsec length of the select (or epoll) call.
+    void record_select(long long nsec)
+    {
+        inc(&selectNsec_, nsec);
+        selectHistogram_.add(nsec);
+    }
+
+    /// Accounts how late a timer ran compared to its deadline.
+    /// @param nsec the delay.
+    void record_timer_lateness(long long nsec)
+    {
+        timerHistogram_.add(nsec);
+    }
+
+    /// @return number of entries, including the overflow entry.
+    unsigned size()
+    {
+        return size_ + 1;
+    }
+
+    /// @param i index, 0 <= i < size(). @return the i-th entry. Unused
+    /// entries have zero runs.
+    const Entry &entry(unsigned i)
+    {
+        return entries_[i];
+    }
+
+    /// @return histogram of the run() durations.
+    const Histogram &run_histogram()
+    {
+        return runHistogram_;
+    }
+
+    /// @return histogram of the executor queue wait times.
+    const Histogram &wait_histogram()
+    {
+        return waitHistogram_;
+    }
+
+    /// @return histogram of the select call durations.
+    const Histogram &select_histogram()
+    {
+        return selectHistogram_;
+    }
+
+    /// @return histogram of the timer lateness.
+    const Histogram &timer_histogram()
+    {
+        return timerHistogram_;
+    }
+
+    /// @return the total time spent waiting in select.
+    uint64_t select_nsec()
+    {
+        return selectNsec_.load(std::memory_order_relaxed);
+    }
+
+    /// Clears all counters. Samples recorded concurrently with the reset may
+    /// be partially lost.
+    void reset();
+
+    /// Prints a human-readable report with the histograms and the executables
+    /// that used the most time.
+    /// @param fp where to print.
+    /// @param max_entries how many executables to list at most.
+    void print(FILE *fp, unsigned max_entries = 20);
+
+    /// Writes a binary snapshot of the counters.
+    /// @param fd file descriptor to write to.
+    /// @return true on success.
+    bool write_snapshot(int fd);
+
+    /// Writes a binary snapshot of the counters into a file.
+    /// @param path file name to (over)write.
+    /// @return true on success.
+    bool write_snapshot(const char *path);
+
+private:
+    /// Adds to a counter. Only the executor thread writes, so no atomic
+    /// read-modify-write is needed.
+    static void inc(std::atomic<uint64_t> *c, long long v)
+    {
+        c->store(c->load(std::memory_order_relaxed) + v,
+            std::memory_order_relaxed);
+    }
+
+    /// Raises a counter to a value if it is smaller.
+    static void update_max(std::atomic<uint64_t> *c, long long v)
+    {
+        if ((uint64_t)v > c->load(std::memory_order_relaxed))
+        {
+            c->store(v, std::memory_order_relaxed);
+        }
+    }
+
+    /// @return the demangled type name of an entry. @param e entry. @param
+    /// buf scratch buffer. @param len size of buf.
+    static const char *entry_name(const Entry &e, char *buf, size_t len);
+
+    /// Number of hash table slots (power of two).
+    unsigned size_;
+    /// Number of occupied slots.
+    unsigned used_{0};
+    /// Hash table of size_ entries with linear probing, followed by the
+    /// overflow entry.
+    std::unique_ptr<Entry[]> entries_;
+    Histogram runHistogram_;
+    Histogram waitHistogram_;
+    Histogram selectHistogram_;
+    Histogram timerHistogram_;
+    /// Total time spent in select.
+    std::atomic<uint64_t> selectNsec_;
+
+    DISALLOW_COPY_AND_ASSIGN(ExecutorProfiler);
+};
+
+#endif // _EXECUTOR_EXECUTORPROFILER_HXX_
@@ -44,6 +44,10 @@ Timer::~Timer()
 
 void Timer::run()
 {
+#ifdef EXECUTOR_PROFILE
+    activeTimers_->executor()->profiler()->record_timer_lateness(
+        OSTime::get_monotonic() - when_);
+#endif
     isExpired_ = 0;
     long long new_period = timeout();
     if (new_period == RESTART)
@@ -62,6 +66,28 @@ void Timer::run()
     }
 }
 
+ActiveTimers::ActiveTimers(ExecutorBase *executor)
+    : executor_(executor)
+#if TIMER_WHEEL
+    , currentTick_(tick_of(OSTime::get_monotonic()))
+    , nextDeadline_(INT64_MAX)
+    , numTimers_(0)
+    , nextDeadlineValid_(1)
+#endif
+    , isPending_(0)
+{
+#if TIMER_WHEEL
+    for (unsigned i = 0; i <= OVERFLOW_SLOT; ++i)
+    {
+        slots_[i].first = slots_[i].last = nullptr;
+    }
+    for (unsigned i = 0; i < NUM_LEVELS; ++i)
+    {
+        occupied_[i] = 0;
+    }
+#endif
+}
+
 ActiveTimers::~ActiveTimers()
 {
 }
@@ -82,6 +108,308 @@ void ActiveTimers::run()
     // call.
 }
 
+#if TIMER_WHEEL
+
+unsigned ActiveTimers::slot_for_tick(uint64_t tick)
+{
+    uint64_t diff = tick ^ currentTick_;
+    unsigned level = 0;
+    if (diff)
+    {
+        level = (63 - __builtin_clzll(diff)) / LEVEL_BITS;
+    }
+    if (level >= NUM_LEVELS)
+    {
+        return OVERFLOW_SLOT;
+    }
+    return level * LEVEL_SIZE +
+        ((tick >> (level * LEVEL_BITS)) & (LEVEL_SIZE - 1));
+}
+
+void ActiveTimers::slot_append(unsigned slot, Timer *timer)
+{
+    Slot *s = &slots_[slot];
+    timer->wheelSlot_ = slot;
+    timer->wheelPrev_ = s->last;
+    timer->next = nullptr;
+    if (s->last)
+    {
+        s->last->next = timer;
+    }
+    else
+    {
+        s->first = timer;
+        if (slot < OVERFLOW_SLOT)
+        {
+            occupied_[slot / LEVEL_SIZE] |= 1ULL << (slot % LEVEL_SIZE);
+        }
+    }
+    s->last = timer;
+}
+
+Timer *ActiveTimers::advance_locked(uint64_t new_tick)
+{
+    QMember *head = nullptr;
+    QMember **tail = &head;
+    for (unsigned level = 0; level < NUM_LEVELS; ++level)
+    {
+        unsigned shift = level * LEVEL_BITS;
+        uint64_t cur = currentTick_ >> shift;
+        uint64_t next = new_tick >> shift;
+        if (cur == next)
+        {
+            // Higher levels are unchanged as well.
+            break;
+        }
+        uint64_t mask;
+        if ((cur >> LEVEL_BITS) != (next >> LEVEL_BITS))
+        {
+            // Went past the end of this level: every timer in it is due.
+            mask = ~0ULL;
+        }
+        else
+        {
+            // Slots from cur to next (inclusive) hold timers whose deadline
+            // is now at or below this level's resolution.
+            unsigned from = cur & (LEVEL_SIZE - 1);
+            unsigned to = next & (LEVEL_SIZE - 1);
+            mask = (to == LEVEL_SIZE - 1 ? ~0ULL : ((1ULL << (to + 1)) - 1)) &
+                ~((1ULL << from) - 1);
+        }
+        uint64_t found = occupied_[level] & mask;
+        occupied_[level] &= ~mask;
+        while (found)
+        {
+            unsigned s = __builtin_ctzll(found);
+            found &= found - 1;
+            Slot *slot = &slots_[level * LEVEL_SIZE + s];
+            *tail = slot->first;
+            tail = &slot->last->next;
+            slot->first = slot->last = nullptr;
+        }
+    }
+    if ((currentTick_ >> (NUM_LEVELS * LEVEL_BITS)) !=
+        (new_tick >> (NUM_LEVELS * LEVEL_BITS)))
+    {
+        Slot *slot = &slots_[OVERFLOW_SLOT];
+        if (slot->first)
+        {
+            *tail = slot->first;
+            tail = &slot->last->next;
+            slot->first = slot->last = nullptr;
+        }
+    }
+    *tail = nullptr;
+    currentTick_ = new_tick;
+    return static_cast<Timer *>(head);
+}
+
+Timer *ActiveTimers::sort_by_deadline(Timer *head)
+{
+    if (!head || !head->next)
+    {
+        return head;
+    }
+    // Splits the list in two halves.
+    Timer *slow = head;
+    Timer *fast = static_cast<Timer *>(head->next);
+    while (fast && fast->next)
+    {
+        slow = static_cast<Timer *>(slow->next);
+        fast = static_cast<Timer *>(fast->next->next);
+    }
+    Timer *second = static_cast<Timer *>(slow->next);
+    slow->next = nullptr;
+    Timer *a = sort_by_deadline(head);
+    Timer *b = sort_by_deadline(second);
+    // Merges them; on equal deadlines the first half goes first.
+    QMember *result = nullptr;
+    QMember **tail = &result;
+    while (a && b)
+    {
+        if (b->when_ < a->when_)
+        {
+            *tail = b;
+            b = static_cast<Timer *>(b->next);
+        }
+        else
+        {
+            *tail = a;
+            a = static_cast<Timer *>(a->next);
+        }
+        tail = &(*tail)->next;
+    }
+    *tail = a ? a : b;
+    return static_cast<Timer *>(result);
+}
+
+long long ActiveTimers::get_next_timeout()
+{
+    OSMutexLock l(&lock_);
+
+    long long now = OSTime::get_monotonic();
+    uint64_t now_tick = tick_of(now);
+    if (now_tick > currentTick_)
+    {
+        Timer *moved = advance_locked(now_tick);
+        while (moved)
+        {
+            Timer *t = moved;
+            moved = static_cast<Timer *>(t->next);
+            uint64_t tick = tick_of(t->when_);
+            slot_append(
+                slot_for_tick(tick < currentTick_ ? currentTick_ : tick), t);
+        }
+    }
+
+    // Takes the expired timers out of the current slot.
+    Slot *slot = &slots_[currentTick_ & (LEVEL_SIZE - 1)];
+    QMember *expired_list = nullptr;
+    QMember **expired_tail = &expired_list;
+    for (Timer *t = slot->first; t;)
+    {
+        Timer *next = static_cast<Timer *>(t->next);
+        if (t->when_ <= now)
+        {
+            remove_locked(t);
+            *expired_tail = t;
+            expired_tail = &t->next;
+        }
+        t = next;
+    }
+    *expired_tail = nullptr;
+
+    if (expired_list)
+    {
+        Timer *expired = sort_by_deadline(static_cast<Timer *>(expired_list));
+        while (expired)
+        {
+            Timer *t = expired;
+            expired = static_cast<Timer *>(t->next);
+            t->next = nullptr;
+            t->isActive_ = 0;
+            t->isExpired_ = 1;
+            // Puts it on the executor.
+            executor_->add(t, t->priority_);
+        }
+        return 0;
+    }
+    if (!nextDeadlineValid_)
+    {
+        nextDeadline_ = INT64_MAX;
+        unsigned first = first_slot_locked();
+        if (first != NO_SLOT)
+        {
+            for (Timer *t = slots_[first].first; t;
+                 t = static_cast<Timer *>(t->next))
+            {
+                if (t->when_ < nextDeadline_)
+                {
+                    nextDeadline_ = t->when_;
+                }
+            }
+        }
+        nextDeadlineValid_ = 1;
+    }
+    if (nextDeadline_ == INT64_MAX)
+    {
+        // Wakes up the timer service every now and then. It won't make any
+        // difference.
+        return SEC_TO_NSEC(3600);
+    }
+    return nextDeadline_ - now;
+}
+
+unsigned ActiveTimers::first_slot_locked()
+{
+    // Every timer in a level expires before all timers in the higher levels,
+    // and the slots of a level are in the order of expiration starting at
+    // the current tick's digit.
+    for (unsigned level = 0; level < NUM_LEVELS; ++level)
+    {
+        unsigned cur = (currentTick_ >> (level * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+        uint64_t later = occupied_[level] & ~((1ULL << cur) - 1);
+        if (later)
+        {
+            return level * LEVEL_SIZE + __builtin_ctzll(later);
+        }
+    }
+    if (slots_[OVERFLOW_SLOT].first)
+    {
+        return OVERFLOW_SLOT;
+    }
+    return NO_SLOT;
+}
+
+bool ActiveTimers::empty()
+{
+    OSMutexLock l(&lock_);
+    return numTimers_ == 0;
+}
+
+void ActiveTimers::schedule_timer(Timer *timer)
+{
+    OSMutexLock l(&lock_);
+    insert_locked(timer);
+}
+
+void ActiveTimers::insert_locked(Timer *timer)
+{
+    HASSERT(timer);
+    HASSERT(timer->wheelSlot_ == NO_SLOT);
+    HASSERT(timer->next == nullptr);
+
+    uint64_t tick = tick_of(timer->when_);
+    slot_append(slot_for_tick(tick < currentTick_ ? currentTick_ : tick), timer);
+    ++numTimers_;
+    if (timer->when_ < nextDeadline_)
+    {
+        nextDeadline_ = timer->when_;
+    }
+
+    // This will wake up the executor, which will schedule all expired timers
+    // and recompute sleep length.
+    notify();
+}
+
+void ActiveTimers::remove_locked(Timer *timer)
+{
+    HASSERT(timer);
+    unsigned slot = timer->wheelSlot_;
+    HASSERT(slot <= OVERFLOW_SLOT);
+    Slot *s = &slots_[slot];
+    Timer *next = static_cast<Timer *>(timer->next);
+    if (timer->wheelPrev_)
+    {
+        timer->wheelPrev_->next = next;
+    }
+    else
+    {
+        s->first = next;
+    }
+    if (next)
+    {
+        next->wheelPrev_ = timer->wheelPrev_;
+    }
+    else
+    {
+        s->last = timer->wheelPrev_;
+    }
+    if (!s->first && slot < OVERFLOW_SLOT)
+    {
+        occupied_[slot / LEVEL_SIZE] &= ~(1ULL << (slot % LEVEL_SIZE));
+    }
+    timer->next = nullptr;
+    timer->wheelPrev_ = nullptr;
+    timer->wheelSlot_ = NO_SLOT;
+    --numTimers_;
+    // We do not know whether this was the earliest timer. Cancel() has
+    // already overwritten the deadline at this point.
+    nextDeadlineValid_ = 0;
+}
+
+#else // TIMER_WHEEL
+
 long long ActiveTimers::get_next_timeout()
 {
     OSMutexLock l(&lock_);
@@ -171,6 +499,8 @@ void ActiveTimers::remove_locked(Timer *timer)
     timer->next = nullptr;
 }
 
+#endif // TIMER_WHEEL
+
 void ActiveTimers::update_timer(Timer *timer)
 {
     HASSERT(timer);
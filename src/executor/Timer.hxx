@@ -43,19 +43,36 @@
 class Timer;
 class ExecutorBase;
 
+#ifndef TIMER_WHEEL
+#if defined(__linux__) || defined(__MACH__)
+/// 1 if ActiveTimers should keep the timers in a hierarchical timing wheel, 0
+/// if in a sorted list. The wheel needs a few kilobytes of RAM per executor,
+/// so it is only the default on hosts.
+#define TIMER_WHEEL 1
+#else
+#define TIMER_WHEEL 0
+#endif
+#endif
+
 /** Class that manages the list of active timers. The Executor uses this class
- * tightly in its sleep-execute loop. */
+ * tightly in its sleep-execute loop.
+ *
+ * With TIMER_WHEEL the timers are kept in a hierarchical timing wheel: each
+ * level has 64 slots, and a timer goes to the lowest level where its
+ * deadline shares all higher tick bits with the current tick. Starting,
+ * updating and cancelling a timer is O(1). When time advances, the slots that
+ * were passed are emptied and their timers placed again, which moves each
+ * timer down at most once per level. The timers in the slot of the current
+ * tick are compared to the exact current time, and the earliest deadline is
+ * cached, so timers expire at the same nanosecond deadline as with the sorted
+ * list. */
 class ActiveTimers : public Executable
 {
 public:
     /// Constructor.
     ///
     /// @param executor parent that will use this instance.
-    ActiveTimers(ExecutorBase *executor)
-        : executor_(executor)
-        , isPending_(0)
-    {
-    }
+    ActiveTimers(ExecutorBase *executor);
 
     ~ActiveTimers();
 
@@ -75,17 +92,18 @@ public:
      * scheduled. */
     void schedule_timer(::Timer *timer);
 
-    /** Updates the expiration time of an already scheduled timer. This call is
-     * somewhat expensive, because it needs to walk the entire queue of active
-     * timers. May wake up the executor.
+    /** Updates the expiration time of an already scheduled timer. Without
+     * TIMER_WHEEL this call is somewhat expensive, because it needs to walk
+     * the entire queue of active timers. May wake up the executor.
      *
      * @param timer is the timer whose next execution time has been updated. It
      * must already be scheduled. */
     void update_timer(::Timer *timer);
 
-    /** Deletes an already scheduled but not yet expired timer. This call is
-     * somewhat expensive, because it needs to walk the entire queue of active
-     * timers. Asserts that the timer is in fact not yet expired.
+    /** Deletes an already scheduled but not yet expired timer. Without
+     * TIMER_WHEEL this call is somewhat expensive, because it needs to walk
+     * the entire queue of active timers. Asserts that the timer is in fact not
+     * yet expired.
      *
      * @param timer is the timer to delete. */
     void remove_timer(::Timer *timer);
@@ -113,16 +131,91 @@ private:
      * @param timer what to insert into the active list. */
     void insert_locked(::Timer *timer);
 
+#if TIMER_WHEEL
+    /// Number of bits of the timer deadline that are ignored when placing a
+    /// timer in the wheel. One tick of the wheel is about one millisecond.
+    static constexpr unsigned TICK_SHIFT = 20;
+    /// Each level of the wheel covers this many bits of the tick count.
+    static constexpr unsigned LEVEL_BITS = 6;
+    /// Number of slots in one level of the wheel.
+    static constexpr unsigned LEVEL_SIZE = 1 << LEVEL_BITS;
+    /// Number of levels of the wheel. Together they cover 2^36 ticks, about
+    /// two years. Later timers go to the overflow slot.
+    static constexpr unsigned NUM_LEVELS = 6;
+    /// Index of the slot for timers beyond the last level.
+    static constexpr unsigned OVERFLOW_SLOT = NUM_LEVELS * LEVEL_SIZE;
+    /// Value of Timer::wheelSlot_ when the timer is not in the wheel.
+    static constexpr uint16_t NO_SLOT = 0xFFFF;
+
+    /// List of timers in one slot of the wheel, in insertion order.
+    struct Slot
+    {
+        /// First timer in the slot, or nullptr.
+        ::Timer *first;
+        /// Last timer in the slot, or nullptr.
+        ::Timer *last;
+    };
+
+    /// @return the wheel tick in which a deadline falls. @param when is the
+    /// deadline in nanoseconds.
+    static uint64_t tick_of(long long when)
+    {
+        return when < 0 ? 0 : ((uint64_t)when) >> TICK_SHIFT;
+    }
+
+    /// @return the slot index where a timer expiring in a given tick
+    /// belongs, relative to currentTick_. @param tick is the expiration tick;
+    /// must not be before currentTick_.
+    unsigned slot_for_tick(uint64_t tick);
+
+    /// Appends a timer to a slot. @param slot is the slot index; @param timer
+    /// is the timer to add.
+    void slot_append(unsigned slot, ::Timer *timer);
+
+    /// Moves all timers of the wheel that need to be placed again to a
+    /// list. Advances currentTick_. @param new_tick is the tick to advance
+    /// to. @return the first collected timer; they are linked via next.
+    ::Timer *advance_locked(uint64_t new_tick);
+
+    /// @return the index of the slot containing the earliest timer, or NO_SLOT
+    /// if there are no timers.
+    unsigned first_slot_locked();
+
+    /// Sorts a list of timers by their deadline. @param head is the first
+    /// timer of the list, linked via next. @return the new first timer.
+    static ::Timer *sort_by_deadline(::Timer *head);
+
+    /// Parent.
+    ExecutorBase *executor_;
+    /// Protects the timer wheel.
+    OSMutex lock_;
+    /// The wheel. Slot s of level L is slots_[L * LEVEL_SIZE + s].
+    Slot slots_[NUM_LEVELS * LEVEL_SIZE + 1];
+    /// Bit s of occupied_[L] is set if slot s of level L is not empty.
+    uint64_t occupied_[NUM_LEVELS];
+    /// The tick of the current time at the last time we looked.
+    uint64_t currentTick_;
+    /// The earliest deadline of the timers in the wheel, INT64_MAX if the
+    /// wheel is empty. Only valid if nextDeadlineValid_ is set.
+    long long nextDeadline_;
+    /// How many timers are in the wheel.
+    unsigned numTimers_ : 31;
+    /// 1 if nextDeadline_ is up to date. Cleared whenever a timer is taken
+    /// out of the wheel.
+    unsigned nextDeadlineValid_ : 1;
+#else
     /// Parent.
     ExecutorBase *executor_;
     /// Protects the timer list.
     OSMutex lock_;
     /// List of timers that are scheduled.
     QMember activeTimers_;
+#endif
     /// 1 if we in the executor's queue.
     unsigned isPending_ : 1;
 
     friend class TimerTest;
+    friend class Timer; // for NO_SLOT
 
     DISALLOW_COPY_AND_ASSIGN(ActiveTimers);
 };
@@ -145,6 +238,10 @@ public:
         , isExpired_(0)
         , isCancelled_(0)
         , tcRequestStop_(0)
+#if TIMER_WHEEL
+        , wheelSlot_(ActiveTimers::NO_SLOT)
+        , wheelPrev_(nullptr)
+#endif
     {
     }
 
@@ -277,6 +374,7 @@ public:
 private:
     friend class ActiveTimers;  // for scheduling an expiring timers
     friend class CountingTimer; // for testing
+    friend class TimerTest;     // for testing
 
     /** Points to the executor's timer structure. Not owned. */
     ActiveTimers *activeTimers_;
@@ -296,6 +394,13 @@ private:
     unsigned isCancelled_ : 1;
     /** For children: 1 if a repeated timer should stop sending wakeups. */
     unsigned tcRequestStop_ : 1;
+#if TIMER_WHEEL
+    /** Which slot of the timer wheel this timer is in, or
+     * ActiveTimers::NO_SLOT. */
+    uint16_t wheelSlot_;
+    /** Previous timer in the same wheel slot. */
+    Timer *wheelPrev_;
+#endif
 
     DISALLOW_COPY_AND_ASSIGN(Timer);
 };
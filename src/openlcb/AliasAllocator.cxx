@@ -33,6 +33,9 @@
  */
 
 #include "openlcb/AliasAllocator.hxx"
+
+#include <algorithm>
+
 #include "openlcb/CanDefs.hxx"
 
 namespace openlcb
@@ -40,13 +43,15 @@ namespace openlcb
 
 size_t g_alias_test_conflicts = 0;
 
+long long ALIAS_ALLOCATION_WAIT_NSEC = MSEC_TO_NSEC(200);
+
 AliasAllocator::AliasAllocator(NodeID if_id, IfCan *if_can)
     : StateFlow<Buffer<AliasInfo>, QList<1>>(if_can)
     , conflictHandler_(this)
-    , timer_(this)
+    , windowTimer_(this)
     , if_id_(if_id)
     , cid_frame_sequence_(0)
-    , conflict_detected_(0)
+    , expireAll_(0)
 {
     reinit_seed();
     // Moves all the allocated alias buffers over to the input queue for
@@ -100,14 +105,48 @@ void AliasAllocator::return_alias(NodeID id, NodeAlias alias)
     }
 }
 
+void AliasAllocator::reserve_aliases(unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        send(alloc());
+    }
+}
+
 AliasAllocator::~AliasAllocator()
 {
+    if (!pending_.empty())
+    {
+        windowTimer_.cancel();
+    }
+    for (auto *b : checking_)
+    {
+        if_can()->frame_dispatcher()->unregister_handler(
+            &conflictHandler_, b->data()->alias, ~0x1FFFF000U);
+    }
+    for (auto &p : pending_)
+    {
+        if (p.b)
+        {
+            p.b->unref();
+        }
+    }
 }
 
 StateFlowBase::Action AliasAllocator::entry()
 {
+    switch (pending_alias()->state)
+    {
+        case AliasInfo::STATE_CHECKING:
+            // The observation window is over.
+            return allocate_and_call(
+                if_can()->frame_write_flow(), STATE(send_rid_frame));
+        case AliasInfo::STATE_CONFLICT:
+            return call_immediately(STATE(handle_alias_conflict));
+        default:
+            break;
+    }
     cid_frame_sequence_ = 7;
-    conflict_detected_ = 0;
     HASSERT(pending_alias()->state == AliasInfo::STATE_EMPTY);
     while (!pending_alias()->alias)
     {
@@ -115,6 +154,13 @@ StateFlowBase::Action AliasAllocator::entry()
         next_seed();
         // TODO(balazs.racz): check if the alias is already known about.
     }
+    pending_alias()->state = AliasInfo::STATE_CHECKING;
+    checking_.push_back(message());
+    stats_.checking = checking_.size();
+    if (stats_.checking > stats_.maxChecking)
+    {
+        stats_.maxChecking = stats_.checking;
+    }
     // Registers ourselves as a handler for incoming CAN frames to detect
     // conflicts.
     if_can()->frame_dispatcher()->register_handler(
@@ -144,6 +190,10 @@ void AliasAllocator::next_seed()
 
 StateFlowBase::Action AliasAllocator::handle_allocate_for_cid_frame()
 {
+    if (pending_alias()->state == AliasInfo::STATE_CONFLICT)
+    {
+        return call_immediately(STATE(handle_alias_conflict));
+    }
     if (cid_frame_sequence_ >= 4)
     {
         return allocate_and_call(if_can()->frame_write_flow(),
@@ -152,7 +202,7 @@ StateFlowBase::Action AliasAllocator::handle_allocate_for_cid_frame()
     else
     {
         // All CID frames are sent, let's wait.
-        return sleep_and_call(&timer_, MSEC_TO_NSEC(200), STATE(wait_done));
+        return call_immediately(STATE(start_window));
     }
 }
 
@@ -162,7 +212,7 @@ StateFlowBase::Action AliasAllocator::send_cid_frame()
         pending_alias()->alias);
     auto *b = get_allocation_result(if_can()->frame_write_flow());
     struct can_frame *f = b->data()->mutable_frame();
-    if (conflict_detected_)
+    if (pending_alias()->state == AliasInfo::STATE_CONFLICT)
     {
         b->unref();
         return call_immediately(STATE(handle_alias_conflict));
@@ -176,11 +226,60 @@ StateFlowBase::Action AliasAllocator::send_cid_frame()
     return wait_and_call(STATE(handle_allocate_for_cid_frame));
 }
 
-StateFlowBase::Action AliasAllocator::handle_alias_conflict()
+StateFlowBase::Action AliasAllocator::start_window()
+{
+    // The candidate waits for its observation window outside of the flow, so
+    // that the next alias buffer can start its CID frames right away.
+    if (pending_.empty())
+    {
+        windowTimer_.start(ALIAS_ALLOCATION_WAIT_NSEC);
+    }
+    pending_.push_back(
+        {transfer_message(),
+            OSTime::get_monotonic() + ALIAS_ALLOCATION_WAIT_NSEC});
+    return exit();
+}
+
+long long AliasAllocator::window_timeout()
+{
+    long long now = OSTime::get_monotonic();
+    auto it = pending_.begin();
+    for (; it != pending_.end() && (expireAll_ || it->deadline <= now); ++it)
+    {
+        // Entries that have seen a conflict are already back in the queue.
+        if (it->b)
+        {
+            send(it->b);
+        }
+    }
+    pending_.erase(pending_.begin(), it);
+    expireAll_ = 0;
+    if (pending_.empty())
+    {
+        return ::Timer::NONE;
+    }
+    return std::max(pending_.front().deadline - now, 2LL);
+}
+
+void AliasAllocator::stop_checking()
 {
     // Marks that we are no longer interested in frames from this alias.
     if_can()->frame_dispatcher()->unregister_handler(
         &conflictHandler_, pending_alias()->alias, ~0x1FFFF000U);
+    for (auto it = checking_.begin(); it != checking_.end(); ++it)
+    {
+        if (*it == message())
+        {
+            checking_.erase(it);
+            break;
+        }
+    }
+    stats_.checking = checking_.size();
+}
+
+StateFlowBase::Action AliasAllocator::handle_alias_conflict()
+{
+    stop_checking();
 
     // Burns up the alias.
     pending_alias()->alias = 0;
@@ -189,61 +288,68 @@ StateFlowBase::Action AliasAllocator::handle_alias_conflict()
     return call_immediately(STATE(entry));
 }
 
-StateFlowBase::Action AliasAllocator::wait_done()
-{
-    if (conflict_detected_)
-    {
-        return call_immediately(STATE(handle_alias_conflict));
-    }
-    // grab a frame buffer for the RID frame.
-    return allocate_and_call(if_can()->frame_write_flow(),
-                             STATE(send_rid_frame));
-}
-
 StateFlowBase::Action AliasAllocator::send_rid_frame()
 {
     LOG(VERBOSE, "Sending RID frame for alias %03x", pending_alias()->alias);
     auto *b = get_allocation_result(if_can()->frame_write_flow());
     struct can_frame *f = b->data()->mutable_frame();
     CanDefs::control_init(*f, pending_alias()->alias, CanDefs::RID_FRAME, 0);
-    if (conflict_detected_)
+    if (pending_alias()->state == AliasInfo::STATE_CONFLICT)
     {
         b->unref();
         return call_immediately(STATE(handle_alias_conflict));
     }
     if_can()->frame_write_flow()->send(b);
     // The alias is reserved, put it into the freelist.
+    stop_checking();
     pending_alias()->state = AliasInfo::STATE_RESERVED;
-    if_can()->frame_dispatcher()->unregister_handler(
-        &conflictHandler_, pending_alias()->alias, ~0x1FFFF000U);
+    ++stats_.reserved;
     if_can()->local_aliases()->add(AliasCache::RESERVED_ALIAS_NODE_ID,
                                    pending_alias()->alias);
     reserved_alias_pool_.insert(transfer_message());
-    return release_and_exit();
+    return exit();
 }
 
 void AliasAllocator::ConflictHandler::send(Buffer<CanMessageData> *message,
                                                 unsigned priority)
 {
-    if (parent_->conflict_detected_) {
-        message->unref();
+    NodeAlias alias = CanDefs::get_src(GET_CAN_FRAME_ID_EFF(*message->data()));
+    message->unref();
+    for (auto *b : parent_->checking_)
+    {
+        if (b->data()->alias != alias)
+        {
+            continue;
+        }
+        if (b->data()->state != AliasInfo::STATE_CHECKING)
+        {
+            // Conflict already known.
+            return;
+        }
+        b->data()->state = AliasInfo::STATE_CONFLICT;
+        g_alias_test_conflicts++;
+        ++parent_->stats_.conflicts;
+        for (auto &p : parent_->pending_)
+        {
+            if (p.b == b)
+            {
+                /* Restarts this candidate right away instead of waiting for
+                 * the rest of its window. The flow will pick a new alias. */
+                p.b = nullptr;
+                parent_->send(b);
+                break;
+            }
+        }
+        // If the candidate is not in its window, then the flow will notice
+        // the conflict at its next state.
         return;
     }
-    parent_->conflict_detected_ = 1;
-    g_alias_test_conflicts++;
-    if (parent_->is_state(static_cast<StateFlowBase::Callback>(&AliasAllocator::wait_done))) {
-        /* Wakes up the actual flow to not have to wait all the 200 ms of
-         * sleep. This will request the timer callback to be issued
-         * immediately, which avoids race condition between the trigger and the
-         * regular timeout call. */
-        parent_->timer_.trigger();
-    }
-    message->unref();
 }
 
 void AliasAllocator::TEST_finish_pending_allocation() {
-    if (is_state(STATE(wait_done))) {
-        timer_.trigger();
+    if (!pending_.empty()) {
+        expireAll_ = 1;
+        windowTimer_.trigger();
     }
 }
 
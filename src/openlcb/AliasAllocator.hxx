@@ -35,9 +35,12 @@
 #ifndef _OPENLCB_ALIASALLOCATOR_HXX_
 #define _OPENLCB_ALIASALLOCATOR_HXX_
 
+#include <vector>
+
 #include "openlcb/IfCan.hxx"
 #include "openlcb/Defs.hxx"
 #include "executor/StateFlow.hxx"
+#include "executor/Timer.hxx"
 
 namespace openlcb
 {
@@ -46,6 +49,23 @@ namespace openlcb
  * arisen during the allocation. */
 extern size_t g_alias_test_conflicts;
 
+/// How long we listen for conflicts after sending the last CID frame of an
+/// alias before we claim it with an RID frame.
+extern long long ALIAS_ALLOCATION_WAIT_NSEC;
+
+/// Counters of the alias allocator.
+struct AliasAllocatorStats
+{
+    /// Number of aliases that were successfully reserved.
+    unsigned reserved{0};
+    /// Number of candidate aliases given up because of a conflict.
+    unsigned conflicts{0};
+    /// Number of candidate aliases being checked now.
+    unsigned checking{0};
+    /// Highest number of candidate aliases that were checked concurrently.
+    unsigned maxChecking{0};
+};
+
 /** Information we know locally about an NMRAnet CAN alias. */
 struct AliasInfo
 {
@@ -91,6 +111,12 @@ struct AliasInfo
  *
  * Users who need an allocated alias should get it from the queue in
  * reserved_aliases().
+ *
+ * Reservations are pipelined: once the CID frames of a candidate alias are
+ * out, the flow moves on to the next incoming buffer while the candidate
+ * waits for its observation window to pass. Any number of candidates can be
+ * checked at the same time, and candidates started together share the same
+ * window. A conflict only restarts the affected candidate.
  */
 class AliasAllocator : public StateFlow<Buffer<AliasInfo>, QList<1>>
 {
@@ -126,6 +152,23 @@ public:
      * the reserved aliases queue. */
     void return_alias(NodeID id, NodeAlias alias);
 
+    /** Adds more alias buffers to the circulation. Every buffer yields one
+     * reserved alias, and once a node takes that alias the buffer comes back
+     * for the next reservation. So the reserved aliases pool is refilled to
+     * this many entries ahead of demand, which lets a burst of virtual nodes
+     * start without waiting for each reservation in turn. Each reserved alias
+     * takes an entry in the local alias cache. Thread-safe.
+     *
+     * @param count how many alias buffers to add. */
+    void reserve_aliases(unsigned count);
+
+    /// @return the allocator counters. Must be called on the interface's
+    /// executor for consistent values.
+    const AliasAllocatorStats &stats()
+    {
+        return stats_;
+    }
+
     /** If there is a pending alias allocation waiting for the timer to expire,
      * finishes it immediately. Needed in test destructors. */
     void TEST_finish_pending_allocation();
@@ -151,6 +194,34 @@ private:
 
     friend class ConflictHandler;
 
+    /// Expires the observation window of the candidate aliases.
+    class WindowTimer : public ::Timer
+    {
+    public:
+        WindowTimer(AliasAllocator *parent)
+            : ::Timer(parent->service()->executor()->active_timers())
+            , parent_(parent)
+        {
+        }
+
+        long long timeout() override
+        {
+            return parent_->window_timeout();
+        }
+
+    private:
+        AliasAllocator *parent_;
+    } windowTimer_;
+
+    /// A candidate alias whose CID frames are all out.
+    struct PendingAlias
+    {
+        /// Holds the candidate alias.
+        Buffer<AliasInfo> *b;
+        /// When the observation window of this candidate is over.
+        long long deadline;
+    };
+
     AliasInfo *pending_alias()
     {
         return message()->data();
@@ -159,19 +230,25 @@ private:
     Action entry() override;
     Action handle_allocate_for_cid_frame();
     Action send_cid_frame();
-    Action wait_done();
+    Action start_window();
     Action send_rid_frame();
 
     Action handle_alias_conflict();
 
+    /// Unregisters the conflict handler of the current candidate.
+    void stop_checking();
+
+    /// Called by the window timer. Sends the candidates whose observation
+    /// window is over back to the flow for the RID frame. @return the timer
+    /// period until the next deadline, or Timer::NONE.
+    long long window_timeout();
+
     /// Generates the next alias to check in the seed_ variable.
     void next_seed();
 
     friend class AsyncAliasAllocatorTest;
     friend class AsyncIfTest;
 
-    StateFlowTimer timer_;
-
     /** Freelist of reserved aliases that can be used by virtual nodes. The
         AliasAllocatorFlow will post successfully reserved aliases to this
         allocator. */
@@ -187,19 +264,26 @@ private:
         return static_cast<IfCan *>(service());
     }
 
+    /// Candidates in their observation window, ordered by deadline.
+    std::vector<PendingAlias> pending_;
+
+    /// Candidates with a registered conflict handler, including the one the
+    /// flow is working on and those in pending_.
+    std::vector<Buffer<AliasInfo> *> checking_;
+
+    /// Counters.
+    AliasAllocatorStats stats_;
+
     /// Which CID frame are we trying to send out. Valid values: 7..4
     unsigned cid_frame_sequence_ : 3;
-    /// Set to 1 if an incoming frame signals an alias conflict.
-    unsigned conflict_detected_ : 1;
+    /// Set to 1 if the next window timeout should expire every candidate.
+    unsigned expireAll_ : 1;
 
     /// Seed for generating random-looking alias numbers.
     unsigned seed_ : 12;
 
     /// Notifiable used for tracking outgoing frames.
     BarrierNotifiable n_;
-
-    /// Timer needed for sleeping the control flow.
-    // SleepData sleep_helper_;
 };
 
 /** Create this object statically to add an alias allocator to an already
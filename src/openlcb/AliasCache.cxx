@@ -299,4 +299,331 @@ void AliasCache::touch(Metadata* metadata)
     }
 }
 
+HashedAliasCache::HashedAliasCache(NodeID seed, size_t entries,
+    void (*remove_callback)(NodeID id, NodeAlias alias, void *), void *context)
+    : pool(new Metadata[entries])
+    , freeList(new uint16_t[entries])
+    , seed(seed)
+    , entries(entries)
+    , removeCallback(remove_callback)
+    , context(context)
+{
+    HASSERT(entries > 0 && entries < EMPTY / 2);
+    /* keeps the load factor of the index tables at or below 1/2 */
+    unsigned bits = 2;
+    while ((1u << bits) < entries * 2)
+    {
+        ++bits;
+    }
+    tableSize = 1u << bits;
+    aliasShift = 32 - bits;
+    idShift = 64 - bits;
+    aliasIndex = new uint16_t[tableSize];
+    idIndex = new uint16_t[tableSize];
+    clear();
+}
+
+HashedAliasCache::~HashedAliasCache()
+{
+    delete [] idIndex;
+    delete [] aliasIndex;
+    delete [] freeList;
+    delete [] pool;
+}
+
+void HashedAliasCache::clear()
+{
+    for (size_t i = 0; i < tableSize; ++i)
+    {
+        aliasIndex[i] = EMPTY;
+        idIndex[i] = EMPTY;
+    }
+    /* slots are handed out from the top of the stack, starting with 0 */
+    freeCount = 0;
+    for (size_t i = entries; i > 0; --i)
+    {
+        pool[i - 1].id = 0;
+        pool[i - 1].alias = 0;
+        pool[i - 1].referenced = false;
+        freeList[freeCount++] = i - 1;
+    }
+    clockHand = 0;
+}
+
+size_t HashedAliasCache::find_alias(NodeAlias alias)
+{
+    const size_t mask = tableSize - 1;
+    for (size_t cell = alias_home(alias);; cell = (cell + 1) & mask)
+    {
+        uint16_t slot = aliasIndex[cell];
+        if (slot == EMPTY)
+        {
+            return tableSize;
+        }
+        if (pool[slot].alias == alias)
+        {
+            return cell;
+        }
+    }
+}
+
+size_t HashedAliasCache::find_id(NodeID id)
+{
+    const size_t mask = tableSize - 1;
+    for (size_t cell = id_home(id);; cell = (cell + 1) & mask)
+    {
+        uint16_t slot = idIndex[cell];
+        if (slot == EMPTY)
+        {
+            return tableSize;
+        }
+        if (pool[slot].id == id)
+        {
+            return cell;
+        }
+    }
+}
+
+void HashedAliasCache::erase_cell(uint16_t *table, size_t cell, bool by_id)
+{
+    const size_t mask = tableSize - 1;
+    size_t hole = cell;
+    for (size_t i = (cell + 1) & mask; table[i] != EMPTY; i = (i + 1) & mask)
+    {
+        const Metadata &m = pool[table[i]];
+        size_t home = by_id ? id_home(m.id) : alias_home(m.alias);
+        /* the entry may fill the hole if its probe sequence passes through
+         * the hole, i.e. its home is not between the hole and itself. */
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            table[hole] = table[i];
+            hole = i;
+        }
+    }
+    table[hole] = EMPTY;
+}
+
+void HashedAliasCache::free_slot(uint16_t slot)
+{
+    Metadata *metadata = pool + slot;
+    erase_cell(aliasIndex, find_alias(metadata->alias), false);
+    /* The ID index might point to a newer slot with the same node ID if the
+     * node was added again with a different alias. */
+    const size_t mask = tableSize - 1;
+    for (size_t cell = id_home(metadata->id); idIndex[cell] != EMPTY;
+         cell = (cell + 1) & mask)
+    {
+        if (idIndex[cell] == slot)
+        {
+            erase_cell(idIndex, cell, true);
+            break;
+        }
+    }
+    metadata->id = 0;
+    metadata->alias = 0;
+    metadata->referenced = false;
+    freeList[freeCount++] = slot;
+}
+
+uint16_t HashedAliasCache::clock_victim()
+{
+    while (true)
+    {
+        Metadata *metadata = pool + clockHand;
+        uint16_t slot = clockHand;
+        if (++clockHand == entries)
+        {
+            clockHand = 0;
+        }
+        if (!metadata->referenced)
+        {
+            return slot;
+        }
+        metadata->referenced = false;
+    }
+}
+
+void HashedAliasCache::add(NodeID id, NodeAlias alias)
+{
+    HASSERT(id != 0);
+    HASSERT(alias != 0);
+
+    size_t cell = find_alias(alias);
+    if (cell != tableSize)
+    {
+        /* we already have a mapping for this alias, so lets remove it */
+        Metadata old = pool[aliasIndex[cell]];
+        free_slot(aliasIndex[cell]);
+
+        if (removeCallback)
+        {
+            /* tell the interface layer that we removed this mapping */
+            (*removeCallback)(old.id, old.alias, context);
+        }
+    }
+
+    if (!freeCount)
+    {
+        /* all slots are in use, so every slot is a candidate */
+        uint16_t victim = clock_victim();
+        Metadata old = pool[victim];
+        free_slot(victim);
+
+        if (removeCallback)
+        {
+            /* tell the interface layer that we removed this mapping */
+            (*removeCallback)(old.id, old.alias, context);
+        }
+    }
+
+    uint16_t slot = freeList[--freeCount];
+    Metadata *insert = pool + slot;
+    insert->id = id;
+    insert->alias = alias;
+    insert->referenced = true;
+
+    const size_t mask = tableSize - 1;
+    cell = alias_home(alias);
+    while (aliasIndex[cell] != EMPTY)
+    {
+        cell = (cell + 1) & mask;
+    }
+    aliasIndex[cell] = slot;
+
+    /* an older entry for the same node ID loses its ID index cell */
+    for (cell = id_home(id); idIndex[cell] != EMPTY; cell = (cell + 1) & mask)
+    {
+        if (pool[idIndex[cell]].id == id)
+        {
+            break;
+        }
+    }
+    idIndex[cell] = slot;
+}
+
+void HashedAliasCache::remove(NodeAlias alias)
+{
+    size_t cell = find_alias(alias);
+    if (cell != tableSize)
+    {
+        free_slot(aliasIndex[cell]);
+    }
+}
+
+bool HashedAliasCache::retrieve(unsigned entry, NodeID* node, NodeAlias* alias)
+{
+    HASSERT(entry < size());
+    Metadata* md = pool + entry;
+    if (!md->alias) return false;
+    if (node) *node = md->id;
+    if (alias) *alias = md->alias;
+    return true;
+}
+
+NodeAlias HashedAliasCache::lookup(NodeID id)
+{
+    HASSERT(id != 0);
+
+    size_t cell = find_id(id);
+    if (cell != tableSize)
+    {
+        Metadata *metadata = pool + idIndex[cell];
+        metadata->referenced = true;
+        return metadata->alias;
+    }
+
+    /* no match found */
+    return 0;
+}
+
+NodeID HashedAliasCache::lookup(NodeAlias alias)
+{
+    HASSERT(alias != 0);
+
+    size_t cell = find_alias(alias);
+    if (cell != tableSize)
+    {
+        Metadata *metadata = pool + aliasIndex[cell];
+        metadata->referenced = true;
+        return metadata->id;
+    }
+
+    /* no match found */
+    return 0;
+}
+
+void HashedAliasCache::for_each(
+    void (*callback)(void*, NodeID, NodeAlias), void *context)
+{
+    HASSERT(callback != NULL);
+
+    for (size_t i = 0; i < entries; ++i)
+    {
+        if (pool[i].alias)
+        {
+            (*callback)(context, pool[i].id, pool[i].alias);
+        }
+    }
+}
+
+NodeAlias HashedAliasCache::generate()
+{
+    NodeAlias alias;
+
+    do
+    {
+        /* calculate the alias given the current seed */
+        alias = (seed ^ (seed >> 12) ^ (seed >> 24) ^ (seed >> 36)) & 0xfff;
+
+        /* calculate the next seed */
+        seed = ((((1 << 9) + 1) * (seed) + CONSTANT)) & 0xffffffffffff;
+    } while (alias == 0 || lookup(alias) != 0);
+
+    /* new random alias */
+    return alias;
+}
+
+int HashedAliasCache::check_consistency()
+{
+    size_t used = 0;
+    for (size_t i = 0; i < entries; ++i)
+    {
+        if (!pool[i].alias)
+        {
+            if (pool[i].id) return 1;
+            continue;
+        }
+        ++used;
+        size_t cell = find_alias(pool[i].alias);
+        if (cell == tableSize) return 2;
+        if (aliasIndex[cell] != i) return 3;
+        cell = find_id(pool[i].id);
+        if (cell == tableSize) return 4;
+    }
+    if (used + freeCount != entries) return 5;
+    for (size_t i = 0; i < freeCount; ++i)
+    {
+        if (pool[freeList[i]].alias) return 6;
+    }
+    size_t alias_cells = 0;
+    size_t id_cells = 0;
+    for (size_t i = 0; i < tableSize; ++i)
+    {
+        if (aliasIndex[i] != EMPTY)
+        {
+            ++alias_cells;
+            if (!pool[aliasIndex[i]].alias) return 7;
+        }
+        if (idIndex[i] != EMPTY)
+        {
+            ++id_cells;
+            if (!pool[idIndex[i]].alias) return 8;
+            if (find_id(pool[idIndex[i]].id) != i) return 9;
+        }
+    }
+    if (alias_cells != used) return 10;
+    if (id_cells > used) return 11;
+    return 0;
+}
+
 }
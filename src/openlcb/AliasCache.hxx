@@ -214,6 +214,191 @@ private:
     DISALLOW_COPY_AND_ASSIGN(AliasCache);
 };
 
+/** Alternative cache of alias to node id mappings for caches with many
+ * entries, such as the remote aliases of a gateway. Has the same API as
+ * AliasCache. IfCan uses this class for both its local and remote alias
+ * caches.
+ *
+ * The entries are stored in a single contiguous array, and two open-addressed
+ * (linear probing) index tables map aliases and node IDs to array
+ * slots. Instead of keeping a strict least-recently-used list, each entry has
+ * a referenced bit that lookups set; when the cache is full, a CLOCK hand
+ * sweeps the array, clearing referenced bits until it finds an entry that was
+ * not used since the last sweep, and evicts that. All memory is allocated at
+ * construction time.
+ *
+ * Differences from AliasCache: for_each() visits the entries in storage
+ * order, not in last touched order, and the entry evicted when the cache is
+ * full is only approximately the least recently used one.
+ */
+class HashedAliasCache
+{
+public:
+    /** Constructor.
+     * @param seed starting seed for generation of aliases
+     * @param entries maximum number of entries in this cache, at most 32767
+     * @param remove_callback callback to call when we remove a mapping from
+     *        the cache however it will not be called in the remove() method
+     * @param context context pointer to pass to remove_callback
+     */
+    HashedAliasCache(NodeID seed, size_t entries,
+        void (*remove_callback)(NodeID id, NodeAlias alias, void *) = NULL,
+        void *context = NULL);
+
+    ~HashedAliasCache();
+
+    /** Reinitializes the entire map. */
+    void clear();
+
+    /** Add an alias to an alias cache.
+     * @param id 48-bit NMRAnet Node ID to associate alias with
+     * @param alias 12-bit alias associated with Node ID
+     */
+    void add(NodeID id, NodeAlias alias);
+
+    /** Remove an alias from an alias cache.  This method does not call the
+     * remove_callback method passed in at construction since it is a
+     * deliberate call not requiring notification.
+     * @param alias 12-bit alias associated with Node ID
+     */
+    void remove(NodeAlias alias);
+
+    /** Lookup a node's alias based on its Node ID.
+     * @param id Node ID to look for
+     * @return alias that matches the Node ID, else 0 if not found
+     */
+    NodeAlias lookup(NodeID id);
+
+    /** Lookup a node's ID based on its alias.
+     * @param alias alias to look for
+     * @return Node ID that matches the alias, else 0 if not found
+     */
+    NodeID lookup(NodeAlias alias);
+
+    /** Call the given callback function once for each alias tracked. The
+     * order is the storage order.
+     * @param callback method to call
+     * @param context context pointer to pass to callback
+     */
+    void for_each(void (*callback)(void*, NodeID, NodeAlias), void *context);
+
+    /** Returns the total number of aliases that can be cached. */
+    size_t size()
+    {
+        return entries;
+    }
+
+    /** Retrieves an entry by index. Allows stable iteration in the face of
+     * changes.
+     * @param entry is between 0 and size() - 1.
+     * @param node will be filled with the node ID. May be null.
+     * @param alias will be filled with the alias. May be null.
+     * @return true if the entry is valid, and node and alias were filled,
+     * otherwise false if the entry is not allocated.
+     */
+    bool retrieve(unsigned entry, NodeID* node, NodeAlias* alias);
+
+    /** Generate a 12-bit pseudo-random alias for a givin alias cache.
+     * @return pseudo-random 12-bit alias, an alias of zero is invalid
+     */
+    NodeAlias generate();
+
+    /** Visible for testing. Check internal consistency. @return 0 if the
+     * cache is consistent, otherwise a number identifying the failed
+     * check. */
+    int check_consistency();
+
+private:
+    /** Value of an index table cell that does not point to any slot. */
+    static constexpr uint16_t EMPTY = 0xFFFF;
+
+    /** One cache entry. A slot is free if alias is zero. */
+    struct Metadata
+    {
+        NodeID id; /**< 48-bit NMRAnet Node ID */
+        NodeAlias alias; /**< NMRAnet alias */
+        bool referenced; /**< true if used since the clock hand passed */
+    };
+
+    /** @return home index table cell of an alias. @param alias to hash */
+    size_t alias_home(NodeAlias alias)
+    {
+        return (uint32_t(alias) * 0x9E3779B1u) >> aliasShift;
+    }
+
+    /** @return home index table cell of a node ID. @param id to hash */
+    size_t id_home(NodeID id)
+    {
+        return (uint64_t(id) * 0x9E3779B97F4A7C15ull) >> idShift;
+    }
+
+    /** Finds an alias in the alias index table.
+     * @param alias what to look for
+     * @return cell in aliasIndex, or tableSize if not found. */
+    size_t find_alias(NodeAlias alias);
+
+    /** Finds a node ID in the node ID index table.
+     * @param id what to look for
+     * @return cell in idIndex, or tableSize if not found. */
+    size_t find_id(NodeID id);
+
+    /** Removes a slot from both index tables and puts it on the free list.
+     * @param slot index into pool of an allocated entry */
+    void free_slot(uint16_t slot);
+
+    /** Removes a cell from an index table by shifting back the subsequent
+     * cells of the probe sequence.
+     * @param table aliasIndex or idIndex
+     * @param cell which cell to clear
+     * @param by_id true if table is idIndex */
+    void erase_cell(uint16_t *table, size_t cell, bool by_id);
+
+    /** Runs the CLOCK hand until an entry that was not referenced is found.
+     * @return the slot to evict */
+    uint16_t clock_victim();
+
+    /** all cache entries */
+    Metadata *pool;
+
+    /** stack of free slot indexes */
+    uint16_t *freeList;
+
+    /** alias to slot index table, tableSize cells */
+    uint16_t *aliasIndex;
+
+    /** node ID to slot index table, tableSize cells */
+    uint16_t *idIndex;
+
+    /** number of entries on the freeList */
+    size_t freeCount;
+
+    /** number of cells in each index table, a power of two */
+    size_t tableSize;
+
+    /** shift for turning a 32-bit alias hash into a table index */
+    unsigned aliasShift;
+
+    /** shift for turning a 64-bit node ID hash into a table index */
+    unsigned idShift;
+
+    /** next slot the CLOCK hand will look at */
+    size_t clockHand;
+
+    /** Seed for the generation of the next alias */
+    NodeID seed;
+
+    /** How many metadata entries have we allocated. */
+    size_t entries;
+
+    /** callback function to be used when we remove an entry from the cache */
+    void (*removeCallback)(NodeID id, NodeAlias alias, void *);
+
+    /** context pointer to pass in with remove_callback */
+    void *context;
+
+    DISALLOW_COPY_AND_ASSIGN(HashedAliasCache);
+};
+
 } /* namepace NMRAnet */
 
 #endif /* _NMRAnetAliasCache_hxx */
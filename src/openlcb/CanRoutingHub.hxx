@@ -36,6 +36,11 @@
 #ifndef _OPENLCB_CANROUTNGHUB_HXX_
 #define _OPENLCB_CANROUTNGHUB_HXX_
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "openlcb/RoutingLogic.hxx"
 #include "openlcb/CanDefs.hxx"
 #include "openlcb/Defs.hxx"
@@ -52,6 +57,15 @@ namespace openlcb
    GridConnect protocol, performs routing decisions on the frames and sends out
    to the appropriate ports.
 
+   The set of ports is published as an immutable snapshot, which is replaced
+   as a whole when a port is registered or unregistered. Incoming data and
+   the delivery flow only take a reference to the current snapshot using
+   atomic operations, so they never wait for a lock, not even while clients
+   are connecting or disconnecting. Replaced snapshots are freed by the
+   delivery flow at the start of its next frame. The routing table is owned
+   by the delivery flow: it is read and updated only from there, therefore it
+   does not need a lock either.
+
    TODO: need to process consumer and producer identified messages.
    TODO: need to exclude CHECK ID frames from the source address learning.
  */
@@ -64,33 +78,49 @@ public:
 
     GcCanRoutingHub(Service *s)
         : deliveryFlow_(s, this)
+        , ports_(new PortSet)
+    {
+    }
+
+    ~GcCanRoutingHub()
     {
+        release_ports(ports_.load());
+        release_retired(retired_.load());
+        for (Notifiable *n : pendingDone_)
+        {
+            n->notify();
+        }
     }
 
     void send(Buffer<HubData> *b, unsigned priority = UINT_MAX) override
     {
-        OSMutexLock l(&lock_);
-        void *port = b->data()->skipMember_;
-        auto it = ports_.find(port);
-        if (it == ports_.end())
+        PortSet *ports = acquire_ports();
+        PortEntry *entry = ports->find(b->data()->skipMember_);
+        if (!entry)
         {
             LOG(INFO, "Arrived packet to routing hub without recognized source "
                       "designation (%p). Dropped packet.",
                 b->data()->skipMember_);
             b->unref();
+            release_ports(ports);
             return;
         }
-        const string &p = *b->data();
-        for (unsigned i = 0; i < p.size(); ++i)
+        const char *p = b->data()->data();
+        size_t len = b->data()->size();
+        while (len)
         {
-            if (it->second.segmenter_.consume_byte(p[i]))
+            bool complete;
+            size_t n = entry->segmenter_.consume_data(p, len, &complete);
+            p += n;
+            len -= n;
+            if (complete)
             {
                 // We have a frame.
                 string ret;
-                it->second.segmenter_.frame_buffer(&ret);
+                entry->segmenter_.frame_buffer(&ret);
                 LOG(VERBOSE, "sending frame: %s", ret.c_str());
                 auto *cb = deliveryFlow_.alloc();
-                HASSERT(it->second.segmenter_.parse_frame_to_output(
+                HASSERT(entry->segmenter_.parse_frame_to_output(
                     cb->data()->mutable_frame()));
                 cb->data()->skipMember_ = reinterpret_cast<
                     FlowInterface<Buffer<HubContainer<CanFrameContainer>>> *>(
@@ -99,6 +129,8 @@ public:
                     cb, reprioritize_frame(cb->data()->frame(), priority));
             }
         }
+        release_ports(ports);
+        b->unref();
     }
 
     CanHubPortInterface *can_hub()
@@ -113,25 +145,213 @@ public:
     {
         OSMutexLock l(&lock_);
         HASSERT(port);
-        ports_[port].hubPort_ = port;
+        PortSet *old = ports_.load();
+        if (old->find(port))
+        {
+            return;
+        }
+        PortSet *ports = new PortSet;
+        ports->entries_ = old->entries_;
+        std::shared_ptr<PortEntry> entry(new PortEntry);
+        entry->hubPort_ = port;
+        auto it = std::lower_bound(ports->entries_.begin(),
+            ports->entries_.end(), port, PortSet::KeyLess());
+        ports->entries_.emplace(it, port, std::move(entry));
+        publish_ports(ports);
     }
 
-    void unregister_port(HubPortInterface *port)
+    /// Removes a port. Does not wait for the delivery flow: no new frame will
+    /// be sent to the port after this call returns, but a send() that is
+    /// already in progress on the delivery flow's thread may still be
+    /// running. May be called from within the port's own send().
+    ///
+    /// @param port the port to remove.
+    /// @param done if not null, will be notified once the delivery flow has
+    /// finished with the port, after which the port may be deleted.
+    void unregister_port(HubPortInterface *port, Notifiable *done = nullptr)
     {
-        OSMutexLock l(&lock_);
-        auto it = ports_.find(port);
-        if (it == ports_.end())
         {
-            LOG(INFO, "Trying to remove a nonexistant port: %p", port);
-            return;
+            OSMutexLock l(&lock_);
+            if (done)
+            {
+                pendingDone_.push_back(done);
+                reclaimPending_ = true;
+            }
+            PortSet *old = ports_.load();
+            PortEntry *entry = old->find(port);
+            if (!entry)
+            {
+                LOG(INFO, "Trying to remove a nonexistant port: %p", port);
+            }
+            else
+            {
+                // The delivery flow checks this before every send, even if it
+                // is still using an old snapshot.
+                entry->inactive_ = true;
+                PortSet *ports = new PortSet;
+                for (auto &e : old->entries_)
+                {
+                    if (e.first != port)
+                    {
+                        ports->entries_.push_back(e);
+                    }
+                }
+                publish_ports(ports);
+                pendingRemove_.push_back(port);
+            }
+        }
+        if (done)
+        {
+            // Wakes up the delivery flow in case it is idle, because the
+            // notification is sent at the start of its next frame.
+            auto *b = deliveryFlow_.alloc();
+            b->data()->skipMember_ = &deliveryFlow_;
+            deliveryFlow_.send(b, 0);
         }
-        it->second.inactive_ = true;
-        pendingRemove_.push_back(port);
     }
 
 private:
-    class PortParser;
-    typedef std::map<void *, PortParser> PortsMap;
+    /// Data and objects we keep for each port.
+    struct PortEntry
+    {
+        /// If true, we must not send any data to this target, because it has
+        /// been unregistered.
+        std::atomic<bool> inactive_{false};
+        GcStreamParser segmenter_;
+        CanHubPortInterface *canPort_{nullptr};
+        HubPortInterface *hubPort_{nullptr};
+    };
+
+    /// Immutable list of the registered ports.
+    struct PortSet
+    {
+        /// Comparator for looking up entries by key.
+        struct KeyLess
+        {
+            bool operator()(const std::pair<void *, std::shared_ptr<PortEntry>>
+                                &e,
+                void *key) const
+            {
+                return e.first < key;
+            }
+        };
+
+        /// @param port the skipMember_ value of data from the port.
+        /// @return the entry of the port or nullptr if it is not registered.
+        PortEntry *find(void *port)
+        {
+            auto it = std::lower_bound(
+                entries_.begin(), entries_.end(), port, KeyLess());
+            if (it == entries_.end() || it->first != port)
+            {
+                return nullptr;
+            }
+            return it->second.get();
+        }
+
+        /// One reference for being the current set, plus one for each user.
+        std::atomic<unsigned> refs_{1};
+        /// Keyed by the skipMember_ value of the incoming data from a given
+        /// port, sorted by key.
+        std::vector<std::pair<void *, std::shared_ptr<PortEntry>>> entries_;
+        /// Link in the list of retired sets.
+        PortSet *nextRetired_{nullptr};
+    };
+
+    /// Takes a reference to the current port set. @return the port set,
+    /// which has to be released with release_ports().
+    PortSet *acquire_ports()
+    {
+        // While readers_ is non-zero, the delivery flow will not drop the
+        // reference of a replaced set, so we can safely add ours.
+        readers_.fetch_add(1);
+        PortSet *ports = ports_.load();
+        ports->refs_.fetch_add(1);
+        readers_.fetch_sub(1);
+        return ports;
+    }
+
+    /// Releases a reference to a port set. @param ports the port set.
+    static void release_ports(PortSet *ports)
+    {
+        if (ports->refs_.fetch_sub(1) == 1)
+        {
+            delete ports;
+        }
+    }
+
+    /// Releases the current-set reference of a list of retired port sets.
+    /// @param list first entry of the list, may be nullptr.
+    static void release_retired(PortSet *list)
+    {
+        while (list)
+        {
+            PortSet *next = list->nextRetired_;
+            release_ports(list);
+            list = next;
+        }
+    }
+
+    /// Replaces the current port set and retires the previous one. Must be
+    /// called with lock_ held. @param ports the new port set.
+    void publish_ports(PortSet *ports)
+    {
+        PortSet *old = ports_.exchange(ports);
+        old->nextRetired_ = retired_.load();
+        retired_.store(old);
+        reclaimPending_ = true;
+    }
+
+    /// Applies pending port removals to the routing table, notifies the
+    /// waiting unregister calls and frees the replaced port sets. Called
+    /// from the delivery flow only, when it is not using any port set.
+    void reclaim()
+    {
+        if (!reclaimPending_)
+        {
+            return;
+        }
+        PortSet *retired;
+        std::vector<void *> removed;
+        std::vector<Notifiable *> done;
+        {
+            OSMutexLock l(&lock_);
+            reclaimPending_ = false;
+            retired = retired_.exchange(nullptr);
+            removed.swap(pendingRemove_);
+            done.swap(pendingDone_);
+        }
+        for (void *p : removed)
+        {
+            routingTable_.remove_port(static_cast<CanHubPortInterface *>(p));
+        }
+        for (Notifiable *n : done)
+        {
+            n->notify();
+        }
+        if (!retired)
+        {
+            return;
+        }
+        if (readers_.load())
+        {
+            // A send() call might have loaded one of the retired pointers
+            // without having taken its reference yet. We will try again at
+            // the next frame.
+            OSMutexLock l(&lock_);
+            PortSet *last = retired;
+            while (last->nextRetired_)
+            {
+                last = last->nextRetired_;
+            }
+            last->nextRetired_ = retired_.load();
+            retired_.store(retired);
+            reclaimPending_ = true;
+            return;
+        }
+        release_retired(retired);
+    }
+
     /**
        Computes the desired priority of a CAN frame.
 
@@ -161,13 +381,13 @@ private:
     private:
         Action entry() override
         {
-            OSMutexLock l(&parent_->lock_);
             // First we apply any pending removes.
-            for (void *p : parent_->pendingRemove_)
+            parent_->reclaim();
+            if (message()->data()->skipMember_ == this)
             {
-                parent_->ports_.erase(p);
+                // Wakeup from unregister_port(), not a real frame.
+                return release_and_exit();
             }
-            parent_->pendingRemove_.clear();
 
             // Classifies the packet.
             srcAddress_ = 0;
@@ -178,6 +398,7 @@ private:
                 return release_and_exit();
             }
             classify_frame(frame);
+            ports_ = parent_->acquire_ports();
 
             if (srcAddress_ != 0)
             {
@@ -191,8 +412,8 @@ private:
             {
                 void *port =
                     parent_->routingTable_.lookup_port_for_address(dstAddress_);
-                nextIt_ = parent_->ports_.find(port);
-                if (nextIt_ != parent_->ports_.end())
+                target_ = port ? ports_->find(port) : nullptr;
+                if (target_)
                 {
                     // We found the desired port in the routing table.
                     return call_immediately(STATE(forward_addressed));
@@ -203,7 +424,14 @@ private:
                 }
             }
 
-            nextIt_ = parent_->ports_.begin();
+            if (forwardType_ == EVENT)
+            {
+                parent_->routingTable_.lookup_pcer(event_, &eventPorts_);
+                nextEventPort_ = 0;
+                return call_immediately(STATE(try_next_event_port));
+            }
+
+            nextPort_ = 0;
 
             return call_immediately(STATE(try_next_entry));
         }
@@ -314,35 +542,37 @@ private:
 
         Action try_next_entry()
         {
-            OSMutexLock l(&parent_->lock_);
-            if (nextIt_ == parent_->ports_.end())
+            if (nextPort_ >= ports_->entries_.size())
             {
                 return done_processing();
             }
 
-            if (forwardType_ == EVENT)
+            // forward all
+            forward_to_port(ports_->entries_[nextPort_].second.get());
+
+            nextPort_++;
+            return again();
+        }
+
+        /// Forwards an event report to the next port that has a consumer for
+        /// it. @return next state.
+        Action try_next_event_port()
+        {
+            if (nextEventPort_ >= eventPorts_.size())
             {
-                if (parent_->routingTable_.check_pcer(
-                        static_cast<CanHubPortInterface *>(nextIt_->first),
-                        event_))
-                {
-                    forward_to_port();
-                }
+                return done_processing();
             }
-            else
+            PortEntry *entry = ports_->find(eventPorts_[nextEventPort_++]);
+            if (entry)
             {
-                // forward all
-                forward_to_port();
+                forward_to_port(entry);
             }
-
-            nextIt_++;
             return again();
         }
 
         Action forward_addressed()
         {
-            OSMutexLock l(&parent_->lock_);
-            forward_to_port();
+            forward_to_port(target_);
             return done_processing();
         }
 
@@ -353,29 +583,40 @@ private:
                 gcBuf_->unref();
                 gcBuf_ = nullptr;
             }
+            release_ports(ports_);
+            ports_ = nullptr;
             return release_and_exit();
         }
 
-        void forward_to_port()
+        /// Sends the current frame to a port.
+        /// @param entry the port to send to.
+        void forward_to_port(PortEntry *entry)
         {
-            if (nextIt_->second.inactive_)
-                return;
-            if (nextIt_->second.canPort_)
+            if (!entry->inactive_)
             {
-                if (nextIt_->second.canPort_ == message()->data()->skipMember_)
+                send_to_port(entry);
+            }
+        }
+
+        /// Sends the current frame to an active port.
+        /// @param entry the port to send to.
+        void send_to_port(PortEntry *entry)
+        {
+            if (entry->canPort_)
+            {
+                if (entry->canPort_ == message()->data()->skipMember_)
                     return;
-                nextIt_->second.canPort_->send(message()->ref(), priority());
+                entry->canPort_->send(message()->ref(), priority());
             }
             else
             {
-                HASSERT(nextIt_->second.hubPort_);
+                HASSERT(entry->hubPort_);
                 CanHubPortInterface *hpi =
-                    reinterpret_cast<CanHubPortInterface *>(
-                        nextIt_->second.hubPort_);
+                    reinterpret_cast<CanHubPortInterface *>(entry->hubPort_);
                 if (hpi == message()->data()->skipMember_)
                     return;
                 ensure_gc_buf_available();
-                nextIt_->second.hubPort_->send(gcBuf_->ref());
+                entry->hubPort_->send(gcBuf_->ref());
             }
         }
 
@@ -406,7 +647,13 @@ private:
         NodeAlias srcAddress_;      //< for all OpenLCB frames
         NodeAlias dstAddress_;      //< for addressed frames
         EventId event_;             //< for PCER messages
-        PortsMap::iterator nextIt_; //< which port to consider next
+        PortSet *ports_{nullptr};   //< ports snapshot for this frame
+        unsigned nextPort_;         //< which port to consider next
+        PortEntry *target_;         //< for addressed frames
+        /// Ports with a consumer for event_ (for PCER messages).
+        std::vector<CanHubPortInterface *> eventPorts_;
+        /// Index of the next entry in eventPorts_ to forward to.
+        unsigned nextEventPort_;
         GcCanRoutingHub *parent_;
         /// Gridconnect-rendered frame.
         Buffer<HubData> *gcBuf_;
@@ -416,25 +663,28 @@ private:
 
     friend class DeliveryFlow;
 
-    /// Data and objects we keep for each port.
-    struct PortParser
-    {
-        /// If true, we must not send any data to this target, because it has
-        /// been unregistered.
-        bool inactive_{false};
-        GcStreamParser segmenter_;
-        CanHubPortInterface *canPort_{nullptr};
-        HubPortInterface *hubPort_{nullptr};
-    };
-    /// Keyed by the skipMember_ value of the incoming data from a given port.
-    std::map<void *, PortParser> ports_;
+    /// The current set of ports.
+    std::atomic<PortSet *> ports_;
+    /// Number of threads in acquire_ports().
+    std::atomic<unsigned> readers_{0};
+    /// Replaced port sets, to be freed by the delivery flow. Written with
+    /// lock_ held.
+    std::atomic<PortSet *> retired_{nullptr};
+    /// Serializes port registration and removal.
     OSMutex lock_;
-    /** Due to race conditions involving iteration and add/remove calls, we
-     * delay applying unregister requests until the next packet is being
-     * sent. */
+    /** The routing table is only touched by the delivery flow, so removing
+     * ports from it is delayed until the next packet is being sent. Protected
+     * by lock_. */
     std::vector<void *> pendingRemove_;
-
-    RoutingLogic<CanHubPortInterface, NodeAlias> routingTable_;
+    /// Callers of unregister_port() to notify once the delivery flow is done
+    /// with the removed ports. Protected by lock_.
+    std::vector<Notifiable *> pendingDone_;
+    /// True if the delivery flow has to call reclaim().
+    std::atomic<bool> reclaimPending_{false};
+
+    /// Only accessed from the delivery flow, thus needs no locking.
+    RoutingLogic<CanHubPortInterface, NodeAlias, RoutingLogicNoLock>
+        routingTable_;
 };
 
 } // namespace openlcb
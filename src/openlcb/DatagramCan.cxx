@@ -34,6 +34,7 @@
 
 #include "openlcb/DatagramCan.hxx"
 
+#include "nmranet_config.h"
 #include "openlcb/DatagramDefs.hxx"
 #include "openlcb/IfCanImpl.hxx"
 
@@ -44,6 +45,10 @@ namespace openlcb
 /// ack/nack response message.
 long long DATAGRAM_RESPONSE_TIMEOUT_NSEC = SEC_TO_NSEC(3);
 
+/// Defines how long a partially received datagram is kept when no more frames
+/// arrive for it.
+long long DATAGRAM_REASSEMBLY_TIMEOUT_NSEC = SEC_TO_NSEC(3);
+
 /// Datagram client implementation for CANbus-based datagram protocol.
 ///
 /// This flow is responsible for the outgoing CAN datagram framing, and listens
@@ -483,20 +488,19 @@ public:
 
         srcAlias_ = (id & CanDefs::SRC_MASK) >> CanDefs::SRC_SHIFT;
 
-        uint64_t buffer_key = id & (CanDefs::DST_MASK | CanDefs::SRC_MASK);
+        uint32_t buffer_key = id & (CanDefs::DST_MASK | CanDefs::SRC_MASK);
 
         dst_.alias = buffer_key >> (CanDefs::DST_SHIFT);
         dstNode_ = nullptr;
         dst_.id = if_can()->local_aliases()->lookup(NodeAlias(dst_.alias));
-        if (dst_.id)
-        {
-            dstNode_ = if_can()->lookup_local_node(dst_.id);
-        }
-        if (!dstNode_)
+        if (!dst_.id || dst_.id == AliasCache::RESERVED_ALIAS_NODE_ID)
         {
             // Destination not local node.
             return release_and_exit();
         }
+        // This might be NULL if dst is a proxied node in a gateway. The
+        // datagram is then assembled for the gateway to pick up.
+        dstNode_ = if_can()->lookup_local_node(dst_.id);
 
         DatagramPayload *buf = nullptr;
         bool last_frame = true;
@@ -513,22 +517,31 @@ public:
             case 3:
             {
                 // Datagram first frame
-                auto it = pendingBuffers_.find(buffer_key);
-                if (it != pendingBuffers_.end())
+                int slot = find_slot(buffer_key);
+                if (slot >= 0)
                 {
-                    pendingBuffers_.erase(it);
+                    free_slot(slot);
                     /** Frames came out of order or more than one datagram is
                      * being sent to the same dst. */
                     errorCode_ = DatagramClient::RESEND_OK |
                                  DatagramClient::OUT_OF_ORDER;
                     break;
                 }
+                slot = alloc_slot(buffer_key);
+                if (slot < 0)
+                {
+                    // Too many datagrams are being reassembled. The sender
+                    // will try again later.
+                    ++stats_.rejected;
+                    errorCode_ = DatagramClient::RESEND_OK |
+                                 DatagramClient::BUFFER_UNAVAILABLE;
+                    break;
+                }
 
-                buf = &pendingBuffers_[buffer_key];
+                buf = &slots_[slot].payload;
                 buf->clear();
-
-                // Datagram first frame. Get a full buffer.
-                buf->reserve(72);
+                // The slots keep the buffers preallocated in the constructor.
+                HASSERT(buf->capacity() >= DatagramDefs::MAX_SIZE);
                 last_frame = false;
                 break;
             }
@@ -539,18 +552,21 @@ public:
             case 5:
             {
                 // Datagram last frame
-                auto it = pendingBuffers_.find(buffer_key);
-                if (it != pendingBuffers_.end())
+                int slot = find_slot(buffer_key);
+                if (slot >= 0)
                 {
-                    buf = &it->second;
+                    buf = &slots_[slot].payload;
+                    slots_[slot].deadline =
+                        os_get_time_monotonic() +
+                        DATAGRAM_REASSEMBLY_TIMEOUT_NSEC;
                     if (last_frame)
                     {
-                        localBuffer_.clear();
-                        // Moves ownership of the allocated data to the local
-                        // buffer.
-                        localBuffer_.swap(*buf);
+                        // Copies the data out, so that the slot keeps its
+                        // preallocated buffer.
+                        localBuffer_.reserve(buf->size() + f->can_dlc);
+                        localBuffer_.assign(*buf);
                         buf = &localBuffer_;
-                        pendingBuffers_.erase(it);
+                        free_slot(slot);
                     }
                 }
                 break;
@@ -562,8 +578,11 @@ public:
 
         if (!buf)
         {
-            errorCode_ =
-                DatagramClient::RESEND_OK | DatagramClient::OUT_OF_ORDER;
+            if (!errorCode_)
+            {
+                errorCode_ =
+                    DatagramClient::RESEND_OK | DatagramClient::OUT_OF_ORDER;
+            }
         }
         else if (buf->size() + f->can_dlc > DatagramDefs::MAX_SIZE)
         {
@@ -573,9 +592,12 @@ public:
                 (int)(buf->size() + f->can_dlc));
             errorCode_ = DatagramClient::PERMANENT_ERROR;
             // Since we reject the datagram, let's not keep the buffer
-            // around. This call should not crash if the buffer was already
-            // deleted.
-            pendingBuffers_.erase(buffer_key);
+            // around. The slot is already gone if this was the last frame.
+            int slot = find_slot(buffer_key);
+            if (slot >= 0)
+            {
+                free_slot(slot);
+            }
         }
 
         if (errorCode_)
@@ -607,7 +629,7 @@ public:
     Action send_rejection()
     {
         HASSERT(errorCode_);
-        HASSERT(dstNode_);
+        HASSERT(dst_.id);
         auto *f =
             get_allocation_result(if_can()->addressed_message_write_flow());
         f->data()->reset(Defs::MTI_DATAGRAM_REJECTED, dst_.id, {0, srcAlias_},
@@ -643,9 +665,177 @@ public:
         return exit();
     }
 
+    /// @return the reassembly counters.
+    const CanDatagramReassemblyStats &stats()
+    {
+        return stats_;
+    }
+
 private:
+    /// Marks an unused slot of the reassembly table.
+    static constexpr uint32_t FREE_SLOT = 0xFFFFFFFFu;
+
+    /// @return the preferred slot of a key in the reassembly table.
+    /// @param key is the source and destination alias of the datagram.
+    unsigned home_slot(uint32_t key)
+    {
+        return ((key * 0x9E3779B1u) >> 8) % numSlots_;
+    }
+
+    /// Looks up a datagram being reassembled. @param key is the source and
+    /// destination alias of the datagram. @return the slot index, or -1 if
+    /// there is no reassembly in progress for key.
+    int find_slot(uint32_t key)
+    {
+        unsigned i = home_slot(key);
+        for (unsigned n = 0; n < numSlots_; ++n)
+        {
+            if (slots_[i].key == key)
+            {
+                return i;
+            }
+            if (slots_[i].key == FREE_SLOT)
+            {
+                break;
+            }
+            if (++i == numSlots_)
+            {
+                i = 0;
+            }
+        }
+        return -1;
+    }
+
+    /// Starts reassembling a new datagram. @param key is the source and
+    /// destination alias of the datagram. @return the slot index, or -1 if
+    /// the table is full.
+    int alloc_slot(uint32_t key)
+    {
+        if (stats_.active >= numSlots_)
+        {
+            return -1;
+        }
+        unsigned i = home_slot(key);
+        while (slots_[i].key != FREE_SLOT)
+        {
+            if (++i == numSlots_)
+            {
+                i = 0;
+            }
+        }
+        slots_[i].key = key;
+        slots_[i].deadline =
+            os_get_time_monotonic() + DATAGRAM_REASSEMBLY_TIMEOUT_NSEC;
+        if (++stats_.active > stats_.maxActive)
+        {
+            stats_.maxActive = stats_.active;
+        }
+        if (!sweepPending_)
+        {
+            sweepPending_ = true;
+            sweepTimer_.start(DATAGRAM_REASSEMBLY_TIMEOUT_NSEC);
+        }
+        return i;
+    }
+
+    /// Releases a slot of the reassembly table. Later entries of the same
+    /// probe sequence are moved back so that lookups never have to skip over
+    /// deleted slots. @param i is the slot index.
+    void free_slot(unsigned i)
+    {
+        slots_[i].key = FREE_SLOT;
+        slots_[i].payload.clear();
+        --stats_.active;
+        unsigned j = i;
+        while (true)
+        {
+            if (++j == numSlots_)
+            {
+                j = 0;
+            }
+            if (slots_[j].key == FREE_SLOT)
+            {
+                return;
+            }
+            unsigned k = home_slot(slots_[j].key);
+            // The entry at j can move to i if its home slot is not
+            // cyclically between i (exclusive) and j (inclusive).
+            bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+            if (stays)
+            {
+                continue;
+            }
+            slots_[i].key = slots_[j].key;
+            slots_[i].deadline = slots_[j].deadline;
+            slots_[i].payload.swap(slots_[j].payload);
+            slots_[j].key = FREE_SLOT;
+            i = j;
+        }
+    }
+
+    /// Drops the reassemblies that did not progress for
+    /// DATAGRAM_REASSEMBLY_TIMEOUT_NSEC. @return true if there are
+    /// reassemblies left.
+    bool sweep()
+    {
+        long long now = os_get_time_monotonic();
+        unsigned i = 0;
+        while (i < numSlots_)
+        {
+            if (slots_[i].key != FREE_SLOT && slots_[i].deadline <= now)
+            {
+                LOG(VERBOSE, "AsyncDatagramCan: dropping incomplete datagram "
+                          "from alias %03x to %03x",
+                    (unsigned)(slots_[i].key & CanDefs::SRC_MASK),
+                    (unsigned)(slots_[i].key >> CanDefs::DST_SHIFT));
+                ++stats_.evicted;
+                // free_slot may move a later entry into slot i, so we look at
+                // slot i again.
+                free_slot(i);
+                continue;
+            }
+            ++i;
+        }
+        sweepPending_ = stats_.active > 0;
+        return sweepPending_;
+    }
+
+    /// One partially received multi-frame datagram.
+    struct Reassembly
+    {
+        /// Payload bytes received so far.
+        DatagramPayload payload;
+        /// When the reassembly gets dropped unless more frames arrive.
+        long long deadline;
+        /// Source and destination alias of the datagram, or FREE_SLOT.
+        uint32_t key{FREE_SLOT};
+    };
+
+    /// Periodically drops the timed out reassemblies.
+    class SweepTimer : public ::Timer
+    {
+    public:
+        /// Constructor. @param parent is the owning parser.
+        SweepTimer(CanDatagramParser *parent)
+            : Timer(parent->service()->executor()->active_timers())
+            , parent_(parent)
+        {
+        }
+
+        /// Callback when the timer expires. @return RESTART while there are
+        /// reassemblies in progress.
+        long long timeout() override
+        {
+            return parent_->sweep() ? RESTART : NONE;
+        }
+
+    private:
+        /// Owning parser.
+        CanDatagramParser *parent_;
+    };
+
     /// A local buffer that owns the datagram payload bytes after we took the
-    /// entry from the pending buffers map.
+    /// entry from the reassembly table.
     DatagramPayload localBuffer_;
 
     Node *dstNode_;
@@ -655,19 +845,27 @@ private:
     /// be forwarded to the upper layer in this case.
     uint16_t errorCode_;
 
-    /** Open datagram buffers. Keyed by (dstid | srcid), value is a datagram
-     * payload. When a payload is finished, it should be moved into the final
-     * datagram message using swap() to avoid memory copies.
-     * @TODO(balazs.racz) we need some kind of timeout-based release mechanism
-     * in here. */
-    StlMap<uint64_t, DatagramPayload> pendingBuffers_;
+    /** Open datagram buffers: a fixed size hash table with linear probing,
+     * keyed by (dst alias | src alias). When a payload is finished, it is
+     * moved into the final datagram message using swap() to avoid memory
+     * copies. */
+    std::unique_ptr<Reassembly[]> slots_;
+    /// Number of entries in slots_.
+    unsigned numSlots_;
+    /// Drops the stuck reassemblies.
+    SweepTimer sweepTimer_{this};
+    /// True if sweepTimer_ is running.
+    bool sweepPending_{false};
+    /// Counters.
+    CanDatagramReassemblyStats stats_;
 };
 CanDatagramService::CanDatagramService(IfCan *iface,
                                        int num_registry_entries,
                                        int num_clients)
     : DatagramService(iface, num_registry_entries)
+    , parser_(new CanDatagramParser(if_can()))
 {
-    if_can()->add_owned_flow(new CanDatagramParser(if_can()));
+    if_can()->add_owned_flow(parser_);
     for (int i = 0; i < num_clients; ++i)
     {
         auto *client_flow = new CanDatagramClient(if_can());
@@ -685,14 +883,31 @@ CanDatagramService::~CanDatagramService()
 {
 }
 
+const CanDatagramReassemblyStats &CanDatagramService::reassembly_stats()
+{
+    return parser_->stats();
+}
+
+constexpr uint32_t CanDatagramParser::FREE_SLOT;
+
 CanDatagramParser::CanDatagramParser(IfCan *iface)
     : CanFrameStateFlow(iface)
+    , slots_(new Reassembly[config_datagram_reassembly_slots()])
+    , numSlots_(config_datagram_reassembly_slots())
 {
+    for (unsigned i = 0; i < numSlots_; ++i)
+    {
+        slots_[i].payload.reserve(DatagramDefs::MAX_SIZE);
+    }
     if_can()->frame_dispatcher()->register_handler(this, CAN_FILTER, CAN_MASK);
 }
 
 CanDatagramParser::~CanDatagramParser()
 {
+    if (sweepPending_)
+    {
+        sweepTimer_.cancel();
+    }
     if_can()->frame_dispatcher()->unregister_handler(this, CAN_FILTER,
                                                      CAN_MASK);
 }
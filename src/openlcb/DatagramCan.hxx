@@ -41,6 +41,25 @@
 namespace openlcb
 {
 
+/// Defines how long a partially received datagram is kept when no more frames
+/// arrive for it.
+extern long long DATAGRAM_REASSEMBLY_TIMEOUT_NSEC;
+
+class CanDatagramParser;
+
+/// Counters of the incoming datagram reassembly.
+struct CanDatagramReassemblyStats
+{
+    /// Number of datagrams being reassembled now.
+    unsigned active{0};
+    /// Highest number of datagrams that were reassembled concurrently.
+    unsigned maxActive{0};
+    /// Number of partial datagrams dropped because they timed out.
+    unsigned evicted{0};
+    /// Number of datagrams rejected because all reassembly slots were in use.
+    unsigned rejected{0};
+};
+
 /// Implementation of the DatagramService with the CANbus-specific OpenLCB
 /// datagram protocol. This service is responsible for fragmenting outgoing
 /// datagram messages to the CANbus, assembling incoming datagram frames into
@@ -61,6 +80,13 @@ public:
     {
         return static_cast<IfCan *>(iface());
     }
+
+    /// @return the counters of the incoming datagram reassembly.
+    const CanDatagramReassemblyStats &reassembly_stats();
+
+private:
+    /// Incoming datagram parser. Owned by the interface.
+    CanDatagramParser *parser_;
 };
 
 /// Creates a CAN datagram parser flow. Exposed for testing only.
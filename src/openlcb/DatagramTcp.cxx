@@ -0,0 +1,377 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file DatagramTcp.cxx
+ *
+ * Datagram service for the OpenLCB-TCP transport.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#include "openlcb/DatagramTcp.hxx"
+
+#include "utils/LinkedObject.hxx"
+
+namespace openlcb
+{
+
+/// Datagram client implementation for the TCP transport.
+///
+/// This flow sends the datagram as one addressed message, then listens for
+/// the incoming datagram response messages. Only one datagram may be
+/// outstanding for a given source and destination node pair, because the
+/// responses do not identify which datagram they belong to.
+class TcpDatagramClient : public DatagramClient,
+                          public StateFlowBase,
+                          public LinkedObject<TcpDatagramClient>
+{
+public:
+    /// Constructor. @param iface is the interface to send datagrams on.
+    TcpDatagramClient(IfTcp *iface)
+        : StateFlowBase(iface)
+        , listener_(this)
+        , isSleeping_(0)
+        , hasResponse_(0)
+        , sendPending_(0)
+    {
+    }
+
+    void write_datagram(Buffer<GenMessage> *b, unsigned priority) override
+    {
+        if (!b->data()->mti)
+        {
+            b->data()->mti = Defs::MTI_DATAGRAM;
+        }
+        HASSERT(b->data()->mti == Defs::MTI_DATAGRAM);
+        result_ = OPERATION_PENDING;
+        message_ = b;
+        start_flow(STATE(acquire_srcdst_lock));
+    }
+
+    /** Requests cancelling the datagram send operation. Will notify the done
+     * callback when the canceling is completed. */
+    void cancel() override
+    {
+        DIE("Canceling datagram send operation is not yet implemented.");
+    }
+
+private:
+    enum
+    {
+        MTI_1a = Defs::MTI_TERMINATE_DUE_TO_ERROR,
+        MTI_1b = Defs::MTI_OPTIONAL_INTERACTION_REJECTED,
+        MASK_1 = ~(MTI_1a ^ MTI_1b),
+        MTI_1 = MTI_1a,
+        MTI_2a = Defs::MTI_DATAGRAM_OK,
+        MTI_2b = Defs::MTI_DATAGRAM_REJECTED,
+        MASK_2 = ~(MTI_2a ^ MTI_2b),
+        MTI_2 = MTI_2a,
+        MTI_3 = Defs::MTI_INITIALIZATION_COMPLETE,
+        MASK_3 = Defs::MTI_EXACT,
+    };
+
+    /// Waits until no other client is sending to the same destination.
+    Action acquire_srcdst_lock()
+    {
+        {
+            AtomicHolder h(LinkedObject<TcpDatagramClient>::head_mu());
+            for (TcpDatagramClient *c = LinkedObject<TcpDatagramClient>::head_;
+                 c; c = c->LinkedObject<TcpDatagramClient>::link_next())
+            {
+                if (!c->sendPending_)
+                    continue;
+                if (c->nmsg()->src.id != nmsg()->src.id)
+                    continue;
+                if (c->nmsg()->dst.id != nmsg()->dst.id)
+                    continue;
+                // Another client is sending to this destination. We need to
+                // wait for that transaction to complete.
+                c->waitingClients_.push_front(this);
+                return wait();
+            }
+            sendPending_ = 1;
+        }
+        if (!nmsg()->dst.id)
+        {
+            // We cannot resolve aliases on TCP.
+            result_ |= PERMANENT_ERROR | DST_NOT_FOUND;
+            release_srcdst_lock();
+            return call_immediately(STATE(datagram_finalize));
+        }
+        register_handlers();
+        return allocate_and_call(
+            iface()->addressed_message_write_flow(), STATE(send_datagram));
+    }
+
+    /// Sends the datagram and starts waiting for the response.
+    Action send_datagram()
+    {
+        auto *b = get_allocation_result(iface()->addressed_message_write_flow());
+        b->data()->reset(
+            Defs::MTI_DATAGRAM, nmsg()->src.id, nmsg()->dst, Payload());
+        b->data()->payload.swap(nmsg()->payload);
+        iface()->addressed_message_write_flow()->send(b);
+        if (hasResponse_)
+        {
+            return call_immediately(STATE(datagram_finalize));
+        }
+        isSleeping_ = 1;
+        return sleep_and_call(&timer_, DATAGRAM_RESPONSE_TIMEOUT_NSEC,
+            STATE(response_or_timeout));
+    }
+
+    /// Called when the response arrived or the timeout expired.
+    Action response_or_timeout()
+    {
+        isSleeping_ = 0;
+        if (!hasResponse_)
+        {
+            LOG(INFO,
+                "TcpDatagramClient: No datagram response arrived from "
+                "destination %012" PRIx64 ".",
+                nmsg()->dst.id);
+            unregister_response_handler();
+            result_ |= PERMANENT_ERROR | TIMEOUT;
+        }
+        return call_immediately(STATE(datagram_finalize));
+    }
+
+    /// Reports the result to the caller.
+    Action datagram_finalize()
+    {
+        HASSERT(!sendPending_);
+        HASSERT(result_ & OPERATION_PENDING);
+        result_ &= ~OPERATION_PENDING;
+        auto *b = message_;
+        message_ = nullptr;
+        b->unref();
+        return set_terminated();
+    }
+
+    void register_handlers()
+    {
+        hasResponse_ = 0;
+        isSleeping_ = 0;
+        iface()->dispatcher()->register_handler(&listener_, MTI_1, MASK_1);
+        iface()->dispatcher()->register_handler(&listener_, MTI_2, MASK_2);
+        iface()->dispatcher()->register_handler(&listener_, MTI_3, MASK_3);
+    }
+
+    void unregister_response_handler()
+    {
+        iface()->dispatcher()->unregister_handler(&listener_, MTI_1, MASK_1);
+        iface()->dispatcher()->unregister_handler(&listener_, MTI_2, MASK_2);
+        iface()->dispatcher()->unregister_handler(&listener_, MTI_3, MASK_3);
+        release_srcdst_lock();
+    }
+
+    /// Hands off the src/dst pair to the next waiting client, if any.
+    void release_srcdst_lock()
+    {
+        sendPending_ = 0;
+        if (!waitingClients_.empty())
+        {
+            TcpDatagramClient *c =
+                static_cast<TcpDatagramClient *>(waitingClients_.pop_front());
+            // Hands off all waiting clients to c.
+            HASSERT(c->waitingClients_.empty());
+            std::swap(waitingClients_, c->waitingClients_);
+            c->notify();
+        }
+    }
+
+    /** This object is registered to receive response messages at the interface
+     * level. Then it forwards the call to the parent TcpDatagramClient. */
+    class ReplyListener : public MessageHandler
+    {
+    public:
+        /// Constructor. @param parent is the client that owns *this.
+        ReplyListener(TcpDatagramClient *parent)
+            : parent_(parent)
+        {
+        }
+
+        void send(message_type *buffer, unsigned priority) override
+        {
+            parent_->handle_response(buffer->data());
+            buffer->unref();
+        }
+
+    private:
+        /// Client to forward the responses to.
+        TcpDatagramClient *parent_;
+    };
+
+    /// Callback when a matching response comes in on the interface.
+    void handle_response(GenMessage *message)
+    {
+        // Check for reboot (unaddressed message) first.
+        if (message->mti == Defs::MTI_INITIALIZATION_COMPLETE)
+        {
+            if (message->payload.size() != 6)
+            {
+                // Malformed message inbound.
+                return;
+            }
+            if (buffer_to_node_id(message->payload) == nmsg()->dst.id)
+            {
+                // Destination node has rebooted. Kill datagram flow.
+                result_ |= DST_REBOOT;
+                return stop_waiting_for_response();
+            }
+            return;
+        }
+        // Node IDs are always present on TCP, so the response has to match
+        // exactly.
+        if (message->dst.id != nmsg()->src.id ||
+            message->src.id != nmsg()->dst.id)
+        {
+            return;
+        }
+
+        uint16_t error_code = 0;
+        uint8_t payload_length = 0;
+        const uint8_t *payload = nullptr;
+        if (!message->payload.empty())
+        {
+            payload =
+                reinterpret_cast<const uint8_t *>(message->payload.data());
+            payload_length = message->payload.size();
+        }
+        if (payload_length >= 2)
+        {
+            error_code = (((uint16_t)payload[0]) << 8) | payload[1];
+        }
+
+        switch (message->mti)
+        {
+            case Defs::MTI_TERMINATE_DUE_TO_ERROR:
+            case Defs::MTI_OPTIONAL_INTERACTION_REJECTED:
+            {
+                if (payload_length >= 4)
+                {
+                    uint16_t return_mti = payload[2];
+                    return_mti <<= 8;
+                    return_mti |= payload[3];
+                    if (return_mti != Defs::MTI_DATAGRAM)
+                    {
+                        // This must be a rejection of some other
+                        // message. Ignore.
+                        return;
+                    }
+                }
+            } // fall through
+            case Defs::MTI_DATAGRAM_REJECTED:
+            {
+                result_ &= ~0xffff;
+                result_ |= error_code;
+                // Ensures that an error response is visible in the flags.
+                if (!(result_ & (PERMANENT_ERROR | RESEND_OK)))
+                {
+                    result_ |= PERMANENT_ERROR;
+                }
+                break;
+            }
+            case Defs::MTI_DATAGRAM_OK:
+            {
+                if (payload_length)
+                {
+                    result_ &= ~(0xff << RESPONSE_FLAGS_SHIFT);
+                    result_ |= payload[0] << RESPONSE_FLAGS_SHIFT;
+                }
+                result_ |= OPERATION_SUCCESS;
+                break;
+            }
+            default:
+                // Ignore message.
+                return;
+        } // switch response MTI
+        stop_waiting_for_response();
+    }
+
+    /// To be called from the handler. Wakes up the main flow, which will then
+    /// terminate with whatever is in the result_ code right now.
+    void stop_waiting_for_response()
+    {
+        unregister_response_handler();
+        hasResponse_ = 1;
+        if (isSleeping_)
+        {
+            timer_.trigger();
+            isSleeping_ = 0;
+        }
+    }
+
+    /// @return the interface this client is sending on.
+    If *iface()
+    {
+        return static_cast<If *>(service());
+    }
+
+    /// @return the datagram being sent.
+    GenMessage *nmsg()
+    {
+        return message_->data();
+    }
+
+    /// The datagram being sent. Owned by this client while sending.
+    Buffer<GenMessage> *message_{nullptr};
+    /// Receives the datagram response messages.
+    ReplyListener listener_;
+    /// Wakes us up when the response arrives or the timeout expires.
+    StateFlowTimer timer_{this};
+    /// List of other datagram clients that are trying to send to the same
+    /// target node. We need to wake up one of this list when we are done
+    /// sending.
+    TypedQueue<Executable> waitingClients_;
+    /// 1 when we are in the sleep call waiting for the datagram Ack or Reject
+    /// message.
+    unsigned isSleeping_ : 1;
+    /// 1 when the datagram response has arrived.
+    unsigned hasResponse_ : 1;
+    /// 1 when we have exclusive lock on the specific src/dst node pair.
+    unsigned sendPending_ : 1;
+};
+
+TcpDatagramService::TcpDatagramService(
+    IfTcp *iface, int num_registry_entries, int num_clients)
+    : DatagramService(iface, num_registry_entries)
+{
+    for (int i = 0; i < num_clients; ++i)
+    {
+        auto *client_flow = new TcpDatagramClient(if_tcp());
+        if_tcp()->add_owned_flow(client_flow);
+        client_allocator()->insert(static_cast<DatagramClient *>(client_flow));
+    }
+}
+
+TcpDatagramService::~TcpDatagramService()
+{
+}
+
+} // namespace openlcb
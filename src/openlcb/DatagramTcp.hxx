@@ -0,0 +1,72 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file DatagramTcp.hxx
+ *
+ * Datagram service for the OpenLCB-TCP transport.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#ifndef _OPENLCB_DATAGRAMTCP_HXX_
+#define _OPENLCB_DATAGRAMTCP_HXX_
+
+#include "openlcb/Datagram.hxx"
+#include "openlcb/IfTcp.hxx"
+
+namespace openlcb
+{
+
+/// Implementation of the DatagramService for the TCP transport. Datagrams are
+/// sent as a single addressed message, so this service only needs the
+/// clients that wait for the datagram response; incoming datagrams arrive
+/// as regular messages through the interface's dispatcher.
+class TcpDatagramService : public DatagramService
+{
+public:
+    /// Constructor.
+    ///
+    /// @param iface is the TCP interface to bind to.
+    /// @param num_registry_entries is the size of the registry map (how
+    /// many datagram handlers can be registered)
+    /// @param num_clients is the number of datagram clients to create.
+    TcpDatagramService(IfTcp *iface, int num_registry_entries,
+                       int num_clients);
+
+    ~TcpDatagramService();
+
+    /// @return the interface this service is bound to.
+    IfTcp *if_tcp()
+    {
+        return static_cast<IfTcp *>(iface());
+    }
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_DATAGRAMTCP_HXX_
@@ -115,6 +115,25 @@ extern WriteHelper event_write_helper2;
 extern WriteHelper event_write_helper3;
 extern WriteHelper event_write_helper4;
 
+/// Collects the Producer / Consumer Identified messages that event handlers
+/// would send in response to an Identify Events message. See
+/// EventHandler::get_identify_responses.
+class EventIdentifySink
+{
+public:
+    virtual ~EventIdentifySink()
+    {
+    }
+
+    /// Adds one message to send.
+    ///
+    /// @param node is the virtual node the message is sent from.
+    /// @param mti is one of the Producer or Consumer Identified MTIs,
+    /// including the Identified Range MTIs.
+    /// @param event is the event ID (or the encoded range) to identify.
+    virtual void add_identified(Node *node, Defs::MTI mti, EventId event) = 0;
+};
+
 /// Abstract base class for all event handlers. Instances of this class can
 /// get registered with the event service to receive notifications of incoming
 /// event messages from the bus.
@@ -198,6 +217,22 @@ public:
                                       EventReport *event,
                                       BarrierNotifiable *done) = 0;
 
+    /// Synchronous alternative to handle_identify_global. Lists the messages
+    /// that handle_identify_global would send into a sink instead of sending
+    /// them, which allows the event service to merge and pace the responses
+    /// of all handlers. Handlers that cannot answer synchronously do not
+    /// override this. @param registry_entry gives the registry entry for
+    /// which the current handler is being called. @param event is as in
+    /// handle_identify_global. @param sink receives the messages. @return
+    /// false if the handler does not support this call; then
+    /// handle_identify_global will be called instead.
+    virtual bool get_identify_responses(
+        const EventRegistryEntry &registry_entry, EventReport *event,
+        EventIdentifySink *sink)
+    {
+        return false;
+    }
+
     /// Called on another node sending IdentifyConsumer. @param event stores
     /// information about the incoming message. Filled: src_node, event,
     /// mask=1. Not filled: state. @param registry_entry gives the registry
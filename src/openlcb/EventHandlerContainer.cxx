@@ -158,4 +158,316 @@ TreeEventHandlers::TreeEventHandlers()
 {
 }
 
+/// Smallest hash table we allocate (log2 of number of slots).
+static constexpr unsigned MIN_HASH_BITS = 4;
+
+HashedEventHandlers::HashedEventHandlers()
+    : exactCount_(0)
+    , hashShift_(64)
+    , rangeMasks_(0)
+{
+}
+
+void HashedEventHandlers::reserve(size_t count)
+{
+    AtomicHolder h(this);
+    unsigned bits = MIN_HASH_BITS;
+    // Keeps the load factor at or below 1/2.
+    while ((1ULL << bits) < count * 2)
+    {
+        ++bits;
+    }
+    if ((1ULL << bits) > exact_.size())
+    {
+        set_dirty();
+        rehash(bits);
+    }
+}
+
+void HashedEventHandlers::rehash(unsigned log2_size)
+{
+    std::vector<EventRegistryEntry> old(
+        1ULL << log2_size, EventRegistryEntry(nullptr, 0));
+    old.swap(exact_);
+    hashShift_ = 64 - log2_size;
+    exactCount_ = 0;
+    for (const auto &e : old)
+    {
+        if (e.handler)
+        {
+            insert_exact(e);
+        }
+    }
+}
+
+void HashedEventHandlers::insert_exact(const EventRegistryEntry &entry)
+{
+    size_t size_mask = exact_.size() - 1;
+    size_t slot = hash_slot(entry.event);
+    while (exact_[slot].handler)
+    {
+        slot = (slot + 1) & size_mask;
+    }
+    exact_[slot] = entry;
+    ++exactCount_;
+}
+
+void HashedEventHandlers::register_handler(
+    const EventRegistryEntry &entry, unsigned mask)
+{
+    AtomicHolder h(this);
+    LOG(VERBOSE, "%p: register %p", this, entry.handler);
+    set_dirty();
+    if (mask == 0)
+    {
+        if ((exactCount_ + 1) * 2 > exact_.size())
+        {
+            rehash(exact_.empty() ? MIN_HASH_BITS : 65 - hashShift_);
+        }
+        insert_exact(entry);
+        return;
+    }
+    HASSERT(mask <= 64);
+    RangeEntry r(entry, mask);
+    ranges_.insert(
+        std::upper_bound(ranges_.begin(), ranges_.end(), r, RangeCmp()), r);
+    rangeMasks_ |= 1ULL << (mask - 1);
+}
+
+void HashedEventHandlers::erase_exact(size_t slot)
+{
+    // Backward-shift deletion: moves later entries of the probe chain into
+    // the hole, unless that would put them before their home slot.
+    size_t size_mask = exact_.size() - 1;
+    size_t hole = slot;
+    size_t next = slot;
+    while (true)
+    {
+        next = (next + 1) & size_mask;
+        if (!exact_[next].handler)
+        {
+            break;
+        }
+        size_t home = hash_slot(exact_[next].event);
+        if (((next - home) & size_mask) >= ((next - hole) & size_mask))
+        {
+            exact_[hole] = exact_[next];
+            hole = next;
+        }
+    }
+    exact_[hole].handler = nullptr;
+    --exactCount_;
+}
+
+void HashedEventHandlers::unregister_handler(EventHandler *handler)
+{
+    AtomicHolder h(this);
+    set_dirty();
+    LOG(VERBOSE, "%p: unregister %p", this, handler);
+    bool found = false;
+    for (size_t i = 0; i < exact_.size(); ++i)
+    {
+        // An entry shifted into slot i has not been checked yet. Entries
+        // shifted across the end of the table come from slots we have
+        // already checked.
+        while (exact_[i].handler == handler)
+        {
+            erase_exact(i);
+            found = true;
+        }
+    }
+    if (found && exactCount_ * 8 < exact_.size() &&
+        exact_.size() > (1U << MIN_HASH_BITS))
+    {
+        // Halves the table, which leaves it less than a quarter full.
+        rehash(63 - hashShift_);
+    }
+    auto erase_it = std::remove_if(ranges_.begin(), ranges_.end(),
+        [handler](const RangeEntry &r) { return r.entry.handler == handler; });
+    if (erase_it != ranges_.end())
+    {
+        found = true;
+        ranges_.erase(erase_it, ranges_.end());
+        rangeMasks_ = 0;
+        for (const auto &r : ranges_)
+        {
+            rangeMasks_ |= 1ULL << (r.mask - 1);
+        }
+    }
+    if (found)
+    {
+        return;
+    }
+    DIE("tried to unregister a handler that was not registered");
+}
+
+/// Class representing the iteration state on the hash-based event handler
+/// registry. First produces the matching range registrations one mask at a
+/// time, then the matching exact registrations.
+class HashedEventHandlers::Iterator : public EventIterator
+{
+public:
+    Iterator(HashedEventHandlers *parent)
+        : parent_(parent)
+    {
+        clear_iteration();
+    }
+
+    EventRegistryEntry *next_entry() OVERRIDE
+    {
+        AtomicHolder h(parent_);
+        while (true)
+        {
+            switch (phase_)
+            {
+                case RANGES:
+                    if (rangeIt_ < rangeEnd_)
+                    {
+                        return &parent_->ranges_[rangeIt_++].entry;
+                    }
+                    if (!setup_next_mask())
+                    {
+                        setup_exact();
+                    }
+                    continue;
+                case EXACT_PROBE:
+                {
+                    const size_t size_mask = parent_->exact_.size() - 1;
+                    while (true)
+                    {
+                        EventRegistryEntry *e = &parent_->exact_[slot_];
+                        if (!e->handler)
+                        {
+                            break;
+                        }
+                        slot_ = (slot_ + 1) & size_mask;
+                        if (e->event == report_->event)
+                        {
+                            return e;
+                        }
+                    }
+                    phase_ = DONE;
+                    continue;
+                }
+                case EXACT_SCAN:
+                    while (slot_ < parent_->exact_.size())
+                    {
+                        EventRegistryEntry *e = &parent_->exact_[slot_++];
+                        if (e->handler && e->event >= report_->event &&
+                            e->event <= report_->event + report_->mask)
+                        {
+                            return e;
+                        }
+                    }
+                    phase_ = DONE;
+                    continue;
+                case DONE:
+                default:
+                    return nullptr;
+            }
+        }
+    }
+
+    void clear_iteration() OVERRIDE
+    {
+        phase_ = DONE;
+    }
+
+    void init_iteration(EventReport *r) OVERRIDE
+    {
+        AtomicHolder h(parent_);
+        report_ = r;
+        phase_ = RANGES;
+        currentMask_ = 0;
+        rangeIt_ = rangeEnd_ = 0;
+        if (!setup_next_mask())
+        {
+            setup_exact();
+        }
+    }
+
+private:
+    /// Advances to the next range mask that has registrations, and computes
+    /// the range of matching entries. @return false if there are no more
+    /// masks.
+    bool setup_next_mask()
+    {
+        uint64_t remaining = currentMask_ >= 64
+            ? 0
+            : parent_->rangeMasks_ & ~((1ULL << currentMask_) - 1);
+        if (!remaining)
+        {
+            return false;
+        }
+        currentMask_ = __builtin_ctzll(remaining) + 1;
+        EventId lo = 0;
+        if (currentMask_ < 64)
+        {
+            lo = report_->event & ~((1ULL << currentMask_) - 1);
+        }
+        EventId hi = report_->event + report_->mask;
+        auto &ranges = parent_->ranges_;
+        RangeCmp cmp;
+        rangeIt_ = std::lower_bound(ranges.begin(), ranges.end(),
+                       RangeEntry(EventRegistryEntry(nullptr, lo),
+                           currentMask_),
+                       cmp) -
+            ranges.begin();
+        rangeEnd_ = std::upper_bound(ranges.begin() + rangeIt_, ranges.end(),
+                        RangeEntry(EventRegistryEntry(nullptr, hi),
+                            currentMask_),
+                        cmp) -
+            ranges.begin();
+        return true;
+    }
+
+    /// Switches to producing the exact registrations.
+    void setup_exact()
+    {
+        if (parent_->exact_.empty())
+        {
+            phase_ = DONE;
+        }
+        else if (report_->mask == 0)
+        {
+            phase_ = EXACT_PROBE;
+            slot_ = parent_->hash_slot(report_->event);
+        }
+        else
+        {
+            phase_ = EXACT_SCAN;
+            slot_ = 0;
+        }
+    }
+
+    /// Iteration states.
+    enum Phase
+    {
+        RANGES,
+        EXACT_PROBE,
+        EXACT_SCAN,
+        DONE
+    };
+
+    /// Registry we are iterating.
+    HashedEventHandlers *parent_;
+    /// Event being looked up.
+    EventReport *report_;
+    /// Current iteration state.
+    Phase phase_;
+    /// Range mask currently being iterated (1..64).
+    unsigned currentMask_;
+    /// Next index in parent_->ranges_ to return.
+    size_t rangeIt_;
+    /// End index in parent_->ranges_ for the current mask.
+    size_t rangeEnd_;
+    /// Next slot in parent_->exact_ to look at.
+    size_t slot_;
+};
+
+EventIterator *HashedEventHandlers::create_iterator()
+{
+    return new Iterator(this);
+}
+
 } // namespace openlcb
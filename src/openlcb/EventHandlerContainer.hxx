@@ -189,6 +189,90 @@ private:
     MaskLookupMap handlers_;
 };
 
+/// EventRegistry implementation for nodes with a large number of registered
+/// events. Exact (mask == 0) registrations are kept in an open-addressed hash
+/// table keyed by the event ID; range registrations are kept in a sorted
+/// vector ordered by (mask, event). An incoming event is looked up with one
+/// hash probe plus one binary search for each distinct range mask in use.
+///
+/// The hash table grows by doubling, so there is no heap allocation per
+/// registration beyond the amortized resizing. Use reserve() to avoid that
+/// as well.
+class HashedEventHandlers : public EventRegistry, private Atomic
+{
+public:
+    HashedEventHandlers();
+
+    EventIterator *create_iterator() OVERRIDE;
+    void register_handler(
+        const EventRegistryEntry &entry, unsigned mask) OVERRIDE;
+    void unregister_handler(EventHandler *handler) OVERRIDE;
+
+    /// Pre-allocates space for exact registrations.
+    /// @param count how many exact registrations to make room for.
+    void reserve(size_t count);
+
+private:
+    class Iterator;
+    friend class Iterator;
+
+    /// Registration of an event range.
+    struct RangeEntry
+    {
+        /// @param e registry entry @param m mask (number of low bits)
+        RangeEntry(const EventRegistryEntry &e, unsigned m)
+            : entry(e)
+            , mask(m)
+        {
+        }
+        /// What was registered.
+        EventRegistryEntry entry;
+        /// Number of low bits of the event ID covered by the range (1..64).
+        unsigned mask;
+    };
+
+    /// Orders RangeEntry by mask, then event ID.
+    struct RangeCmp
+    {
+        bool operator()(const RangeEntry &a, const RangeEntry &b)
+        {
+            return a.mask < b.mask ||
+                (a.mask == b.mask && a.entry.event < b.entry.event);
+        }
+    };
+
+    /// @param event event ID @return the home slot of event in exact_.
+    size_t hash_slot(EventId event)
+    {
+        return (event * 0x9E3779B97F4A7C15ULL) >> hashShift_;
+    }
+
+    /// Adds an entry to the hash table. Does not check load factor.
+    /// @param entry what to add.
+    void insert_exact(const EventRegistryEntry &entry);
+
+    /// Removes an entry from the hash table, keeping the probe chains of the
+    /// other entries intact. Does not check load factor.
+    /// @param slot index of the entry in exact_.
+    void erase_exact(size_t slot);
+
+    /// Re-creates the hash table with a given size.
+    /// @param log2_size log2 of the new number of slots.
+    void rehash(unsigned log2_size);
+
+    /// Open-addressed hash table with linear probing for mask == 0
+    /// registrations. Unused slots have handler == nullptr.
+    std::vector<EventRegistryEntry> exact_;
+    /// Number of used slots in exact_.
+    size_t exactCount_;
+    /// 64 - log2(exact_.size()).
+    unsigned hashShift_;
+    /// Registrations with mask != 0, sorted by RangeCmp.
+    std::vector<RangeEntry> ranges_;
+    /// Bit (m-1) is set if there is an entry in ranges_ with mask m.
+    uint64_t rangeMasks_;
+};
+
 }; /* namespace openlcb */
 
 #endif  // _OPENLCB_EVENTHANDLERCONTAINER_HXX_
@@ -581,6 +581,26 @@ void BitEventHandler::SendConsumerIdentified(BarrierNotifiable *done)
                                    done->new_child());
 }
 
+void BitEventHandler::AddProducerIdentified(EventIdentifySink *sink)
+{
+    EventState state = bit_->get_current_state();
+    sink->add_identified(bit_->node(),
+        Defs::MTI_PRODUCER_IDENTIFIED_VALID + state, bit_->event_on());
+    sink->add_identified(bit_->node(),
+        Defs::MTI_PRODUCER_IDENTIFIED_VALID + invert_event_state(state),
+        bit_->event_off());
+}
+
+void BitEventHandler::AddConsumerIdentified(EventIdentifySink *sink)
+{
+    EventState state = bit_->get_current_state();
+    sink->add_identified(bit_->node(),
+        Defs::MTI_CONSUMER_IDENTIFIED_VALID + state, bit_->event_on());
+    sink->add_identified(bit_->node(),
+        Defs::MTI_CONSUMER_IDENTIFIED_VALID + invert_event_state(state),
+        bit_->event_off());
+}
+
 void BitEventHandler::SendEventReport(WriteHelper *writer, Notifiable *done)
 {
     EventState value = bit_->get_requested_state();
@@ -697,6 +717,16 @@ void BitEventProducer::handle_identify_global(const EventRegistryEntry& entry, E
     done->maybe_done();
 }
 
+bool BitEventProducer::get_identify_responses(const EventRegistryEntry &entry,
+    EventReport *event, EventIdentifySink *sink)
+{
+    if (!event->dst_node || event->dst_node == bit_->node())
+    {
+        AddProducerIdentified(sink);
+    }
+    return true;
+}
+
 void BitEventProducer::handle_identify_producer(const EventRegistryEntry& entry, EventReport *event,
                                               BarrierNotifiable *done)
 {
@@ -726,6 +756,16 @@ void BitEventConsumer::handle_identify_global(const EventRegistryEntry& entry, E
     done->maybe_done();
 }
 
+bool BitEventConsumer::get_identify_responses(const EventRegistryEntry &entry,
+    EventReport *event, EventIdentifySink *sink)
+{
+    if (!event->dst_node || event->dst_node == bit_->node())
+    {
+        AddConsumerIdentified(sink);
+    }
+    return true;
+}
+
 void BitEventPC::SendQueryConsumer(WriteHelper *writer, BarrierNotifiable *done)
 {
     writer->WriteAsync(bit_->node(), Defs::MTI_CONSUMER_IDENTIFY,
@@ -745,6 +785,17 @@ void BitEventPC::handle_identify_global(const EventRegistryEntry& entry, EventRe
     done->maybe_done();
 }
 
+bool BitEventPC::get_identify_responses(const EventRegistryEntry &entry,
+    EventReport *event, EventIdentifySink *sink)
+{
+    if (!event->dst_node || event->dst_node == bit_->node())
+    {
+        AddProducerIdentified(sink);
+        AddConsumerIdentified(sink);
+    }
+    return true;
+}
+
 void BitEventPC::handle_consumer_identified(const EventRegistryEntry& entry, EventReport *event,
                                                 BarrierNotifiable *done)
 {
@@ -156,6 +156,17 @@ public:
             WriteHelper::global(), openlcb::eventid_to_buffer(EVENT_ID), done);
     }
 
+    bool get_identify_responses(const EventRegistryEntry &registry_entry,
+        EventReport *event, EventIdentifySink *sink) override
+    {
+        if (!event->dst_node || event->dst_node == node_)
+        {
+            sink->add_identified(
+                node_, Defs::MTI_PRODUCER_IDENTIFIED_UNKNOWN, EVENT_ID);
+        }
+        return true;
+    }
+
     void handle_identify_producer(const EventRegistryEntry &registry_entry, EventReport *event, BarrierNotifiable *done)
         OVERRIDE
     {
@@ -514,6 +525,14 @@ protected:
     /// the barrier. The caller should always use new_child.
     void SendConsumerIdentified(BarrierNotifiable *done);
 
+    /// Adds the two ProducerIdentified messages of SendProducerIdentified to
+    /// an identify response sink.
+    void AddProducerIdentified(EventIdentifySink *sink);
+
+    /// Adds the two ConsumerIdentified messages of SendConsumerIdentified to
+    /// an identify response sink.
+    void AddConsumerIdentified(EventIdentifySink *sink);
+
     /// Checks if the event in the report is something we are interested in, and
     /// if so, sends off a {Producer|Consumer}Identified{Valid|Invalid} message
     /// depending on the current state of the hardware bit. Uses
@@ -588,6 +607,8 @@ public:
     void handle_identify_global(const EventRegistryEntry &entry,
                               EventReport *event,
                               BarrierNotifiable *done) override;
+    bool get_identify_responses(const EventRegistryEntry &entry,
+        EventReport *event, EventIdentifySink *sink) override;
     void handle_identify_producer(const EventRegistryEntry &entry,
                                 EventReport *event,
                                 BarrierNotifiable *done) override;
@@ -628,6 +649,8 @@ public:
     void handle_identify_global(const EventRegistryEntry &entry,
                               EventReport *event,
                               BarrierNotifiable *done) override;
+    bool get_identify_responses(const EventRegistryEntry &entry,
+        EventReport *event, EventIdentifySink *sink) override;
     void handle_identify_consumer(const EventRegistryEntry &entry,
                                 EventReport *event,
                                 BarrierNotifiable *done) override;
@@ -671,6 +694,8 @@ public:
     void handle_identify_global(const EventRegistryEntry &entry,
                               EventReport *event,
                               BarrierNotifiable *done) override;
+    bool get_identify_responses(const EventRegistryEntry &entry,
+        EventReport *event, EventIdentifySink *sink) override;
     void handle_consumer_identified(const EventRegistryEntry &entry,
                                   EventReport *event,
                                   BarrierNotifiable *done) override;
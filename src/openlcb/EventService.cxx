@@ -13,6 +13,7 @@
 #include "openlcb/EventHandlerContainer.hxx"
 #include "openlcb/Defs.hxx"
 #include "openlcb/EndianHelper.hxx"
+#include "nmranet_config.h"
 
 namespace openlcb
 {
@@ -47,20 +48,38 @@ void EventService::register_interface(If *iface)
     impl()->ownedFlows_.emplace_back(new InlineEventIteratorFlow(
         iface, this, EventService::Impl::MTI_VALUE_EVENT,
         EventService::Impl::MTI_MASK_EVENT));
-    impl()->ownedFlows_.emplace_back(new EventIteratorFlow(
-        iface, this, EventService::Impl::MTI_VALUE_GLOBAL,
-        EventService::Impl::MTI_MASK_GLOBAL));
-    impl()->ownedFlows_.emplace_back(new EventIteratorFlow(
-        iface, this, EventService::Impl::MTI_VALUE_ADDRESSED_ALL,
-        EventService::Impl::MTI_MASK_ADDRESSED_ALL));
+    impl()->ownedFlows_.emplace_back(
+        new IdentifyEventIteratorFlow(iface, this));
 }
 
-EventService::Impl::Impl(EventService *service) : callerFlow_(service)
+void EventService::set_identify_coalescing(bool enabled)
+{
+    impl()->identifyCoalesce_ = enabled;
+}
+
+void EventService::set_identify_rate(unsigned msgs_per_sec, unsigned burst)
+{
+    impl()->identifyRate_ = msgs_per_sec;
+    impl()->identifyBurst_ = burst;
+}
+
+EventService::Impl::Impl(EventService *service)
+    : callerFlow_(service)
+    , identifyCoalesce_(config_event_identify_coalesce() == CONSTANT_TRUE)
+    , identifyRate_(config_event_identify_rate())
+    , identifyBurst_(config_event_identify_burst())
 {
 #ifdef TARGET_LPC11Cxx
     registry.reset(new VectorEventHandlers());
 #else
-    registry.reset(new TreeEventHandlers());
+    if (config_event_registry_use_hash() == CONSTANT_TRUE)
+    {
+        registry.reset(new HashedEventHandlers());
+    }
+    else
+    {
+        registry.reset(new TreeEventHandlers());
+    }
 #endif
 }
 
@@ -257,30 +276,35 @@ StateFlowBase::Action EventIteratorFlow::iterate_next()
     if (!entry)
     {
         no_more_matches();
-        if (incomingDone_)
-        {
-            incomingDone_->notify();
-            incomingDone_ = nullptr;
-        }
+        return iteration_done();
+    }
+    return dispatch_event(entry);
+}
+
+StateFlowBase::Action EventIteratorFlow::iteration_done()
+{
+    if (incomingDone_)
+    {
+        incomingDone_->notify();
+        incomingDone_ = nullptr;
+    }
 
 #ifdef DEBUG_EVENT_PERFORMANCE
-        long long len = os_get_time_monotonic() - currentProcessStart_;
-        numProcessNsec_ += len;
-        countEvents_++;
-        if (countEvents_ >= REPORT_COUNT)
-        {
-            //long msec = numProcessNsec_ / 1000000;
-            //printf("event perf for mti %04x: %ld msec for %d events\n",
-            //       mtiValue_, msec, REPORT_COUNT);
-            countEvents_ = 0;
-            numProcessNsec_ = 0;
-        }
+    long long len = os_get_time_monotonic() - currentProcessStart_;
+    numProcessNsec_ += len;
+    countEvents_++;
+    if (countEvents_ >= REPORT_COUNT)
+    {
+        //long msec = numProcessNsec_ / 1000000;
+        //printf("event perf for mti %04x: %ld msec for %d events\n",
+        //       mtiValue_, msec, REPORT_COUNT);
+        countEvents_ = 0;
+        numProcessNsec_ = 0;
+    }
 
 #endif
 
-        return exit();
-    }
-    return dispatch_event(entry);
+    return exit();
 }
 
 StateFlowBase::Action EventIteratorFlow::dispatch_event(const EventRegistryEntry *entry)
@@ -344,4 +368,171 @@ StateFlowBase::Action InlineEventIteratorFlow::perform_call()
     }
 }
 
+IdentifyEventIteratorFlow::IdentifyEventIteratorFlow(
+    If *iface, EventService *event_service)
+    : EventIteratorFlow(iface, event_service,
+          EventService::Impl::MTI_VALUE_GLOBAL,
+          EventService::Impl::MTI_MASK_GLOBAL)
+{
+    iface->dispatcher()->register_handler(this,
+        EventService::Impl::MTI_VALUE_ADDRESSED_ALL,
+        EventService::Impl::MTI_MASK_ADDRESSED_ALL);
+}
+
+StateFlowBase::Action
+IdentifyEventIteratorFlow::dispatch_event(const EventRegistryEntry *entry)
+{
+    if (eventService_->impl()->identifyCoalesce_ &&
+        entry->handler->get_identify_responses(*entry, &eventReport_, this))
+    {
+        return yield_and_call(STATE(iterate_next));
+    }
+    return EventIteratorFlow::dispatch_event(entry);
+}
+
+void IdentifyEventIteratorFlow::add_identified(
+    Node *node, Defs::MTI mti, EventId event)
+{
+    responses_.push_back({node, mti, event});
+}
+
+/// @return the range identifier for an aligned block of events.
+/// @param begin first event of the block, must be aligned to size.
+/// @param size number of events in the block, a power of two >= 2.
+static EventId encode_aligned_range(EventId begin, uint64_t size)
+{
+    if (begin & size)
+    {
+        // The bit above the range is one: the range is encoded with trailing
+        // zeros.
+        return begin;
+    }
+    return begin | (size - 1);
+}
+
+void IdentifyEventIteratorFlow::compress_responses()
+{
+    std::sort(responses_.begin(), responses_.end(),
+        [](const Identified &a, const Identified &b) {
+            if (a.node != b.node)
+            {
+                return a.node->node_id() < b.node->node_id();
+            }
+            if (a.mti != b.mti)
+            {
+                return a.mti < b.mti;
+            }
+            return a.event < b.event;
+        });
+    auto same = [](const Identified &a, const Identified &b) {
+        return a.node == b.node && a.mti == b.mti && a.event == b.event;
+    };
+    responses_.erase(
+        std::unique(responses_.begin(), responses_.end(), same),
+        responses_.end());
+
+    // Only the unknown state is expressible with a range identified message.
+    unsigned dst = 0;
+    for (unsigned i = 0; i < responses_.size();)
+    {
+        Identified r = responses_[i];
+        Defs::MTI range_mti;
+        if (r.mti == Defs::MTI_PRODUCER_IDENTIFIED_UNKNOWN)
+        {
+            range_mti = Defs::MTI_PRODUCER_IDENTIFIED_RANGE;
+        }
+        else if (r.mti == Defs::MTI_CONSUMER_IDENTIFIED_UNKNOWN)
+        {
+            range_mti = Defs::MTI_CONSUMER_IDENTIFIED_RANGE;
+        }
+        else
+        {
+            responses_[dst++] = r;
+            ++i;
+            continue;
+        }
+        // Finds the run of consecutive events.
+        unsigned end = i + 1;
+        while (end < responses_.size() && responses_[end].node == r.node &&
+            responses_[end].mti == r.mti &&
+            responses_[end].event == r.event + (end - i))
+        {
+            ++end;
+        }
+        // Splits the run into aligned power-of-two blocks.
+        while (i < end)
+        {
+            EventId begin = responses_[i].event;
+            uint64_t size = 1;
+            while ((begin & (size * 2 - 1)) == 0 && size * 2 <= end - i)
+            {
+                size *= 2;
+            }
+            if (size == 1)
+            {
+                responses_[dst++] = responses_[i];
+            }
+            else
+            {
+                responses_[dst++] = {
+                    r.node, range_mti, encode_aligned_range(begin, size)};
+            }
+            i += size;
+        }
+    }
+    responses_.resize(dst);
+}
+
+StateFlowBase::Action IdentifyEventIteratorFlow::iteration_done()
+{
+    if (responses_.empty())
+    {
+        return EventIteratorFlow::iteration_done();
+    }
+    compress_responses();
+    nextResponse_ = 0;
+    return call_immediately(STATE(send_next));
+}
+
+StateFlowBase::Action IdentifyEventIteratorFlow::send_next()
+{
+    if (nextResponse_ >= responses_.size())
+    {
+        responses_.clear();
+        return EventIteratorFlow::iteration_done();
+    }
+    unsigned rate = eventService_->impl()->identifyRate_;
+    if (rate)
+    {
+        long long cost = SEC_TO_NSEC(1) / rate;
+        long long max_credit = cost * eventService_->impl()->identifyBurst_;
+        long long now = os_get_time_monotonic();
+        bucketNsec_ = std::min(bucketNsec_ + (now - bucketTime_), max_credit);
+        bucketTime_ = now;
+        if (bucketNsec_ < cost)
+        {
+            return sleep_and_call(
+                &timer_, cost - bucketNsec_, STATE(send_next));
+        }
+        bucketNsec_ -= cost;
+    }
+    if (!responses_[nextResponse_].node->is_initialized())
+    {
+        ++nextResponse_;
+        return call_immediately(STATE(send_next));
+    }
+    return allocate_and_call(
+        iface()->global_message_write_flow(), STATE(fill_message));
+}
+
+StateFlowBase::Action IdentifyEventIteratorFlow::fill_message()
+{
+    auto *b = get_allocation_result(iface()->global_message_write_flow());
+    const Identified &r = responses_[nextResponse_++];
+    b->data()->reset(r.mti, r.node->node_id(), eventid_to_buffer(r.event));
+    b->set_done(n_.reset(this));
+    iface()->global_message_write_flow()->send(b, b->data()->priority());
+    return wait_and_call(STATE(send_next));
+}
+
 } /* namespace openlcb */
@@ -88,6 +88,18 @@ public:
      * handled. */
     bool event_processing_pending();
 
+    /** Enables or disables collecting the responses to Identify Events
+     * messages from the event handlers that support it, and sending them as
+     * merged range identified messages. Defaults to
+     * config_event_identify_coalesce(). */
+    void set_identify_coalescing(bool enabled);
+
+    /** Sets the token bucket that paces the collected Identify Events
+     * responses on each interface.
+     * @param msgs_per_sec steady-state rate; 0 means unlimited.
+     * @param burst how many messages may go out back-to-back. */
+    void set_identify_rate(unsigned msgs_per_sec, unsigned burst);
+
     static EventService *instance;
 
 private:
@@ -108,6 +108,15 @@ public:
     /// calls need to be sent to this flow.
     EventCallerFlow callerFlow_;
 
+    /// True if the identify flows should collect the responses of the event
+    /// handlers and send them merged.
+    bool identifyCoalesce_;
+    /// Rate limit of the collected identify responses, messages per second,
+    /// or 0 for unlimited.
+    unsigned identifyRate_;
+    /// Number of identify responses that can be sent without waiting.
+    unsigned identifyBurst_;
+
     enum
     {
         // These address/mask should match all the messages carrying an event
@@ -136,8 +145,12 @@ protected:
     Action entry() OVERRIDE;
     Action iterate_next();
 
-private:
     virtual Action dispatch_event(const EventRegistryEntry *entry);
+    /// Called when the iteration is complete. Releases the incoming message
+    /// and terminates the flow.
+    virtual Action iteration_done();
+
+private:
     /// Called when there will be no more dispatch_event calls for this
     /// iteration.
     virtual void no_more_matches() {};
@@ -199,6 +212,49 @@ private:
     const EventRegistryEntry *currentEntry_{nullptr};
 };
 
+/** Flow to handle the Identify Events (global and addressed) messages. When
+ * coalescing is enabled, the event handlers are asked for their responses
+ * instead of sending them. The collected responses are sorted, duplicates
+ * removed, consecutive events in unknown state are merged into range
+ * identified messages, and the result is sent out paced by a token
+ * bucket. Handlers that do not support collection are called as usual. */
+class IdentifyEventIteratorFlow : public EventIteratorFlow,
+                                  private EventIdentifySink
+{
+public:
+    IdentifyEventIteratorFlow(If *iface, EventService *event_service);
+
+private:
+    /// One collected identified message.
+    struct Identified
+    {
+        Node *node;
+        Defs::MTI mti;
+        EventId event;
+    };
+
+    Action dispatch_event(const EventRegistryEntry *entry) OVERRIDE;
+    Action iteration_done() OVERRIDE;
+    void add_identified(Node *node, Defs::MTI mti, EventId event) OVERRIDE;
+
+    /// Sorts and merges the collected responses in responses_.
+    void compress_responses();
+    /// Sends the next entry from responses_.
+    Action send_next();
+    Action fill_message();
+    Action send_done();
+
+    /// Responses collected in the current iteration.
+    std::vector<Identified> responses_;
+    /// Index of the next entry in responses_ to send.
+    unsigned nextResponse_{0};
+    /// Token bucket content, in nanoseconds of sending credit.
+    long long bucketNsec_{0};
+    /// When bucketNsec_ was last updated.
+    long long bucketTime_{0};
+    StateFlowTimer timer_{this};
+};
+
 } // namespace openlcb
 
 #endif // _OPENLCB_EVENTSERVICEIMPL_HXX_
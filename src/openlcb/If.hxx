@@ -254,7 +254,7 @@ typedef FlowInterface<Buffer<GenMessage>> MessageHandler;
 /// the local software stack and the physical bus has to go through this
 /// class. The API that's not specific to the wire protocol appears here. The
 /// implementations of this class would be specific to the wire protocol
-/// (e.g. IfCan for CAN, and a not-yet-implemented class for TCP).
+/// (e.g. IfCan for CAN, and IfTcp for TCP).
 class If : public Service
 {
 public:
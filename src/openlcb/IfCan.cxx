@@ -655,6 +655,87 @@ private:
     StlMap<uint32_t, Payload> pendingBuffers_;
 };
 
+/** This class listens for incoming stream data frames destined for local
+ * nodes, and translates each frame into an MTI_STREAM_DATA message. The
+ * payload of the generated message starts with the destination stream ID
+ * followed by the data bytes, which is the same layout the CAN write flow
+ * expects when rendering stream data messages to frames. */
+class FrameToStreamDataParser : public CanFrameStateFlow
+{
+public:
+    enum
+    {
+        CAN_FILTER = CanMessageData::CAN_EXT_FRAME_FILTER |
+            (CanDefs::STREAM_DATA << CanDefs::CAN_FRAME_TYPE_SHIFT) |
+            (CanDefs::NMRANET_MSG << CanDefs::FRAME_TYPE_SHIFT) |
+            (CanDefs::NORMAL_PRIORITY << CanDefs::PRIORITY_SHIFT),
+        CAN_MASK = CanMessageData::CAN_EXT_FRAME_MASK |
+            CanDefs::CAN_FRAME_TYPE_MASK | CanDefs::FRAME_TYPE_MASK |
+            CanDefs::PRIORITY_MASK
+    };
+
+    FrameToStreamDataParser(IfCan *service)
+        : CanFrameStateFlow(service)
+    {
+        if_can()->frame_dispatcher()->register_handler(
+            this, CAN_FILTER, CAN_MASK);
+    }
+
+    ~FrameToStreamDataParser()
+    {
+        if_can()->frame_dispatcher()->unregister_handler(
+            this, CAN_FILTER, CAN_MASK);
+    }
+
+    /// Handler entry for incoming messages.
+    Action entry() override
+    {
+        struct can_frame *f = message()->data();
+        id_ = GET_CAN_FRAME_ID_EFF(*f);
+        if (f->can_dlc < 1)
+        {
+            // Missing destination stream ID.
+            return release_and_exit();
+        }
+        dstHandle_.alias = CanDefs::get_dst(id_);
+        dstHandle_.id = if_can()->local_aliases()->lookup(dstHandle_.alias);
+        if (!dstHandle_.id)
+        {
+            // Not destined for us.
+            return release_and_exit();
+        }
+        buf_.assign((const char *)f->data, f->can_dlc);
+        release();
+        return allocate_and_call(if_can()->dispatcher(), STATE(send_to_if));
+    }
+
+    Action send_to_if()
+    {
+        auto *b = get_allocation_result(if_can()->dispatcher());
+        GenMessage *m = b->data();
+        m->mti = Defs::MTI_STREAM_DATA;
+        m->payload.swap(buf_);
+        m->dst = dstHandle_;
+        m->dstNode = if_can()->lookup_local_node(dstHandle_.id);
+        m->src.alias = CanDefs::get_src(id_);
+        m->src.id = if_can()->remote_aliases()->lookup(m->src.alias);
+        if (!m->src.id)
+        {
+            m->src.id = if_can()->local_aliases()->lookup(m->src.alias);
+        }
+        if_can()->dispatcher()->send(b, b->data()->priority());
+        return exit();
+    }
+
+private:
+    /// CAN frame ID, saved from the incoming frame.
+    uint32_t id_;
+    /// Payload for the MTI message (destination stream ID and data).
+    string buf_;
+    /// Local node the frame was addressed to.
+    NodeHandle dstHandle_;
+};
+
 IfCan::IfCan(ExecutorBase *executor, CanHubFlow *device,
     int local_alias_cache_size, int remote_alias_cache_size,
     int local_nodes_count)
@@ -707,6 +788,7 @@ void IfCan::add_addressed_message_support()
     if (addressedWriteFlow_)
         return;
     add_owned_flow(new FrameToAddressedMessageParser(this));
+    add_owned_flow(new FrameToStreamDataParser(this));
     auto *f = new AddressedCanMessageWriteFlow(this);
     addressedWriteFlow_ = f;
     add_owned_flow(f);
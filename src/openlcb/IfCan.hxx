@@ -93,14 +93,14 @@ public:
     void add_addressed_message_support();
 
     /// @returns the alias cache for local nodes (vnodes and proxies)
-    AliasCache *local_aliases()
+    HashedAliasCache *local_aliases()
     {
         executor()->assert_current();
         return &localAliases_;
     }
 
     /// @returns the alias cache for remote nodes on this IF
-    AliasCache *remote_aliases()
+    HashedAliasCache *remote_aliases()
     {
         executor()->assert_current();
         return &remoteAliases_;
@@ -130,12 +130,12 @@ private:
      *
      *  This member must only be accessed from the If's executor.
      */
-    AliasCache localAliases_;
+    HashedAliasCache localAliases_;
     /** Aliases we know are owned by remote nodes on this If.
      *
      *  This member must only be accessed from the If's executor.
      */
-    AliasCache remoteAliases_;
+    HashedAliasCache remoteAliases_;
 
     /// Various implementation control flows that this interface owns.
     std::vector<std::unique_ptr<Executable>> ownedFlows_;
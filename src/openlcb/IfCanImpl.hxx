@@ -62,24 +62,30 @@ public:
 protected:
     unsigned srcAlias_ : 12;  ///< Source node alias.
     unsigned dstAlias_ : 12;  ///< Destination node alias.
-    unsigned dataOffset_ : 8; /**< for continuation frames: which offset in
-                                * the Buffer should we start the payload at. */
+    unsigned dataOffset_ : 16; /**< for continuation frames: which offset in
+                                 * the Buffer should we start the payload at. */
 
     Action send_to_hardware() override
     {
         dataOffset_ = 0;
         srcAlias_ = 0;
         dstAlias_ = 0;
-        if (nmsg()->payload.size())
-        {
-            // We have limited space for counting offsets. In practice this
-            // value will be max 10 for certain traction control protocol
-            // messages. Longer data usually travels via datagrams or streams.
-            HASSERT(nmsg()->payload.size() < 256);
-        }
+        check_payload_size();
         return call_immediately(STATE(find_local_alias));
     }
 
+    /** Verifies that the payload fits the offset counter. */
+    void check_payload_size()
+    {
+        // We have limited space for counting offsets. In practice this value
+        // will be max 10 for certain traction control protocol messages, or a
+        // stream window for stream data messages. Longer data usually travels
+        // via datagrams.
+        HASSERT(nmsg()->payload.size() < 256 ||
+            (nmsg()->mti == Defs::MTI_STREAM_DATA &&
+                nmsg()->payload.size() < 65536));
+    }
+
     /** Performs the local alias lookup and branches depending on whether we
      * found a local alias or not. */
     Action find_local_alias()
@@ -185,6 +191,10 @@ private:
         auto *b = get_allocation_result(if_can()->frame_write_flow());
         b->set_done(message()->new_child());
         struct can_frame *f = b->data()->mutable_frame();
+        if (nmsg()->mti == Defs::MTI_STREAM_DATA)
+        {
+            return fill_stream_data_frame(b, f);
+        }
         if (nmsg()->mti & (Defs::MTI_DATAGRAM_MASK | Defs::MTI_SPECIAL_MASK |
                            Defs::MTI_RESERVED_MASK))
         {
@@ -253,6 +263,42 @@ private:
             return call_immediately(STATE(send_finished));
         }
     }
+
+    /** Renders the next frame of a stream data message. The first payload
+     * byte is the destination stream ID, which is repeated in every frame;
+     * the rest of the payload is split into 7-byte chunks. */
+    Action fill_stream_data_frame(Buffer<CanHubData> *b, struct can_frame *f)
+    {
+        const string &data = nmsg()->payload;
+        if (data.empty())
+        {
+            b->unref();
+            return call_immediately(STATE(send_finished));
+        }
+        uint32_t can_id;
+        CanDefs::set_datagram_fields(
+            &can_id, srcAlias_, dstAlias_, CanDefs::STREAM_DATA);
+        SET_CAN_FRAME_ID_EFF(*f, can_id);
+        if (!dataOffset_)
+        {
+            dataOffset_ = 1;
+        }
+        f->data[0] = data[0];
+        unsigned len = data.size() - dataOffset_;
+        if (len > 7)
+        {
+            len = 7;
+        }
+        memcpy(f->data + 1, data.data() + dataOffset_, len);
+        dataOffset_ += len;
+        f->can_dlc = 1 + len;
+        if_can()->frame_write_flow()->send(b);
+        if (dataOffset_ < data.size())
+        {
+            return call_immediately(STATE(get_can_frame_buffer));
+        }
+        return call_immediately(STATE(send_finished));
+    }
 };
 
 /** The addressed write flow is responsible for sending addressed messages to
@@ -281,13 +327,7 @@ protected:
         dataOffset_ = 0;
         srcAlias_ = 0;
         dstAlias_ = 0;
-        if (nmsg()->payload.size())
-        {
-            // We have limited space for counting offsets. In practice this
-            // value will be max 10 for certain traction control protocol
-            // messages. Longer data usually travels via datagrams or streams.
-            HASSERT(nmsg()->payload.size() < 256);
-        }
+        check_payload_size();
         NodeHandle &dst_ = nmsg()->dst;
         HASSERT(dst_.id || dst_.alias); // We must have some kind of address.
         if (dst_.id)
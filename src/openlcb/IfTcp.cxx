@@ -0,0 +1,386 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file IfTcp.cxx
+ *
+ * Implementation of the OpenLCB interface for the TCP transport.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#include "openlcb/IfTcp.hxx"
+
+#include <sys/socket.h>
+
+#include "openlcb/IfImpl.hxx"
+#include "utils/HubDeviceSelect.hxx"
+
+namespace openlcb
+{
+
+/// Renders outgoing messages into the TCP format and sends them to the
+/// device. Global messages are looped back to the local dispatcher after
+/// sending; addressed messages to local nodes do not reach the device.
+class TcpSendFlow : public WriteFlowBase
+{
+public:
+    /// Constructor.
+    ///
+    /// @param iface is the interface to send on.
+    /// @param addressed true for the addressed write flow, false for the
+    /// global write flow.
+    TcpSendFlow(IfTcp *iface, bool addressed)
+        : WriteFlowBase(iface)
+        , addressed_(addressed)
+    {
+    }
+
+private:
+    Action entry() override
+    {
+        if (addressed_)
+        {
+            return addressed_entry();
+        }
+        return send_to_hardware();
+    }
+
+    Action send_to_hardware() override
+    {
+        if (addressed_ && !nmsg()->dst.id)
+        {
+            LOG(WARNING,
+                "IfTcp: dropping addressed message mti %04x to alias %03x "
+                "with unknown node ID.",
+                (unsigned)nmsg()->mti, (unsigned)nmsg()->dst.alias);
+            return release_and_exit();
+        }
+        return allocate_and_call(if_tcp()->device(), STATE(render));
+    }
+
+    /// Renders the message into the freshly allocated hub buffer and sends
+    /// it off.
+    Action render()
+    {
+        auto *b = get_allocation_result(if_tcp()->device());
+        TcpDefs::render_tcp_message(*nmsg(), if_tcp()->gateway_node_id(),
+            os_get_time_monotonic() / 1000000, b->data());
+        b->data()->skipMember_ = if_tcp()->recvFlow_.get();
+        if_tcp()->device()->send(b, nmsg()->priority());
+        if (addressed_)
+        {
+            return call_immediately(STATE(send_finished));
+        }
+        return global_entry();
+    }
+
+    /// @return the interface this flow is sending on.
+    IfTcp *if_tcp()
+    {
+        return static_cast<IfTcp *>(async_if());
+    }
+
+    /// True if this is the addressed write flow.
+    bool addressed_;
+};
+
+/// Hub port that parses the incoming messages from the device and sends them
+/// to the interface's dispatcher.
+class TcpRecvFlow : public HubPort
+{
+public:
+    /// Constructor. @param iface is the interface to receive messages for.
+    TcpRecvFlow(IfTcp *iface)
+        : HubPort(iface)
+    {
+    }
+
+private:
+    Action entry() override
+    {
+        return allocate_and_call(if_tcp()->dispatcher(), STATE(parse));
+    }
+
+    /// Parses the incoming message into the dispatcher buffer.
+    Action parse()
+    {
+        auto *b = get_allocation_result(if_tcp()->dispatcher());
+        GenMessage *m = b->data();
+        if (!TcpDefs::parse_tcp_message(*message()->data(), m))
+        {
+            LOG(INFO, "IfTcp: dropping malformed message of %u bytes.",
+                (unsigned)message()->data()->size());
+            b->unref();
+            return release_and_exit();
+        }
+        release();
+        m->dstNode = nullptr;
+        if (m->dst.id)
+        {
+            m->dstNode = if_tcp()->lookup_local_node(m->dst.id);
+            if (!m->dstNode)
+            {
+                // Not destined for us.
+                b->unref();
+                return exit();
+            }
+        }
+        if_tcp()->dispatcher()->send(b, m->priority());
+        return exit();
+    }
+
+    /// @return the interface this flow is receiving for.
+    IfTcp *if_tcp()
+    {
+        return static_cast<IfTcp *>(service());
+    }
+};
+
+IfTcp::IfTcp(NodeID gateway_node_id, HubFlow *device, int local_nodes_count)
+    : If(device->service()->executor(), local_nodes_count)
+    , gatewayNodeId_(gateway_node_id)
+    , device_(device)
+    , recvFlow_(new TcpRecvFlow(this))
+{
+    auto *gflow = new TcpSendFlow(this, false);
+    globalWriteFlow_ = gflow;
+    add_owned_flow(gflow);
+    auto *aflow = new TcpSendFlow(this, true);
+    addressedWriteFlow_ = aflow;
+    add_owned_flow(aflow);
+    add_owned_flow(new VerifyNodeIdHandler(this));
+    device_->register_port(recvFlow_.get());
+}
+
+IfTcp::~IfTcp()
+{
+    device_->unregister_port(recvFlow_.get());
+}
+
+void IfTcp::add_owned_flow(Executable *e)
+{
+    ownedFlows_.push_back(std::unique_ptr<Executable>(e));
+}
+
+bool IfTcp::matching_node(NodeHandle expected, NodeHandle actual)
+{
+    return expected.id != 0 && expected.id == actual.id;
+}
+
+void IfTcp::delete_local_node(Node *node)
+{
+    remove_local_node_from_map(node);
+}
+
+size_t TcpStreamParser::consume_data(
+    const char *data, size_t len, bool *complete)
+{
+    *complete = false;
+    if (error_)
+    {
+        return len;
+    }
+    size_t consumed = 0;
+    if (buffer_.size() < TcpDefs::MIN_HEADER_SIZE)
+    {
+        consumed = std::min(len, TcpDefs::MIN_HEADER_SIZE - buffer_.size());
+        buffer_.append(data, consumed);
+        if (buffer_.size() < TcpDefs::MIN_HEADER_SIZE)
+        {
+            return consumed;
+        }
+        expected_ = TcpDefs::get_message_length(buffer_.data());
+        if (expected_ > TcpDefs::MAX_MESSAGE_SIZE)
+        {
+            error_ = true;
+            buffer_.clear();
+            return len;
+        }
+        buffer_.reserve(expected_);
+    }
+    size_t n = std::min(len - consumed, expected_ - buffer_.size());
+    buffer_.append(data + consumed, n);
+    consumed += n;
+    *complete = (buffer_.size() == expected_);
+    return consumed;
+}
+
+/// Implementation class that adds a socket to a hub of TCP messages. The
+/// socket is handled by a HubDeviceSelect on a private hub of raw bytes; two
+/// ports bridge between the byte hub and the message hub, splitting the
+/// incoming stream into messages.
+///
+/// Sends a notification to the application level when there is an error on
+/// the device and the connection is closed.
+struct TcpHubPort : public Executable
+{
+    /// Constructor.
+    ///
+    /// @param tcp_hub Parent hub of TCP messages.
+    /// @param fd device descriptor of open channel (typically a socket)
+    /// @param on_exit Notifiable that will be called when the descriptor
+    /// experiences an error (typically upon device closed or connection lost).
+    TcpHubPort(HubFlow *tcp_hub, int fd, Notifiable *on_exit)
+        : tcpHub_(tcp_hub)
+        , rawHub_(tcp_hub->service())
+        , onExit_(on_exit)
+    {
+        LOG(VERBOSE, "tcp hub port %p", (Executable *)this);
+        tcpHub_->register_port(&writePort_);
+        rawHub_.register_port(&readPort_);
+        device_.reset(new HubDeviceSelect<HubFlow>(&rawHub_, fd, this));
+    }
+
+    /// Forwards the outgoing messages to the byte hub.
+    class WritePort : public HubPortInterface
+    {
+    public:
+        /// Constructor. @param parent owns *this.
+        WritePort(TcpHubPort *parent)
+            : parent_(parent)
+        {
+        }
+
+        void send(Buffer<HubData> *b, unsigned priority) override
+        {
+            auto *o = parent_->rawHub_.alloc();
+            o->data()->assign(*b->data());
+            o->data()->skipMember_ = &parent_->readPort_;
+            b->unref();
+            parent_->rawHub_.send(o, priority);
+        }
+
+    private:
+        /// Object owning *this.
+        TcpHubPort *parent_;
+    } writePort_{this};
+
+    /// Splits the incoming bytes into messages and forwards them to the
+    /// message hub.
+    class ReadPort : public HubPortInterface
+    {
+    public:
+        /// Constructor. @param parent owns *this.
+        ReadPort(TcpHubPort *parent)
+            : parent_(parent)
+        {
+        }
+
+        void send(Buffer<HubData> *b, unsigned priority) override
+        {
+            if (parser_.error())
+            {
+                // Connection is being closed.
+                b->unref();
+                return;
+            }
+            const string &d = *b->data();
+            size_t ofs = 0;
+            while (ofs < d.size())
+            {
+                bool complete;
+                ofs += parser_.consume_data(
+                    d.data() + ofs, d.size() - ofs, &complete);
+                if (parser_.error())
+                {
+                    LOG(WARNING, "TcpHubPort: incoming message too long, "
+                                 "closing connection. (%p)",
+                        (Executable *)parent_);
+                    // The read error will tear down the port.
+                    ::shutdown(parent_->device_->fd(), SHUT_RDWR);
+                    break;
+                }
+                if (complete)
+                {
+                    auto *m = parent_->tcpHub_->alloc();
+                    parser_.take_message(m->data());
+                    m->data()->skipMember_ = &parent_->writePort_;
+                    parent_->tcpHub_->send(m, priority);
+                }
+            }
+            b->unref();
+        }
+
+    private:
+        /// Object owning *this.
+        TcpHubPort *parent_;
+        /// Reassembles the messages from the byte stream.
+        TcpStreamParser parser_;
+    } readPort_{this};
+
+    /** Callback in case the connection is closed due to error. */
+    void notify() override
+    {
+        /* We cannot delete *this in this callback, because we don't know
+         * what executor we are running on. */
+        tcpHub_->service()->executor()->add(this);
+    }
+
+    void run() override
+    {
+        if (!unregistered_)
+        {
+            tcpHub_->unregister_port(&writePort_);
+            rawHub_.unregister_port(&readPort_);
+            unregistered_ = true;
+        }
+        if (!rawHub_.is_waiting() || !tcpHub_->is_waiting())
+        {
+            // Yield.
+            tcpHub_->service()->executor()->add(this);
+            return;
+        }
+        LOG(INFO, "TcpHubPort: Shutting down port %d. (%p)", device_->fd(),
+            (Executable *)this);
+        if (onExit_)
+        {
+            onExit_->notify();
+            onExit_ = nullptr;
+        }
+        delete this;
+    }
+
+    /// Hub of the TCP messages.
+    HubFlow *tcpHub_;
+    /// Hub of the raw bytes. Members are the readPort_ and the device.
+    HubFlow rawHub_;
+    /// Reads and writes the fd.
+    std::unique_ptr<FdHubPortInterface> device_;
+    /// If not null, this notifiable will be called when the device is
+    /// closed.
+    Notifiable *onExit_;
+    /// True once the bridge ports are removed from the hubs.
+    bool unregistered_{false};
+};
+
+void create_tcp_port_for_hub(HubFlow *tcp_hub, int fd, Notifiable *on_exit)
+{
+    new TcpHubPort(tcp_hub, fd, on_exit);
+}
+
+} // namespace openlcb
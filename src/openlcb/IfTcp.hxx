@@ -0,0 +1,164 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file IfTcp.hxx
+ *
+ * Implementation of the OpenLCB interface for the TCP transport.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#ifndef _OPENLCB_IFTCP_HXX_
+#define _OPENLCB_IFTCP_HXX_
+
+#include <memory>
+#include <vector>
+
+#include "openlcb/If.hxx"
+#include "openlcb/TcpDefs.hxx"
+#include "utils/Hub.hxx"
+
+namespace openlcb
+{
+
+/// Implementation of the OpenLCB interface abstraction for the OpenLCB-TCP
+/// transport standard. Messages travel with full node IDs as a whole, so
+/// there is no alias allocation, alias cache or fragmentation involved. The
+/// interface is attached to a hub on which every buffer carries exactly one
+/// complete message in the binary TCP format; use create_tcp_port_for_hub()
+/// to connect sockets to such a hub.
+class IfTcp : public If
+{
+public:
+    /**
+     * Creates a TCP interface.
+     *
+     * @param gateway_node_id will be sent in the gateway field of the
+     * outgoing messages. Typically the node ID of the main virtual node.
+     *
+     * @param device is the hub carrying the messages in TCP format. The
+     * interface will add a member to this hub to handle incoming and outgoing
+     * traffic. All processing will happen on the executor of this hub.
+     *
+     * @param local_nodes_count is the maximum number of virtual nodes that
+     * this interface will support. */
+    IfTcp(NodeID gateway_node_id, HubFlow *device, int local_nodes_count);
+
+    ~IfTcp();
+
+    /// @return the hub that this interface is sending to.
+    HubFlow *device()
+    {
+        return device_;
+    }
+
+    /// @return the node ID that is sent as the gateway of outgoing messages.
+    NodeID gateway_node_id()
+    {
+        return gatewayNodeId_;
+    }
+
+    void add_owned_flow(Executable *e) override;
+
+    bool matching_node(NodeHandle expected, NodeHandle actual) override;
+
+    void delete_local_node(Node *node) override;
+
+private:
+    friend class TcpSendFlow; // needs the receiver as skipMember_.
+
+    /// Node ID to put into the outgoing messages.
+    NodeID gatewayNodeId_;
+    /// Hub with the messages in TCP format.
+    HubFlow *device_;
+    /// Port on device_ that parses the incoming messages.
+    std::unique_ptr<HubPortInterface> recvFlow_;
+    /// Various implementation control flows that this interface owns.
+    std::vector<std::unique_ptr<Executable>> ownedFlows_;
+
+    DISALLOW_COPY_AND_ASSIGN(IfTcp);
+};
+
+/// Splits a byte stream in the OpenLCB-TCP format into messages.
+class TcpStreamParser
+{
+public:
+    /// Consumes bytes from the stream, stopping at the end of a message.
+    ///
+    /// @param data points to the incoming bytes.
+    /// @param len is the number of bytes available.
+    /// @param complete will be set to true if the consumed bytes completed a
+    /// message. The message then has to be retrieved by take_message()
+    /// before calling this function again.
+    /// @return the number of bytes consumed.
+    size_t consume_data(const char *data, size_t len, bool *complete);
+
+    /// @return true if the stream announced a message longer than
+    /// TcpDefs::MAX_MESSAGE_SIZE. The stream cannot be resynchronized; all
+    /// further data is dropped and the connection should be closed.
+    bool error()
+    {
+        return error_;
+    }
+
+    /// Moves the completed message out of the parser and resets the parser
+    /// for the next message.
+    ///
+    /// @param tgt will hold the complete message in TCP format.
+    void take_message(string *tgt)
+    {
+        tgt->swap(buffer_);
+        buffer_.clear();
+    }
+
+private:
+    /// Bytes of the message being assembled.
+    string buffer_;
+    /// Total length of the current message, valid once the header is in.
+    unsigned expected_{0};
+    /// True if an oversized message arrived.
+    bool error_{false};
+};
+
+/** Creates a new port on a hub of OpenLCB-TCP messages for a
+ * select-compatible file descriptor (typically a TCP socket). The byte stream
+ * read from the fd is split into messages before being sent to the hub. The
+ * port will automatically be closed, deleted and on_exit notified when the fd
+ * encounters an error.
+ *
+ * @param tcp_hub carries the TCP messages, one message per buffer.
+ * @param fd the file descriptor to send/receive the messages to/from.
+ * @param on_exit is a notifiable (may be null) which will be called in case
+ * an error is encountered on this port and the port is subsequently
+ * closed. */
+void create_tcp_port_for_hub(
+    HubFlow *tcp_hub, int fd, Notifiable *on_exit = nullptr);
+
+} // namespace openlcb
+
+#endif // _OPENLCB_IFTCP_HXX_
@@ -38,6 +38,7 @@
 #include "openlcb/DatagramDefs.hxx"
 #include "openlcb/DatagramHandlerDefault.hxx"
 #include "openlcb/MemoryConfig.hxx"
+#include "openlcb/StreamService.hxx"
 #include "utils/Destructable.hxx"
 #include "utils/ConfigUpdateService.hxx"
 
@@ -77,6 +78,8 @@ struct MemoryConfigDefs {
         COMMAND_READ_REPLY        = 0x50, /**< reply to read data from address space */
         COMMAND_READ_FAILED       = 0x58, /**< failed to read data from address space */
         COMMAND_READ_STREAM       = 0x60, /**< command to read data using a stream */
+        COMMAND_READ_STREAM_REPLY = 0x70, /**< reply to read data using a stream */
+        COMMAND_READ_STREAM_FAILED= 0x78, /**< failed to read data using a stream */
         COMMAND_MAX_FOR_RW        = 0x80, /**< command <= this value have fixed bit arrangement. */
         COMMAND_OPTIONS           = 0x80,
         COMMAND_OPTIONS_REPLY     = 0x82,
@@ -201,6 +204,39 @@ struct MemoryConfigDefs {
         return p;
     }
 
+    /// Creates a read stream request datagram.
+    /// @param space is the memory space to read from
+    /// @param offset is the address of the first byte to read
+    /// @param dst_stream_id is the stream ID of the local stream receiver that
+    /// will accept the data
+    /// @param length is the number of bytes to read; 0 reads until the end of
+    /// the memory space
+    static DatagramPayload read_stream_datagram(uint8_t space, uint32_t offset,
+        uint8_t dst_stream_id, uint32_t length = 0)
+    {
+        DatagramPayload p;
+        p.reserve(13);
+        p.push_back(DatagramDefs::CONFIGURATION);
+        p.push_back(COMMAND_READ_STREAM);
+        p.push_back(0xff & (offset >> 24));
+        p.push_back(0xff & (offset >> 16));
+        p.push_back(0xff & (offset >> 8));
+        p.push_back(0xff & (offset));
+        if (is_special_space(space)) {
+            p[1] |= space & ~SPACE_SPECIAL;
+        } else {
+            p.push_back(space);
+        }
+        // The source stream ID is assigned by the node serving the read.
+        p.push_back(0xff);
+        p.push_back(dst_stream_id);
+        p.push_back(0xff & (length >> 24));
+        p.push_back(0xff & (length >> 16));
+        p.push_back(0xff & (length >> 8));
+        p.push_back(0xff & (length));
+        return p;
+    }
+
     /// @return true if the payload has minimum number of bytes you need in a
     /// read or write datagram message to cover for the necessary fields
     /// (command, offset, space).
@@ -632,6 +668,19 @@ public:
         HASSERT(client_ == client);
         client_ = nullptr;
     }
+
+    /// Enables the read stream commands. The requested data is sent on a
+    /// stream from the addressed node to the requester.
+    /// @param service is the stream service of the interface.
+    void set_stream_service(StreamService *service)
+    {
+        streamSender_.reset(new StreamSender(service));
+        streamBuffer_.resize(READ_STREAM_CHUNK_SIZE);
+    }
+
+    /// How many bytes of a read stream are read from the memory space at a
+    /// time.
+    static constexpr unsigned READ_STREAM_CHUNK_SIZE = 256;
     
 private:
     typedef MemorySpace::address_t address_t;
@@ -640,6 +689,7 @@ private:
     Action entry() OVERRIDE
     {
         response_.clear();
+        streamSpace_ = nullptr;
         const uint8_t *bytes = in_bytes();
         size_t len = message()->data()->payload.size();
         HASSERT(len >= 1);
@@ -661,6 +711,12 @@ private:
         {
             return call_immediately(STATE(handle_write));
         }
+        else if ((cmd & MemoryConfigDefs::COMMAND_MASK) ==
+                     MemoryConfigDefs::COMMAND_READ_STREAM &&
+            streamSender_)
+        {
+            return call_immediately(STATE(handle_read_stream));
+        }
         switch (cmd)
         {
             case MemoryConfigDefs::COMMAND_LOCK:
@@ -717,6 +773,8 @@ private:
             case MemoryConfigDefs::COMMAND_WRITE_STREAM_FAILED:
             case MemoryConfigDefs::COMMAND_READ_REPLY:
             case MemoryConfigDefs::COMMAND_READ_FAILED:
+            case MemoryConfigDefs::COMMAND_READ_STREAM_REPLY:
+            case MemoryConfigDefs::COMMAND_READ_STREAM_FAILED:
             case MemoryConfigDefs::COMMAND_OPTIONS_REPLY:
             case MemoryConfigDefs::COMMAND_INFORMATION_REPLY:
             case MemoryConfigDefs::COMMAND_LOCK_REPLY:
@@ -736,6 +794,10 @@ private:
 
     Action ok_response_sent() OVERRIDE
     {
+        if (streamSpace_)
+        {
+            return call_immediately(STATE(read_stream_open));
+        }
         if (!response_.empty())
         {
             return allocate_and_call(STATE(client_allocated),
@@ -777,13 +839,24 @@ private:
 
     Action response_flow_complete()
     {
-        if (!(responseFlow_->result() & DatagramClient::OPERATION_SUCCESS))
+        bool success =
+            responseFlow_->result() & DatagramClient::OPERATION_SUCCESS;
+        if (!success)
         {
             LOG(WARNING,
                 "MemoryConfig: Failed to send response datagram. error code %x",
                 (unsigned)responseFlow_->result());
         }
         dg_service()->client_allocator()->typed_insert(responseFlow_);
+        if (streamSpace_)
+        {
+            // The read stream reply is out; the data follows on the stream.
+            if (!success)
+            {
+                streamRemaining_ = 0;
+            }
+            return call_immediately(STATE(read_stream_data));
+        }
         return call_immediately(STATE(cleanup));
     }
 
@@ -962,6 +1035,164 @@ private:
         return respond_ok(DatagramClient::REPLY_PENDING);
     }
 
+    Action handle_read_stream()
+    {
+        unsigned ofs = has_custom_space() ? 7 : 6;
+        if (message()->data()->payload.size() < ofs + 6)
+        {
+            return respond_reject(Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
+        }
+        MemorySpace *space = get_space();
+        if (!space)
+        {
+            return respond_reject(MemoryConfigDefs::ERROR_SPACE_NOT_KNOWN);
+        }
+        const uint8_t *bytes = in_bytes() + ofs + 2;
+        uint32_t count = ((uint32_t)bytes[0] << 24) | (bytes[1] << 16) |
+            (bytes[2] << 8) | bytes[3];
+        address_t address = get_address();
+        address_t max_address = space->max_address();
+        if (address > max_address)
+        {
+            prepare_read_stream_response(
+                MemoryConfigDefs::COMMAND_READ_STREAM_FAILED);
+            response_.push_back(MemoryConfigDefs::ERROR_OUT_OF_BOUNDS >> 8);
+            response_.push_back(MemoryConfigDefs::ERROR_OUT_OF_BOUNDS & 0xff);
+            return respond_ok(DatagramClient::REPLY_PENDING);
+        }
+        // Zero count means until the end of the space.
+        if (count == 0 || count - 1 > max_address - address)
+        {
+            count = max_address - address + 1;
+        }
+        streamSpace_ = space;
+        streamAddress_ = address;
+        streamRemaining_ = count;
+        return respond_ok(DatagramClient::REPLY_PENDING);
+    }
+
+    /// Opens the stream to the requester. The incoming datagram is still
+    /// held, because the reply datagram needs its fields.
+    Action read_stream_open()
+    {
+        uint8_t dst_stream_id = in_bytes()[(has_custom_space() ? 7 : 6) + 1];
+        return invoke_subflow_and_wait(streamSender_.get(),
+            STATE(read_stream_opened), StreamSenderRequest::START,
+            message()->data()->dst, message()->data()->src,
+            StreamService::DEFAULT_WINDOW, dst_stream_id);
+    }
+
+    Action read_stream_opened()
+    {
+        auto b =
+            get_buffer_deleter(full_allocation_result(streamSender_.get()));
+        int error = b->data()->resultCode;
+        if (error)
+        {
+            LOG(INFO, "MemoryConfig: failed to open read stream. error code %x",
+                error);
+            streamSpace_ = nullptr;
+            prepare_read_stream_response(
+                MemoryConfigDefs::COMMAND_READ_STREAM_FAILED);
+            response_.push_back((error >> 8) & 0xff);
+            response_.push_back(error & 0xff);
+        }
+        else
+        {
+            prepare_read_stream_response(
+                MemoryConfigDefs::COMMAND_READ_STREAM_REPLY);
+            response_.push_back(streamSender_->src_stream_id());
+            response_.push_back(b->data()->dstStreamId);
+            response_.push_back((streamRemaining_ >> 24) & 0xff);
+            response_.push_back((streamRemaining_ >> 16) & 0xff);
+            response_.push_back((streamRemaining_ >> 8) & 0xff);
+            response_.push_back(streamRemaining_ & 0xff);
+        }
+        return allocate_and_call(
+            STATE(client_allocated), dg_service()->client_allocator());
+    }
+
+    Action read_stream_data()
+    {
+        if (!streamRemaining_)
+        {
+            return invoke_subflow_and_wait(streamSender_.get(),
+                STATE(read_stream_closed), StreamSenderRequest::CLOSE);
+        }
+        streamFill_ = 0;
+        return call_immediately(STATE(try_read_stream));
+    }
+
+    /// Fills the stream buffer from the memory space, then hands it to the
+    /// stream sender.
+    Action try_read_stream()
+    {
+        size_t len = streamRemaining_;
+        if (len > READ_STREAM_CHUNK_SIZE)
+        {
+            len = READ_STREAM_CHUNK_SIZE;
+        }
+        len -= streamFill_;
+        errorcode_t error = 0;
+        if (len > 0)
+        {
+            size_t read = streamSpace_->read(streamAddress_ + streamFill_,
+                (uint8_t *)&streamBuffer_[streamFill_], len, &error, this);
+            streamFill_ += read;
+            len -= read;
+            if (error == MemorySpace::ERROR_AGAIN)
+            {
+                return wait();
+            }
+            else if (error == 0 && len)
+            {
+                return again();
+            }
+        }
+        if (error)
+        {
+            // Sends what we have, then closes the stream.
+            streamRemaining_ = streamFill_;
+        }
+        return invoke_subflow_and_wait(streamSender_.get(),
+            STATE(read_stream_sent), StreamSenderRequest::SEND,
+            streamBuffer_.data(), (size_t)streamFill_);
+    }
+
+    Action read_stream_sent()
+    {
+        auto b =
+            get_buffer_deleter(full_allocation_result(streamSender_.get()));
+        streamAddress_ += streamFill_;
+        streamRemaining_ -= streamFill_;
+        if (b->data()->resultCode)
+        {
+            LOG(WARNING, "MemoryConfig: read stream failed. error code %x",
+                b->data()->resultCode);
+            streamRemaining_ = 0;
+        }
+        return call_immediately(STATE(read_stream_data));
+    }
+
+    Action read_stream_closed()
+    {
+        auto b =
+            get_buffer_deleter(full_allocation_result(streamSender_.get()));
+        streamSpace_ = nullptr;
+        return call_immediately(STATE(cleanup));
+    }
+
+    /// Fills the outgoing datagram with the header of a read stream reply:
+    /// the command, the address and the space from the request.
+    /// @param command is the reply command.
+    void prepare_read_stream_response(uint8_t command)
+    {
+        response_.assign(has_custom_space() ? 7 : 6, 0);
+        out_bytes()[0] = DATAGRAM_ID;
+        out_bytes()[1] = command;
+        set_address_and_space();
+    }
+
     Action handle_write()
     {
         size_t len = message()->data()->payload.size();
@@ -1206,6 +1437,20 @@ private:
     /// it.
     DatagramHandlerFlow* client_{nullptr};
 
+    /// Sends the data for the read stream commands. nullptr if the read
+    /// stream commands are not enabled.
+    std::unique_ptr<StreamSender> streamSender_;
+    /// Data read from the memory space for the stream.
+    string streamBuffer_;
+    /// Memory space of the current read stream; nullptr if there is none.
+    MemorySpace *streamSpace_{nullptr};
+    /// Next address to read for the stream.
+    address_t streamAddress_;
+    /// Number of bytes still to send on the stream.
+    uint32_t streamRemaining_;
+    /// Number of bytes in streamBuffer_.
+    unsigned streamFill_;
+
     /** Offset withing the current write/read datagram. This does not include
      * the offset from the incoming datagram. */
     uint8_t currentOffset_;
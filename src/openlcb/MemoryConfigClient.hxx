@@ -38,6 +38,7 @@
 #include "executor/CallableFlow.hxx"
 #include "openlcb/MemoryConfig.hxx"
 #include "openlcb/DatagramHandlerDefault.hxx"
+#include "openlcb/StreamService.hxx"
 
 namespace openlcb
 {
@@ -54,6 +55,11 @@ struct MemoryConfigClientRequest : public CallableFlowRequestBase
         READ_PART
     };
 
+    enum ReadStreamCmd
+    {
+        READ_STREAM
+    };
+
     enum WriteCmd
     {
         WRITE
@@ -112,21 +118,41 @@ struct MemoryConfigClientRequest : public CallableFlowRequestBase
         payload.clear();
     }
 
+    /// Sets up a command to read a part of a memory space using a stream
+    /// instead of datagrams. Needs MemoryConfigClient::set_stream_service().
+    /// @param ReadStreamCmd polymorphic matching arg; always set to
+    /// READ_STREAM.
+    /// @param d is the destination node to query
+    /// @param space is the memory space to read out
+    /// @param offset if the address of the first byte to read
+    /// @param size is the number of bytes to read
+    void reset(ReadStreamCmd, NodeHandle d, uint8_t space, unsigned offset,
+        unsigned size)
+    {
+        reset_base();
+        cmd = CMD_READ_STREAM;
+        memory_space = space;
+        dst = d;
+        this->address = offset;
+        this->size = size;
+        payload.clear();
+    }
+
     /// Sets up a command to read a part of a memory space.
     /// @param WriteCmd polymorphic matching arg; always set to WRITE.
     /// @param d is the destination node to query
     /// @param space is the memory space to write to
     /// @param offset if the address of the first byte to read
     /// @param data is the data to write
-    void reset(
-        WriteCmd, NodeHandle d, uint8_t space, unsigned offset, string data)
+    void reset(WriteCmd, NodeHandle d, uint8_t space, unsigned offset,
+        string data)
     {
         reset_base();
         cmd = CMD_WRITE;
         memory_space = space;
         dst = d;
         this->address = offset;
-        this->size = size;
+        this->size = data.size();
         payload = std::move(data);
     }
 
@@ -198,6 +224,7 @@ struct MemoryConfigClientRequest : public CallableFlowRequestBase
     {
         CMD_READ,
         CMD_READ_PART,
+        CMD_READ_STREAM,
         CMD_WRITE,
         CMD_META_REQUEST
     };
@@ -220,6 +247,17 @@ public:
     {
     }
 
+    /// How many times one datagram is sent again after a temporary rejection
+    /// or a missing reply before the operation fails.
+    static constexpr unsigned MAX_RETRIES = 3;
+
+    /// Enables the READ_STREAM command. @param service is the stream service
+    /// of the interface.
+    void set_stream_service(StreamService *service)
+    {
+        streamReceiver_.reset(new StreamReceiver(service));
+    }
+
     /// These result codes are written into request()->resultCode during and as
     /// a return from the flow.
     enum ResultCodes
@@ -239,11 +277,16 @@ private:
         {
             case MemoryConfigClientRequest::CMD_READ:
             case MemoryConfigClientRequest::CMD_READ_PART:
-                return allocate_and_call(
-                    STATE(do_read), dg_service()->client_allocator());
             case MemoryConfigClientRequest::CMD_WRITE:
                 return allocate_and_call(
-                    STATE(do_write), dg_service()->client_allocator());
+                    STATE(do_transfer), dg_service()->client_allocator());
+            case MemoryConfigClientRequest::CMD_READ_STREAM:
+                if (!streamReceiver_ || !request()->size)
+                {
+                    break;
+                }
+                return allocate_and_call(
+                    STATE(do_read_stream), dg_service()->client_allocator());
             case MemoryConfigClientRequest::CMD_META_REQUEST:
                 return allocate_and_call(
                     STATE(do_meta_request), dg_service()->client_allocator());
@@ -253,260 +296,322 @@ private:
         return return_with_error(Defs::ERROR_UNIMPLEMENTED_SUBCMD);
     }
 
-    Action do_read()
+    /// Starts a read or write operation. The data is cut into chunks of
+    /// MAX_DATAGRAM_RW_BYTES, each carried by one datagram. Each chunk waits
+    /// for the reply to the previous one; a chunk is sent again on its own
+    /// when it is rejected temporarily or its reply does not arrive.
+    Action do_transfer()
     {
         dgClient_ = full_allocation_result(dg_service()->client_allocator());
         offset_ = request()->address;
+        uint32_t size = request()->size;
+        if (size > 0xffffffffu - offset_)
+        {
+            size = 0xffffffffu - offset_;
+        }
+        endAddress_ = offset_ + size;
+        chunk_.state = CHUNK_FREE;
+        transferError_ = 0;
         memoryConfigHandler_->set_client(&responseFlow_);
-        return call_immediately(STATE(send_next_read));
+        return call_immediately(STATE(next_chunk));
     }
 
-    Action send_next_read()
+    /// Decides what to do next: resend the chunk, send a new chunk, wait for
+    /// the reply or finish.
+    Action next_chunk()
+    {
+        if (transferError_)
+        {
+            return finish_transfer(transferError_);
+        }
+        if (chunk_.state == CHUNK_RESEND)
+        {
+            return call_immediately(STATE(send_next_chunk));
+        }
+        if (chunk_.state == CHUNK_FREE)
+        {
+            if (offset_ >= endAddress_)
+            {
+                return finish_transfer(0);
+            }
+            chunk_.address = offset_;
+            chunk_.size = std::min(endAddress_ - offset_,
+                (uint32_t)MemoryConfigDefs::MAX_DATAGRAM_RW_BYTES);
+            chunk_.retries = 0;
+            offset_ += chunk_.size;
+            return call_immediately(STATE(send_next_chunk));
+        }
+        isWaitingForTimer_ = 1;
+        hasProgress_ = 0;
+        return sleep_and_call(
+            &timer_, SEC_TO_NSEC(3), STATE(reply_wait_done));
+    }
+
+    Action send_next_chunk()
     {
         return allocate_and_call(
-            dg_service()->iface()->dispatcher(), STATE(send_read_datagram));
+            dg_service()->iface()->dispatcher(), STATE(send_chunk_datagram));
     }
 
-    Action send_read_datagram()
+    Action send_chunk_datagram()
     {
         auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
         b->set_done(bn_.reset(this));
-        unsigned sz = request()->size > 64 ? 64 : request()->size;
-        b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(), request()->dst,
-            MemoryConfigDefs::read_datagram(
-                             request()->memory_space, offset_, sz));
-        if (request()->size < 0xffffffffu)
+        Chunk &c = chunk_;
+        c.state = CHUNK_SENDING;
+        if (request()->cmd == MemoryConfigClientRequest::CMD_WRITE)
         {
-            request()->size -= sz;
+            b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(),
+                request()->dst,
+                MemoryConfigDefs::write_datagram(request()->memory_space,
+                    c.address,
+                    request()->payload.substr(
+                        c.address - request()->address, c.size)));
+        }
+        else
+        {
+            b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(),
+                request()->dst,
+                MemoryConfigDefs::read_datagram(
+                    request()->memory_space, c.address, c.size));
         }
-        isWaitingForTimer_ = 0;
-        responseCode_ = DatagramClient::OPERATION_PENDING;
         dgClient_->write_datagram(b);
-        return wait_and_call(STATE(read_complete));
+        return wait_and_call(STATE(chunk_sent));
     }
 
-    Action read_complete()
+    Action chunk_sent()
     {
-        if (!(dgClient_->result() & DatagramClient::OPERATION_SUCCESS))
+        Chunk &c = chunk_;
+        if (c.state != CHUNK_SENDING)
         {
-            // some error occurred.
-            return handle_read_error(dgClient_->result());
+            // The reply has already arrived, or the chunk is not needed
+            // anymore.
+            return call_immediately(STATE(next_chunk));
         }
-        if (responseCode_ & DatagramClient::OPERATION_PENDING)
+        unsigned result = dgClient_->result();
+        if (result & DatagramClient::OPERATION_SUCCESS)
         {
-            isWaitingForTimer_ = 1;
-            return sleep_and_call(
-                &timer_, SEC_TO_NSEC(3), STATE(read_response_timeout));
+            c.state = CHUNK_WAIT_REPLY;
+            return call_immediately(STATE(next_chunk));
         }
-        else
+        if ((result & (DatagramClient::RESEND_OK | DatagramClient::TIMEOUT)) &&
+            c.retries < MAX_RETRIES)
         {
-            return call_immediately(STATE(read_response_timeout));
+            // Temporary rejection (e.g. the destination is out of buffers) or
+            // lost acknowledgement.
+            ++c.retries;
+            c.state = CHUNK_RESEND;
+            return call_immediately(STATE(next_chunk));
         }
+        return finish_transfer(result);
     }
 
-    Action read_response_timeout()
+    Action reply_wait_done()
     {
-        if (responseCode_ & DatagramClient::OPERATION_PENDING)
+        isWaitingForTimer_ = 0;
+        if (hasProgress_ || transferError_)
         {
-            return handle_read_error(Defs::OPENMRN_TIMEOUT);
+            return call_immediately(STATE(next_chunk));
         }
-        size_t len = responsePayload_.size();
-        const uint8_t *bytes =
-            MemoryConfigDefs::payload_bytes(responsePayload_);
-        if (!MemoryConfigDefs::payload_min_length_check(responsePayload_, 0))
+        // No reply arrived for a while. Resends the request.
+        if (chunk_.state == CHUNK_WAIT_REPLY)
+        {
+            if (chunk_.retries >= MAX_RETRIES)
+            {
+                return finish_transfer(Defs::OPENMRN_TIMEOUT);
+            }
+            ++chunk_.retries;
+            chunk_.state = CHUNK_RESEND;
+        }
+        return call_immediately(STATE(next_chunk));
+    }
+
+    /// Called by the response flow when a reply datagram arrives.
+    /// @param payload is the reply datagram.
+    void handle_reply(const string &payload)
+    {
+        if (!MemoryConfigDefs::payload_min_length_check(payload, 0))
         {
             LOG(INFO, "Memory Config client: response datagram payload not "
                       "long enough");
-            return handle_read_error(
-                Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
+            return;
         }
-        unsigned ofs = MemoryConfigDefs::get_payload_offset(responsePayload_);
-        unsigned address = MemoryConfigDefs::get_address(responsePayload_);
-        uint8_t space = MemoryConfigDefs::get_space(responsePayload_);
+        const uint8_t *bytes = MemoryConfigDefs::payload_bytes(payload);
+        unsigned len = payload.size();
+        unsigned ofs = MemoryConfigDefs::get_payload_offset(payload);
+        uint32_t address = MemoryConfigDefs::get_address(payload);
         uint8_t cmd = bytes[1] & MemoryConfigDefs::COMMAND_MASK;
-        if (address != offset_)
+        Chunk *c = &chunk_;
+        if ((c->state != CHUNK_SENDING && c->state != CHUNK_WAIT_REPLY) ||
+            c->address != address)
         {
-            return handle_read_error(Defs::ERROR_OUT_OF_ORDER);
+            // Late reply to a chunk that was resent, or garbage.
+            return;
         }
-        if (space != request()->memory_space)
+        if (MemoryConfigDefs::get_space(payload) != request()->memory_space)
         {
-            return handle_read_error(Defs::ERROR_OUT_OF_ORDER);
+            transferError_ = Defs::ERROR_OUT_OF_ORDER;
         }
-        if (cmd == MemoryConfigDefs::COMMAND_READ_FAILED)
+        else if (cmd == MemoryConfigDefs::COMMAND_READ_FAILED ||
+            cmd == MemoryConfigDefs::COMMAND_WRITE_FAILED)
         {
-            if (len < ofs + 2)
+            uint16_t error = Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT;
+            if (len >= ofs + 2)
             {
-                return handle_read_error(
-                    Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
+                error = (bytes[ofs] << 8) | bytes[ofs + 1];
+            }
+            if (error == MemoryConfigDefs::ERROR_OUT_OF_BOUNDS)
+            {
+                set_end_address(address);
+            }
+            else
+            {
+                transferError_ = error;
+            }
+        }
+        else if (cmd == MemoryConfigDefs::COMMAND_READ_REPLY)
+        {
+            unsigned dlen = len - ofs;
+            if (dlen > c->size)
+            {
+                dlen = c->size;
+            }
+            string &p = request()->payload;
+            unsigned pofs = address - request()->address;
+            if (p.size() < pofs + dlen)
+            {
+                p.resize(pofs + dlen);
+            }
+            memcpy(&p[pofs], bytes + ofs, dlen);
+            if (dlen < c->size)
+            {
+                set_end_address(address + dlen);
             }
-            uint16_t error = bytes[ofs++];
-            error <<= 8;
-            error |= bytes[ofs];
-            return handle_read_error(error);
         }
-        if (cmd != MemoryConfigDefs::COMMAND_READ_REPLY)
+        else if (cmd != MemoryConfigDefs::COMMAND_WRITE_REPLY)
         {
-            return handle_read_error(Defs::ERROR_UNIMPLEMENTED);
+            transferError_ = Defs::ERROR_UNIMPLEMENTED;
         }
-        unsigned dlen = len - ofs;
-        request()->payload.append((char *)(bytes + ofs), dlen);
-        offset_ += dlen;
-        if ((dlen < 64) || (request()->size == 0))
+        c->state = CHUNK_FREE;
+        hasProgress_ = 1;
+        if (isWaitingForTimer_)
         {
-            return call_immediately(STATE(finish_read));
+            timer_.trigger();
         }
-        return call_immediately(STATE(send_next_read));
     }
 
-    Action handle_read_error(int error) {
-        if (error == MemoryConfigDefs::ERROR_OUT_OF_BOUNDS) {
-            return finish_read();
+    /// Records that the memory space ends at a given address.
+    void set_end_address(uint32_t address)
+    {
+        if (address < endAddress_)
+        {
+            endAddress_ = address;
         }
-        cleanup_read();
-        return return_with_error(error);
     }
 
-    void cleanup_read() {
-        responsePayload_.clear();
+    /// Terminates a read or write operation. @param error is the result
+    /// code to return to the caller.
+    Action finish_transfer(int error)
+    {
+        if (request()->cmd != MemoryConfigClientRequest::CMD_WRITE &&
+            request()->payload.size() > endAddress_ - request()->address)
+        {
+            request()->payload.resize(endAddress_ - request()->address);
+        }
         dg_service()->client_allocator()->typed_insert(dgClient_);
         memoryConfigHandler_->clear_client(&responseFlow_);
         dgClient_ = nullptr;
+        return return_with_error(error);
     }
 
-    Action finish_read() {
-        cleanup_read();
-        return return_ok();
-    }
-
-    Action do_write()
+    /// Starts a stream read. The stream receiver starts listening before the
+    /// request goes out, and writes the data straight into the request
+    /// payload.
+    Action do_read_stream()
     {
         dgClient_ = full_allocation_result(dg_service()->client_allocator());
-        offset_ = request()->address;
-        payloadOffset_ = 0;
+        request()->payload.resize(request()->size);
+        endAddress_ = request()->address;
+        transferError_ = 0;
+        isWaitingForTimer_ = 0;
+        receiverDone_.done_ = 0;
         memoryConfigHandler_->set_client(&responseFlow_);
-        return call_immediately(STATE(send_next_write));
+        mainBufferPool->alloc(&receiverBuf_);
+        receiverBuf_->data()->reset(node_, &request()->payload[0],
+            request()->payload.size(), request()->dst);
+        receiverBuf_->data()->done.reset(&receiverDone_);
+        streamReceiver_->send(receiverBuf_->ref());
+        return allocate_and_call(dg_service()->iface()->dispatcher(),
+            STATE(send_read_stream_datagram));
     }
 
-    Action send_next_write()
-    {
-        return allocate_and_call(
-            dg_service()->iface()->dispatcher(), STATE(send_write_datagram));
-    }
-
-    Action send_write_datagram()
+    Action send_read_stream_datagram()
     {
         auto *b = get_allocation_result(dg_service()->iface()->dispatcher());
         b->set_done(bn_.reset(this));
-        unsigned sz = request()->payload.size() - payloadOffset_;
-        if (sz > MemoryConfigDefs::MAX_DATAGRAM_RW_BYTES)
-        {
-            sz = MemoryConfigDefs::MAX_DATAGRAM_RW_BYTES;
-        }
-        writeLength_ = sz;
         b->data()->reset(Defs::MTI_DATAGRAM, node_->node_id(), request()->dst,
-            MemoryConfigDefs::write_datagram(request()->memory_space, offset_,
-                             request()->payload.substr(payloadOffset_, sz)));
-        isWaitingForTimer_ = 0;
-        responseCode_ = DatagramClient::OPERATION_PENDING;
+            MemoryConfigDefs::read_stream_datagram(request()->memory_space,
+                request()->address, streamReceiver_->dst_stream_id(),
+                request()->size));
         dgClient_->write_datagram(b);
-        return wait_and_call(STATE(write_complete));
+        return wait_and_call(STATE(read_stream_datagram_sent));
     }
 
-    Action write_complete()
+    Action read_stream_datagram_sent()
     {
-        if (!(dgClient_->result() & DatagramClient::OPERATION_SUCCESS))
+        unsigned result = dgClient_->result();
+        if (!(result & DatagramClient::OPERATION_SUCCESS))
         {
-            // some error occurred.
-            return handle_write_error(dgClient_->result());
-        }
-        if (responseCode_ & DatagramClient::OPERATION_PENDING)
-        {
-            isWaitingForTimer_ = 1;
-            return sleep_and_call(
-                &timer_, SEC_TO_NSEC(3), STATE(write_response_timeout));
-        }
-        else
-        {
-            return call_immediately(STATE(write_response_timeout));
+            transferError_ = result;
+            streamReceiver_->cancel(Defs::ERROR_PERMANENT);
         }
+        return call_immediately(STATE(read_stream_wait));
     }
 
-    Action write_response_timeout()
+    /// Waits for the stream receiver to return. It has its own timeout.
+    Action read_stream_wait()
     {
-        if (responseCode_ & DatagramClient::OPERATION_PENDING)
-        {
-            return handle_write_error(Defs::OPENMRN_TIMEOUT);
-        }
-        size_t len = responsePayload_.size();
-        const uint8_t *bytes =
-            MemoryConfigDefs::payload_bytes(responsePayload_);
-        if (!MemoryConfigDefs::payload_min_length_check(responsePayload_, 0))
-        {
-            LOG(INFO, "Memory Config client: response datagram payload not "
-                      "long enough");
-            return handle_write_error(
-                Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
-        }
-        unsigned ofs = MemoryConfigDefs::get_payload_offset(responsePayload_);
-        unsigned address = MemoryConfigDefs::get_address(responsePayload_);
-        uint8_t space = MemoryConfigDefs::get_space(responsePayload_);
-        uint8_t cmd = bytes[1] & MemoryConfigDefs::COMMAND_MASK;
-        if (address != offset_)
-        {
-            return handle_write_error(Defs::ERROR_OUT_OF_ORDER);
-        }
-        if (space != request()->memory_space)
-        {
-            return handle_write_error(Defs::ERROR_OUT_OF_ORDER);
-        }
-        if (cmd == MemoryConfigDefs::COMMAND_WRITE_FAILED)
-        {
-            if (len < ofs + 2)
-            {
-                return handle_write_error(
-                    Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT);
-            }
-            uint16_t error = bytes[ofs++];
-            error <<= 8;
-            error |= bytes[ofs];
-            return handle_write_error(error);
-        }
-        if (cmd != MemoryConfigDefs::COMMAND_WRITE_REPLY)
-        {
-            return handle_write_error(Defs::ERROR_UNIMPLEMENTED);
-        }
-        // write success.
-        offset_ += writeLength_;
-        payloadOffset_ += writeLength_;
-        if (payloadOffset_ >= request()->payload.size())
+        isWaitingForTimer_ = 0;
+        if (receiverDone_.done_)
         {
-            return call_immediately(STATE(finish_write));
+            return call_immediately(STATE(read_stream_done));
         }
-        return call_immediately(STATE(send_next_write));
+        isWaitingForTimer_ = 1;
+        return sleep_and_call(
+            &timer_, SEC_TO_NSEC(3), STATE(read_stream_wait));
     }
 
-    Action handle_write_error(int error)
+    Action read_stream_done()
     {
-        if (error == MemoryConfigDefs::ERROR_OUT_OF_BOUNDS)
+        int error = receiverBuf_->data()->resultCode;
+        endAddress_ += receiverBuf_->data()->received;
+        receiverBuf_->unref();
+        receiverBuf_ = nullptr;
+        if (transferError_)
         {
-            return finish_write();
+            error = transferError_;
         }
-        cleanup_write();
-        return return_with_error(error);
+        return finish_transfer(error);
     }
 
-    void cleanup_write()
+    /// Called by the response flow when a read stream reply datagram arrives.
+    /// @param payload is the reply datagram.
+    void handle_stream_reply(const string &payload)
     {
-        responsePayload_.clear();
-        dg_service()->client_allocator()->typed_insert(dgClient_);
-        memoryConfigHandler_->clear_client(&responseFlow_);
-        dgClient_ = nullptr;
-    }
-
-    Action finish_write()
-    {
-        cleanup_write();
-        return return_ok();
+        const uint8_t *bytes = MemoryConfigDefs::payload_bytes(payload);
+        if ((bytes[1] & MemoryConfigDefs::COMMAND_MASK) !=
+            MemoryConfigDefs::COMMAND_READ_STREAM_FAILED)
+        {
+            // The data is coming on the stream.
+            return;
+        }
+        unsigned ofs = MemoryConfigDefs::get_payload_offset(payload);
+        transferError_ = Defs::ERROR_INVALID_ARGS_MESSAGE_TOO_SHORT;
+        if (payload.size() >= ofs + 2)
+        {
+            transferError_ = (bytes[ofs] << 8) | bytes[ofs + 1];
+        }
+        streamReceiver_->cancel(transferError_);
     }
 
     Action do_meta_request()
@@ -570,39 +675,37 @@ private:
             }
             auto* bytes = payload();
             uint8_t cmd = bytes[1] & ~3;
+            bool is_write =
+                parent_->request()->cmd == MemoryConfigClientRequest::CMD_WRITE;
+            bool is_stream = parent_->request()->cmd ==
+                MemoryConfigClientRequest::CMD_READ_STREAM;
             switch (cmd)
             {
                 case MemoryConfigDefs::COMMAND_READ_REPLY:
                 case MemoryConfigDefs::COMMAND_READ_FAILED:
-                {
-                    if (parent_->request()->cmd !=
-                            MemoryConfigClientRequest::CMD_READ &&
-                        parent_->request()->cmd !=
-                            MemoryConfigClientRequest::CMD_READ_PART)
+                    if (is_write || is_stream)
                     {
                         break;
                     }
-                    parent_->responseCode_ = 0;
-                    message()->data()->payload.swap(parent_->responsePayload_);
-                    if (parent_->isWaitingForTimer_)
+                    parent_->handle_reply(message()->data()->payload);
+                    return respond_ok(0);
+                case MemoryConfigDefs::COMMAND_READ_STREAM_REPLY:
+                case MemoryConfigDefs::COMMAND_READ_STREAM_FAILED:
+                    if (!is_stream ||
+                        !MemoryConfigDefs::payload_min_length_check(
+                            message()->data()->payload, 0))
                     {
-                        parent_->timer_.trigger();
+                        break;
                     }
+                    parent_->handle_stream_reply(message()->data()->payload);
                     return respond_ok(0);
-                }
                 case MemoryConfigDefs::COMMAND_WRITE_REPLY:
                 case MemoryConfigDefs::COMMAND_WRITE_FAILED:
-                    if (parent_->request()->cmd !=
-                        MemoryConfigClientRequest::CMD_WRITE)
+                    if (!is_write)
                     {
                         break;
                     }
-                    parent_->responseCode_ = 0;
-                    message()->data()->payload.swap(parent_->responsePayload_);
-                    if (parent_->isWaitingForTimer_)
-                    {
-                        parent_->timer_.trigger();
-                    }
+                    parent_->handle_reply(message()->data()->payload);
                     return respond_ok(0);
             }
             return respond_reject(Defs::ERROR_UNIMPLEMENTED_SUBCMD);
@@ -625,20 +728,77 @@ private:
     DatagramClient *dgClient_{nullptr};
     /// Handler for the incoming reply datagrams.
     ResponseFlow responseFlow_{this};
+
+    /// Gets notified when the stream receiver returns; wakes up the flow.
+    class ReceiverDone : public Notifiable
+    {
+    public:
+        ReceiverDone(MemoryConfigClient *parent)
+            : parent_(parent)
+        {
+        }
+
+        void notify() override
+        {
+            done_ = 1;
+            if (parent_->isWaitingForTimer_)
+            {
+                parent_->timer_.trigger();
+            }
+        }
+
+        /// 1 if the receiver returned.
+        uint8_t done_{0};
+
+    private:
+        MemoryConfigClient *parent_;
+    };
+
+    /// Receives the data for READ_STREAM; nullptr if streams are not enabled.
+    std::unique_ptr<StreamReceiver> streamReceiver_;
+    /// Request buffer of the stream receiver.
+    Buffer<StreamReceiverRequest> *receiverBuf_{nullptr};
+    /// Wakes us up when the stream receiver is done.
+    ReceiverDone receiverDone_{this};
     /// Notify helper.
     BarrierNotifiable bn_;
-    /// Next byte to read from the memory space.
+    /// One read or write datagram of a transfer.
+    struct Chunk
+    {
+        /// Address in the memory space.
+        uint32_t address;
+        /// Number of bytes requested or written.
+        uint8_t size;
+        /// How many times we sent this chunk again.
+        uint8_t retries;
+        /// One of the ChunkState values.
+        uint8_t state;
+    };
+
+    enum ChunkState : uint8_t
+    {
+        /// No datagram is outstanding.
+        CHUNK_FREE,
+        /// Needs to be (re)sent.
+        CHUNK_RESEND,
+        /// Datagram is being sent.
+        CHUNK_SENDING,
+        /// Datagram acknowledged, waiting for the reply datagram.
+        CHUNK_WAIT_REPLY,
+    };
+
+    /// Chunk of the current transfer being sent or waiting for its reply.
+    Chunk chunk_;
+    /// Next byte to request from the memory space.
     uint32_t offset_;
-    /// Next byte in the payload to write.
-    uint32_t payloadOffset_;
-    /// How many bytes we wrote in this datagram.
-    uint16_t writeLength_;
+    /// First address of the memory space that is beyond the transfer.
+    uint32_t endAddress_;
     /// timing helper
     StateFlowTimer timer_{this};
-    /// The data that came back from reading.
-    string responsePayload_;
-    /// error code that came with the response. 0 for success.
-    int responseCode_;
+    /// Error code for the current transfer. 0 for success.
+    int transferError_;
+    /// 1 if a reply arrived since we started waiting.
+    uint8_t hasProgress_ : 1;
     /// 1 if we are pending on the timer.
     uint8_t isWaitingForTimer_ : 1;
 };
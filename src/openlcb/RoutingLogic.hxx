@@ -39,6 +39,7 @@
 #include <set>
 #include <map>
 #include <unordered_map>
+#include <vector>
 
 #include "os/OS.hxx"
 #include "openlcb/EventHandler.hxx"
@@ -57,12 +58,33 @@ namespace openlcb
  */
 uint8_t event_range_to_bit_count(EventId *event);
 
+/** Mutex type for a RoutingLogic that is only ever accessed from a single
+ * flow, for example the delivery flow of a routing hub. */
+class RoutingLogicNoLock
+{
+public:
+    /// Does nothing.
+    void lock()
+    {
+    }
+    /// Does nothing.
+    void unlock()
+    {
+    }
+};
+
 /** Routing table for gateways and routers in OpenLCB.
  *
  * The routing table contains which direction to send addressed packets as well
- * as filters for the event IDs that have listeners in a given port.
+ * as filters for the event IDs that have listeners in a given port. The event
+ * filters are indexed by event ID (and range), and yield a bit mask of the
+ * ports, so that one lookup finds all destinations of an event report.
+ *
+ * @param Mutex protects the tables. Use RoutingLogicNoLock if the owner makes
+ * all calls from the same flow.
  */
-template <class Port, typename Address> class RoutingLogic
+template <class Port, typename Address, class Mutex = OSMutex>
+class RoutingLogic
 {
 public:
     RoutingLogic()
@@ -79,8 +101,39 @@ public:
      */
     void remove_port(Port *port)
     {
-        OSMutexLock l(&lock_);
-        eventRoutingTable_.erase(port);
+        Guard l(&lock_);
+        auto ip = portIndex_.find(port);
+        if (ip != portIndex_.end())
+        {
+            PortMask bit = PortMask(1) << ip->second;
+            for (auto it = eventTables_.begin(); it != eventTables_.end();)
+            {
+                auto &table = it->second;
+                for (auto ie = table.begin(); ie != table.end();)
+                {
+                    ie->second &= ~bit;
+                    if (ie->second)
+                    {
+                        ++ie;
+                    }
+                    else
+                    {
+                        ie = table.erase(ie);
+                    }
+                }
+                if (table.empty())
+                {
+                    it = eventTables_.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            portByIndex_[ip->second] = nullptr;
+            portIndex_.erase(ip);
+        }
+        unindexedPorts_.erase(port);
         // Removing entries from a hashmap invalidates an iterator, thus it is
         // safer to null them out than actually remove. Having a null value
         // will cause address lookup to return null for a node that has not
@@ -104,7 +157,7 @@ public:
      */
     void add_node_id_to_route(Port *port, Address source)
     {
-        OSMutexLock l(&lock_);
+        Guard l(&lock_);
         addressRoutingTable_[source] = port;
     }
 
@@ -117,7 +170,7 @@ public:
      */
     Port *lookup_port_for_address(Address dest)
     {
-        OSMutexLock l(&lock_);
+        Guard l(&lock_);
         auto it = addressRoutingTable_.find(dest);
         if (it == addressRoutingTable_.end())
             return nullptr;
@@ -132,8 +185,8 @@ public:
      * that port. */
     void register_consumer(Port *port, EventId event)
     {
-        OSMutexLock l(&lock_);
-        eventRoutingTable_[port].registeredConsumers_[0].insert(event);
+        Guard l(&lock_);
+        add_event(port, 0, event);
     }
 
     /** Declares that there is a consumer for the given event ID range on the
@@ -144,10 +197,9 @@ public:
      * method. */
     void register_consumer_range(Port *port, EventId encoded_range)
     {
-        OSMutexLock l(&lock_);
+        Guard l(&lock_);
         uint8_t bit_count = event_range_to_bit_count(&encoded_range);
-        eventRoutingTable_[port].registeredConsumers_[bit_count].insert(
-            encoded_range);
+        add_event(port, bit_count, encoded_range);
     }
 
     /** Declares that there is a producer for the given event ID on the given
@@ -184,53 +236,166 @@ public:
      * @return true if the given event has a consumer on the given port. */
     bool check_pcer(Port *port, EventId event)
     {
-        OSMutexLock l(&lock_);
-        auto ip = eventRoutingTable_.find(port);
-        if (ip == eventRoutingTable_.end())
+        Guard l(&lock_);
+        if (unindexedPorts_.count(port))
+        {
+            return true;
+        }
+        auto ip = portIndex_.find(port);
+        if (ip == portIndex_.end())
         {
             return false;
         }
-        for (auto im = ip->second.registeredConsumers_.begin();
-             im != ip->second.registeredConsumers_.end(); ++im)
+        return (lookup_mask(event) >> ip->second) & 1;
+    }
+
+    /** Finds all ports that a given PCER message should be forwarded to.
+     *
+     * @param event is the event ID from the PCER message.
+     * @param ports will be filled with the ports that have a consumer for the
+     * given event (in no particular order). */
+    void lookup_pcer(EventId event, std::vector<Port *> *ports)
+    {
+        Guard l(&lock_);
+        ports->clear();
+        PortMask mask = lookup_mask(event);
+        while (mask)
         {
-            if (im->first == 0)
-            {
-                if (im->second.find(event) != im->second.end())
-                    return true;
-            }
-            else if (im->first == 64)
-            {
-                if (!im->second.empty())
-                    return true;
-            }
-            else
+            ports->push_back(portByIndex_[__builtin_ctzll(mask)]);
+            mask &= mask - 1;
+        }
+        ports->insert(
+            ports->end(), unindexedPorts_.begin(), unindexedPorts_.end());
+    }
+
+private:
+    /// Bit mask of port indexes.
+    typedef uint64_t PortMask;
+
+    /// How many ports fit into a PortMask. Ports registering events above
+    /// this count are not indexed; they receive every PCER.
+    static constexpr unsigned MAX_INDEXED_PORTS = 64;
+
+    /// @param bit_count number of mask bits of an event range (0..64).
+    /// @return the mask that clears the range bits from an event ID.
+    static EventId range_mask(uint8_t bit_count)
+    {
+        return bit_count >= 64 ? 0 : ~((UINT64_C(1) << bit_count) - 1);
+    }
+
+    /// Adds an event or event range to the index. Must be called with lock_
+    /// held.
+    ///
+    /// @param port the port where the event was identified.
+    /// @param bit_count number of mask bits, 0 for a single event.
+    /// @param event base value of the event range.
+    void add_event(Port *port, uint8_t bit_count, EventId event)
+    {
+        int idx = get_port_index(port);
+        if (idx < 0)
+        {
+            unindexedPorts_.insert(port);
+            return;
+        }
+        eventTables_[bit_count][event] |= PortMask(1) << idx;
+    }
+
+    /// Looks up or allocates the bit index for a port. Must be called with
+    /// lock_ held.
+    ///
+    /// @param port the port to look up.
+    /// @return the index of the port in the masks, or -1 if we ran out of
+    /// bits.
+    int get_port_index(Port *port)
+    {
+        auto ip = portIndex_.find(port);
+        if (ip != portIndex_.end())
+        {
+            return ip->second;
+        }
+        unsigned idx = 0;
+        while (idx < portByIndex_.size() && portByIndex_[idx])
+        {
+            ++idx;
+        }
+        if (idx >= MAX_INDEXED_PORTS)
+        {
+            return -1;
+        }
+        if (idx == portByIndex_.size())
+        {
+            portByIndex_.push_back(port);
+        }
+        else
+        {
+            portByIndex_[idx] = port;
+        }
+        portIndex_[port] = idx;
+        return idx;
+    }
+
+    /// Computes which ports have a consumer for an event. Must be called with
+    /// lock_ held.
+    ///
+    /// @param event is the event ID from the PCER message.
+    /// @return bit mask of port indexes.
+    PortMask lookup_mask(EventId event)
+    {
+        PortMask mask = 0;
+        for (auto &t : eventTables_)
+        {
+            auto it = t.second.find(event & range_mask(t.first));
+            if (it != t.second.end())
             {
-                EventId masked_range =
-                    event & ~((UINT64_C(1) << im->first) - 1);
-                if (im->second.find(masked_range) != im->second.end())
-                    return true;
+                mask |= it->second;
             }
         }
-        return false;
+        return mask;
     }
 
-private:
+    /// Holds a Mutex locked for the lifetime of the object.
+    class Guard
+    {
+    public:
+        /// Constructor. @param mutex is the mutex to lock.
+        Guard(Mutex *mutex)
+            : mutex_(mutex)
+        {
+            mutex_->lock();
+        }
+
+        ~Guard()
+        {
+            mutex_->unlock();
+        }
+
+    private:
+        DISALLOW_COPY_AND_ASSIGN(Guard);
+
+        /// Mutex we are having locked.
+        Mutex *mutex_;
+    };
+
     /// Protects all internal data structures.
-    OSMutex lock_;
+    Mutex lock_;
 
     /// Stores all known addresses and which port they route to.
     std::unordered_map<Address, Port *> addressRoutingTable_;
 
-    /// The per-port event information.
-    struct EventSet
-    {
-        /// key: number of bits set in the mask part. Valid values:
-        /// 0..64. Value of 0 means individual event.
-        std::map<uint8_t, std::set<EventId>> registeredConsumers_;
-    };
+    /// Inverted event index. key: number of bits set in the mask part. Valid
+    /// values: 0..64. Value of 0 means individual event. The inner map goes
+    /// from the base value of the event range to the ports that have a
+    /// consumer for it.
+    std::map<uint8_t, std::unordered_map<EventId, PortMask>> eventTables_;
+
+    /// Bit index of each port that registered an event.
+    std::unordered_map<Port *, unsigned> portIndex_;
+
+    /// Reverse of portIndex_. Free indexes hold nullptr.
+    std::vector<Port *> portByIndex_;
 
-    /// Stores per-port event information.
-    std::map<Port *, EventSet> eventRoutingTable_;
+    /// Ports that did not fit into the masks.
+    std::set<Port *> unindexedPorts_;
 };
 
 } // namespace openlcb
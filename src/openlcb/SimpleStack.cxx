@@ -58,18 +58,58 @@
 namespace openlcb
 {
 
+SimpleStackBase::SimpleStackBase(const CreateIfFunction &create_if)
+    : ifaceHolder_(create_if(&service_))
+{
+}
+
 SimpleCanStackBase::SimpleCanStackBase(const openlcb::NodeID node_id)
+    : SimpleStackBase([node_id](Service *service) {
+        return new CanPhysicalIf(service, node_id);
+    })
+{
+}
+
+SimpleCanStackBase::CanPhysicalIf::CanPhysicalIf(
+    Service *service, NodeID node_id)
+    : canHub0_(service)
+    , ifCan_(service->executor(), &canHub0_, config_local_alias_cache_size(),
+          config_remote_alias_cache_size(), config_local_nodes_count())
+    , datagramService_(&ifCan_, config_num_datagram_registry_entries(),
+          config_num_datagram_clients())
 {
     AddAliasAllocator(node_id, &ifCan_);
 }
 
 SimpleCanStack::SimpleCanStack(const openlcb::NodeID node_id)
     : SimpleCanStackBase(node_id)
-    , node_(&ifCan_, node_id)
+    , node_(iface(), node_id)
+{
+}
+
+SimpleTcpStackBase::SimpleTcpStackBase(const openlcb::NodeID node_id)
+    : SimpleStackBase([node_id](Service *service) {
+        return new TcpPhysicalIf(service, node_id);
+    })
+{
+}
+
+SimpleTcpStackBase::TcpPhysicalIf::TcpPhysicalIf(
+    Service *service, NodeID node_id)
+    : tcpHub_(service)
+    , ifTcp_(node_id, &tcpHub_, config_local_nodes_count())
+    , datagramService_(&ifTcp_, config_num_datagram_registry_entries(),
+          config_num_datagram_clients())
+{
+}
+
+SimpleTcpStack::SimpleTcpStack(const openlcb::NodeID node_id)
+    : SimpleTcpStackBase(node_id)
+    , node_(iface(), node_id)
 {
 }
 
-void SimpleCanStackBase::start_stack(bool delay_start)
+void SimpleStackBase::start_stack(bool delay_start)
 {
     // Opens the eeprom file and sends configuration update commands to all
     // listeners.
@@ -77,8 +117,7 @@ void SimpleCanStackBase::start_stack(bool delay_start)
     configUpdateFlow_.init_flow();
 
     if (!delay_start) {
-        // Bootstraps the alias allocation process.
-        ifCan_.alias_allocator()->send(ifCan_.alias_allocator()->alloc());
+        start_iface(false);
     }
 
     // Adds memory spaces.
@@ -94,7 +133,7 @@ void SimpleCanStackBase::start_stack(bool delay_start)
     start_node();
 }
 
-void SimpleCanStackBase::default_start_node()
+void SimpleStackBase::default_start_node()
 {
     {
         auto *space = new ReadOnlyMemoryBlock(
@@ -147,38 +186,47 @@ void SimpleTrainCanStack::start_node()
         &trainNode_, MemoryConfigDefs::SPACE_FDI, &fdiBlock_);
 }
 
-void SimpleCanStackBase::start_after_delay()
+void SimpleStackBase::start_after_delay()
 {
-    // Bootstraps the alias allocation process.
-    ifCan_.alias_allocator()->send(ifCan_.alias_allocator()->alloc());
+    start_iface(false);
 }
 
-void SimpleCanStackBase::restart_stack()
+void SimpleStackBase::restart_stack()
 {
     node()->clear_initialized();
-    ifCan_.alias_allocator()->reinit_seed();
-    ifCan_.local_aliases()->clear();
-    ifCan_.remote_aliases()->clear();
-    // Deletes all reserved aliases from the queue.
-    while (!ifCan_.alias_allocator()->reserved_aliases()->empty())
+    start_iface(true);
+    // Causes all nodes to send out node initialization done messages (on CAN
+    // after grabbing a new alias). This object owns itself and will do
+    // `delete this;` at the end of the process.
+    new ReinitAllNodes(iface());
+}
+
+void SimpleCanStackBase::start_iface(bool restart)
+{
+    IfCan *if_can = iface();
+    if (restart)
     {
-        Buffer<AliasInfo> *a = static_cast<Buffer<AliasInfo> *>(
-            ifCan_.alias_allocator()->reserved_aliases()->next().item);
-        if (a)
+        if_can->alias_allocator()->reinit_seed();
+        if_can->local_aliases()->clear();
+        if_can->remote_aliases()->clear();
+        // Deletes all reserved aliases from the queue.
+        while (!if_can->alias_allocator()->reserved_aliases()->empty())
         {
-            a->unref();
+            Buffer<AliasInfo> *a = static_cast<Buffer<AliasInfo> *>(
+                if_can->alias_allocator()->reserved_aliases()->next().item);
+            if (a)
+            {
+                a->unref();
+            }
         }
     }
 
-    // Bootstraps the fresh alias allocation process.
-    ifCan_.alias_allocator()->send(ifCan_.alias_allocator()->alloc());
-    // Causes all nodes to grab a new alias and send out node initialization
-    // done messages. This object owns itself and will do `delete this;` at the
-    // end of the process.
-    new ReinitAllNodes(&ifCan_);
+    // Bootstraps the alias allocation process.
+    if_can->alias_allocator()->reserve_aliases(
+        config_reserved_alias_pool_size());
 }
 
-int SimpleCanStackBase::create_config_file_if_needed(
+int SimpleStackBase::create_config_file_if_needed(
     const InternalConfigData &cfg, uint16_t expected_version,
     unsigned file_size)
 {
@@ -250,7 +298,7 @@ int SimpleCanStackBase::create_config_file_if_needed(
     return fd;
 }
 
-int SimpleCanStackBase::check_version_and_factory_reset(
+int SimpleStackBase::check_version_and_factory_reset(
     const InternalConfigData &cfg, uint16_t expected_version, bool force)
 {
     HASSERT(CONFIG_FILENAME);
@@ -284,7 +332,7 @@ int SimpleCanStackBase::check_version_and_factory_reset(
 /// defined by cdi.o for the linker.
 extern const uint16_t CDI_EVENT_OFFSETS[];
 
-void SimpleCanStackBase::factory_reset_all_events(
+void SimpleStackBase::factory_reset_all_events(
     const InternalConfigData &cfg, int fd)
 {
     // First we find the event count.
@@ -312,7 +360,7 @@ void SimpleCanStackBase::add_gridconnect_port(
     int fd = ::open(path, O_RDWR);
     HASSERT(fd >= 0);
     LOG(INFO, "Adding device %s as fd %d", path, fd);
-    create_gc_port_for_can_hub(&canHub0_, fd, on_exit);
+    create_gc_port_for_can_hub(can_hub(), fd, on_exit);
 }
 
 #if defined(__linux__) || defined(__MACH__)
@@ -322,7 +370,7 @@ void SimpleCanStackBase::add_gridconnect_tty(
     int fd = ::open(device, O_RDWR);
     HASSERT(fd >= 0);
     LOG(INFO, "Adding device %s as fd %d", device, fd);
-    create_gc_port_for_can_hub(&canHub0_, fd, on_exit);
+    create_gc_port_for_can_hub(can_hub(), fd, on_exit);
 
     HASSERT(!tcflush(fd, TCIOFLUSH));
     struct termios settings;
@@ -363,7 +411,7 @@ void SimpleCanStackBase::add_socketcan_port_select(
 
     bind(s, (struct sockaddr *)&addr, sizeof(addr));
 
-    auto *port = new HubDeviceSelect<CanHubFlow>(&canHub0_, s);
+    auto *port = new HubDeviceSelect<CanHubFlow>(can_hub(), s);
     additionalComponents_.emplace_back(port);
 }
 #endif
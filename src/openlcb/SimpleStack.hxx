@@ -37,15 +37,20 @@
 
 #include <fcntl.h>
 
+#include <functional>
+#include <memory>
+
 #include "executor/Executor.hxx"
 #include "openlcb/AliasAllocator.hxx"
 #include "openlcb/ConfigRepresentation.hxx"
 #include "openlcb/ConfigUpdateFlow.hxx"
 #include "openlcb/DatagramCan.hxx"
+#include "openlcb/DatagramTcp.hxx"
 #include "openlcb/DefaultNode.hxx"
 #include "openlcb/EventService.hxx"
 #include "openlcb/EventHandlerTemplates.hxx"
 #include "openlcb/IfCan.hxx"
+#include "openlcb/IfTcp.hxx"
 #include "openlcb/MemoryConfig.hxx"
 #include "openlcb/NodeInitializeFlow.hxx"
 #include "openlcb/ProtocolIdentification.hxx"
@@ -73,23 +78,55 @@ extern const char *const CONFIG_FILENAME;
 extern const size_t CONFIG_FILE_SIZE;
 
 /// Helper class for bringing up all components needed for a typical OpenLCB
-/// node.
+/// node. This base class contains the components that are independent of the
+/// wire protocol; the derived classes SimpleCanStackBase and
+/// SimpleTcpStackBase add the interface and the means to connect it to the
+/// bus.
 ///
-/// Usage: create a global variable of type SimpleCanStack with the node's
-/// NodeID as argument. For any additional components needed use the accessors
-/// (such as executor(), service(), or memory_config_handler()) to instantiate
-/// them. In the beginning of appl_main define how to access the bus, for
-/// example by add_can_port_async() or add_gridconnect_port() or
+/// Usage: create a global variable of type SimpleCanStack (or SimpleTcpStack)
+/// with the node's NodeID as argument. For any additional components needed
+/// use the accessors (such as executor(), service(), or
+/// memory_config_handler()) to instantiate them. In the beginning of
+/// appl_main define how to access the bus, for example by
+/// add_can_port_async() or add_gridconnect_port() or
 /// connect_tcp_gridconnect_hub(). At the end of appl_main start the stack's
 /// executor by calling either loop_executor() or start_executor_thread().
 ///
 /// Example: applications/async_blink/main.cxx
-class SimpleCanStackBase
+class SimpleStackBase
 {
 public:
     static const unsigned EXECUTOR_PRIORITIES = 5;
 
-    SimpleCanStackBase(const openlcb::NodeID node_id);
+    /// Wire protocol specific part of the stack: the OpenLCB interface and
+    /// the datagram service bound to it.
+    class PhysicalIf
+    {
+    public:
+        virtual ~PhysicalIf()
+        {
+        }
+
+        /// @return the OpenLCB interface.
+        virtual If *iface() = 0;
+
+        /// @return the datagram service bound to the interface.
+        virtual DatagramService *datagram_service() = 0;
+    };
+
+    /// Callback type to instantiate the wire protocol specific
+    /// components. Gets the stack's main service as argument.
+    typedef std::function<PhysicalIf *(Service *)> CreateIfFunction;
+
+    /// Constructor.
+    ///
+    /// @param create_if will be called once (from the constructor) to create
+    /// the interface of the stack.
+    SimpleStackBase(const CreateIfFunction &create_if);
+
+    virtual ~SimpleStackBase()
+    {
+    }
 
     /// @returns the executor that's controlling the main thread of the OpenLCB
     /// stack.
@@ -105,16 +142,16 @@ public:
     }
 
     /// @returns the openlcb Interface object.
-    IfCan *iface()
+    If *iface()
     {
-        return &ifCan_;
+        return ifaceHolder_->iface();
     }
 
     /// @returns the datagram service for registering new datagram handlers or
     /// acquiring datagram client objects.
     DatagramService *dg_service()
     {
-        return &datagramService_;
+        return ifaceHolder_->datagram_service();
     }
 
     /// Accessor for clients that have their custom SNIP-like handler.
@@ -123,15 +160,6 @@ public:
         return &infoFlow_;
     }
 
-    /// @returns the CanHubFlow to which this stack is talking to. This hub
-    /// flow usually has two members: the interface object from the software
-    /// stack and the hardware connection via which to connect to the physical
-    /// bus (which may be a device driver or a gridconnect protocol converter).
-    CanHubFlow *can_hub()
-    {
-        return &canHub0_;
-    }
-
     /// @returns the virtual node pointer of the main virtual node of the stack
     /// (as defined by the NodeID argument of the constructor).
     virtual Node *node() = 0;
@@ -143,13 +171,160 @@ public:
         return &memoryConfigHandler_;
     }
 
+    ConfigUpdateService *config_service()
+    {
+        return &configUpdateFlow_;
+    }
+
+    /// Reinitializes the node. Useful to call after the connection has flapped
+    /// (gone down and up).
+    void restart_stack();
+
+    /// Donates the current thread to the executor. Never returns.
+    /// @param delay_start if true, then prevents sending traffic to the bus
+    void loop_executor(bool delay_start = false)
+    {
+        start_stack(delay_start);
+        executor_.thread_body();
+    }
+
+    /// Call this function when you used delay_start upon starting the
+    /// executor.
+    void start_after_delay();
+
+    /// Instructs the executor to create a new thread and run in there.
+    /// @param name is the thread name for the executor thread
+    /// @param priority is the executor thread priority (used only for freertos)
+    /// @param stack_size is the executor stack in bytes (used only for
+    /// freertos)
+    /// @param delay_start if true, then prevents sending traffic to the bus
+    void start_executor_thread(
+        const char *name, int priority, size_t stack_size, bool delay_start = false)
+    {
+        start_stack(delay_start);
+        executor_.start_thread(name, priority, stack_size);
+    }
+
+    /// Tries to open the config file; if not existant, the size too small, or
+    /// the version number is mismatched, then creates a new file of the given
+    /// size with all 0xFF bytes inside. This will internally do everything
+    /// done by the check_version_and_factory_reset call.
+    ///
+    /// @param ofs tells where in the file the versioninfo structure lies.
+    ///
+    /// @param expected_verison is the correct version of the config file.
+    ///
+    /// @param file_size is the minimum required size of the config file.
+    ///
+    /// @return file descriptor for config file.
+    int create_config_file_if_needed(const InternalConfigData &ofs,
+        uint16_t expected_version, unsigned file_size);
+
+    /// Checks the version information in the EEPROM and performs a factory
+    /// reset if incorrect or if force is set.
+    /// @return file descriptor for config file.
+    int check_version_and_factory_reset(const InternalConfigData &ofs,
+        uint16_t expected_version, bool force = false);
+
+    /// Overwrites all events in the eeprom with a brand new event ID.
+    void factory_reset_all_events(const InternalConfigData &ofs, int fd);
+
+    /// Helper function to send an event report to the bus. Performs
+    /// synchronous (dynamic) memory allocation so use it sparingly and when
+    /// there is sufficient amount of RAM available.
+    /// @param event_id is the event to send off.
+    void send_event(uint64_t event_id)
+    {
+        auto *b = node()->iface()->global_message_write_flow()->alloc();
+        b->data()->reset(Defs::MTI_EVENT_REPORT, node()->node_id(),
+            eventid_to_buffer(event_id));
+        node()->iface()->global_message_write_flow()->send(b);
+    }
+
+    /// Sends an addressed message to the bus. Performs
+    /// synchronous (dynamic) memory allocation so use it sparingly and when
+    /// there is sufficient amount of RAM available.
+    /// @param mti is the message to send
+    /// @param dst is the node to send message to.
+    /// @param payload is the contents of the message
+    void send_message_to(
+        Defs::MTI mti, NodeHandle dst, const string &payload = EMPTY_PAYLOAD)
+    {
+        auto *b = node()->iface()->addressed_message_write_flow()->alloc();
+        b->data()->reset(mti, node()->node_id(), dst, payload);
+        node()->iface()->addressed_message_write_flow()->send(b);
+    }
+
+protected:
+    /// Call this function once after the actual IO ports are set up. Calling
+    /// before the executor starts looping is okay.
+    void start_stack(bool delay_start);
+
+    /// Hook for the wire protocol specific classes to start (or restart) the
+    /// interface.
+    ///
+    /// @param restart is false upon the first start, true when called from
+    /// restart_stack().
+    virtual void start_iface(bool restart) = 0;
+
+    /// Hook for clients to initialize the node-specific components.
+    virtual void start_node() = 0;
+
+    /// Exports the memory config spaces that are typically used for a complex
+    /// node. Expected to be called from start_node().
+    void default_start_node();
+
+    /// This executor's threads will be handled
+    Executor<EXECUTOR_PRIORITIES> executor_{NO_THREAD()};
+    /// Default service on the particular executor.
+    Service service_{&executor_};
+    /// Owns the interface and the datagram service.
+    std::unique_ptr<PhysicalIf> ifaceHolder_;
+    /// Calls the config listeners with the configuration FD.
+    ConfigUpdateFlow configUpdateFlow_{iface()};
+    /// The initialization flow takes care for node startup duties.
+    InitializeFlow initFlow_{&service_};
+    /// Dispatches event protocol requests to the event handlers.
+    EventService eventService_{iface()};
+    /// General flow for simple info requests.
+    SimpleInfoFlow infoFlow_{iface()};
+
+    MemoryConfigHandler memoryConfigHandler_{
+        dg_service(), nullptr, config_num_memory_spaces()};
+
+    /// Stores and keeps ownership of optional components.
+    std::vector<std::unique_ptr<Destructable>> additionalComponents_;
+};
+
+/// Stack base for nodes talking to a CAN bus, either directly via a CAN
+/// controller or via a gridconnect connection.
+class SimpleCanStackBase : public SimpleStackBase
+{
+public:
+    SimpleCanStackBase(const openlcb::NodeID node_id);
+
+    /// @returns the openlcb Interface object.
+    IfCan *iface()
+    {
+        return &can_physical_if()->ifCan_;
+    }
+
+    /// @returns the CanHubFlow to which this stack is talking to. This hub
+    /// flow usually has two members: the interface object from the software
+    /// stack and the hardware connection via which to connect to the physical
+    /// bus (which may be a device driver or a gridconnect protocol converter).
+    CanHubFlow *can_hub()
+    {
+        return &can_physical_if()->canHub0_;
+    }
+
     /// Adds a CAN bus port with synchronous driver API.
     void add_can_port_blocking(const char *device)
     {
         int can_fd = ::open(device, O_RDWR);
         HASSERT(can_fd >= 0);
         auto *port = new FdHubPort<CanHubFlow>(
-            &canHub0_, can_fd, EmptyNotifiable::DefaultInstance());
+            can_hub(), can_fd, EmptyNotifiable::DefaultInstance());
         additionalComponents_.emplace_back(port);
     }
 
@@ -160,14 +335,14 @@ public:
     /// asynchronous API, so they need add_can_port_select().
     void add_can_port_async(const char *device)
     {
-        auto *port = new HubDeviceNonBlock<CanHubFlow>(&canHub0_, device);
+        auto *port = new HubDeviceNonBlock<CanHubFlow>(can_hub(), device);
         additionalComponents_.emplace_back(port);
     }
 
     /// Adds a CAN bus port with select-based asynchronous driver API.
     void add_can_port_select(const char *device)
     {
-        auto *port = new HubDeviceSelect<CanHubFlow>(&canHub0_, device);
+        auto *port = new HubDeviceSelect<CanHubFlow>(can_hub(), device);
         additionalComponents_.emplace_back(port);
     }
 
@@ -176,7 +351,7 @@ public:
     /// @param on_error Notifiable to wakeup on error
     void add_can_port_select(int fd, Notifiable *on_error = nullptr)
     {
-        auto *port = new HubDeviceSelect<CanHubFlow>(&canHub0_, fd, on_error);
+        auto *port = new HubDeviceSelect<CanHubFlow>(can_hub(), fd, on_error);
         additionalComponents_.emplace_back(port);
     }
 #endif
@@ -209,7 +384,7 @@ public:
         /// @TODO (balazs.racz) make this more efficient by rendering to string
         /// only once for all connections.
         /// @TODO (balazs.racz) do not leak this.
-        new GcTcpHub(&canHub0_, port);
+        new GcTcpHub(can_hub(), port);
     }
 
     /// Connects to a CAN hub using TCP with the gridconnect protocol.
@@ -217,7 +392,7 @@ public:
     {
         int fd = ConnectSocket(host, port);
         HASSERT(fd >= 0);
-        create_gc_port_for_can_hub(&canHub0_, fd);
+        create_gc_port_for_can_hub(can_hub(), fd);
     }
 
     /// Causes all CAN packets to be printed to stdout.
@@ -240,139 +415,129 @@ public:
         {
             gcHub_.reset(new HubFlow(&service_));
             gcAdapter_.reset(GCAdapterBase::CreateGridConnectAdapter(
-                gcHub_.get(), &canHub0_, false));
+                gcHub_.get(), can_hub(), false));
         }
         return gcHub_.get();
     }
 
-    ConfigUpdateService *config_service()
+protected:
+    /// CAN-specific part of the stack.
+    struct CanPhysicalIf : public PhysicalIf
     {
-        return &configUpdateFlow_;
-    }
+        /// Constructor.
+        /// @param service is the stack's main service.
+        /// @param node_id is the node ID used for seeding the alias
+        /// allocator.
+        CanPhysicalIf(Service *service, NodeID node_id);
 
-    /// Reinitializes the node. Useful to call after the connection has flapped
-    /// (gone down and up).
-    void restart_stack();
+        If *iface() override
+        {
+            return &ifCan_;
+        }
 
-    /// Donates the current thread to the executor. Never returns.
-    /// @param delay_start if true, then prevents sending traffic to the bus
-    void loop_executor(bool delay_start = false)
+        DatagramService *datagram_service() override
+        {
+            return &datagramService_;
+        }
+
+        /// Abstract CAN bus in-memory.
+        CanHubFlow canHub0_;
+        /// NMRAnet interface for sending and receiving messages, formatting
+        /// them to the CAN bus port and maintaining the conversion flows,
+        /// caches etc.
+        IfCan ifCan_;
+        /// Datagram service with CAN fragmentation.
+        CanDatagramService datagramService_;
+    };
+
+    /// @return the CAN-specific part of the stack.
+    CanPhysicalIf *can_physical_if()
     {
-        start_stack(delay_start);
-        executor_.thread_body();
+        return static_cast<CanPhysicalIf *>(ifaceHolder_.get());
     }
 
-    /// Call this function when you used delay_start upon starting the
-    /// executor.
-    void start_after_delay();
+    void start_iface(bool restart) override;
 
-    /// Instructs the executor to create a new thread and run in there.
-    /// @param name is the thread name for the executor thread
-    /// @param priority is the executor thread priority (used only for freertos)
-    /// @param stack_size is the executor stack in bytes (used only for
-    /// freertos)
-    /// @param delay_start if true, then prevents sending traffic to the bus
-    void start_executor_thread(
-        const char *name, int priority, size_t stack_size, bool delay_start = false)
-    {
-        start_stack(delay_start);
-        executor_.start_thread(name, priority, stack_size);
-    }
+    /// All packets are forwarded to this hub in gridconnect format, if
+    /// needed. Will be initialized upon first use.
+    std::unique_ptr<HubFlow> gcHub_;
+    /// Bridge between canHub_ and gcHub_. Lazily initialized.
+    std::unique_ptr<GCAdapterBase> gcAdapter_;
+};
 
-    /// Tries to open the config file; if not existant, the size too small, or
-    /// the version number is mismatched, then creates a new file of the given
-    /// size with all 0xFF bytes inside. This will internally do everything
-    /// done by the check_version_and_factory_reset call.
-    ///
-    /// @param ofs tells where in the file the versioninfo structure lies.
-    ///
-    /// @param expected_verison is the correct version of the config file.
-    ///
-    /// @param file_size is the minimum required size of the config file.
-    ///
-    /// @return file descriptor for config file.
-    int create_config_file_if_needed(const InternalConfigData &ofs,
-        uint16_t expected_version, unsigned file_size);
+/// Stack base for nodes talking the OpenLCB-TCP protocol. Messages are sent
+/// with full node IDs and without fragmentation.
+class SimpleTcpStackBase : public SimpleStackBase
+{
+public:
+    SimpleTcpStackBase(const openlcb::NodeID node_id);
 
-    /// Checks the version information in the EEPROM and performs a factory
-    /// reset if incorrect or if force is set.
-    /// @return file descriptor for config file.
-    int check_version_and_factory_reset(const InternalConfigData &ofs,
-        uint16_t expected_version, bool force = false);
+    /// @returns the openlcb Interface object.
+    IfTcp *iface()
+    {
+        return &tcp_physical_if()->ifTcp_;
+    }
 
-    /// Overwrites all events in the eeprom with a brand new event ID.
-    void factory_reset_all_events(const InternalConfigData &ofs, int fd);
+    /// @returns the hub carrying the OpenLCB-TCP messages (one message per
+    /// buffer). Its members are the interface object and the connections.
+    HubFlow *tcp_hub()
+    {
+        return &tcp_physical_if()->tcpHub_;
+    }
 
-    /// Helper function to send an event report to the bus. Performs
-    /// synchronous (dynamic) memory allocation so use it sparingly and when
-    /// there is sufficient amount of RAM available.
-    /// @param event_id is the event to send off.
-    void send_event(uint64_t event_id)
+    /// Adds a select-compatible file descriptor (e.g. a TCP socket) talking
+    /// the OpenLCB-TCP protocol.
+    /// @param fd file descriptor to add to the hub
+    /// @param on_exit Notifiable to wakeup on error
+    void add_tcp_port_select(int fd, Notifiable *on_exit = nullptr)
     {
-        auto *b = node()->iface()->global_message_write_flow()->alloc();
-        b->data()->reset(Defs::MTI_EVENT_REPORT, node()->node_id(),
-            eventid_to_buffer(event_id));
-        node()->iface()->global_message_write_flow()->send(b);
+        create_tcp_port_for_hub(tcp_hub(), fd, on_exit);
     }
 
-    /// Sends an addressed message to the bus. Performs
-    /// synchronous (dynamic) memory allocation so use it sparingly and when
-    /// there is sufficient amount of RAM available.
-    /// @param mti is the message to send
-    /// @param dst is the node to send message to.
-    /// @param payload is the contents of the message
-    void send_message_to(
-        Defs::MTI mti, NodeHandle dst, const string &payload = EMPTY_PAYLOAD)
+    /// Connects to an OpenLCB-TCP hub.
+    void connect_tcp_hub(const char *host, int port)
     {
-        auto *b = node()->iface()->addressed_message_write_flow()->alloc();
-        b->data()->reset(mti, node()->node_id(), dst, payload);
-        node()->iface()->addressed_message_write_flow()->send(b);
+        int fd = ConnectSocket(host, port);
+        HASSERT(fd >= 0);
+        add_tcp_port_select(fd);
     }
 
 protected:
-    /// Call this function once after the actual IO ports are set up. Calling
-    /// before the executor starts looping is okay.
-    void start_stack(bool delay_start);
-
-    /// Hook for clients to initialize the node-specific components.
-    virtual void start_node() = 0;
+    /// TCP-specific part of the stack.
+    struct TcpPhysicalIf : public PhysicalIf
+    {
+        /// Constructor.
+        /// @param service is the stack's main service.
+        /// @param node_id is sent as the gateway node ID.
+        TcpPhysicalIf(Service *service, NodeID node_id);
 
-    /// Exports the memory config spaces that are typically used for a complex
-    /// node. Expected to be called from start_node().
-    void default_start_node();
+        If *iface() override
+        {
+            return &ifTcp_;
+        }
 
-    /// This executor's threads will be handled
-    Executor<EXECUTOR_PRIORITIES> executor_{NO_THREAD()};
-    /// Default service on the particular executor.
-    Service service_{&executor_};
-    /// Abstract CAN bus in-memory.
-    CanHubFlow canHub0_{&service_};
-    /// NMRAnet interface for sending and receiving messages, formatting them
-    /// to the CAN bus port and maintaining the conversion flows, caches etc.
-    IfCan ifCan_{&executor_, &canHub0_, config_local_alias_cache_size(),
-        config_remote_alias_cache_size(), config_local_nodes_count()};
-    /// Calls the config listeners with the configuration FD.
-    ConfigUpdateFlow configUpdateFlow_{&ifCan_};
-    /// The initialization flow takes care for node startup duties.
-    InitializeFlow initFlow_{&service_};
-    /// Dispatches event protocol requests to the event handlers.
-    EventService eventService_{&ifCan_};
-    /// General flow for simple info requests.
-    SimpleInfoFlow infoFlow_{&ifCan_};
+        DatagramService *datagram_service() override
+        {
+            return &datagramService_;
+        }
 
-    CanDatagramService datagramService_{&ifCan_,
-        config_num_datagram_registry_entries(), config_num_datagram_clients()};
-    MemoryConfigHandler memoryConfigHandler_{
-        &datagramService_, nullptr, config_num_memory_spaces()};
+        /// Hub of the OpenLCB-TCP messages.
+        HubFlow tcpHub_;
+        /// NMRAnet interface rendering and parsing the TCP messages.
+        IfTcp ifTcp_;
+        /// Datagram service for TCP.
+        TcpDatagramService datagramService_;
+    };
 
-    /// All packets are forwarded to this hub in gridconnect format, if
-    /// needed. Will be initialized upon first use.
-    std::unique_ptr<HubFlow> gcHub_;
-    /// Bridge between canHub_ and gcHub_. Lazily initialized.
-    std::unique_ptr<GCAdapterBase> gcAdapter_;
+    /// @return the TCP-specific part of the stack.
+    TcpPhysicalIf *tcp_physical_if()
+    {
+        return static_cast<TcpPhysicalIf *>(ifaceHolder_.get());
+    }
 
-    /// Stores and keeps ownership of optional components.
-    std::vector<std::unique_ptr<Destructable>> additionalComponents_;
+    void start_iface(bool restart) override
+    {
+    }
 };
 
 /// CAN-based stack with DefaultNode.
@@ -400,7 +565,35 @@ private:
     /// Handles PIP requests.
     ProtocolIdentificationHandler pipHandler_{&node_, PIP_RESPONSE};
     /// Handles SNIP requests.
-    SNIPHandler snipHandler_{&ifCan_, &node_, &infoFlow_};
+    SNIPHandler snipHandler_{iface(), &node_, &infoFlow_};
+};
+
+/// TCP-based stack with DefaultNode.
+class SimpleTcpStack : public SimpleTcpStackBase
+{
+public:
+    SimpleTcpStack(const openlcb::NodeID node_id);
+
+    /// @returns the virtual node pointer of the main virtual node of the stack
+    /// (as defined by the NodeID argument of the constructor).
+    Node *node() override
+    {
+        return &node_;
+    }
+
+private:
+    static const auto PIP_RESPONSE = Defs::EVENT_EXCHANGE | Defs::DATAGRAM |
+        Defs::MEMORY_CONFIGURATION | Defs::ABBREVIATED_DEFAULT_CDI |
+        Defs::SIMPLE_NODE_INFORMATION | Defs::CDI;
+
+    void start_node() override { default_start_node(); }
+
+    /// The actual node.
+    DefaultNode node_;
+    /// Handles PIP requests.
+    ProtocolIdentificationHandler pipHandler_{&node_, PIP_RESPONSE};
+    /// Handles SNIP requests.
+    SNIPHandler snipHandler_{iface(), &node_, &infoFlow_};
 };
 
 /// CAN-based stack with TrainNode.
@@ -429,7 +622,7 @@ private:
 
     void start_node() override;
 
-    TrainService tractionService_{&ifCan_};
+    TrainService tractionService_{iface()};
     /// The actual node.
     TrainNodeWithId trainNode_;
     FixedEventProducer<openlcb::TractionDefs::IS_TRAIN_EVENT>
@@ -438,7 +631,7 @@ private:
     /// Handles PIP requests.
     ProtocolIdentificationHandler pipHandler_{&trainNode_, PIP_RESPONSE};
     /// Handles SNIP requests.
-    SNIPHandler snipHandler_{&ifCan_, &trainNode_, &infoFlow_};
+    SNIPHandler snipHandler_{iface(), &trainNode_, &infoFlow_};
 };
 
 } // namespace openlcb
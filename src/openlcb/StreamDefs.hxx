@@ -40,6 +40,10 @@ namespace openlcb
 struct StreamDefs
 {
     static const uint16_t MAX_PAYLOAD = 0xffff;
+    /// Stream ID value that does not designate any stream. Used in the
+    /// initiate request when the destination stream ID is left to the
+    /// receiver.
+    static const uint8_t INVALID_STREAM_ID = 0xff;
 
     enum Flags
     {
@@ -72,6 +76,47 @@ struct StreamDefs
         return p;
     }
 
+    /// Creates an initiate request with a suggested destination stream ID.
+    static Payload create_initiate_request(uint16_t max_buffer_size,
+        bool has_ident, uint8_t src_stream_id, uint8_t dst_stream_id)
+    {
+        Payload p = create_initiate_request(
+            max_buffer_size, has_ident, src_stream_id);
+        p.push_back(dst_stream_id);
+        return p;
+    }
+
+    /// Creates the reply to an initiate request.
+    /// @param max_buffer_size is the negotiated window size.
+    /// @param src_stream_id is the source stream ID from the request.
+    /// @param dst_stream_id is the stream ID assigned by the receiver.
+    /// @param flags is FLAG_ACCEPT to accept the stream, or 0 /
+    /// FLAG_PERMANENT_ERROR to reject it with a temporary or permanent error.
+    /// @param additional_flags is one of the REJECT_* values when rejecting.
+    static Payload create_initiate_response(uint16_t max_buffer_size,
+        uint8_t src_stream_id, uint8_t dst_stream_id,
+        uint8_t flags = FLAG_ACCEPT, uint8_t additional_flags = 0)
+    {
+        Payload p(6, 0);
+        p[0] = max_buffer_size >> 8;
+        p[1] = max_buffer_size & 0xff;
+        p[2] = flags;
+        p[3] = additional_flags;
+        p[4] = src_stream_id;
+        p[5] = dst_stream_id;
+        return p;
+    }
+
+    /// Creates a data proceed message, granting the sender another window.
+    static Payload create_data_proceed(
+        uint8_t src_stream_id, uint8_t dst_stream_id)
+    {
+        Payload p(4, 0);
+        p[0] = src_stream_id;
+        p[1] = dst_stream_id;
+        return p;
+    }
+
     static Payload create_close_request(uint8_t src_stream_id, uint8_t dst_stream_id)
     {
         Payload p(2, 0);
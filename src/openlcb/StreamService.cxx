@@ -0,0 +1,618 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file StreamService.cxx
+ *
+ * Stream transport service: windowed stream sender and receiver flows on top
+ * of a generic OpenLCB interface.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+#include "openlcb/StreamService.hxx"
+
+#include "endian.h"
+
+namespace openlcb
+{
+
+long long STREAM_RESPONSE_TIMEOUT_NSEC = SEC_TO_NSEC(3);
+long long STREAM_RECEIVE_TIMEOUT_NSEC = SEC_TO_NSEC(3);
+
+/// Largest number of senders or receivers on one service. Stream ID 0xff is
+/// reserved as invalid.
+static constexpr unsigned MAX_STREAMS = StreamDefs::INVALID_STREAM_ID;
+
+/// Registered on the interface's dispatcher for all stream MTIs; forwards the
+/// incoming messages to the sender or receiver they belong to.
+class StreamService::IncomingMessageHandler : public IncomingMessageStateFlow
+{
+public:
+    IncomingMessageHandler(StreamService *service)
+        : IncomingMessageStateFlow(service->iface())
+        , streamService_(service)
+    {
+        for (auto mti : MTIS)
+        {
+            iface()->dispatcher()->register_handler(this, mti, Defs::MTI_EXACT);
+        }
+    }
+
+    ~IncomingMessageHandler()
+    {
+        iface()->dispatcher()->unregister_handler_all(this);
+    }
+
+private:
+    Action entry() override
+    {
+        if (!nmsg()->dstNode)
+        {
+            return release_and_exit();
+        }
+        const string &p = nmsg()->payload;
+        switch (nmsg()->mti)
+        {
+            case Defs::MTI_STREAM_INITIATE_REQUEST:
+            {
+                if (p.size() < 5)
+                {
+                    break;
+                }
+                for (StreamReceiver *r : streamService_->receivers_)
+                {
+                    if (r && r->is_listening(nmsg()))
+                    {
+                        r->initiate_request(nmsg());
+                        return release_and_exit();
+                    }
+                }
+                return allocate_and_call(
+                    iface()->addressed_message_write_flow(),
+                    STATE(send_reject));
+            }
+            case Defs::MTI_STREAM_INITIATE_REPLY:
+            {
+                StreamSender *s;
+                if (p.size() >= 6 && (s = sender((uint8_t)p[4])))
+                {
+                    s->initiate_reply(nmsg());
+                }
+                break;
+            }
+            case Defs::MTI_STREAM_PROCEED:
+            {
+                StreamSender *s;
+                if (p.size() >= 2 && (s = sender((uint8_t)p[0])))
+                {
+                    s->proceed(nmsg());
+                }
+                break;
+            }
+            case Defs::MTI_STREAM_DATA:
+            {
+                StreamReceiver *r;
+                if (p.size() >= 1 && (r = receiver((uint8_t)p[0])))
+                {
+                    r->data(nmsg());
+                }
+                break;
+            }
+            case Defs::MTI_STREAM_COMPLETE:
+            {
+                StreamReceiver *r;
+                if (p.size() >= 2 && (r = receiver((uint8_t)p[1])))
+                {
+                    r->complete(nmsg());
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        return release_and_exit();
+    }
+
+    /// Rejects an initiate request for which there is no listening receiver.
+    Action send_reject()
+    {
+        auto *b = get_allocation_result(iface()->addressed_message_write_flow());
+        const string &p = nmsg()->payload;
+        b->data()->reset(Defs::MTI_STREAM_INITIATE_REPLY,
+            nmsg()->dstNode->node_id(), nmsg()->src,
+            StreamDefs::create_initiate_response(0, p[4],
+                StreamDefs::INVALID_STREAM_ID, StreamDefs::FLAG_PERMANENT_ERROR,
+                StreamDefs::REJECT_PERMANENT_STREAMS_NOT_ACCEPTED));
+        iface()->addressed_message_write_flow()->send(b);
+        return release_and_exit();
+    }
+
+    /// @return the sender with a given stream ID if it is the destination of
+    /// the current message, otherwise nullptr.
+    StreamSender *sender(uint8_t id)
+    {
+        if (id >= streamService_->senders_.size())
+        {
+            return nullptr;
+        }
+        StreamSender *s = streamService_->senders_[id];
+        if (!s || s->node_ != nmsg()->dstNode)
+        {
+            return nullptr;
+        }
+        return s;
+    }
+
+    /// @return the receiver with a given stream ID if it is the destination of
+    /// the current message, otherwise nullptr.
+    StreamReceiver *receiver(uint8_t id)
+    {
+        if (id >= streamService_->receivers_.size())
+        {
+            return nullptr;
+        }
+        StreamReceiver *r = streamService_->receivers_[id];
+        if (!r || r->state_ == StreamReceiver::IDLE ||
+            r->request()->dst != nmsg()->dstNode)
+        {
+            return nullptr;
+        }
+        return r;
+    }
+
+    /// MTIs we are registered for.
+    static constexpr Defs::MTI MTIS[] = {Defs::MTI_STREAM_INITIATE_REQUEST,
+        Defs::MTI_STREAM_INITIATE_REPLY, Defs::MTI_STREAM_DATA,
+        Defs::MTI_STREAM_PROCEED, Defs::MTI_STREAM_COMPLETE};
+
+    /// Owning service.
+    StreamService *streamService_;
+};
+
+constexpr Defs::MTI StreamService::IncomingMessageHandler::MTIS[];
+constexpr uint16_t StreamService::DEFAULT_WINDOW;
+
+StreamService::StreamService(If *iface)
+    : Service(iface->executor())
+    , iface_(iface)
+    , handler_(new IncomingMessageHandler(this))
+{
+}
+
+StreamService::~StreamService()
+{
+}
+
+/// Finds a free slot in a stream ID table. @return the index of the slot.
+template <class T> static uint8_t allocate_stream_id(std::vector<T *> *v, T *t)
+{
+    for (unsigned i = 0; i < v->size(); ++i)
+    {
+        if (!(*v)[i])
+        {
+            (*v)[i] = t;
+            return i;
+        }
+    }
+    HASSERT(v->size() < MAX_STREAMS);
+    v->push_back(t);
+    return v->size() - 1;
+}
+
+uint8_t StreamService::register_sender(StreamSender *sender)
+{
+    return allocate_stream_id(&senders_, sender);
+}
+
+void StreamService::unregister_sender(uint8_t id)
+{
+    senders_[id] = nullptr;
+}
+
+uint8_t StreamService::register_receiver(StreamReceiver *receiver)
+{
+    return allocate_stream_id(&receivers_, receiver);
+}
+
+void StreamService::unregister_receiver(uint8_t id)
+{
+    receivers_[id] = nullptr;
+}
+
+StreamSender::StreamSender(StreamService *service)
+    : CallableFlow<StreamSenderRequest>(service)
+    , srcStreamId_(service->register_sender(this))
+{
+}
+
+StreamSender::~StreamSender()
+{
+    stream_service()->unregister_sender(srcStreamId_);
+}
+
+StateFlowBase::Action StreamSender::entry()
+{
+    switch (request()->cmd)
+    {
+        case StreamSenderRequest::CMD_START:
+            if (state_ != IDLE || !request()->window)
+            {
+                return return_with_error(Defs::ERROR_INVALID_ARGS);
+            }
+            node_ = request()->src;
+            dst_ = request()->dst;
+            window_ = request()->window;
+            dstStreamId_ = request()->dstStreamId;
+            totalSent_ = 0;
+            credit_ = 0;
+            errorCode_ = 0;
+            state_ = INITIATING;
+            return allocate_and_call(
+                stream_service()->iface()->addressed_message_write_flow(),
+                STATE(send_initiate));
+        case StreamSenderRequest::CMD_SEND:
+            if (state_ != OPEN)
+            {
+                return return_with_error(Defs::ERROR_OUT_OF_ORDER);
+            }
+            data_ = request()->data;
+            remaining_ = request()->size;
+            return call_immediately(STATE(send_more));
+        case StreamSenderRequest::CMD_CLOSE:
+            if (state_ != OPEN)
+            {
+                return return_with_error(Defs::ERROR_OUT_OF_ORDER);
+            }
+            return allocate_and_call(
+                stream_service()->iface()->addressed_message_write_flow(),
+                STATE(send_close));
+        default:
+            break;
+    }
+    return return_with_error(Defs::ERROR_UNIMPLEMENTED_SUBCMD);
+}
+
+StateFlowBase::Action StreamSender::send_initiate()
+{
+    auto *b = get_allocation_result(
+        stream_service()->iface()->addressed_message_write_flow());
+    b->data()->reset(Defs::MTI_STREAM_INITIATE_REQUEST, node_->node_id(), dst_,
+        dstStreamId_ == StreamDefs::INVALID_STREAM_ID
+            ? StreamDefs::create_initiate_request(window_, false, srcStreamId_)
+            : StreamDefs::create_initiate_request(
+                  window_, false, srcStreamId_, dstStreamId_));
+    stream_service()->iface()->addressed_message_write_flow()->send(b);
+    return sleep_and_call(
+        &timer_, STREAM_RESPONSE_TIMEOUT_NSEC, STATE(initiate_done));
+}
+
+void StreamSender::initiate_reply(const GenMessage *m)
+{
+    if (state_ != INITIATING)
+    {
+        return;
+    }
+    const uint8_t *p = (const uint8_t *)m->payload.data();
+    if (!(p[2] & StreamDefs::FLAG_ACCEPT))
+    {
+        errorCode_ = (p[2] & StreamDefs::FLAG_PERMANENT_ERROR
+                             ? Defs::ERROR_PERMANENT
+                             : Defs::ERROR_TEMPORARY) |
+            p[3];
+        state_ = IDLE;
+    }
+    else
+    {
+        uint16_t window = (p[0] << 8) | p[1];
+        if (window && window < window_)
+        {
+            window_ = window;
+        }
+        dstStreamId_ = p[5];
+        // Stream data messages are rendered into 7-byte CAN frames; we keep
+        // the messages at half a window so that the receiver can grant the
+        // next window while the rest is still on the wire.
+        maxChunk_ = window_ > 1 ? window_ / 2 : 1;
+        if (maxChunk_ > 7)
+        {
+            maxChunk_ -= maxChunk_ % 7;
+        }
+        credit_ = window_;
+        state_ = OPEN;
+    }
+    timer_.ensure_triggered();
+}
+
+StateFlowBase::Action StreamSender::initiate_done()
+{
+    if (state_ == INITIATING)
+    {
+        state_ = IDLE;
+        return return_with_error(Defs::ERROR_OPENLCB_TIMEOUT);
+    }
+    if (state_ != OPEN)
+    {
+        return return_with_error(errorCode_);
+    }
+    request()->window = window_;
+    request()->dstStreamId = dstStreamId_;
+    return return_ok();
+}
+
+StateFlowBase::Action StreamSender::send_more()
+{
+    if (!remaining_)
+    {
+        return return_ok();
+    }
+    if (!credit_)
+    {
+        return sleep_and_call(
+            &timer_, STREAM_RESPONSE_TIMEOUT_NSEC, STATE(proceed_wait_done));
+    }
+    return allocate_and_call(
+        stream_service()->iface()->addressed_message_write_flow(),
+        STATE(send_data));
+}
+
+StateFlowBase::Action StreamSender::send_data()
+{
+    auto *b = get_allocation_result(
+        stream_service()->iface()->addressed_message_write_flow());
+    size_t len = remaining_;
+    if (len > credit_)
+    {
+        len = credit_;
+    }
+    if (len > maxChunk_)
+    {
+        len = maxChunk_;
+    }
+    b->data()->reset(
+        Defs::MTI_STREAM_DATA, node_->node_id(), dst_, EMPTY_PAYLOAD);
+    string &p = b->data()->payload;
+    p.reserve(len + 1);
+    p.push_back(dstStreamId_);
+    p.append((const char *)data_, len);
+    stream_service()->iface()->addressed_message_write_flow()->send(b);
+    data_ += len;
+    remaining_ -= len;
+    credit_ -= len;
+    totalSent_ += len;
+    return call_immediately(STATE(send_more));
+}
+
+void StreamSender::proceed(const GenMessage *m)
+{
+    if (state_ != OPEN)
+    {
+        return;
+    }
+    credit_ += window_;
+    timer_.ensure_triggered();
+}
+
+StateFlowBase::Action StreamSender::proceed_wait_done()
+{
+    if (!credit_)
+    {
+        return return_with_error(Defs::ERROR_OPENLCB_TIMEOUT);
+    }
+    return call_immediately(STATE(send_more));
+}
+
+StateFlowBase::Action StreamSender::send_close()
+{
+    auto *b = get_allocation_result(
+        stream_service()->iface()->addressed_message_write_flow());
+    Payload p = StreamDefs::create_close_request(srcStreamId_, dstStreamId_);
+    uint32_t total = htobe32(totalSent_);
+    p.append((const char *)&total, 4);
+    b->data()->reset(
+        Defs::MTI_STREAM_COMPLETE, node_->node_id(), dst_, std::move(p));
+    stream_service()->iface()->addressed_message_write_flow()->send(b);
+    state_ = IDLE;
+    return return_ok();
+}
+
+StreamReceiver::StreamReceiver(StreamService *service)
+    : CallableFlow<StreamReceiverRequest>(service)
+    , dstStreamId_(service->register_receiver(this))
+{
+}
+
+StreamReceiver::~StreamReceiver()
+{
+    stream_service()->unregister_receiver(dstStreamId_);
+}
+
+StateFlowBase::Action StreamReceiver::entry()
+{
+    if (!request()->window)
+    {
+        return return_with_error(Defs::ERROR_INVALID_ARGS);
+    }
+    received_ = 0;
+    granted_ = 0;
+    errorCode_ = 0;
+    pendingProceeds_ = 0;
+    state_ = LISTENING;
+    return call_immediately(STATE(wait_for_event));
+}
+
+StateFlowBase::Action StreamReceiver::wait_for_event()
+{
+    if (has_work())
+    {
+        return call_immediately(STATE(process_event));
+    }
+    progressMark_ = received_;
+    return sleep_and_call(
+        &timer_, STREAM_RECEIVE_TIMEOUT_NSEC, STATE(timeout_or_event));
+}
+
+StateFlowBase::Action StreamReceiver::timeout_or_event()
+{
+    if (!timer_.is_triggered() && !has_work())
+    {
+        if (received_ != progressMark_)
+        {
+            // Data is still flowing; keeps waiting.
+            return call_immediately(STATE(wait_for_event));
+        }
+        errorCode_ = Defs::ERROR_OPENLCB_TIMEOUT;
+    }
+    return call_immediately(STATE(process_event));
+}
+
+StateFlowBase::Action StreamReceiver::process_event()
+{
+    if (state_ == ACCEPTING)
+    {
+        return allocate_and_call(
+            stream_service()->iface()->addressed_message_write_flow(),
+            STATE(send_initiate_reply));
+    }
+    if (pendingProceeds_ && !errorCode_ && state_ == OPEN)
+    {
+        return allocate_and_call(
+            stream_service()->iface()->addressed_message_write_flow(),
+            STATE(send_proceed));
+    }
+    if (errorCode_ || state_ == CLOSED)
+    {
+        state_ = IDLE;
+        request()->received = received_;
+        return return_with_error(errorCode_);
+    }
+    return call_immediately(STATE(wait_for_event));
+}
+
+bool StreamReceiver::is_listening(const GenMessage *m)
+{
+    if (state_ != LISTENING || m->dstNode != request()->dst)
+    {
+        return false;
+    }
+    const uint8_t *p = (const uint8_t *)m->payload.data();
+    if (m->payload.size() >= 6 && p[5] != StreamDefs::INVALID_STREAM_ID &&
+        p[5] != dstStreamId_)
+    {
+        return false;
+    }
+    const NodeHandle &filter = request()->src;
+    return (!filter.id && !filter.alias) ||
+        stream_service()->iface()->matching_node(filter, m->src);
+}
+
+void StreamReceiver::initiate_request(const GenMessage *m)
+{
+    const uint8_t *p = (const uint8_t *)m->payload.data();
+    src_ = m->src;
+    srcStreamId_ = p[4];
+    window_ = (p[0] << 8) | p[1];
+    if (!window_ || window_ > request()->window)
+    {
+        window_ = request()->window;
+    }
+    granted_ = window_;
+    state_ = ACCEPTING;
+    wakeup();
+}
+
+StateFlowBase::Action StreamReceiver::send_initiate_reply()
+{
+    auto *b = get_allocation_result(
+        stream_service()->iface()->addressed_message_write_flow());
+    b->data()->reset(Defs::MTI_STREAM_INITIATE_REPLY,
+        request()->dst->node_id(), src_,
+        StreamDefs::create_initiate_response(
+            window_, srcStreamId_, dstStreamId_));
+    stream_service()->iface()->addressed_message_write_flow()->send(b);
+    state_ = OPEN;
+    return call_immediately(STATE(wait_for_event));
+}
+
+void StreamReceiver::data(const GenMessage *m)
+{
+    if (state_ != OPEN || errorCode_)
+    {
+        return;
+    }
+    size_t len = m->payload.size() - 1;
+    if (received_ + len > request()->size)
+    {
+        errorCode_ = Defs::ERROR_INVALID_ARGS;
+        len = request()->size - received_;
+    }
+    memcpy(request()->data + received_, m->payload.data() + 1, len);
+    received_ += len;
+    // Grants the next window when half of the outstanding one has arrived,
+    // provided the caller's buffer has room for it.
+    while (granted_ - received_ <= window_ / 2 && granted_ < request()->size)
+    {
+        granted_ += window_;
+        ++pendingProceeds_;
+    }
+    if (has_work())
+    {
+        wakeup();
+    }
+}
+
+void StreamReceiver::complete(const GenMessage *m)
+{
+    if (state_ != OPEN)
+    {
+        return;
+    }
+    if (m->payload.size() >= 6 && !errorCode_)
+    {
+        uint32_t total;
+        memcpy(&total, m->payload.data() + 2, 4);
+        if (be32toh(total) != received_)
+        {
+            // Some data was lost.
+            errorCode_ = Defs::ERROR_OUT_OF_ORDER;
+        }
+    }
+    state_ = CLOSED;
+    wakeup();
+}
+
+StateFlowBase::Action StreamReceiver::send_proceed()
+{
+    auto *b = get_allocation_result(
+        stream_service()->iface()->addressed_message_write_flow());
+    b->data()->reset(Defs::MTI_STREAM_PROCEED, request()->dst->node_id(), src_,
+        StreamDefs::create_data_proceed(srcStreamId_, dstStreamId_));
+    stream_service()->iface()->addressed_message_write_flow()->send(b);
+    --pendingProceeds_;
+    return call_immediately(STATE(wait_for_event));
+}
+
+} // namespace openlcb
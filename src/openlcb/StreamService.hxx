@@ -0,0 +1,437 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file StreamService.hxx
+ *
+ * Stream transport service: windowed stream sender and receiver flows on top
+ * of a generic OpenLCB interface.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+#ifndef _OPENLCB_STREAMSERVICE_HXX_
+#define _OPENLCB_STREAMSERVICE_HXX_
+
+#include <memory>
+#include <vector>
+
+#include "executor/CallableFlow.hxx"
+#include "openlcb/If.hxx"
+#include "openlcb/StreamDefs.hxx"
+
+namespace openlcb
+{
+
+/// How long a stream sender waits for the initiate reply or for a proceed
+/// message before giving up.
+extern long long STREAM_RESPONSE_TIMEOUT_NSEC;
+/// How long a stream receiver waits for the next message from the sender
+/// (initiate request, data or complete) before giving up.
+extern long long STREAM_RECEIVE_TIMEOUT_NSEC;
+
+class StreamSender;
+class StreamReceiver;
+
+/// Routes incoming stream messages of an interface to the local stream
+/// senders and receivers. Each sender and receiver gets a fixed local stream
+/// ID when it is created; the incoming messages are dispatched by that ID, so
+/// routing a data message is a table lookup.
+class StreamService : public Service
+{
+public:
+    /// Constructor. @param iface is the interface to send and receive stream
+    /// messages on.
+    StreamService(If *iface);
+    ~StreamService();
+
+    /// @return the interface this service is operating on.
+    If *iface()
+    {
+        return iface_;
+    }
+
+    /// Default window (stream buffer size) offered by senders and receivers.
+    static constexpr uint16_t DEFAULT_WINDOW = 1024;
+
+private:
+    friend class StreamSender;
+    friend class StreamReceiver;
+
+    class IncomingMessageHandler;
+
+    /// Allocates a local stream ID for a sender. @return the stream ID.
+    uint8_t register_sender(StreamSender *sender);
+    /// Releases the stream ID of a sender.
+    void unregister_sender(uint8_t id);
+    /// Allocates a local stream ID for a receiver. @return the stream ID.
+    uint8_t register_receiver(StreamReceiver *receiver);
+    /// Releases the stream ID of a receiver.
+    void unregister_receiver(uint8_t id);
+
+    /// Interface we are registered on.
+    If *iface_;
+    /// Senders by source stream ID. Free slots are nullptr.
+    std::vector<StreamSender *> senders_;
+    /// Receivers by destination stream ID. Free slots are nullptr.
+    std::vector<StreamReceiver *> receivers_;
+    /// Dispatches the incoming stream messages.
+    std::unique_ptr<IncomingMessageHandler> handler_;
+};
+
+/// Request structure for the StreamSender flow.
+struct StreamSenderRequest : public CallableFlowRequestBase
+{
+    enum StartCmd
+    {
+        START
+    };
+
+    enum SendCmd
+    {
+        SEND
+    };
+
+    enum CloseCmd
+    {
+        CLOSE
+    };
+
+    /// Sets up a command to open a stream to a remote node.
+    /// @param StartCmd polymorphic matching arg; always set to START.
+    /// @param node is the local node to send the stream from.
+    /// @param d is the destination node.
+    /// @param max_window is the largest window (stream buffer size) we would
+    /// like to use. The receiver may negotiate it down.
+    /// @param dst_stream_id is the stream ID to suggest to the receiver, or
+    /// INVALID_STREAM_ID to let the receiver pick one.
+    void reset(StartCmd, Node *node, NodeHandle d,
+        uint16_t max_window = StreamService::DEFAULT_WINDOW,
+        uint8_t dst_stream_id = StreamDefs::INVALID_STREAM_ID)
+    {
+        reset_base();
+        cmd = CMD_START;
+        src = node;
+        dst = d;
+        window = max_window;
+        dstStreamId = dst_stream_id;
+    }
+
+    /// Sets up a command to send data on an open stream. The data is not
+    /// copied into the request; the caller has to keep it alive until the
+    /// request is returned.
+    /// @param SendCmd polymorphic matching arg; always set to SEND.
+    /// @param d is the data to send.
+    /// @param len is the number of bytes to send.
+    void reset(SendCmd, const void *d, size_t len)
+    {
+        reset_base();
+        cmd = CMD_SEND;
+        data = static_cast<const uint8_t *>(d);
+        size = len;
+        payload.clear();
+    }
+
+    /// Sets up a command to send data on an open stream, handing over the
+    /// ownership of the data to the request.
+    /// @param SendCmd polymorphic matching arg; always set to SEND.
+    /// @param d is the data to send.
+    void reset(SendCmd, string d)
+    {
+        reset_base();
+        cmd = CMD_SEND;
+        payload = std::move(d);
+        data = reinterpret_cast<const uint8_t *>(payload.data());
+        size = payload.size();
+    }
+
+    /// Sets up a command to close the open stream.
+    /// @param CloseCmd polymorphic matching arg; always set to CLOSE.
+    void reset(CloseCmd)
+    {
+        reset_base();
+        cmd = CMD_CLOSE;
+    }
+
+    enum Command : uint8_t
+    {
+        CMD_START,
+        CMD_SEND,
+        CMD_CLOSE,
+    };
+    Command cmd;
+    /// Suggested destination stream ID for START.
+    uint8_t dstStreamId;
+    /// Window size. For START this is the requested maximum; upon return it
+    /// contains the negotiated window.
+    uint16_t window;
+    /// Local node to send the stream from.
+    Node *src;
+    /// Node to send the stream to.
+    NodeHandle dst;
+    /// Data to send (SEND).
+    const uint8_t *data;
+    /// Number of bytes to send (SEND).
+    size_t size;
+    /// Owns the data to send when the caller handed it over.
+    string payload;
+};
+
+/// Flow that sends a stream to a remote (or local) node. The caller opens the
+/// stream with a START request, then feeds data with any number of SEND
+/// requests, then finishes with CLOSE. Data is cut into stream data messages
+/// directly from the caller's memory; the amount of data in flight is limited
+/// by the window that the receiver granted via proceed messages.
+class StreamSender : public CallableFlow<StreamSenderRequest>
+{
+public:
+    /// Constructor. @param service is the stream service to use.
+    StreamSender(StreamService *service);
+    ~StreamSender();
+
+    /// @return the local (source) stream ID of this sender.
+    uint8_t src_stream_id()
+    {
+        return srcStreamId_;
+    }
+
+    /// @return the total number of bytes sent on the current stream.
+    size_t total_sent()
+    {
+        return totalSent_;
+    }
+
+private:
+    friend class StreamService::IncomingMessageHandler;
+
+    Action entry() override;
+    Action send_initiate();
+    Action initiate_done();
+    Action send_more();
+    Action send_data();
+    Action proceed_wait_done();
+    Action send_close();
+
+    /// Called by the service when an initiate reply arrives for us.
+    void initiate_reply(const GenMessage *m);
+    /// Called by the service when a proceed message arrives for us.
+    void proceed(const GenMessage *m);
+
+    StreamService *stream_service()
+    {
+        return static_cast<StreamService *>(service());
+    }
+
+    enum State : uint8_t
+    {
+        /// No stream open.
+        IDLE,
+        /// Waiting for the initiate reply.
+        INITIATING,
+        /// Stream open, data may be sent.
+        OPEN,
+    };
+
+    /// Helper for the timeouts.
+    StateFlowTimer timer_{this};
+    /// Local node sending the stream.
+    Node *node_{nullptr};
+    /// Destination of the stream.
+    NodeHandle dst_;
+    /// Bytes of the current SEND request that are not yet sent.
+    const uint8_t *data_;
+    /// Number of bytes at data_.
+    size_t remaining_{0};
+    /// Total bytes sent on this stream.
+    size_t totalSent_{0};
+    /// Number of bytes we are allowed to send before the next proceed.
+    uint32_t credit_{0};
+    /// Negotiated window.
+    uint16_t window_{0};
+    /// Largest stream data message we generate.
+    uint16_t maxChunk_{0};
+    /// Error code from the initiate reply.
+    uint16_t errorCode_{0};
+    /// Our stream ID.
+    uint8_t srcStreamId_;
+    /// Stream ID at the receiver.
+    uint8_t dstStreamId_{StreamDefs::INVALID_STREAM_ID};
+    /// One of the State values.
+    State state_{IDLE};
+};
+
+/// Request structure for the StreamReceiver flow.
+struct StreamReceiverRequest : public CallableFlowRequestBase
+{
+    /// Sets up a command to receive a stream.
+    /// @param node is the local node that will accept the stream.
+    /// @param d is the memory to write the incoming data to. Must stay alive
+    /// until the request is returned.
+    /// @param len is the number of bytes available at d.
+    /// @param s is the node the stream is expected from. If empty, the stream
+    /// will be accepted from any node.
+    /// @param max_window is the largest window we offer to the sender.
+    void reset(Node *node, void *d, size_t len, NodeHandle s = NodeHandle(),
+        uint16_t max_window = StreamService::DEFAULT_WINDOW)
+    {
+        reset_base();
+        dst = node;
+        data = static_cast<uint8_t *>(d);
+        size = len;
+        src = s;
+        window = max_window;
+        received = 0;
+    }
+
+    /// Local node receiving the stream.
+    Node *dst;
+    /// Filter for the stream source.
+    NodeHandle src;
+    /// Caller's memory.
+    uint8_t *data;
+    /// Capacity at data.
+    size_t size;
+    /// Largest window to offer.
+    uint16_t window;
+    /// Upon return: number of bytes written to data.
+    size_t received;
+};
+
+/// Flow that receives a stream into caller-supplied memory. Invoking the flow
+/// starts listening for an initiate request on the given node; the flow
+/// returns when the stream is completed by the sender, or an error or timeout
+/// happens. The incoming data is copied straight from the incoming messages to
+/// the caller's buffer. Proceed messages are sent when half of the granted
+/// window has arrived, so the sender never has to stop while the data is
+/// flowing.
+class StreamReceiver : public CallableFlow<StreamReceiverRequest>
+{
+public:
+    /// Constructor. @param service is the stream service to use.
+    StreamReceiver(StreamService *service);
+    ~StreamReceiver();
+
+    /// @return the local (destination) stream ID of this receiver.
+    uint8_t dst_stream_id()
+    {
+        return dstStreamId_;
+    }
+
+    /// Aborts the current receive operation. Used when the sender told us via
+    /// another protocol that the stream is not coming. The flow returns with
+    /// the given error code. Must be called on the service's executor.
+    /// @param error is the error code to return to the caller.
+    void cancel(uint16_t error)
+    {
+        if (state_ == IDLE || errorCode_)
+        {
+            return;
+        }
+        errorCode_ = error;
+        wakeup();
+    }
+
+private:
+    friend class StreamService::IncomingMessageHandler;
+
+    Action entry() override;
+    Action wait_for_event();
+    Action timeout_or_event();
+    Action process_event();
+    Action send_initiate_reply();
+    Action send_proceed();
+
+    /// @return true if the receiver is waiting for an initiate request that
+    /// matches m. An initiate request that suggests a destination stream ID
+    /// only matches the receiver with that ID.
+    bool is_listening(const GenMessage *m);
+    /// Called by the service when an initiate request is accepted by us.
+    void initiate_request(const GenMessage *m);
+    /// Called by the service when a stream data message arrives for us.
+    void data(const GenMessage *m);
+    /// Called by the service when a stream complete message arrives for us.
+    void complete(const GenMessage *m);
+
+    /// @return true if there is something for the flow to do.
+    bool has_work()
+    {
+        return errorCode_ || pendingProceeds_ || state_ == ACCEPTING ||
+            state_ == CLOSED;
+    }
+
+    /// Wakes up the flow if it is waiting.
+    void wakeup()
+    {
+        timer_.ensure_triggered();
+    }
+
+    StreamService *stream_service()
+    {
+        return static_cast<StreamService *>(service());
+    }
+
+    enum State : uint8_t
+    {
+        /// Not receiving.
+        IDLE,
+        /// Waiting for an initiate request.
+        LISTENING,
+        /// Initiate request arrived, reply not sent yet.
+        ACCEPTING,
+        /// Data is flowing.
+        OPEN,
+        /// Complete message arrived.
+        CLOSED,
+    };
+
+    /// Helper for the timeouts.
+    StateFlowTimer timer_{this};
+    /// Sender of the stream.
+    NodeHandle src_;
+    /// Total bytes received.
+    size_t received_{0};
+    /// Total bytes the sender is allowed to send (sum of granted windows).
+    size_t granted_{0};
+    /// Value of received_ when the flow last went to sleep. Used to tell an
+    /// idle stream from one that is making progress.
+    size_t progressMark_{0};
+    /// Negotiated window.
+    uint16_t window_{0};
+    /// Error to return to the caller.
+    uint16_t errorCode_{0};
+    /// Number of proceed messages we owe the sender.
+    uint8_t pendingProceeds_{0};
+    /// Stream ID at the sender.
+    uint8_t srcStreamId_{StreamDefs::INVALID_STREAM_ID};
+    /// Our stream ID.
+    uint8_t dstStreamId_;
+    /// One of the State values.
+    State state_{IDLE};
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_STREAMSERVICE_HXX_
@@ -0,0 +1,222 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file TcpCanGateway.cxx
+ *
+ * Gateway between the OpenLCB-TCP and the CAN interfaces.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#include "openlcb/TcpCanGateway.hxx"
+
+#include "openlcb/TcpDefs.hxx"
+
+namespace openlcb
+{
+
+/// Listens to all messages arriving on the CAN interface and forwards the
+/// relevant ones to the TCP hub.
+class TcpCanGateway::CanToTcp : public MessageHandler
+{
+public:
+    /// Constructor. @param parent is the gateway owning *this.
+    CanToTcp(TcpCanGateway *parent)
+        : parent_(parent)
+    {
+        parent_->ifCan_->dispatcher()->register_handler(this, 0, 0);
+    }
+
+    ~CanToTcp()
+    {
+        parent_->ifCan_->dispatcher()->unregister_handler(this, 0, 0);
+    }
+
+    void send(Buffer<GenMessage> *message, unsigned priority) override;
+
+private:
+    /// Gateway owning *this.
+    TcpCanGateway *parent_;
+};
+
+/// Port on the TCP hub that sends the incoming messages to the CAN
+/// interface.
+class TcpCanGateway::TcpToCan : public HubPort
+{
+public:
+    /// Constructor. @param parent is the gateway owning *this.
+    TcpToCan(TcpCanGateway *parent)
+        : HubPort(parent->ifCan_)
+        , parent_(parent)
+    {
+        parent_->tcpHub_->register_port(this);
+    }
+
+    ~TcpToCan()
+    {
+        parent_->tcpHub_->unregister_port(this);
+    }
+
+private:
+    Action entry() override
+    {
+        bool valid = TcpDefs::parse_tcp_message(*message()->data(), &msg_);
+        release();
+        if (!valid)
+        {
+            return exit();
+        }
+        parent_->tcpNodes_.insert(msg_.src.id);
+        if (!Defs::get_mti_address(msg_.mti))
+        {
+            return allocate_and_call(
+                parent_->ifCan_->global_message_write_flow(),
+                STATE(send_global));
+        }
+        if (parent_->is_tcp_node(msg_.dst.id))
+        {
+            // Traffic between two TCP nodes.
+            return exit();
+        }
+        if (msg_.mti == Defs::MTI_DATAGRAM)
+        {
+            return allocate_and_call(STATE(got_dg_client),
+                parent_->canDatagram_->client_allocator());
+        }
+        return allocate_and_call(
+            parent_->ifCan_->addressed_message_write_flow(),
+            STATE(send_addressed));
+    }
+
+    /// Sends a global message to the CAN bus.
+    Action send_global()
+    {
+        auto *flow = parent_->ifCan_->global_message_write_flow();
+        auto *b = get_allocation_result(flow);
+        b->data()->reset(msg_.mti, msg_.src.id, EMPTY_PAYLOAD);
+        b->data()->payload.swap(msg_.payload);
+        flow->send(b);
+        return exit();
+    }
+
+    /// Sends an addressed message to the CAN bus.
+    Action send_addressed()
+    {
+        auto *flow = parent_->ifCan_->addressed_message_write_flow();
+        auto *b = get_allocation_result(flow);
+        b->data()->reset(msg_.mti, msg_.src.id, msg_.dst, EMPTY_PAYLOAD);
+        b->data()->payload.swap(msg_.payload);
+        flow->send(b);
+        return exit();
+    }
+
+    /// Sends a datagram to the CAN bus and waits for the response.
+    Action got_dg_client()
+    {
+        dgClient_ =
+            full_allocation_result(parent_->canDatagram_->client_allocator());
+        Buffer<GenMessage> *b;
+        mainBufferPool->alloc(&b);
+        b->data()->reset(
+            Defs::MTI_DATAGRAM, msg_.src.id, msg_.dst, EMPTY_PAYLOAD);
+        b->data()->payload.swap(msg_.payload);
+        b->set_done(bn_.reset(this));
+        dgClient_->write_datagram(b);
+        return wait_and_call(STATE(datagram_done));
+    }
+
+    /// Returns the datagram client after the datagram response arrived.
+    Action datagram_done()
+    {
+        parent_->canDatagram_->client_allocator()->typed_insert(dgClient_);
+        dgClient_ = nullptr;
+        return exit();
+    }
+
+    /// Gateway owning *this.
+    TcpCanGateway *parent_;
+    /// The message being forwarded.
+    GenMessage msg_;
+    /// Datagram client used for forwarding datagrams.
+    DatagramClient *dgClient_{nullptr};
+    /// Notified when the datagram is sent.
+    BarrierNotifiable bn_;
+};
+
+void TcpCanGateway::CanToTcp::send(
+    Buffer<GenMessage> *message, unsigned priority)
+{
+    AutoReleaseBuffer<GenMessage> ab(message);
+    GenMessage *m = message->data();
+    NodeID src = m->src.id;
+    if (!src && m->payload.size() == 6 &&
+        (m->mti == Defs::MTI_INITIALIZATION_COMPLETE ||
+            m->mti == Defs::MTI_VERIFIED_NODE_ID_NUMBER))
+    {
+        src = data_to_node_id(m->payload.data());
+    }
+    if (!src)
+    {
+        LOG(VERBOSE, "TcpCanGateway: unknown source alias %03x.",
+            (unsigned)m->src.alias);
+        return;
+    }
+    if (parent_->is_tcp_node(src))
+    {
+        // Loopback of a message we sent to the CAN interface.
+        return;
+    }
+    if (Defs::get_mti_address(m->mti) && !parent_->is_tcp_node(m->dst.id))
+    {
+        return;
+    }
+    auto *b = parent_->tcpHub_->alloc();
+    TcpDefs::render_tcp_message(*m, parent_->gatewayNodeId_,
+        os_get_time_monotonic() / 1000000, b->data());
+    node_id_to_data(src, &(*b->data())[TcpDefs::MSG_SRC_OFS]);
+    b->data()->skipMember_ = parent_->tcpToCan_.get();
+    parent_->tcpHub_->send(b, priority);
+}
+
+TcpCanGateway::TcpCanGateway(IfCan *if_can, DatagramService *can_datagram,
+    HubFlow *tcp_hub, NodeID gateway_node_id)
+    : ifCan_(if_can)
+    , canDatagram_(can_datagram)
+    , tcpHub_(tcp_hub)
+    , gatewayNodeId_(gateway_node_id)
+{
+    HASSERT(tcp_hub->service()->executor() == if_can->executor());
+    canToTcp_.reset(new CanToTcp(this));
+    tcpToCan_.reset(new TcpToCan(this));
+}
+
+TcpCanGateway::~TcpCanGateway()
+{
+}
+
+} // namespace openlcb
@@ -0,0 +1,108 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file TcpCanGateway.hxx
+ *
+ * Gateway between the OpenLCB-TCP and the CAN interfaces.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#ifndef _OPENLCB_TCPCANGATEWAY_HXX_
+#define _OPENLCB_TCPCANGATEWAY_HXX_
+
+#include <memory>
+#include <set>
+
+#include "openlcb/Datagram.hxx"
+#include "openlcb/IfCan.hxx"
+#include "utils/Hub.hxx"
+
+namespace openlcb
+{
+
+/// Message-level gateway between a CAN interface and a hub of OpenLCB-TCP
+/// messages. Global messages are forwarded in both directions. Addressed
+/// messages from the TCP side are sent to the CAN bus, using the alias
+/// allocator of the CAN interface to reserve a proxy alias for every TCP
+/// node; addressed messages on the CAN bus are forwarded to the TCP side when
+/// they are destined to one of these proxy aliases. Datagrams going to the
+/// CAN bus are fragmented by a datagram client of the CAN datagram service.
+///
+/// Messages from CAN nodes are only forwarded once the node ID belonging to
+/// the source alias is known (from an alias mapping definition or from the
+/// node's initialization complete or verified node ID message).
+///
+/// The CAN interface and the TCP hub have to run on the same executor.
+class TcpCanGateway
+{
+public:
+    /// Constructor.
+    ///
+    /// @param if_can is the CAN interface. It must have an alias allocator.
+    /// @param can_datagram is the datagram service bound to if_can.
+    /// @param tcp_hub carries the TCP messages, one message per buffer.
+    /// @param gateway_node_id will be sent in the gateway field of the
+    /// messages forwarded to the TCP side.
+    TcpCanGateway(IfCan *if_can, DatagramService *can_datagram,
+        HubFlow *tcp_hub, NodeID gateway_node_id);
+
+    ~TcpCanGateway();
+
+private:
+    class CanToTcp;
+    class TcpToCan;
+
+    /// @return true if the given node was seen sending on the TCP side.
+    /// @param id is the node ID to look up.
+    bool is_tcp_node(NodeID id)
+    {
+        return tcpNodes_.find(id) != tcpNodes_.end();
+    }
+
+    /// CAN side interface.
+    IfCan *ifCan_;
+    /// Datagram service for the CAN side.
+    DatagramService *canDatagram_;
+    /// Hub with the TCP messages.
+    HubFlow *tcpHub_;
+    /// Node ID to put into the TCP messages.
+    NodeID gatewayNodeId_;
+    /// Nodes that we have seen messages from on the TCP side.
+    std::set<NodeID> tcpNodes_;
+    /// Handler on the CAN interface's dispatcher.
+    std::unique_ptr<CanToTcp> canToTcp_;
+    /// Port on the TCP hub.
+    std::unique_ptr<TcpToCan> tcpToCan_;
+
+    DISALLOW_COPY_AND_ASSIGN(TcpCanGateway);
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_TCPCANGATEWAY_HXX_
@@ -35,9 +35,102 @@
 
 #include "openlcb/TcpDefs.hxx"
 
+#include "openlcb/If.hxx"
+
 namespace openlcb {
 
 const char TcpDefs::MDNS_SERVICE_NAME_TCP[] = "_openlcb-hub._tcp";
 const char TcpDefs::MDNS_SERVICE_NAME_GRIDCONNECT_CAN[] = "_openlcb-can._tcp";
 
+void TcpDefs::render_tcp_message(const GenMessage &msg,
+    NodeID gateway_node_id, uint64_t timestamp, std::string *tgt)
+{
+    bool has_dst = Defs::get_mti_address(msg.mti);
+    unsigned len = (has_dst ? MIN_ADDRESSED_MESSAGE_SIZE : MIN_MESSAGE_SIZE) +
+        msg.payload.size();
+    tgt->resize(len);
+    uint8_t *p = (uint8_t *)&(*tgt)[0];
+    uint16_t flags = FLAGS_OPENLCB_MSG;
+    p[HDR_FLAG_OFS] = flags >> 8;
+    p[HDR_FLAG_OFS + 1] = flags & 0xff;
+    unsigned size = len - HDR_GATEWAY_OFS;
+    p[HDR_SIZE_OFS] = (size >> 16) & 0xff;
+    p[HDR_SIZE_OFS + 1] = (size >> 8) & 0xff;
+    p[HDR_SIZE_OFS + 2] = size & 0xff;
+    node_id_to_data(gateway_node_id, p + HDR_GATEWAY_OFS);
+    node_id_to_data(timestamp, p + HDR_TIMESTAMP_OFS);
+    p[MSG_MTI_OFS] = (msg.mti >> 8) & 0xff;
+    p[MSG_MTI_OFS + 1] = msg.mti & 0xff;
+    node_id_to_data(msg.src.id, p + MSG_SRC_OFS);
+    unsigned ofs = MSG_DST_OFS;
+    if (has_dst)
+    {
+        node_id_to_data(msg.dst.id, p + MSG_DST_OFS);
+        ofs += 6;
+    }
+    if (!msg.payload.empty())
+    {
+        memcpy(p + ofs, msg.payload.data(), msg.payload.size());
+    }
+}
+
+unsigned TcpDefs::get_message_length(const void *data)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    return HDR_GATEWAY_OFS + ((unsigned)p[HDR_SIZE_OFS] << 16) +
+        ((unsigned)p[HDR_SIZE_OFS + 1] << 8) + p[HDR_SIZE_OFS + 2];
+}
+
+bool TcpDefs::parse_tcp_message(
+    const std::string &data, GenMessage *tgt, NodeID *gateway_node_id)
+{
+    if (data.size() < MIN_MESSAGE_SIZE)
+    {
+        return false;
+    }
+    const uint8_t *p = (const uint8_t *)data.data();
+    if (get_message_length(p) != data.size())
+    {
+        return false;
+    }
+    uint16_t flags = (p[HDR_FLAG_OFS] << 8) | p[HDR_FLAG_OFS + 1];
+    if ((flags & FLAGS_OPENLCB_MSG) == 0)
+    {
+        return false;
+    }
+    if (flags & (FLAGS_FRAGMENT_NOT_FIRST | FLAGS_FRAGMENT_NOT_LAST))
+    {
+        // We never send multi-part messages, and do not reassemble them
+        // either. All parts get dropped.
+        return false;
+    }
+    Defs::MTI mti = (Defs::MTI)((p[MSG_MTI_OFS] << 8) | p[MSG_MTI_OFS + 1]);
+    unsigned ofs = MSG_DST_OFS;
+    if (Defs::get_mti_address(mti))
+    {
+        if (data.size() < MIN_ADDRESSED_MESSAGE_SIZE)
+        {
+            return false;
+        }
+        ofs += 6;
+        tgt->dst.id = data_to_node_id(p + MSG_DST_OFS);
+    }
+    else
+    {
+        tgt->dst.id = 0;
+    }
+    tgt->dst.alias = 0;
+    tgt->mti = mti;
+    tgt->src.id = data_to_node_id(p + MSG_SRC_OFS);
+    tgt->src.alias = 0;
+    tgt->payload.assign(data, ofs, std::string::npos);
+    tgt->flagsSrc = 0;
+    tgt->flagsDst = 0;
+    if (gateway_node_id)
+    {
+        *gateway_node_id = data_to_node_id(p + HDR_GATEWAY_OFS);
+    }
+    return true;
+}
+
 }  // namespace openlcb
@@ -36,15 +36,96 @@
 #ifndef _OPENLCB_TCPDEFS_HXX_
 #define _OPENLCB_TCPDEFS_HXX_
 
+#include <stdint.h>
+#include <string>
+
+#include "openlcb/Defs.hxx"
 #include "utils/macros.h"
 
 namespace openlcb {
 
+struct GenMessage;
+
+/// Static constants and helper functions for the OpenLCB-TCP transport
+/// protocol. Each message on the wire carries a header with flags, length,
+/// the node ID of the originating gateway and a capture timestamp, followed by
+/// a complete OpenLCB message (MTI, source node ID, optional destination node
+/// ID and the payload).
 class TcpDefs {
 public:
     static const char MDNS_SERVICE_NAME_TCP[];
     static const char MDNS_SERVICE_NAME_GRIDCONNECT_CAN[];
 
+    /// Bits of the flags field (first two bytes of the header).
+    enum Flags
+    {
+        /// Set when the message contains an OpenLCB message (as opposed to a
+        /// link control message).
+        FLAGS_OPENLCB_MSG = 0x8000,
+        /// Set when the message has gone through a gateway.
+        FLAGS_CHAINING = 0x4000,
+        /// Set when this is not the first part of a multi-part message.
+        FLAGS_FRAGMENT_NOT_FIRST = 0x0800,
+        /// Set when this is not the last part of a multi-part message.
+        FLAGS_FRAGMENT_NOT_LAST = 0x0400,
+    };
+
+    /// Offset of the flags field in the header.
+    static constexpr unsigned HDR_FLAG_OFS = 0;
+    /// Offset of the 24-bit length field in the header. The length counts
+    /// the bytes after the length field.
+    static constexpr unsigned HDR_SIZE_OFS = 2;
+    /// Offset of the gateway node ID in the header.
+    static constexpr unsigned HDR_GATEWAY_OFS = 5;
+    /// Offset of the 48-bit capture timestamp in the header.
+    static constexpr unsigned HDR_TIMESTAMP_OFS = 11;
+    /// Offset of the MTI in the message.
+    static constexpr unsigned MSG_MTI_OFS = 17;
+    /// Offset of the source node ID in the message.
+    static constexpr unsigned MSG_SRC_OFS = 19;
+    /// Offset of the destination node ID in addressed messages.
+    static constexpr unsigned MSG_DST_OFS = 25;
+    /// Number of bytes needed to compute the length of a message.
+    static constexpr unsigned MIN_HEADER_SIZE = HDR_GATEWAY_OFS;
+    /// Size of the shortest valid (global) message.
+    static constexpr unsigned MIN_MESSAGE_SIZE = MSG_DST_OFS;
+    /// Size of the shortest valid addressed message.
+    static constexpr unsigned MIN_ADDRESSED_MESSAGE_SIZE = MSG_DST_OFS + 6;
+    /// Longest message we accept from the wire. The length field would allow
+    /// 16 MB.
+    static constexpr unsigned MAX_MESSAGE_SIZE = 4096;
+
+    /// Renders an OpenLCB message into the TCP wire format.
+    ///
+    /// @param msg is the message to render. The source and (for addressed
+    /// messages) the destination node ID must be filled in.
+    /// @param gateway_node_id is the node ID of the sending interface.
+    /// @param timestamp is the 48-bit capture timestamp to send.
+    /// @param tgt will be overwritten with the binary message.
+    static void render_tcp_message(const GenMessage &msg,
+        NodeID gateway_node_id, uint64_t timestamp, std::string *tgt);
+
+    /// Computes the total length of a message from its header.
+    ///
+    /// @param data points to at least MIN_HEADER_SIZE bytes of a message.
+    /// @return the total length of the message in bytes, including the
+    /// header.
+    static unsigned get_message_length(const void *data);
+
+    /// Parses a message in the TCP wire format.
+    ///
+    /// @param data is one complete message (as returned by the stream
+    /// segmenter).
+    /// @param tgt will be filled in with the MTI, source, destination and
+    /// payload. The dstNode field is not touched.
+    /// @param gateway_node_id if not null, will be filled in with the node ID
+    /// of the gateway that sent the message.
+    /// @return true if the message was valid; false if it was malformed, not
+    /// an OpenLCB message, or a part of a multi-part message (these are not
+    /// supported).
+    static bool parse_tcp_message(const std::string &data, GenMessage *tgt,
+        NodeID *gateway_node_id = nullptr);
+
 private:
     /// Nobody can construct this class.
     TcpDefs();
@@ -190,7 +190,11 @@ struct TractionDefs {
         FNCONFIG_BINARYSTATE_SHORT = 0x2,
         /** Analog outputs, defined by NMRA DCC WG Topic 9910241. Offset 0-255,
          * values 0-255 each. */
-        FNCONFIG_ANALOG_OUTPUT = 0x3
+        FNCONFIG_ANALOG_OUTPUT = 0x3,
+
+        /** Largest number of function values a train node returns in a
+         * single response to a block function query. */
+        FN_QUERY_BLOCK_MAX = 32,
     };
 
     /** Converts a legacy address to an NMRAnet node ID.
@@ -385,6 +389,19 @@ struct TractionDefs {
         return p;
     }
 
+    /** Generates a query for a block of consecutive functions. This is an
+     * extension of the GET_FN command: a fifth byte carries the number of
+     * functions requested. Train nodes that do not know about this byte
+     * ignore it and respond with the value of the first function only.
+     * @param address is the first function address to query.
+     * @param count is the number of functions to query (at most
+     * FN_QUERY_BLOCK_MAX). */
+    static Payload fn_get_block_payload(unsigned address, uint8_t count) {
+        Payload p = fn_get_payload(address);
+        p.push_back(count);
+        return p;
+    }
+
     /** Parses the response payload of a GET_FN packet.
      * @returns true if there is a valid function value.
      * @param p is the response payload.
@@ -407,6 +424,35 @@ struct TractionDefs {
         return true;
     }
 
+    /** Parses the response payload of a block GET_FN packet. Also accepts a
+     * regular (single function) response.
+     * @returns the number of function values stored in values; 0 if the
+     * payload is malformed.
+     * @param p is the response payload.
+     * @param address will be set to the address of the first function.
+     * @param values will be filled in with the function values, the i-th
+     * entry belonging to function address + i.
+     * @param max_count is the number of entries in values. */
+    static unsigned fn_get_block_parse(const Payload &p, unsigned *address,
+        uint16_t *values, unsigned max_count)
+    {
+        if (!fn_get_parse(p, &values[0], address))
+        {
+            return 0;
+        }
+        unsigned count = (p.size() - 4) / 2;
+        if (count > max_count)
+        {
+            count = max_count;
+        }
+        for (unsigned i = 1; i < count; ++i)
+        {
+            values[i] = (((uint16_t)p[4 + 2 * i]) << 8) |
+                uint8_t(p[5 + 2 * i]);
+        }
+        return count;
+    }
+
     static Payload assign_controller_payload(Node *ctrl)
     {
         Payload p(9, 0);
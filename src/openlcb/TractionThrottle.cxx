@@ -1,3 +1,93 @@
 
 
 #include "openlcb/TractionThrottle.hxx"
+
+namespace openlcb
+{
+
+TractionFnCache::Entry *TractionFnCache::find(NodeID train)
+{
+    for (auto &e : entries_)
+    {
+        if (e.train == train)
+        {
+            e.lastUse = ++useCounter_;
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+uint16_t TractionFnCache::get(NodeID train, uint32_t address)
+{
+    Entry *e = find(train);
+    if (!e)
+    {
+        return NOT_KNOWN;
+    }
+    if (address < NUM_FLAT)
+    {
+        if (e->known & (1u << address))
+        {
+            return e->values[address];
+        }
+        return NOT_KNOWN;
+    }
+    for (const auto &p : e->overflow)
+    {
+        if (p.first == address)
+        {
+            return p.second;
+        }
+    }
+    return NOT_KNOWN;
+}
+
+void TractionFnCache::set(NodeID train, uint32_t address, uint16_t value)
+{
+    Entry *e = find(train);
+    if (!e)
+    {
+        // Evicts the least recently used train (free entries have lastUse 0).
+        e = &entries_[0];
+        for (auto &c : entries_)
+        {
+            if (c.lastUse < e->lastUse)
+            {
+                e = &c;
+            }
+        }
+        e->train = train;
+        e->known = 0;
+        e->overflow.clear();
+        e->lastUse = ++useCounter_;
+    }
+    if (address < NUM_FLAT)
+    {
+        e->values[address] = value;
+        e->known |= 1u << address;
+        return;
+    }
+    for (auto &p : e->overflow)
+    {
+        if (p.first == address)
+        {
+            p.second = value;
+            return;
+        }
+    }
+    e->overflow.emplace_back(address, value);
+}
+
+void TractionFnCache::clear()
+{
+    for (auto &e : entries_)
+    {
+        e.train = 0;
+        e.lastUse = 0;
+        e.known = 0;
+        e.overflow.clear();
+    }
+}
+
+} // namespace openlcb
@@ -200,6 +200,64 @@ public:
     virtual openlcb::NodeID target_node() = 0;
 };
 
+/// Function state cache of a throttle, keyed by train node. The low
+/// function numbers of each train live in a flat array with a validity
+/// bitmask; the rare higher function numbers are kept in a short overflow
+/// list. When all entries are in use, the least recently used train is
+/// evicted.
+class TractionFnCache
+{
+public:
+    enum
+    {
+        /// How many trains we keep function state for.
+        NUM_TRAINS = 4,
+        /// Functions 0..NUM_FLAT-1 are stored in the flat array.
+        NUM_FLAT = 32,
+        /// Returned from get() when there is no cached value.
+        NOT_KNOWN = 0xffff,
+    };
+
+    /// Looks up a cached function value.
+    /// @param train is the node ID of the train.
+    /// @param address is the function address.
+    /// @return the last known value, or NOT_KNOWN.
+    uint16_t get(NodeID train, uint32_t address);
+
+    /// Stores a function value in the cache, allocating an entry for the
+    /// train if needed.
+    /// @param train is the node ID of the train.
+    /// @param address is the function address.
+    /// @param value is the function value.
+    void set(NodeID train, uint32_t address, uint16_t value);
+
+    /// Forgets all cached function values.
+    void clear();
+
+private:
+    /// Cached state of one train.
+    struct Entry
+    {
+        /// Which train this entry belongs to. 0 if the entry is free.
+        NodeID train{0};
+        /// Value of useCounter_ when this entry was last touched.
+        unsigned lastUse{0};
+        /// Bit N is set if values[N] is valid.
+        uint32_t known{0};
+        /// Function values for the low function numbers.
+        uint16_t values[NUM_FLAT];
+        /// (address, value) pairs for the function numbers >= NUM_FLAT.
+        std::vector<std::pair<uint32_t, uint16_t>> overflow;
+    };
+
+    /// @return the entry for a given train, or nullptr if there is none.
+    Entry *find(NodeID train);
+
+    Entry entries_[NUM_TRAINS];
+    /// Incremented at every lookup; used for LRU eviction.
+    unsigned useCounter_{0};
+};
+
 /** Interface for a single throttle for running a train node.
  *
  */
@@ -212,6 +270,7 @@ public:
     /// sending its messages.
     TractionThrottle(Node *node)
         : CallableFlow<TractionThrottleInput>(node->iface())
+        , dst_(0)
         , node_(node)
     {
         clear_cache();
@@ -228,7 +287,7 @@ public:
         TIMEOUT_NSEC = SEC_TO_NSEC(1),
         /// Returned from get_fn() when we don't have a cahced value for a
         /// function.
-        FN_NOT_KNOWN = 0xffff,
+        FN_NOT_KNOWN = TractionFnCache::NOT_KNOWN,
         /// Upon a load state request, how far do we go into the function list?
         MAX_FN_QUERY = 28,
         ERROR_UNASSIGNED = 0x4000000,
@@ -257,17 +316,12 @@ public:
     void set_fn(uint32_t address, uint16_t value) override
     {
         send_traction_message(TractionDefs::fn_set_payload(address, value));
-        lastKnownFn_[address] = value;
+        fnCache_.set(dst_, address, value);
     }
 
     uint16_t get_fn(uint32_t address) override
     {
-        auto it = lastKnownFn_.find(address);
-        if (it != lastKnownFn_.end())
-        {
-            return it->second;
-        }
-        return FN_NOT_KNOWN;
+        return fnCache_.get(dst_, address);
     }
 
     void toggle_fn(uint32_t fn) override
@@ -522,18 +576,20 @@ private:
 
     Action load_state()
     {
-        pendingQueries_ = 1;
+        pendingQueries_ = 2;
         send_traction_message(TractionDefs::speed_get_payload());
-        for (int i = 0; i <= MAX_FN_QUERY; ++i)
-        {
-            pendingQueries_++;
-            send_traction_message(TractionDefs::fn_get_payload(i));
-        }
+        // Asks for all functions in one go. Trains that do not support the
+        // block query return only F0, and we fall back to querying the
+        // remaining functions one by one when that reply arrives.
+        fnBlockPending_ = true;
+        send_traction_message(
+            TractionDefs::fn_get_block_payload(0, MAX_FN_QUERY + 1));
         return sleep_and_call(&timer_, TIMEOUT_NSEC, STATE(load_done));
     }
 
     Action load_done()
     {
+        fnBlockPending_ = false;
         if (!timer_.is_triggered())
         {
             // timed out
@@ -582,13 +638,24 @@ private:
             }
             case TractionDefs::RESP_QUERY_FN:
             {
-                pending_reply_arrived();
-                uint16_t v;
+                uint16_t v[MAX_FN_QUERY + 1];
                 unsigned num;
-                if (TractionDefs::fn_get_parse(p, &v, &num))
+                unsigned count = TractionDefs::fn_get_block_parse(
+                    p, &num, v, MAX_FN_QUERY + 1);
+                for (unsigned i = 0; i < count; ++i)
                 {
-                    lastKnownFn_[num] = v;
+                    fnCache_.set(dst_, num + i, v[i]);
                 }
+                if (fnBlockPending_ && (count == 0 || num == 0))
+                {
+                    fnBlockPending_ = false;
+                    for (unsigned i = count; i <= MAX_FN_QUERY; ++i)
+                    {
+                        pendingQueries_++;
+                        send_traction_message(TractionDefs::fn_get_payload(i));
+                    }
+                }
+                pending_reply_arrived();
             }
         }
     }
@@ -733,7 +800,7 @@ private:
                 // function get and set have the same signature
                 if (TractionDefs::fn_get_parse(p, &v, &num))
                 {
-                    lastKnownFn_[num] = v;
+                    fnCache_.set(dst_, num, v);
                     if (updateCallback_)
                     {
                         updateCallback_(num);
@@ -786,10 +853,12 @@ private:
         iface()->dispatcher()->unregister_handler(&speedReplyHandler_, Defs::MTI_TRACTION_CONTROL_REPLY, Defs::MTI_EXACT);
     }
 
+    /// Forgets the speed of the train. Function values are kept, because
+    /// they are stored per train; they get refreshed by the next
+    /// CMD_LOAD_STATE.
     void clear_cache()
     {
         lastSetSpeed_ = nan_to_speed();
-        lastKnownFn_.clear();
     }
 
     TractionThrottleInput *input()
@@ -811,6 +880,9 @@ private:
     /// How many speed/fn query requests I have sent off to the train node that
     /// have not yet seen a reply.
     unsigned pendingQueries_{0};
+    /// True while we are waiting for the response to the block function
+    /// query of CMD_LOAD_STATE.
+    bool fnBlockPending_{false};
     StateFlowTimer timer_{this};
     /// True if the assign controller has returned positive.
     bool assigned_{false};
@@ -825,7 +897,7 @@ private:
     /// Cache: Velocity value that we last commanded to the train.
     SpeedType lastSetSpeed_;
     /// Cache: all known function values.
-    std::map<uint32_t, uint16_t> lastKnownFn_;
+    TractionFnCache fnCache_;
 };
 
 } // namespace openlcb
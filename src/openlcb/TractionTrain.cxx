@@ -248,7 +248,15 @@ struct TrainService::Impl
                 }
                 case TractionDefs::REQ_QUERY_FN:
                 {
-                    p->resize(6);
+                    // The optional fifth byte asks for a block of
+                    // consecutive functions.
+                    unsigned count = 1;
+                    if (size() >= 5 && payload()[4] > 1)
+                    {
+                        count = std::min((unsigned)payload()[4],
+                            (unsigned)TractionDefs::FN_QUERY_BLOCK_MAX);
+                    }
+                    p->resize(4 + 2 * count);
                     uint8_t *d = reinterpret_cast<uint8_t *>(&(*p)[0]);
                     d[0] = TractionDefs::RESP_QUERY_FN;
                     d[1] = payload()[1];
@@ -259,9 +267,13 @@ struct TrainService::Impl
                     address |= payload()[2];
                     address <<= 8;
                     address |= payload()[3];
-                    uint16_t fn_value = train_node()->train()->get_fn(address);
-                    d[4] = fn_value >> 8;
-                    d[5] = fn_value & 0xff;
+                    for (unsigned i = 0; i < count; ++i)
+                    {
+                        uint16_t fn_value =
+                            train_node()->train()->get_fn(address + i);
+                        d[4 + 2 * i] = fn_value >> 8;
+                        d[5 + 2 * i] = fn_value & 0xff;
+                    }
                     return send_response();
                 }
             }
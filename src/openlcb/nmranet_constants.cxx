@@ -39,6 +39,10 @@ DEFAULT_CONST(remote_alias_cache_size, 10);
 /** Number of entries in the local alias cache */
 DEFAULT_CONST(local_alias_cache_size, 3);
 
+/** Number of node aliases the CAN interface keeps reserved ahead of demand.
+ * Each of them takes an entry in the local alias cache. */
+DEFAULT_CONST(reserved_alias_pool_size, 1);
+
 /** Maximum number of local nodes */
 DEFAULT_CONST(local_nodes_count, 2);
 
@@ -50,6 +54,10 @@ DEFAULT_CONST(num_datagram_registry_entries, 2);
  * happen concurrently. */
 DEFAULT_CONST(num_datagram_clients, 2);
 
+/** Number of incoming multi-frame datagrams that can be reassembled at the
+ * same time on a CAN interface. */
+DEFAULT_CONST(datagram_reassembly_slots, 8);
+
 /** Maximum number of memory spaces that can be registered for the MemoryConfig
  * datagram handler. */
 DEFAULT_CONST(num_memory_spaces, 5);
@@ -63,3 +71,20 @@ DEFAULT_CONST_FALSE(enable_all_memory_space);
  * identified messages at boot time. This is required by the OpenLCB
  * standard. */
 DEFAULT_CONST_TRUE(node_init_identify);
+
+/** Set to CONSTANT_TRUE to use the hash-based event registry, which is faster
+ * for nodes with thousands of registered events. */
+DEFAULT_CONST_FALSE(event_registry_use_hash);
+
+/** Set to CONSTANT_TRUE to have the event service collect the responses to
+ * Identify Events messages, and merge contiguous events in unknown state into
+ * producer / consumer range identified messages. */
+DEFAULT_CONST_FALSE(event_identify_coalesce);
+
+/** Maximum rate (messages per second) of the collected Identify Events
+ * responses on each interface. Zero means unlimited. */
+DEFAULT_CONST(event_identify_rate, 0);
+
+/** How many collected Identify Events responses may be sent back-to-back
+ * before the event_identify_rate limit applies. */
+DEFAULT_CONST(event_identify_burst, 16);
@@ -51,6 +51,15 @@
 #include <sys/select.h>
 #endif
 
+#ifdef EXECUTOR_EPOLL
+#ifndef __linux__
+#error EXECUTOR_EPOLL is only supported on linux.
+#endif
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 /// Signal handler that does nothing. @param sig ignored.
 void empty_signal_handler(int sig);
 
@@ -61,9 +70,29 @@ public:
     OSSelectWakeup()
         : pendingWakeup_(false)
         , inSelect_(false)
+#ifdef EXECUTOR_EPOLL
+        , wakeupFd_(-1)
+#endif
     {
     }
 
+#ifdef EXECUTOR_EPOLL
+    ~OSSelectWakeup()
+    {
+        if (wakeupFd_ >= 0)
+        {
+            ::close(wakeupFd_);
+        }
+    }
+
+    /// @return the eventfd that becomes readable upon wakeup(). Valid only
+    /// after lock_to_thread() was called.
+    int wakeup_fd()
+    {
+        return wakeupFd_;
+    }
+#endif
+
     /// @return the thread ID that we are engaged upon.
     os_thread_t main_thread() {
         return thread_;
@@ -78,6 +107,9 @@ public:
 #ifdef __FreeRTOS__
         Device::select_insert(&selectInfo_);
 #elif defined(ESP_NONOS)
+#elif defined(EXECUTOR_EPOLL)
+        wakeupFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        HASSERT(wakeupFd_ >= 0);
 #elif !defined(__WINNT__)
         // Blocks SIGUSR1 in the signal mask of the current thread.
         sigset_t usrmask;
@@ -113,6 +145,12 @@ public:
             Device::SelectInfo copy(selectInfo_);
             Device::select_wakeup(&copy);
 #elif defined(__WINNT__) || defined(ESP_NONOS)
+#elif defined(EXECUTOR_EPOLL)
+            uint64_t one = 1;
+            int ret = ::write(wakeupFd_, &one, sizeof(one));
+            // EAGAIN means the counter is saturated; the wakeup is pending
+            // anyway.
+            (void)ret;
 #else
             pthread_kill(thread_, WAKEUP_SIG);
 #endif
@@ -141,6 +179,7 @@ public:
     }
 #endif
 
+#ifndef EXECUTOR_EPOLL
     /** Portable call to a select that can be woken up asynchronously from a
      * different thread or an ISR context.
      *
@@ -200,6 +239,71 @@ public:
         }
         return ret;
     }
+#else
+    /** Waits on an epoll set that can be woken up asynchronously from a
+     * different thread. The caller must have added wakeup_fd() to the epoll
+     * set with EPOLLIN and event.data.fd == wakeup_fd().
+     *
+     * @param epfd is the epoll instance to wait on.
+     * @param events is where the ready events will be stored.
+     * @param max_events is the length of the events array.
+     * @param deadline_nsec is the maximum time to sleep if no fd activity and
+     * no wakeup happens. -1 to sleep indefinitely, 0 to return immediately.
+     *
+     * @return number of entries filled in events (the wakeup fd's event is
+     * removed), 0 in case of timeout, or -1 and errno==EINTR if the wait was
+     * woken up asynchronously and there is no fd activity.
+     */
+    int epoll_wait(int epfd, struct epoll_event *events, int max_events,
+        long long deadline_nsec)
+    {
+        {
+            AtomicHolder l(this);
+            inSelect_ = true;
+            if (pendingWakeup_)
+            {
+                deadline_nsec = 0;
+            }
+        }
+        int timeout_msec;
+        if (deadline_nsec < 0)
+        {
+            timeout_msec = -1;
+        }
+        else
+        {
+            // Rounds up so that we do not spin on sub-millisecond timers.
+            timeout_msec = (deadline_nsec + 999999) / 1000000;
+        }
+        int ret = ::epoll_wait(epfd, events, max_events, timeout_msec);
+        {
+            AtomicHolder l(this);
+            pendingWakeup_ = false;
+            inSelect_ = false;
+        }
+        if (ret <= 0)
+        {
+            return ret;
+        }
+        for (int i = 0; i < ret; ++i)
+        {
+            if (events[i].data.fd == wakeupFd_)
+            {
+                uint64_t cnt;
+                int r = ::read(wakeupFd_, &cnt, sizeof(cnt));
+                (void)r;
+                events[i] = events[--ret];
+                break;
+            }
+        }
+        if (!ret)
+        {
+            ret = -1;
+            errno = EINTR;
+        }
+        return ret;
+    }
+#endif
 
 private:
 #if !defined(__FreeRTOS__) && !defined(__WINNT__)
@@ -214,6 +318,9 @@ private:
     os_thread_t thread_;
 #if defined(__FreeRTOS__)
     Device::SelectInfo selectInfo_;
+#elif defined(EXECUTOR_EPOLL)
+    /// eventfd used to interrupt epoll_wait from other threads.
+    int wakeupFd_;
 #elif !defined(__WINNT__)
     /// Original signal mask. Used for pselect to reenable the signal we'll be
     /// using to wake up.
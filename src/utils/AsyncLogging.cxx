@@ -0,0 +1,715 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file AsyncLogging.cxx
+ *
+ * Ring buffers, rendering and binary output of the asynchronous logger.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#include "utils/AsyncLogging.hxx"
+
+#if defined(__linux__) || defined(__MACH__)
+
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nmranet_config.h"
+
+constexpr char AsyncLogger::BINARY_MAGIC[4];
+constexpr uint32_t AsyncLogger::BINARY_VERSION;
+constexpr uint8_t AsyncLogger::BINARY_FORMAT;
+constexpr uint8_t AsyncLogger::BINARY_RECORD;
+constexpr uint8_t AsyncLogRecord::PADDING_LEVEL;
+
+/// Hands out small numbers to the threads, so that they can index the ring
+/// buffers of the AsyncLogger. The number is given back when the thread
+/// exits, and the next new thread inherits the ring buffer.
+class AsyncLogThreadId
+{
+public:
+    AsyncLogThreadId()
+    {
+        for (unsigned i = 0; i < AsyncLogger::MAX_THREADS; ++i)
+        {
+            uint32_t bit = 1u << i;
+            if ((used_.fetch_or(bit, std::memory_order_acquire) & bit) == 0)
+            {
+                id_ = i;
+                return;
+            }
+        }
+        id_ = AsyncLogger::MAX_THREADS;
+    }
+
+    ~AsyncLogThreadId()
+    {
+        if (id_ < AsyncLogger::MAX_THREADS)
+        {
+            used_.fetch_and(~(1u << id_), std::memory_order_release);
+        }
+    }
+
+    /// @return the thread number, or MAX_THREADS if the thread does not have
+    /// one.
+    unsigned id()
+    {
+        return id_;
+    }
+
+private:
+    static_assert(AsyncLogger::MAX_THREADS <= 32, "used_ is 32 bits");
+    /// Bit N is set if thread number N is taken.
+    static std::atomic<uint32_t> used_;
+    /// Number of the current thread.
+    unsigned id_;
+};
+
+std::atomic<uint32_t> AsyncLogThreadId::used_{0};
+
+/// @return monotonic time for the log records. Does not take a lock, unlike
+/// os_get_time_monotonic().
+static int64_t async_log_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+void AsyncLogEncoder::put(const char *value)
+{
+    if (!value)
+    {
+        value = "(null)";
+    }
+    if (pos_ + 3 > MAX_SIZE)
+    {
+        return;
+    }
+    size_t len = strlen(value);
+    if (len > MAX_SIZE - pos_ - 3)
+    {
+        len = MAX_SIZE - pos_ - 3;
+    }
+    data_[pos_] = AsyncLogRecord::ARG_STRING;
+    uint16_t len16 = len;
+    memcpy(data_ + pos_ + 1, &len16, 2);
+    memcpy(data_ + pos_ + 3, value, len);
+    pos_ += 3 + len;
+    ++record()->num_args;
+}
+
+AsyncLogger::AsyncLogger()
+    : AsyncLogger(config_async_log_ring_size())
+{
+}
+
+AsyncLogger::AsyncLogger(unsigned ring_size)
+    : ringSize_(ring_size)
+{
+    HASSERT((ring_size & (ring_size - 1)) == 0);
+    HASSERT(ring_size >= 2 * AsyncLogEncoder::MAX_SIZE);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    if (is_created())
+    {
+        stopRequested_.store(true);
+        threadExited_.wait();
+    }
+    flush();
+    for (unsigned i = 0; i < MAX_THREADS; ++i)
+    {
+        delete[] rings_[i].data.load();
+    }
+}
+
+void AsyncLogger::start_thread(
+    const char *name, int priority, size_t stack_size)
+{
+    OSThread::start(name, priority, stack_size);
+}
+
+void *AsyncLogger::entry()
+{
+    while (!stopRequested_.load())
+    {
+        if (!flush())
+        {
+            usleep(POLL_USEC);
+        }
+    }
+    threadExited_.post();
+    return nullptr;
+}
+
+bool AsyncLogger::push(AsyncLogEncoder *enc)
+{
+    static thread_local AsyncLogThreadId tid;
+    unsigned id = tid.id();
+    if (id >= MAX_THREADS)
+    {
+        return false;
+    }
+    Ring *r = &rings_[id];
+    uint8_t *data = r->data.load(std::memory_order_relaxed);
+    if (!data)
+    {
+        data = new uint8_t[ringSize_];
+        r->data.store(data, std::memory_order_release);
+    }
+    AsyncLogRecord *rec = enc->finish();
+    rec->thread = id;
+    rec->time_nsec = async_log_now();
+    uint32_t size = rec->size;
+    uint32_t head = r->head.load(std::memory_order_relaxed);
+    uint32_t tail = r->tail.load(std::memory_order_acquire);
+    uint32_t offset = head & (ringSize_ - 1);
+    uint32_t contiguous = ringSize_ - offset;
+    uint32_t needed = size <= contiguous ? size : size + contiguous;
+    if (ringSize_ - (head - tail) < needed)
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (size > contiguous)
+    {
+        // Record does not fit to the end of the buffer; pads the end and
+        // wraps around. Offsets are multiples of 8, so there is room for the
+        // size and level fields.
+        auto *pad = reinterpret_cast<AsyncLogRecord *>(data + offset);
+        pad->size = contiguous;
+        pad->level = AsyncLogRecord::PADDING_LEVEL;
+        head += contiguous;
+        offset = 0;
+    }
+    memcpy(data + offset, rec, size);
+    r->head.store(head + size, std::memory_order_release);
+    return true;
+}
+
+AsyncLogRecord *AsyncLogger::peek(Ring *r)
+{
+    uint8_t *data = r->data.load(std::memory_order_acquire);
+    if (!data)
+    {
+        return nullptr;
+    }
+    while (true)
+    {
+        uint32_t tail = r->tail.load(std::memory_order_relaxed);
+        uint32_t head = r->head.load(std::memory_order_acquire);
+        if (tail == head)
+        {
+            return nullptr;
+        }
+        auto *rec =
+            reinterpret_cast<AsyncLogRecord *>(data + (tail & (ringSize_ - 1)));
+        if (rec->level != AsyncLogRecord::PADDING_LEVEL)
+        {
+            return rec;
+        }
+        r->tail.store(tail + rec->size, std::memory_order_release);
+    }
+}
+
+unsigned AsyncLogger::flush()
+{
+    OSMutexLock l(&consumerLock_);
+    unsigned count = 0;
+    while (true)
+    {
+        // Merges the rings by picking the oldest record each time.
+        Ring *oldest = nullptr;
+        AsyncLogRecord *rec = nullptr;
+        for (unsigned i = 0; i < MAX_THREADS; ++i)
+        {
+            AsyncLogRecord *r = peek(&rings_[i]);
+            if (r && (!rec || r->time_nsec < rec->time_nsec))
+            {
+                oldest = &rings_[i];
+                rec = r;
+            }
+        }
+        if (!rec)
+        {
+            break;
+        }
+        emit(rec);
+        oldest->tail.store(
+            oldest->tail.load(std::memory_order_relaxed) + rec->size,
+            std::memory_order_release);
+        ++count;
+    }
+    uint32_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reportedDropped_ && binaryFd_ < 0)
+    {
+        int len = snprintf(line_, sizeof(line_),
+            "Async log: %u messages dropped", dropped - reportedDropped_);
+        reportedDropped_ = dropped;
+        LOCK_LOG;
+        ::log_output(line_, len);
+        UNLOCK_LOG;
+    }
+    return count;
+}
+
+void AsyncLogger::emit(const AsyncLogRecord *rec)
+{
+    if (binaryFd_ >= 0)
+    {
+        write_binary(rec);
+        return;
+    }
+    int len = render((const char *)(uintptr_t)rec->fmt, rec, line_,
+        sizeof(line_));
+    LOCK_LOG;
+    ::log_output(line_, len);
+    UNLOCK_LOG;
+}
+
+void AsyncLogger::set_binary_output(int fd)
+{
+    OSMutexLock l(&consumerLock_);
+    binaryFd_ = fd;
+    knownFormats_.clear();
+    if (fd >= 0)
+    {
+        write_all(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        write_all(&BINARY_VERSION, sizeof(BINARY_VERSION));
+    }
+}
+
+void AsyncLogger::write_binary(const AsyncLogRecord *rec)
+{
+    if (knownFormats_.insert(rec->fmt).second)
+    {
+        const char *fmt = (const char *)(uintptr_t)rec->fmt;
+        uint16_t len = strlen(fmt);
+        write_all(&BINARY_FORMAT, 1);
+        write_all(&rec->fmt, sizeof(rec->fmt));
+        write_all(&len, sizeof(len));
+        write_all(fmt, len);
+    }
+    write_all(&BINARY_RECORD, 1);
+    write_all(rec, rec->size);
+}
+
+void AsyncLogger::write_all(const void *data, size_t len)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (len > 0 && binaryFd_ >= 0)
+    {
+        ssize_t ret = ::write(binaryFd_, p, len);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret <= 0)
+        {
+            // Output is gone; continues by rendering the messages.
+            binaryFd_ = -1;
+            return;
+        }
+        p += ret;
+        len -= ret;
+    }
+}
+
+/// Sequential access to the arguments of a record.
+class AsyncLogArgReader
+{
+public:
+    /// Constructor. @param rec the record to read.
+    AsyncLogArgReader(const AsyncLogRecord *rec)
+        : p_(reinterpret_cast<const uint8_t *>(rec + 1))
+        , left_(rec->num_args)
+    {
+    }
+
+    /// Fetches the next argument.
+    /// @param type will be set to the ArgType, or 0 if there are no more
+    /// arguments; @param size to the size of the original C type;
+    /// @param value to the numeric value; @param str and @param len to the
+    /// characters of string arguments.
+    void next(uint8_t *type, unsigned *size, uint64_t *value,
+        const char **str, unsigned *len)
+    {
+        if (!left_)
+        {
+            *type = 0;
+            return;
+        }
+        --left_;
+        *type = p_[0] & 0xf;
+        *size = p_[0] >> 4;
+        if (*type == AsyncLogRecord::ARG_STRING)
+        {
+            uint16_t len16;
+            memcpy(&len16, p_ + 1, 2);
+            *str = (const char *)p_ + 3;
+            *len = len16;
+            p_ += 3 + len16;
+        }
+        else
+        {
+            memcpy(value, p_ + 1, 8);
+            p_ += 9;
+        }
+    }
+
+private:
+    /// Next argument.
+    const uint8_t *p_;
+    /// Number of arguments remaining.
+    unsigned left_;
+};
+
+int AsyncLogger::render(
+    const char *fmt, const AsyncLogRecord *rec, char *buf, unsigned size)
+{
+    AsyncLogArgReader args(rec);
+    unsigned pos = 0;
+    // Appends printf output to buf, clamping at the end of the buffer.
+    auto append = [buf, size, &pos](int ret) {
+        if (ret > 0)
+        {
+            pos += ret;
+            if (pos > size - 1)
+            {
+                pos = size - 1;
+            }
+        }
+    };
+    buf[0] = 0;
+    while (*fmt && pos < size - 1)
+    {
+        if (*fmt != '%' || fmt[1] == '%')
+        {
+            buf[pos++] = *fmt;
+            fmt += (*fmt == '%') ? 2 : 1;
+            continue;
+        }
+        // Rebuilds the conversion specification with the length modifier
+        // matching the captured argument.
+        char spec[32];
+        unsigned s = 0;
+        spec[s++] = *fmt++;
+        while (*fmt && strchr("-+ #0'", *fmt) && s < 8)
+        {
+            spec[s++] = *fmt++;
+        }
+        uint8_t type;
+        unsigned asize;
+        uint64_t value;
+        const char *str;
+        unsigned len;
+        for (int part = 0; part < 2; ++part)
+        {
+            if (part == 1)
+            {
+                if (*fmt != '.')
+                {
+                    break;
+                }
+                spec[s++] = *fmt++;
+            }
+            if (*fmt == '*')
+            {
+                ++fmt;
+                args.next(&type, &asize, &value, &str, &len);
+                int v = (type == AsyncLogRecord::ARG_SIGNED ||
+                            type == AsyncLogRecord::ARG_UNSIGNED)
+                    ? (int)value
+                    : 0;
+                s += snprintf(spec + s, 12, "%d", v);
+            }
+            else
+            {
+                while (*fmt >= '0' && *fmt <= '9' && s < 24)
+                {
+                    spec[s++] = *fmt++;
+                }
+            }
+        }
+        // Length modifiers. Only hh and h change the printed value.
+        unsigned short_size = 0;
+        while (*fmt && strchr("hlLqjzt", *fmt))
+        {
+            if (*fmt == 'h')
+            {
+                short_size = short_size ? 1 : 2;
+            }
+            ++fmt;
+        }
+        char conv = *fmt;
+        if (!conv)
+        {
+            break;
+        }
+        ++fmt;
+        args.next(&type, &asize, &value, &str, &len);
+        bool integer = type == AsyncLogRecord::ARG_SIGNED ||
+            type == AsyncLogRecord::ARG_UNSIGNED;
+        if (integer && asize < 8)
+        {
+            // Reinterprets the value as the original C type would be by
+            // printf: sign extended for %d, zero extended otherwise.
+            unsigned shift = 64 - asize * 8;
+            if (conv == 'd' || conv == 'i')
+            {
+                value = (uint64_t)((int64_t)(value << shift) >> shift);
+            }
+            else
+            {
+                value = (value << shift) >> shift;
+            }
+        }
+        if (short_size)
+        {
+            if (short_size == 1)
+            {
+                value = (conv == 'd' || conv == 'i') ? (int64_t)(int8_t)value
+                                                     : (uint8_t)value;
+            }
+            else
+            {
+                value = (conv == 'd' || conv == 'i') ? (int64_t)(int16_t)value
+                                                     : (uint16_t)value;
+            }
+        }
+        char *out = buf + pos;
+        unsigned room = size - pos;
+        switch (conv)
+        {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                if (!integer)
+                {
+                    break;
+                }
+                spec[s++] = 'l';
+                spec[s++] = 'l';
+                spec[s++] = conv;
+                spec[s] = 0;
+                if (conv == 'd' || conv == 'i')
+                {
+                    append(snprintf(out, room, spec, (long long)value));
+                }
+                else
+                {
+                    append(
+                        snprintf(out, room, spec, (unsigned long long)value));
+                }
+                continue;
+            case 'c':
+                if (!integer)
+                {
+                    break;
+                }
+                spec[s++] = conv;
+                spec[s] = 0;
+                append(snprintf(out, room, spec, (int)value));
+                continue;
+            case 'p':
+                if (type != AsyncLogRecord::ARG_POINTER && !integer)
+                {
+                    break;
+                }
+                spec[s++] = conv;
+                spec[s] = 0;
+                append(snprintf(out, room, spec, (void *)(uintptr_t)value));
+                continue;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+            {
+                if (type != AsyncLogRecord::ARG_DOUBLE)
+                {
+                    break;
+                }
+                double d;
+                memcpy(&d, &value, sizeof(d));
+                spec[s++] = conv;
+                spec[s] = 0;
+                append(snprintf(out, room, spec, d));
+                continue;
+            }
+            case 's':
+            {
+                if (type != AsyncLogRecord::ARG_STRING)
+                {
+                    break;
+                }
+                char tmp[AsyncLogEncoder::MAX_SIZE];
+                memcpy(tmp, str, len);
+                tmp[len] = 0;
+                spec[s++] = conv;
+                spec[s] = 0;
+                append(snprintf(out, room, spec, tmp));
+                continue;
+            }
+            case 'n':
+                continue;
+            default:
+                break;
+        }
+        append(snprintf(out, room, "<?>"));
+    }
+    buf[pos] = 0;
+    return pos;
+}
+
+bool AsyncLogDecoder::feed(const void *data, size_t len)
+{
+    if (error_)
+    {
+        return false;
+    }
+    pending_.append(static_cast<const char *>(data), len);
+    size_t pos = 0;
+    // Returns true if there are at least n more bytes after pos.
+    auto have = [this, &pos](size_t n) { return pending_.size() - pos >= n; };
+    if (!headerSeen_)
+    {
+        if (!have(8))
+        {
+            return true;
+        }
+        uint32_t version;
+        memcpy(&version, pending_.data() + 4, 4);
+        if (memcmp(pending_.data(), AsyncLogger::BINARY_MAGIC, 4) != 0 ||
+            version != AsyncLogger::BINARY_VERSION)
+        {
+            error_ = true;
+            return false;
+        }
+        headerSeen_ = true;
+        pos = 8;
+    }
+    char line[sizeof(logbuffer)];
+    while (have(1))
+    {
+        const char *p = pending_.data() + pos;
+        if (p[0] == AsyncLogger::BINARY_FORMAT)
+        {
+            uint64_t id;
+            uint16_t flen;
+            if (!have(11))
+            {
+                break;
+            }
+            memcpy(&id, p + 1, 8);
+            memcpy(&flen, p + 9, 2);
+            if (!have(11 + flen))
+            {
+                break;
+            }
+            formats_[id].assign(p + 11, flen);
+            pos += 11 + flen;
+        }
+        else if (p[0] == AsyncLogger::BINARY_RECORD)
+        {
+            AsyncLogRecord rec;
+            if (!have(1 + sizeof(rec)))
+            {
+                break;
+            }
+            memcpy(&rec, p + 1, sizeof(rec));
+            if (rec.size < sizeof(rec) || rec.size > AsyncLogEncoder::MAX_SIZE)
+            {
+                error_ = true;
+                return false;
+            }
+            if (!have(1 + rec.size))
+            {
+                break;
+            }
+            // Copies to get an aligned record.
+            uint64_t copy[AsyncLogEncoder::MAX_SIZE / 8];
+            memcpy(copy, p + 1, rec.size);
+            auto it = formats_.find(rec.fmt);
+            if (it == formats_.end())
+            {
+                error_ = true;
+                return false;
+            }
+            int llen = AsyncLogger::render(it->second.c_str(),
+                reinterpret_cast<AsyncLogRecord *>(copy), line, sizeof(line));
+            callback_(rec, line, llen);
+            pos += 1 + rec.size;
+        }
+        else
+        {
+            error_ = true;
+            return false;
+        }
+    }
+    pending_.erase(0, pos);
+    return true;
+}
+
+bool AsyncLogDecoder::decode_fd(int fd)
+{
+    char buf[1024];
+    while (true)
+    {
+        ssize_t ret = ::read(fd, buf, sizeof(buf));
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret < 0)
+        {
+            return false;
+        }
+        if (ret == 0)
+        {
+            return pending_.empty() && !error_;
+        }
+        if (!feed(buf, ret))
+        {
+            return false;
+        }
+    }
+}
+
+#endif // __linux__ || __MACH__
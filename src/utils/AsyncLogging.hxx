@@ -0,0 +1,423 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file AsyncLogging.hxx
+ *
+ * Logging backend that captures LOG() calls into per-thread ring buffers and
+ * renders them later on a background thread or in an offline decoder.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+
+#ifndef _UTILS_ASYNCLOGGING_HXX_
+#define _UTILS_ASYNCLOGGING_HXX_
+
+#include "utils/logging.h"
+
+#if defined(__linux__) || defined(__MACH__)
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+#include "os/OS.hxx"
+#include "utils/Singleton.hxx"
+
+/// Header of one captured log call. It is followed by the arguments, each
+/// starting with a type byte (ARG_* | (size << 4)). Numeric arguments then
+/// have 8 bytes of value; strings have a 16-bit length and the characters
+/// without terminating zero. All values are in host byte order, so binary log
+/// files can only be decoded on the same architecture.
+struct AsyncLogRecord
+{
+    /// Length of the record in bytes including this header, a multiple of 8.
+    uint32_t size;
+    /// Log level; PADDING_LEVEL marks the unused end of a ring buffer.
+    uint8_t level;
+    /// Number of arguments captured.
+    uint8_t num_args;
+    /// Number of the thread that logged the message.
+    uint16_t thread;
+    /// Address of the format string; serves as its identifier in binary logs.
+    uint64_t fmt;
+    /// Monotonic time of the log call.
+    int64_t time_nsec;
+
+    /// Value of level for padding records.
+    static constexpr uint8_t PADDING_LEVEL = 0xff;
+
+    /// Argument types.
+    enum ArgType : uint8_t
+    {
+        ARG_SIGNED = 1,
+        ARG_UNSIGNED,
+        ARG_DOUBLE,
+        ARG_POINTER,
+        ARG_STRING,
+    };
+};
+
+static_assert(sizeof(AsyncLogRecord) == 24, "AsyncLogRecord layout");
+
+/// Serializes the arguments of a log call into an AsyncLogRecord. Strings
+/// are copied, so the caller's buffers may be reused as soon as the log call
+/// returns. Arguments that do not fit into MAX_SIZE bytes are truncated
+/// (strings) or dropped, and the renderer prints them as "<?>".
+class AsyncLogEncoder
+{
+public:
+    /// Largest record size.
+    static constexpr unsigned MAX_SIZE = 256;
+
+    /// Constructor. @param level is the log level; @param fmt is the format
+    /// string, which must be a literal.
+    AsyncLogEncoder(int level, const char *fmt)
+        : pos_(sizeof(AsyncLogRecord))
+    {
+        record()->level = level;
+        record()->num_args = 0;
+        record()->fmt = (uintptr_t)fmt;
+    }
+
+    /// Adds an integer argument.
+    template <class T>
+    typename std::enable_if<std::is_integral<T>::value>::type put(T value)
+    {
+        if (std::is_signed<T>::value)
+        {
+            int64_t v = value;
+            put_value(AsyncLogRecord::ARG_SIGNED, sizeof(T), &v);
+        }
+        else
+        {
+            uint64_t v = value;
+            put_value(AsyncLogRecord::ARG_UNSIGNED, sizeof(T), &v);
+        }
+    }
+
+    /// Adds an enum argument.
+    template <class T>
+    typename std::enable_if<std::is_enum<T>::value>::type put(T value)
+    {
+        put((typename std::underlying_type<T>::type)value);
+    }
+
+    /// Adds a floating point argument.
+    template <class T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type put(
+        T value)
+    {
+        double v = value;
+        put_value(AsyncLogRecord::ARG_DOUBLE, sizeof(v), &v);
+    }
+
+    /// Adds a pointer argument (for %p).
+    template <class T> void put(T *value)
+    {
+        uint64_t v = (uintptr_t)value;
+        put_value(AsyncLogRecord::ARG_POINTER, sizeof(void *), &v);
+    }
+
+    /// Adds a null pointer argument.
+    void put(std::nullptr_t)
+    {
+        put((const void *)nullptr);
+    }
+
+    /// Adds a string argument (for %s). The characters are copied.
+    void put(const char *value);
+
+    /// Adds a string argument (for %s). The characters are copied.
+    void put(char *value)
+    {
+        put((const char *)value);
+    }
+
+    /// Completes the record. @return the record.
+    AsyncLogRecord *finish()
+    {
+        unsigned size = (pos_ + 7) & ~7u;
+        memset(data_ + pos_, 0, size - pos_);
+        record()->size = size;
+        return record();
+    }
+
+private:
+    /// @return the header of the record being built.
+    AsyncLogRecord *record()
+    {
+        return reinterpret_cast<AsyncLogRecord *>(data_);
+    }
+
+    /// Appends a numeric argument. @param type is an ArgType; @param size is
+    /// the size of the original C type; @param value points to 8 bytes.
+    void put_value(uint8_t type, unsigned size, const void *value)
+    {
+        if (pos_ + 9 > MAX_SIZE)
+        {
+            return;
+        }
+        data_[pos_] = type | (size << 4);
+        memcpy(data_ + pos_ + 1, value, 8);
+        pos_ += 9;
+        ++record()->num_args;
+    }
+
+    /// Record being built.
+    alignas(8) uint8_t data_[MAX_SIZE];
+    /// Number of bytes filled in data_.
+    unsigned pos_;
+};
+
+/// Logging backend that defers rendering of log messages. When an instance
+/// exists, LOG() calls (in C++ code compiled with -DASYNC_LOGGING) capture the
+/// level, the format string pointer, a timestamp and the raw arguments into a
+/// ring buffer of the calling thread, and return without formatting or
+/// taking a lock. flush() renders the pending messages in timestamp order and
+/// hands them to log_output(), so the usual sinks (stderr,
+/// FdLoggingServer, TcpLoggingServer) receive the same lines as with
+/// synchronous logging. Alternatively set_binary_output() writes the raw
+/// records to a file descriptor, to be rendered later by AsyncLogDecoder.
+///
+/// Each of the first MAX_THREADS threads gets its own single-producer
+/// single-consumer ring; when a thread exits, the next new thread inherits
+/// its ring. Further threads, and format strings that are not literals, are
+/// logged synchronously. When a ring is full, messages are dropped and
+/// counted.
+class AsyncLogger : public Singleton<AsyncLogger>, private OSThread
+{
+public:
+    /// Number of threads that get their own ring buffer.
+    static constexpr unsigned MAX_THREADS = 32;
+    /// How long the background thread sleeps when there is nothing to log.
+    static constexpr unsigned POLL_USEC = 1000;
+
+    /// Constructor. The ring buffer size is config_async_log_ring_size().
+    AsyncLogger();
+
+    /// Constructor. @param ring_size is the size of the ring buffer of each
+    /// thread in bytes, must be a power of two.
+    explicit AsyncLogger(unsigned ring_size);
+
+    /// Destructor. Stops the background thread and flushes the pending
+    /// messages. All logging threads have to be finished by this point.
+    ~AsyncLogger();
+
+    /// Starts a background thread that calls flush() periodically.
+    /// @param name thread name; @param priority thread priority (0 for
+    /// default); @param stack_size size of the thread stack in bytes.
+    void start_thread(const char *name = "async_log", int priority = 0,
+        size_t stack_size = 2048);
+
+    /// Renders (or writes out) all pending messages. Can be called from any
+    /// thread. @return the number of messages processed.
+    unsigned flush();
+
+    /// Switches to binary output. Instead of rendering them, flush() writes
+    /// the records and the format strings to a file descriptor.
+    /// @param fd is the file descriptor to write to, or -1 to switch back to
+    /// rendering via log_output().
+    void set_binary_output(int fd);
+
+    /// @return the number of messages dropped because a ring buffer was full.
+    uint32_t dropped()
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    /// Called by async_log() to enqueue a message.
+    /// @param enc the encoded message.
+    /// @return false if the calling thread has no ring buffer, and the
+    /// message has to be logged synchronously.
+    bool push(AsyncLogEncoder *enc);
+
+    /// Renders a log record.
+    /// @param fmt the format string of the record.
+    /// @param rec the record.
+    /// @param buf output buffer; @param size is the size of buf.
+    /// @return the number of characters written to buf, excluding the
+    /// terminating zero.
+    static int render(
+        const char *fmt, const AsyncLogRecord *rec, char *buf, unsigned size);
+
+    /// Identification of binary log files, followed by the 32-bit
+    /// BINARY_VERSION. Then frames follow, each starting with a tag byte:
+    /// BINARY_FORMAT is followed by a 64-bit format id, 16-bit length and the
+    /// format string; BINARY_RECORD is followed by an AsyncLogRecord.
+    static constexpr char BINARY_MAGIC[4] = {'A', 'L', 'O', 'G'};
+    /// Version of the binary log file format.
+    static constexpr uint32_t BINARY_VERSION = 1;
+    /// Frame tag for format string definitions.
+    static constexpr uint8_t BINARY_FORMAT = 'F';
+    /// Frame tag for records.
+    static constexpr uint8_t BINARY_RECORD = 'R';
+
+private:
+    /// Ring buffer of one thread. Only the owning thread writes head, only
+    /// the consumer writes tail. The padding keeps head and tail, and the
+    /// rings of different threads, on separate cache lines (alignas would
+    /// need aligned new to allocate the logger).
+    struct Ring
+    {
+        /// Buffer of ringSize_ bytes, allocated at first use.
+        std::atomic<uint8_t *> data{nullptr};
+        /// Offset where the next record will be written.
+        std::atomic<uint32_t> head{0};
+        /// Unused.
+        uint8_t padding1[64 - sizeof(void *) - sizeof(uint32_t)];
+        /// Offset of the first record not yet consumed.
+        std::atomic<uint32_t> tail{0};
+        /// Unused.
+        uint8_t padding2[64 - sizeof(uint32_t)];
+    };
+
+    /// Background thread body.
+    void *entry() override;
+
+    /// @return the oldest unconsumed record of a ring, or nullptr if the
+    /// ring is empty. @param r the ring.
+    AsyncLogRecord *peek(Ring *r);
+
+    /// Renders or writes out a record. @param rec the record.
+    void emit(const AsyncLogRecord *rec);
+
+    /// Writes a record to the binary output. @param rec the record.
+    void write_binary(const AsyncLogRecord *rec);
+
+    /// Writes bytes to the binary output. @param data bytes to write;
+    /// @param len number of bytes.
+    void write_all(const void *data, size_t len);
+
+    /// Size of each ring buffer in bytes.
+    const unsigned ringSize_;
+    /// Ring buffers indexed by the thread number.
+    Ring rings_[MAX_THREADS];
+    /// Number of messages dropped.
+    std::atomic<uint32_t> dropped_{0};
+    /// Value of dropped_ when last reported in the log.
+    uint32_t reportedDropped_{0};
+    /// Serializes the consumers.
+    OSMutex consumerLock_;
+    /// Binary output file descriptor, or -1 for rendering.
+    int binaryFd_{-1};
+    /// Format strings already written to the binary output.
+    std::set<uint64_t> knownFormats_;
+    /// Output buffer for rendering.
+    char line_[sizeof(logbuffer)];
+    /// True when the background thread should exit.
+    std::atomic<bool> stopRequested_{false};
+    /// Posted by the background thread on exit.
+    OSSem threadExited_;
+};
+
+/// Renders binary log files written by AsyncLogger::set_binary_output(). The
+/// file has to come from a binary of the same architecture.
+class AsyncLogDecoder
+{
+public:
+    /// Called for each decoded message with the record and the rendered
+    /// line (zero terminated, without newline) and its length.
+    typedef std::function<void(
+        const AsyncLogRecord &rec, const char *line, int len)>
+        Callback;
+
+    /// Constructor. @param callback receives the decoded messages.
+    AsyncLogDecoder(Callback callback)
+        : callback_(std::move(callback))
+    {
+    }
+
+    /// Decodes a part of a binary log.
+    /// @param data next bytes of the log; @param len number of bytes.
+    /// @return false if the data is corrupt.
+    bool feed(const void *data, size_t len);
+
+    /// Decodes a binary log from a file descriptor until EOF.
+    /// @param fd file descriptor to read.
+    /// @return false if there was a read error or the data is corrupt.
+    bool decode_fd(int fd);
+
+private:
+    /// Receives the decoded lines.
+    Callback callback_;
+    /// Bytes received but not yet decoded.
+    std::string pending_;
+    /// True once the file header was checked.
+    bool headerSeen_{false};
+    /// True after a decoding error.
+    bool error_{false};
+    /// Format strings by identifier.
+    std::map<uint64_t, std::string> formats_;
+};
+
+/// Fallback of async_log for format strings that are not literals.
+template <typename... Args>
+inline bool async_log_capture(std::false_type, int, const char *, Args...)
+{
+    return false;
+}
+
+/// Captures a log call into the AsyncLogger if there is one.
+template <typename... Args>
+inline bool async_log_capture(
+    std::true_type, int level, const char *fmt, Args... args)
+{
+    if (!AsyncLogger::exists())
+    {
+        return false;
+    }
+    AsyncLogEncoder enc(level, fmt);
+    int unused[] = {0, (enc.put(args), 0)...};
+    (void)unused;
+    return AsyncLogger::instance()->push(&enc);
+}
+
+/// Hands a log call to the AsyncLogger. The format string is referenced by
+/// pointer, so only string literals (const char arrays) are captured.
+/// @param level log level; @param fmt printf format; @param args arguments
+/// referenced by the format.
+/// @return false if the message was not captured and needs to be rendered
+/// synchronously.
+template <typename F, typename... Args>
+bool async_log(int level, F &&fmt, Args... args)
+{
+    typedef typename std::remove_reference<F>::type Fmt;
+    return async_log_capture(
+        std::integral_constant<bool, std::is_array<Fmt>::value &&
+                std::is_const<typename std::remove_extent<Fmt>::type>::value>(),
+        level, fmt, args...);
+}
+
+#endif // __linux__ || __MACH__
+
+#endif // _UTILS_ASYNCLOGGING_HXX_
@@ -201,6 +201,264 @@ void DynamicPool::free(BufferBase *item)
     free_large(item);
 }
 
+#if defined(__linux__) || defined(__MACH__)
+
+/// Hands out small numbers to the threads using a LockFreePool, so that they
+/// can index the per-thread caches. The number is given back when the thread
+/// exits, and the next new thread inherits the cache contents.
+class LockFreePoolThreadId
+{
+public:
+    LockFreePoolThreadId()
+    {
+        for (unsigned i = 0; i < LockFreePool::MAX_THREADS; ++i)
+        {
+            uint32_t bit = 1u << i;
+            if ((used_.fetch_or(bit, std::memory_order_acquire) & bit) == 0)
+            {
+                id_ = i;
+                return;
+            }
+        }
+        id_ = LockFreePool::MAX_THREADS;
+    }
+
+    ~LockFreePoolThreadId()
+    {
+        if (id_ < LockFreePool::MAX_THREADS)
+        {
+            used_.fetch_and(~(1u << id_), std::memory_order_release);
+        }
+    }
+
+    /// @return the thread number, or MAX_THREADS if the thread does not have
+    /// one.
+    unsigned id()
+    {
+        return id_;
+    }
+
+private:
+    static_assert(LockFreePool::MAX_THREADS <= 32, "used_ is 32 bits");
+    /// Bit N is set if thread number N is taken.
+    static std::atomic<uint32_t> used_;
+    /// Number of the current thread.
+    unsigned id_;
+};
+
+std::atomic<uint32_t> LockFreePoolThreadId::used_{0};
+
+LockFreePool::LockFreePool(std::initializer_list<uint16_t> sizes)
+    : numClasses_(0)
+{
+    HASSERT(sizes.size() <= MAX_SIZE_CLASSES);
+    for (uint16_t s : sizes)
+    {
+        HASSERT(numClasses_ == 0 || s > bins_[numClasses_ - 1].size);
+        HASSERT(s >= sizeof(FreeItem));
+        bins_[numClasses_++].size = s;
+    }
+}
+
+LockFreePool::~LockFreePool()
+{
+    for (unsigned i = 0; i < numClasses_; ++i)
+    {
+        FreeItem *item = bins_[i].head.exchange(nullptr);
+        while (item)
+        {
+            FreeItem *next = item->next;
+            ::free(item);
+            item = next;
+        }
+        for (unsigned t = 0; t < MAX_THREADS; ++t)
+        {
+            item = caches_[t].bins[i].head;
+            while (item)
+            {
+                FreeItem *next = item->next;
+                ::free(item);
+                item = next;
+            }
+        }
+    }
+}
+
+LockFreePool::ThreadCache *LockFreePool::thread_cache()
+{
+    static thread_local LockFreePoolThreadId tid;
+    unsigned id = tid.id();
+    return id < MAX_THREADS ? &caches_[id] : nullptr;
+}
+
+void LockFreePool::push_chain(
+    GlobalBin *bin, FreeItem *first, FreeItem *last, unsigned count)
+{
+    FreeItem *head = bin->head.load(std::memory_order_relaxed);
+    do
+    {
+        last->next = head;
+    } while (!bin->head.compare_exchange_weak(
+        head, first, std::memory_order_release, std::memory_order_relaxed));
+    bin->count.fetch_add(count, std::memory_order_relaxed);
+}
+
+size_t LockFreePool::free_items()
+{
+    size_t total = 0;
+    for (unsigned i = 0; i < numClasses_; ++i)
+    {
+        total += free_items(bins_[i].size);
+    }
+    return total;
+}
+
+size_t LockFreePool::free_items(size_t size)
+{
+    for (unsigned i = 0; i < numClasses_; ++i)
+    {
+        if (bins_[i].size >= size)
+        {
+            size_t total = bins_[i].count.load(std::memory_order_relaxed);
+            for (unsigned t = 0; t < MAX_THREADS; ++t)
+            {
+                total +=
+                    caches_[t].bins[i].count.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+    }
+    return 0;
+}
+
+BufferBase *LockFreePool::alloc_untyped(size_t size, Executable *flow)
+{
+    void *result = nullptr;
+    unsigned i = 0;
+    while (i < numClasses_ && size > bins_[i].size)
+    {
+        ++i;
+    }
+    if (i >= numClasses_)
+    {
+        /* big items are just malloc'd freely */
+        result = malloc(size);
+        totalSize_.fetch_add(size, std::memory_order_relaxed);
+    }
+    else
+    {
+        ThreadCache *cache = thread_cache();
+        GlobalBin *bin = &bins_[i];
+        if (cache)
+        {
+            ThreadBin *tbin = &cache->bins[i];
+            if (!tbin->head && bin->head.load(std::memory_order_relaxed))
+            {
+                // Refills the thread cache with everything from the global
+                // bin. Taking all entries at once is immune to ABA.
+                FreeItem *chain =
+                    bin->head.exchange(nullptr, std::memory_order_acquire);
+                unsigned count = 0;
+                for (FreeItem *it = chain; it; it = it->next)
+                {
+                    ++count;
+                }
+                bin->count.fetch_sub(count, std::memory_order_relaxed);
+                tbin->head = chain;
+                tbin->count.store(count, std::memory_order_relaxed);
+            }
+            if (tbin->head)
+            {
+                result = tbin->head;
+                tbin->head = tbin->head->next;
+                tbin->count.store(tbin->count.load(std::memory_order_relaxed) -
+                        1,
+                    std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            // No cache: we take everything and put back the rest.
+            FreeItem *chain =
+                bin->head.exchange(nullptr, std::memory_order_acquire);
+            if (chain)
+            {
+                result = chain;
+                bin->count.fetch_sub(1, std::memory_order_relaxed);
+                if (chain->next)
+                {
+                    FreeItem *last = chain->next;
+                    unsigned count = 1;
+                    while (last->next)
+                    {
+                        last = last->next;
+                        ++count;
+                    }
+                    bin->count.fetch_sub(count, std::memory_order_relaxed);
+                    push_chain(bin, chain->next, last, count);
+                }
+            }
+        }
+        if (!result)
+        {
+            result = malloc(bin->size);
+            totalSize_.fetch_add(bin->size, std::memory_order_relaxed);
+        }
+    }
+    BufferBase *b = new (result) BufferBase(size, this);
+    if (flow)
+    {
+        flow->alloc_result(b);
+    }
+    return b;
+}
+
+void LockFreePool::free(BufferBase *item)
+{
+    size_t size = item->size();
+    unsigned i = 0;
+    while (i < numClasses_ && size > bins_[i].size)
+    {
+        ++i;
+    }
+    if (i >= numClasses_)
+    {
+        /* big items are just freed */
+        totalSize_.fetch_sub(size, std::memory_order_relaxed);
+        ::free(item);
+        return;
+    }
+    FreeItem *f = reinterpret_cast<FreeItem *>(item);
+    ThreadCache *cache = thread_cache();
+    if (!cache)
+    {
+        push_chain(&bins_[i], f, f, 1);
+        return;
+    }
+    ThreadBin *tbin = &cache->bins[i];
+    f->next = tbin->head;
+    tbin->head = f;
+    unsigned count = tbin->count.load(std::memory_order_relaxed) + 1;
+    if (count > CACHE_LIMIT)
+    {
+        // Gives half of the cache back to the other threads.
+        FreeItem *last = tbin->head;
+        for (unsigned j = 1; j < CACHE_LIMIT / 2; ++j)
+        {
+            last = last->next;
+        }
+        FreeItem *first = tbin->head;
+        tbin->head = last->next;
+        count -= CACHE_LIMIT / 2;
+        tbin->count.store(count, std::memory_order_relaxed);
+        push_chain(&bins_[i], first, last, CACHE_LIMIT / 2);
+        return;
+    }
+    tbin->count.store(count, std::memory_order_relaxed);
+}
+
+#endif // __linux__ || __MACH__
+
 /** Get a free item out of the pool.
  * @param size how many payload bytes should he allocated buffer have. Usually
  * sizeof<T> for Buffer<T>.
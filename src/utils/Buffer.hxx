@@ -38,10 +38,15 @@
 //#define DEBUG_BUFFER_MEMORY
 
 #include <memory>
+#include <utility>
 #include <new>
 #include <cstdint>
 #include <cstdlib>
 #include <cstdarg>
+#if defined(__linux__) || defined(__MACH__)
+#include <atomic>
+#include <initializer_list>
+#endif
 
 #include "executor/Executable.hxx"
 #include "executor/Notifiable.hxx"
@@ -182,6 +187,9 @@ protected:
     /** Allow FixedPool access to our constructor */
     friend class FixedPool;
 
+    /** Allow LockFreePool access to our constructor */
+    friend class LockFreePool;
+
     DISALLOW_COPY_AND_ASSIGN(BufferBase);
 };
 
@@ -268,6 +276,115 @@ template<typename T> BufferPtr<T> get_buffer_deleter(Buffer<T>* b) {
     return BufferPtr<T>(b);
 }
 
+/// Read-only view of a payload that is owned by a reference counted
+/// Buffer<T>. Copying a view adds a reference to the payload buffer instead of
+/// copying the payload.
+///
+/// This is useful as the value type of a buffer that is fanned out to many
+/// recipients, such as a Hub: each recipient gets its own (small) buffer with
+/// its own queue link and routing information, but all of them point to the
+/// same payload. The payload must not be modified once it is shared; use
+/// mutable_payload() to fill it in before the view is copied.
+///
+/// The reference count of Buffer is not thread-safe, so all copies of a view
+/// have to be created and destroyed on the same executor.
+template <class T> class BufferView
+{
+public:
+    /// Creates an empty view.
+    BufferView()
+        : payload_(nullptr)
+    {
+    }
+
+    /// Creates a view of a payload buffer. @param payload is the buffer to
+    /// view; the view takes ownership of the caller's reference.
+    explicit BufferView(Buffer<T> *payload)
+        : payload_(payload)
+    {
+    }
+
+    /// Copy constructor. Adds a reference to the payload. @param o is the
+    /// view to copy.
+    BufferView(const BufferView &o)
+        : payload_(o.payload_ ? o.payload_->ref() : nullptr)
+    {
+    }
+
+    /// Assignment operator. Adds a reference to the payload of o and releases
+    /// the current payload. @param o is the view to copy. @return *this.
+    BufferView &operator=(const BufferView &o)
+    {
+        reset(o.payload_ ? o.payload_->ref() : nullptr);
+        return *this;
+    }
+
+    ~BufferView()
+    {
+        reset();
+    }
+
+    /// Replaces the payload. @param payload is the new buffer to view (may be
+    /// nullptr); the view takes ownership of the caller's reference.
+    void reset(Buffer<T> *payload = nullptr)
+    {
+        if (payload_)
+        {
+            payload_->unref();
+        }
+        payload_ = payload;
+    }
+
+    /// Allocates a new payload buffer and makes this view point to it.
+    /// @param pool is where to allocate the payload from. @return the new
+    /// payload for filling in.
+    T *alloc_payload(Pool *pool = mainBufferPool);
+
+    /// @return true if this view does not point to a payload.
+    bool empty() const
+    {
+        return payload_ == nullptr;
+    }
+
+    /// @return the buffer holding the payload (or nullptr).
+    Buffer<T> *payload_buffer() const
+    {
+        return payload_;
+    }
+
+    /// @return the payload. Must not be empty.
+    const T &payload() const
+    {
+        return *payload_->data();
+    }
+
+    /// @return the payload for modification. The payload must not be shared
+    /// with other views yet.
+    T *mutable_payload()
+    {
+        HASSERT(payload_ && payload_->references() == 1);
+        return payload_->data();
+    }
+
+    /// @return the payload's data() for string-like payloads, or nullptr if
+    /// the view is empty.
+    auto data() const -> decltype(std::declval<const T &>().data())
+    {
+        return payload_ ? payload_->data()->data() : nullptr;
+    }
+
+    /// @return the payload's size() for string-like payloads, or 0 if the
+    /// view is empty.
+    size_t size() const
+    {
+        return payload_ ? payload_->data()->size() : 0;
+    }
+
+private:
+    /// Buffer owning the payload. We hold one reference.
+    Buffer<T> *payload_;
+};
+
 /** Pool of previously allocated, but currently unused, items. */
 class Pool
 {
@@ -532,6 +649,121 @@ private:
     DISALLOW_COPY_AND_ASSIGN(DynamicPool);
 };
 
+#if defined(__linux__) || defined(__MACH__)
+/** A variant of DynamicPool for multi-threaded hosts that does not take a
+ * lock when allocating or freeing buffers.
+ *
+ * Each thread keeps a small free list per size class, which it uses without
+ * any synchronization. When a thread's list runs empty, it takes all free
+ * items of that size class from a global bin; when it grows too long, half of
+ * it is returned to the global bin. The global bins are lock-free stacks that
+ * only support pushing a chain of items and taking all items, which avoids
+ * the ABA problem of a lock-free pop.
+ *
+ * Items freed by a thread are cached by that thread, even if they were
+ * allocated by another thread. Items in the cache of a thread that exited
+ * stay there (and are counted as free) until the pool is destroyed.
+ */
+class LockFreePool : public Pool
+{
+public:
+    /** Constructor.
+     * @param sizes size of each bucket, in strictly ascending order. At most
+     * MAX_SIZE_CLASSES entries.
+     */
+    LockFreePool(std::initializer_list<uint16_t> sizes);
+
+    /** Destructor. Frees all items held in the caches and bins. All buffers
+     * must have been returned to the pool. */
+    ~LockFreePool();
+
+    /** Number of free items in the pool. The value is approximate if other
+     * threads are allocating or freeing at the same time.
+     * @return number of free items in the pool
+     */
+    size_t free_items() override;
+
+    /** Number of free items in the pool for a given allocation size.
+     * @param size size of interest
+     * @return number of free items in the pool for a given allocation size
+     */
+    size_t free_items(size_t size) override;
+
+    /** @return the total memory held by this pool. */
+    size_t total_size()
+    {
+        return totalSize_.load(std::memory_order_relaxed);
+    }
+
+    /// Maximum number of bucket sizes.
+    static constexpr unsigned MAX_SIZE_CLASSES = 8;
+    /// Maximum number of threads that get their own cache. Further threads
+    /// use the global bins directly.
+    static constexpr unsigned MAX_THREADS = 32;
+    /// How many items a thread keeps in its cache per size class before
+    /// returning half of them to the global bin.
+    static constexpr unsigned CACHE_LIMIT = 64;
+
+private:
+    /// Overlay of an item that is sitting in a free list.
+    struct FreeItem
+    {
+        FreeItem *next;
+    };
+
+    /// Free list of one size class of one thread.
+    struct ThreadBin
+    {
+        /// First free item.
+        FreeItem *head{nullptr};
+        /// Number of items in the list. Written only by the owning thread,
+        /// read by free_items().
+        std::atomic<unsigned> count{0};
+    };
+
+    /// Caches belonging to one thread. Aligned to avoid false sharing.
+    struct alignas(64) ThreadCache
+    {
+        ThreadBin bins[MAX_SIZE_CLASSES];
+    };
+
+    /// Global free items of one size class.
+    struct alignas(64) GlobalBin
+    {
+        /// Item size.
+        uint16_t size{0};
+        /// Top of the lock-free stack.
+        std::atomic<FreeItem *> head{nullptr};
+        /// Number of items in the stack.
+        std::atomic<unsigned> count{0};
+    };
+
+    BufferBase *alloc_untyped(size_t size, Executable *flow) override;
+    void free(BufferBase *item) override;
+
+    /// @return the cache of the calling thread or nullptr if the thread did
+    /// not get a cache.
+    ThreadCache *thread_cache();
+
+    /// Pushes a chain of items to a global bin. @param bin is the global bin;
+    /// @param first and @param last are the ends of the chain; @param count
+    /// is the number of items in the chain.
+    static void push_chain(
+        GlobalBin *bin, FreeItem *first, FreeItem *last, unsigned count);
+
+    /// Number of valid entries in bins_.
+    unsigned numClasses_;
+    /// Global bins by size class.
+    GlobalBin bins_[MAX_SIZE_CLASSES];
+    /// Per-thread caches, indexed by the thread number.
+    ThreadCache caches_[MAX_THREADS];
+    /// Total memory allocated from the heap.
+    std::atomic<size_t> totalSize_{0};
+
+    DISALLOW_COPY_AND_ASSIGN(LockFreePool);
+};
+#endif // __linux__ || __MACH__
+
 /** Pool of fixed number of items which can be allocated up on request.
  */
 class FixedPool : public Pool, public Atomic
@@ -651,4 +883,12 @@ template <class T> void Buffer<T>::unref()
     }
 }
 
+template <class T> T *BufferView<T>::alloc_payload(Pool *pool)
+{
+    Buffer<T> *b;
+    pool->alloc(&b);
+    reset(b);
+    return b->data();
+}
+
 #endif /* _UTILS_BUFFER_HXX_ */
@@ -32,10 +32,13 @@
  * @date 26 May 2016
  */
 
+#include <string.h>
+#include <algorithm>
 #include <string>
 
 #include "utils/GcStreamParser.hxx"
 #include "utils/gc_format.h"
+#include "can_frame.h"
 
 bool GcStreamParser::consume_byte(char c)
 {
@@ -75,6 +78,114 @@ bool GcStreamParser::consume_byte(char c)
     return false;
 }
 
+size_t GcStreamParser::consume_data(
+    const char *data, size_t len, bool *complete)
+{
+    const char *p = data;
+    const char *end = data + len;
+    *complete = false;
+    while (p < end)
+    {
+        if (offset_ < 0)
+        {
+            // Drops bytes until the next frame start.
+            p = static_cast<const char *>(memchr(p, ':', end - p));
+            if (!p)
+            {
+                return len;
+            }
+            ++p;
+            offset_ = 0;
+            continue;
+        }
+        // Looks at the characters that fit into cbuf_ and one more, which
+        // is either the terminator or overruns the buffer.
+        size_t room = sizeof(cbuf_) - 1 - offset_;
+        size_t window = std::min(static_cast<size_t>(end - p), room + 1);
+        const char *term = static_cast<const char *>(memchr(p, ';', window));
+        const char *seg_end = term ? term : p + window;
+        const char *start =
+            static_cast<const char *>(memchr(p, ':', seg_end - p));
+        if (start)
+        {
+            // Frame is restarting here.
+            offset_ = 0;
+            p = start + 1;
+            continue;
+        }
+        size_t n = seg_end - p;
+        if (n > room)
+        {
+            // We overran the buffer, so this can't be a valid frame.
+            memcpy(cbuf_ + offset_, p, room);
+            offset_ = -1;
+            p = seg_end;
+            continue;
+        }
+        memcpy(cbuf_ + offset_, p, n);
+        if (term)
+        {
+            // Frame ends here.
+            cbuf_[offset_ + n] = 0;
+            offset_ = -1;
+            *complete = true;
+            return term + 1 - data;
+        }
+        offset_ += n;
+        p = seg_end;
+    }
+    return len;
+}
+
+size_t GcStreamParser::parse_frames(const char *data, size_t len,
+    struct can_frame *frames, unsigned max_frames, unsigned *num_frames)
+{
+    const char *p = data;
+    const char *end = data + len;
+    unsigned count = 0;
+    while (count < max_frames && p < end)
+    {
+        if (offset_ < 0)
+        {
+            const char *start =
+                static_cast<const char *>(memchr(p, ':', end - p));
+            if (!start)
+            {
+                p = end;
+                break;
+            }
+            // A frame that is entirely in the block and fits cbuf_ is parsed
+            // in place.
+            const char *body = start + 1;
+            size_t window =
+                std::min(static_cast<size_t>(end - body), sizeof(cbuf_));
+            const char *term =
+                static_cast<const char *>(memchr(body, ';', window));
+            if (term && !memchr(body, ':', term - body))
+            {
+                if (gc_format_parse_buffer(body, term - body, frames + count) ==
+                    0)
+                {
+                    ++count;
+                }
+                p = term + 1;
+                continue;
+            }
+            p = start;
+        }
+        // Partial, restarted and overlong frames go through the frame
+        // buffer.
+        bool complete;
+        p += consume_data(p, end - p, &complete);
+        if (complete && parse_frame_to_output(frames + count))
+        {
+            ++count;
+        }
+    }
+    *num_frames = count;
+    return p - data;
+}
+
 void GcStreamParser::frame_buffer(std::string* payload) {
     if (offset_ >= 0) {
         payload->assign(cbuf_, offset_);
@@ -35,6 +35,7 @@
 #ifndef _UTILS_GCSTREAMPARSER_HXX_
 #define _UTILS_GCSTREAMPARSER_HXX_
 
+#include <stddef.h>
 #include <string>
 
 /**
@@ -56,6 +57,32 @@ public:
      * internal buffer contains a complete frame. @param c next character. */
     bool consume_byte(char c);
 
+    /** Adds a block of characters from the source stream, stopping after the
+     * first complete frame. Equivalent to calling consume_byte() for each
+     * character, but skips to the frame delimiters with memchr().
+     *
+     * @param data next characters from the stream.
+     * @param len number of characters in data.
+     * @param complete will be set to true if the internal buffer contains a
+     * complete frame.
+     * @return the number of characters consumed. */
+    size_t consume_data(const char *data, size_t len, bool *complete);
+
+    /** Parses all frames from a block of characters. Frames that are
+     * entirely in the block are decoded in place, without copying them to the
+     * frame buffer. A partial frame at the end of the block is kept and
+     * continued by the next call. Malformed frames are dropped.
+     *
+     * @param data next characters from the stream.
+     * @param len number of characters in data.
+     * @param frames will be filled with the parsed frames.
+     * @param max_frames the number of entries in frames.
+     * @param num_frames will be set to how many frames were parsed.
+     * @return the number of characters consumed. This is less than len only
+     * if frames got full. */
+    size_t parse_frames(const char *data, size_t len,
+        struct can_frame *frames, unsigned max_frames, unsigned *num_frames);
+
     /** Parses the current contents of the frame buffer to a can_frame
      * struct. Should be called if and inly if the previous consume_char call
      * returned true.
@@ -37,16 +37,27 @@
 
 #include "nmranet_config.h"
 #include "utils/GridConnectHub.hxx"
+#include "utils/ShardedHub.hxx"
 
 void GcTcpHub::OnNewConnection(int fd)
 {
     const bool use_select =
         (config_gridconnect_tcp_use_select() == CONSTANT_TRUE);
-    create_gc_port_for_can_hub(canHub_, fd, nullptr, use_select);
+    CanHubFlow *hub = shardedHub_ ? shardedHub_->next_shard() : canHub_;
+    create_gc_port_for_can_hub(hub, fd, nullptr, use_select);
 }
 
 GcTcpHub::GcTcpHub(CanHubFlow *can_hub, int port)
     : canHub_(can_hub)
+    , shardedHub_(nullptr)
+    , tcpListener_(port, std::bind(&GcTcpHub::OnNewConnection, this,
+                                   std::placeholders::_1))
+{
+}
+
+GcTcpHub::GcTcpHub(ShardedHub<CanHubFlow> *can_hubs, int port)
+    : canHub_(can_hubs->shard(0))
+    , shardedHub_(can_hubs)
     , tcpListener_(port, std::bind(&GcTcpHub::OnNewConnection, this,
                                    std::placeholders::_1))
 {
@@ -38,6 +38,7 @@
 #include "utils/Hub.hxx"
 
 class ExecutorBase;
+template <class HFlow> class ShardedHub;
 
 /** This class runs a CAN-bus HUB listening on TCP socket using the gridconnect
  * format. Any new incoming connection will be wired into the same virtual CAN
@@ -52,6 +53,14 @@ public:
     /// onto.
     /// @param port TCp port number to listen on.
     GcTcpHub(CanHubFlow *can_hub, int port);
+
+    /// Constructor for a multi-threaded hub. Incoming connections are
+    /// assigned to the shards in a round-robin fashion.
+    ///
+    /// @param can_hubs Which sharded CAN-hub should we attach the TCP
+    /// gridconnect hub onto.
+    /// @param port TCp port number to listen on.
+    GcTcpHub(ShardedHub<CanHubFlow> *can_hubs, int port);
     ~GcTcpHub();
 
     /// @return true of the listener is ready to accept incoming connections.
@@ -70,6 +79,9 @@ private:
     /// @param can_hub Which CAN-hub should we attach the TCP gridconnect hub
     /// onto.
     CanHubFlow *canHub_;
+    /// If not null, new connections are added to the shards of this hub
+    /// instead of canHub_.
+    ShardedHub<CanHubFlow> *shardedHub_;
     /// Helper object representing the listening on the socket.
     SocketListener tcpListener_;
 };
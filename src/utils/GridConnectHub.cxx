@@ -38,6 +38,7 @@
 #include "executor/StateFlow.hxx"
 #include "can_frame.h"
 #include "nmranet_config.h"
+#include "utils/Atomic.hxx"
 #include "utils/Buffer.hxx"
 #include "utils/BufferPort.hxx"
 #include "utils/HubDevice.hxx"
@@ -46,6 +47,207 @@
 #include "utils/GcStreamParser.hxx"
 #include "utils/gc_format.h"
 
+/// Remembers the gridconnect rendering of the most recently seen CAN frames.
+///
+/// When a CAN hub has many gridconnect ports (e.g. a TCP hub with dozens of
+/// clients), every frame is cloned to every port and each port would render
+/// the very same frame into ASCII again. All ports of the same CAN hub that
+/// use the same output format share one instance of this class, so the
+/// rendering happens once per frame. Ports on string hubs copy the resulting
+/// text; ports on shared-payload hubs (SharedGCAdapter) take a reference to a
+/// buffer holding the text.
+///
+/// The instances are reference counted and kept in a global list keyed by the
+/// CAN hub and the formatting options. The cache is not thread-safe; it must
+/// only be used from the executor of the CAN hub, which is where all
+/// formatting ports of the same hub run. The same holds for the shared
+/// buffers, whose reference count is not atomic.
+class GcFormatCache
+{
+public:
+    /// Finds or creates the shared cache instance.
+    ///
+    /// @param can_hub the binary CAN hub the formatting ports are attached to.
+    /// @param double_bytes whether the output uses the double-byte format.
+    ///
+    /// @return a cache instance. Must be handed back to release() when not
+    /// needed anymore.
+    static GcFormatCache *acquire(CanHubFlow *can_hub, bool double_bytes)
+    {
+        AtomicHolder h(&lock_);
+        for (GcFormatCache *c = head_; c; c = c->next_)
+        {
+            if (c->canHub_ == can_hub && c->doubleBytes_ == double_bytes)
+            {
+                ++c->refCount_;
+                return c;
+            }
+        }
+        GcFormatCache *c = new GcFormatCache(can_hub, double_bytes);
+        c->next_ = head_;
+        head_ = c;
+        return c;
+    }
+
+    /// Gives back a reference to a cache instance. Deletes the instance when
+    /// the last reference is released.
+    ///
+    /// @param cache instance from acquire().
+    static void release(GcFormatCache *cache)
+    {
+        AtomicHolder h(&lock_);
+        if (--cache->refCount_)
+        {
+            return;
+        }
+        for (GcFormatCache **p = &head_; *p; p = &(*p)->next_)
+        {
+            if (*p == cache)
+            {
+                *p = cache->next_;
+                break;
+            }
+        }
+        delete cache;
+    }
+
+    /// Renders a CAN frame into gridconnect format, or looks up a previous
+    /// rendering of an identical frame.
+    ///
+    /// @param frame the CAN frame to render.
+    /// @param size will be filled with the number of characters rendered.
+    ///
+    /// @return pointer to the rendered characters. Valid until the next call
+    /// to format() on the same cache.
+    const char *format(const struct can_frame *frame, size_t *size)
+    {
+        Entry *e = render(frame);
+        *size = e->length;
+        return e->text;
+    }
+
+    /// Renders a CAN frame into gridconnect format into a reference counted
+    /// buffer, or looks up a previous rendering of an identical frame. The
+    /// ports that forward the same frame get references to the same buffer.
+    ///
+    /// @param frame the CAN frame to render.
+    ///
+    /// @return a view of the rendered characters.
+    BufferView<string> format_shared(const struct can_frame *frame)
+    {
+        Entry *e = render(frame);
+        if (e->shared.empty())
+        {
+            e->shared.alloc_payload()->assign(e->text, e->length);
+        }
+        return e->shared;
+    }
+
+private:
+    /// How many recent frames to remember. The ports of a hub usually process
+    /// the same frame right after each other, but the executor may interleave
+    /// the next frame's dispatch, so we keep a few of them.
+    static constexpr unsigned CACHE_SIZE = 4;
+
+    /// One remembered rendering.
+    struct Entry
+    {
+        /// Source frame.
+        struct can_frame frame;
+        /// Number of valid characters in text. 0 if the entry is empty.
+        size_t size;
+        /// Number of characters rendered into text, even if the entry is not
+        /// a valid cache entry.
+        size_t length;
+        /// Rendered characters. Double format with newline is 58 bytes.
+        char text[64];
+        /// The same characters in a shared buffer; filled in on demand.
+        BufferView<string> shared;
+    };
+
+    /// Constructor. @param can_hub the hub; @param double_bytes the format.
+    GcFormatCache(CanHubFlow *can_hub, bool double_bytes)
+        : canHub_(can_hub)
+        , next_(nullptr)
+        , refCount_(1)
+        , nextEntry_(0)
+        , doubleBytes_(double_bytes ? 1 : 0)
+    {
+        for (unsigned i = 0; i < CACHE_SIZE; ++i)
+        {
+            entries_[i].size = 0;
+        }
+    }
+
+    /// Finds the cache entry of a CAN frame, or renders the frame into a new
+    /// entry. @param frame the CAN frame. @return the entry with the
+    /// rendering of frame.
+    Entry *render(const struct can_frame *frame)
+    {
+        if (frame->can_dlc > 8)
+        {
+            // Invalid frame, we do not bother caching it.
+            Entry *e = &entries_[nextEntry_];
+            e->size = 0;
+            e->shared.reset();
+            e->length = gc_format_generate(frame, e->text, doubleBytes_) - e->text;
+            return e;
+        }
+        unsigned idx = nextEntry_;
+        for (unsigned i = 0; i < CACHE_SIZE; ++i)
+        {
+            idx = (idx + CACHE_SIZE - 1) % CACHE_SIZE;
+            if (entries_[idx].size && same_frame(entries_[idx].frame, *frame))
+            {
+                return &entries_[idx];
+            }
+        }
+        Entry *e = &entries_[nextEntry_];
+        nextEntry_ = (nextEntry_ + 1) % CACHE_SIZE;
+        e->frame = *frame;
+        e->shared.reset();
+        e->length = gc_format_generate(frame, e->text, doubleBytes_) - e->text;
+        e->size = e->length;
+        return e;
+    }
+
+    /// Compares two CAN frames for equality of their rendering.
+    ///
+    /// @param a first frame
+    /// @param b second frame; must have dlc <= 8.
+    ///
+    /// @return true if the two frames render to the same gridconnect text.
+    static bool same_frame(const struct can_frame &a, const struct can_frame &b)
+    {
+        return a.can_id == b.can_id && a.can_dlc == b.can_dlc &&
+            !IS_CAN_FRAME_EFF(a) == !IS_CAN_FRAME_EFF(b) &&
+            !IS_CAN_FRAME_RTR(a) == !IS_CAN_FRAME_RTR(b) &&
+            !IS_CAN_FRAME_ERR(a) == !IS_CAN_FRAME_ERR(b) &&
+            memcmp(a.data, b.data, b.can_dlc) == 0;
+    }
+
+    /// Protects the global list of instances.
+    static Atomic lock_;
+    /// Head of the global list of instances.
+    static GcFormatCache *head_;
+
+    /// Which hub this cache belongs to.
+    CanHubFlow *canHub_;
+    /// Next instance in the global list.
+    GcFormatCache *next_;
+    /// How many formatting ports share this instance.
+    unsigned refCount_;
+    /// Which entry to overwrite next. The entry before it is the newest.
+    unsigned nextEntry_ : 8;
+    /// 1 if the double-byte format should be generated.
+    unsigned doubleBytes_ : 1;
+    /// Recently rendered frames.
+    Entry entries_[CACHE_SIZE];
+};
+
+Atomic GcFormatCache::lock_;
+GcFormatCache *GcFormatCache::head_ = nullptr;
+
 /// Actual implementation for the gridconnect bridge between a string-typed Hub
 /// and a CAN-frame-typed Hub.
 class GCAdapter : public GCAdapterBase
@@ -57,9 +259,14 @@ public:
     /// @param can_side A hub of type struct can_frame, the binary side.
     /// @param double_bytes if true, upon rendering data each byte will be
     /// doubled. This is an anciant workaround.
-    GCAdapter(HubFlow *gc_side, CanHubFlow *can_side, bool double_bytes)
+    /// @param share_format if true, the rendered gridconnect text will be
+    /// shared with other ports of the same CAN hub.
+    GCAdapter(HubFlow *gc_side, CanHubFlow *can_side, bool double_bytes,
+        bool share_format)
         : parser_(can_side->service(), can_side, &formatter_)
-        , formatter_(can_side->service(), gc_side, &parser_, double_bytes)
+        , formatter_(can_side->service(), gc_side, &parser_, double_bytes,
+              share_format ? GcFormatCache::acquire(can_side, double_bytes)
+                           : nullptr)
     {
         gc_side->register_port(&parser_);
         can_side->register_port(&formatter_);
@@ -75,10 +282,14 @@ public:
     /// @param can_side  A hub of type struct can_frame, the binary side.
     /// @param double_bytes  if true, upon rendering data each byte will be
     /// doubled. This is an anciant workaround.
+    /// @param share_format if true, the rendered gridconnect text will be
+    /// shared with other ports of the same CAN hub.
     GCAdapter(HubFlow *gc_side_read, HubFlow *gc_side_write,
-        CanHubFlow *can_side, bool double_bytes)
+        CanHubFlow *can_side, bool double_bytes, bool share_format)
         : parser_(can_side->service(), can_side, &formatter_)
-        , formatter_(can_side->service(), gc_side_write, &parser_, double_bytes)
+        , formatter_(can_side->service(), gc_side_write, &parser_, double_bytes,
+              share_format ? GcFormatCache::acquire(can_side, double_bytes)
+                           : nullptr)
     {
         gc_side_read->register_port(&parser_);
         can_side->register_port(&formatter_);
@@ -122,17 +333,28 @@ public:
         /// packets to.
         /// @param double_bytes if true, upon rendering data each byte will be
         /// doubled. This is an anciant workaround.
+        /// @param cache if not null, a shared format cache to render the
+        /// frames with. Takes ownership of the reference.
         BinaryToGCMember(Service *service, HubFlow *destination,
-            HubPort *skip_member, int double_bytes)
+            HubPort *skip_member, int double_bytes, GcFormatCache *cache)
             : CanHubPort(service)
             , delayPort_(service, destination, config_gridconnect_buffer_size(),
                   USEC_TO_NSEC(config_gridconnect_buffer_delay_usec()))
             , destination_(destination)
             , skipMember_(skip_member)
             , double_bytes_(double_bytes)
+            , formatCache_(cache)
         {
         }
 
+        ~BinaryToGCMember()
+        {
+            if (formatCache_)
+            {
+                GcFormatCache::release(formatCache_);
+            }
+        }
+
         /// @return where to write the packets to.
         HubFlow *destination()
         {
@@ -147,9 +369,19 @@ public:
         {
             LOG(VERBOSE, "can packet arrived: %" PRIx32,
                 GET_CAN_FRAME_ID_EFF(*message()->data()));
-            char *end =
-                gc_format_generate(message()->data(), dbuf_, double_bytes_);
-            size_t size = (end - dbuf_);
+            const char *text;
+            size_t size;
+            if (formatCache_)
+            {
+                text = formatCache_->format(message()->data(), &size);
+            }
+            else
+            {
+                char *end =
+                    gc_format_generate(message()->data(), dbuf_, double_bytes_);
+                text = dbuf_;
+                size = (end - dbuf_);
+            }
             if (size)
             {
                 Buffer<HubData> *target_buffer = nullptr;
@@ -159,7 +391,7 @@ public:
                 /// @todo(balazs.racz) try to use an assign function for better
                 /// performance.
                 target_buffer->data()->resize(size);
-                memcpy((char *)target_buffer->data()->data(), dbuf_, size);
+                memcpy((char *)target_buffer->data()->data(), text, size);
                 target_buffer->set_done(bn_.reset(this));
                 delayPort_.send(target_buffer, 0);
                 release();
@@ -189,14 +421,17 @@ public:
         HubPort *skipMember_;
         /// Non-zero if doubling was requested.
         int double_bytes_;
+        /// If not null, renders the frames shared with other ports.
+        GcFormatCache *formatCache_;
         /// Helper object
         BarrierNotifiable bn_;
     };
 
     /// HubPort (on a string hub) that turns a gridconnect-formatted CAN packet
     /// into a binary CAN packet, and sends them off to the HubFlow (of CAN
-    /// frame).
-    class GCToBinaryMember : public HubPort
+    /// frame). HPort is the port base class of the string hub, HubPort or
+    /// SharedHubPort.
+    template <class HPort> class GCToBinaryMemberBase : public HPort
     {
     public:
         /// Constructor.
@@ -205,9 +440,9 @@ public:
         /// @param destination Where to write converted binary packets.
         /// @param skip_member what to set skipMember_ of the outgoing packets
         /// to.
-        GCToBinaryMember(
+        GCToBinaryMemberBase(
             Service *service, CanHubFlow *destination, CanHubPort *skip_member)
-            : HubPort(service)
+            : HPort(service)
             , destination_(destination)
             , skipMember_(skip_member)
         {
@@ -226,37 +461,41 @@ public:
         }
 
         /** Takes more characters from the pending incoming buffer. @return next state */
-        Action entry() override
+        StateFlowBase::Action entry() override
         {
-            inBuf_ = message()->data()->data();
-            inBufSize_ = message()->data()->size();
-            return call_immediately(STATE(parse_more_data));
+            inBuf_ = this->message()->data()->data();
+            inBufSize_ = this->message()->data()->size();
+            return this->call_immediately(STATE(parse_more_data));
         }
 
         /// Matches the incoming characters to the pattern to form incoming
         /// frames. @return next state.
-        Action parse_more_data()
+        StateFlowBase::Action parse_more_data()
         {
-            while (inBufSize_--)
+            while (inBufSize_)
             {
-                char c = *inBuf_++;
-                if (streamSegmenter_.consume_byte(c))
+                bool complete;
+                size_t len =
+                    streamSegmenter_.consume_data(inBuf_, inBufSize_, &complete);
+                inBuf_ += len;
+                inBufSize_ -= len;
+                if (complete)
                 {
                     // End of frame. Allocate an output buffer and parse the
                     // frame.
-                    return allocate_and_call(destination_, STATE(parse_to_output_frame), frameAllocator_.get());
+                    return this->allocate_and_call(destination_, STATE(parse_to_output_frame), frameAllocator_.get());
                 }
             }
             // Will notify the caller.
-            return release_and_exit();
+            return this->release_and_exit();
         }
 
         /** Takes the completed frame in cbuf_, parses it into the allocation
          * result (a can pipe buffer) and sends off frame. Then comes back to
          * process buffer. @return next state. */
-        Action parse_to_output_frame()
+        StateFlowBase::Action parse_to_output_frame()
         {
-            auto* b = get_allocation_result(destination_);
+            auto* b = this->get_allocation_result(destination_);
             if (streamSegmenter_.parse_frame_to_output(b->data()))
             {
                 b->data()->skipMember_ = skipMember_;
@@ -267,7 +506,7 @@ public:
                 // Releases the buffer.
                 b->unref();
             }
-            return call_immediately(STATE(parse_more_data));
+            return this->call_immediately(STATE(parse_more_data));
         }
 
     private:
@@ -291,6 +530,9 @@ public:
         CanHubPortInterface *skipMember_;
     };
 
+    /// Parser port for string hubs.
+    typedef GCToBinaryMemberBase<HubPort> GCToBinaryMember;
+
 private:
     /// PipeMember doing the parsing.
     GCToBinaryMember parser_;
@@ -300,19 +542,184 @@ private:
     unsigned isRegistered_ : 1;
 };
 
+/// Gridconnect bridge between a shared-payload string hub and a CAN hub. Each
+/// CAN frame is rendered once into a reference counted buffer (via the
+/// GcFormatCache of the CAN hub), and every bridge of the same CAN hub sends
+/// a reference to that buffer to its gridconnect hub, so the text is neither
+/// copied nor allocated per port.
+class SharedGCAdapter : public GCAdapterBase
+{
+public:
+    /// Constructor.
+    ///
+    /// @param gc_side A shared-payload string hub, the gridconnect side.
+    /// @param can_side A hub of type struct can_frame, the binary side.
+    /// @param double_bytes if true, upon rendering data each byte will be
+    /// doubled.
+    SharedGCAdapter(
+        SharedHubFlow *gc_side, CanHubFlow *can_side, bool double_bytes)
+        : parser_(can_side->service(), can_side, &formatter_)
+        , formatter_(can_side->service(), gc_side, &parser_,
+              GcFormatCache::acquire(can_side, double_bytes))
+    {
+        gc_side->register_port(&parser_);
+        can_side->register_port(&formatter_);
+        isRegistered_ = 1;
+    }
+
+    ~SharedGCAdapter()
+    {
+        unregister();
+    }
+
+    /// Unregisters the ports from the hubs.
+    void unregister()
+    {
+        if (isRegistered_)
+        {
+            parser_.destination()->unregister_port(&formatter_);
+            formatter_.destination()->unregister_port(&parser_);
+            isRegistered_ = 0;
+        }
+    }
+
+    bool shutdown() override
+    {
+        unregister();
+        return formatter_.shutdown() && parser_.is_waiting() &&
+            formatter_.is_waiting();
+    }
+
+    /// Port on the CAN hub that sends the shared rendering of each CAN frame
+    /// to the gridconnect hub.
+    class SharedBinaryToGCMember : public CanHubPort
+    {
+    public:
+        /// Constructor.
+        ///
+        /// @param service which executor to run on
+        /// @param destination string hub where to write gridconnect data to.
+        /// @param skip_member what to set the skipMember_ field of the
+        /// outgoing packets to.
+        /// @param cache the shared format cache to render the frames with.
+        /// Takes ownership of the reference.
+        SharedBinaryToGCMember(Service *service, SharedHubFlow *destination,
+            SharedHubPortInterface *skip_member, GcFormatCache *cache)
+            : CanHubPort(service)
+            , destination_(destination)
+            , skipMember_(skip_member)
+            , formatCache_(cache)
+        {
+        }
+
+        ~SharedBinaryToGCMember()
+        {
+            GcFormatCache::release(formatCache_);
+        }
+
+        /// @return where to write the packets to.
+        SharedHubFlow *destination()
+        {
+            return destination_;
+        }
+
+        /// @return true if all packets were written out.
+        bool shutdown()
+        {
+            if (pending_ && !bn_.abort_if_almost_done())
+            {
+                return false;
+            }
+            pending_ = 0;
+            return true;
+        }
+
+        Action entry() override
+        {
+            BufferView<string> text =
+                formatCache_->format_shared(message()->data());
+            release();
+            if (!text.size())
+            {
+                LOG(INFO, "gc generate failed.");
+                return exit();
+            }
+            if (!pending_)
+            {
+                bn_.reset(this);
+            }
+            Buffer<SharedHubData> *b;
+            mainBufferPool->alloc(&b);
+            b->data()->skipMember_ = skipMember_;
+            *static_cast<BufferView<string> *>(b->data()) = text;
+            b->set_done(bn_.new_child());
+            destination_->send(b);
+            if (++pending_ < MAX_PENDING)
+            {
+                return exit();
+            }
+            // Flow control: waits until the device wrote out the packets.
+            pending_ = 0;
+            bn_.notify();
+            return wait_and_call(STATE(all_written));
+        }
+
+        /// Called when the outstanding packets are written. @return next
+        /// state.
+        Action all_written()
+        {
+            return exit();
+        }
+
+    private:
+        /// How many packets we send to the gridconnect hub before waiting
+        /// for them to be written out.
+        static constexpr unsigned MAX_PENDING = 16;
+
+        /// Pipe to send data to.
+        SharedHubFlow *destination_;
+        /// The pipe member that should be sent as "source".
+        SharedHubPortInterface *skipMember_;
+        /// Renders the frames shared with other ports.
+        GcFormatCache *formatCache_;
+        /// Number of packets sent since bn_ was armed.
+        unsigned pending_{0};
+        /// Gets a child for every packet sent; notifies us when all of them
+        /// are written out.
+        BarrierNotifiable bn_;
+    };
+
+private:
+    /// Port doing the parsing.
+    GCAdapter::GCToBinaryMemberBase<SharedHubPort> parser_;
+    /// Port doing the formatting.
+    SharedBinaryToGCMember formatter_;
+    /// 1 if the flows are registered.
+    unsigned isRegistered_ : 1;
+};
+
 GCAdapterBase *GCAdapterBase::CreateGridConnectAdapter(HubFlow *gc_side,
                                                        CanHubFlow *can_side,
-                                                       bool double_bytes)
+                                                       bool double_bytes,
+                                                       bool share_format)
 {
-    return new GCAdapter(gc_side, can_side, double_bytes);
+    return new GCAdapter(gc_side, can_side, double_bytes, share_format);
 }
 
 GCAdapterBase *GCAdapterBase::CreateGridConnectAdapter(HubFlow *gc_side_read,
                                                        HubFlow *gc_side_write,
                                                        CanHubFlow *can_side,
-                                                       bool double_bytes)
+                                                       bool double_bytes,
+                                                       bool share_format)
 {
-    return new GCAdapter(gc_side_read, gc_side_write, can_side, double_bytes);
+    return new GCAdapter(
+        gc_side_read, gc_side_write, can_side, double_bytes, share_format);
+}
+
+GCAdapterBase *GCAdapterBase::CreateGridConnectAdapter(
+    SharedHubFlow *gc_side, CanHubFlow *can_side, bool double_bytes)
+{
+    return new SharedGCAdapter(gc_side, can_side, double_bytes);
 }
 
 /// Implementation for the gridconnect bridge. Owns all necessary structures,
@@ -384,7 +791,10 @@ GcPacketPrinter::~GcPacketPrinter()
 ///
 /// Sends a notification to the application level when there is an error on the
 /// device and the connection is closed.
-struct GcHubPort : public Executable
+///
+/// HFlow is the type of the gridconnect hub: HubFlow, or SharedHubFlow for
+/// select-based ports.
+template <class HFlow> struct GcHubPort : public Executable
 {
     /// Constructor.
     ///
@@ -397,15 +807,11 @@ struct GcHubPort : public Executable
     GcHubPort(CanHubFlow *can_hub, int fd, Notifiable *on_exit, bool use_select)
         : gcHub_(can_hub->service())
         , bridge_(
-              GCAdapterBase::CreateGridConnectAdapter(&gcHub_, can_hub, false))
+              create_adapter(&gcHub_, can_hub))
         , onExit_(on_exit)
     {
         LOG(VERBOSE, "gchub port %p", (Executable *)this);
-        if (use_select) {
-            gcWrite_.reset(new HubDeviceSelect<HubFlow>(&gcHub_, fd, this));
-        } else {
-            gcWrite_.reset(new FdHubPort<HubFlow>(&gcHub_, fd, this));
-        }
+        gcWrite_.reset(create_device(&gcHub_, fd, use_select));
     }
     virtual ~GcHubPort()
     {
@@ -417,7 +823,7 @@ struct GcHubPort : public Executable
      * Destruction requirement: HubFlow should be empty. This means after the
      * disconnection of the bridge (write side) and the FdHubport (read side)
      * we need to wait for the executor until this flow drains. */
-    HubFlow gcHub_;
+    HFlow gcHub_;
     /** Translates packets between the can-hub of the device and the char-hub
      * of this port.
      *
@@ -442,6 +848,47 @@ struct GcHubPort : public Executable
         gcHub_.service()->executor()->add(this);
     }
 
+    /// Creates the bridge for a string hub. The rendered text is shared with
+    /// the other gridconnect ports of the same CAN hub. @param hub the
+    /// gridconnect hub; @param can_hub the CAN hub. @return the bridge.
+    static GCAdapterBase *create_adapter(HubFlow *hub, CanHubFlow *can_hub)
+    {
+        return GCAdapterBase::CreateGridConnectAdapter(
+            hub, can_hub, false, true);
+    }
+
+    /// Creates the bridge for a shared-payload hub. @param hub the
+    /// gridconnect hub; @param can_hub the CAN hub. @return the bridge.
+    static GCAdapterBase *create_adapter(
+        SharedHubFlow *hub, CanHubFlow *can_hub)
+    {
+        return GCAdapterBase::CreateGridConnectAdapter(hub, can_hub, false);
+    }
+
+    /// Creates the device port for a string hub.
+    /// @param hub the gridconnect hub; @param fd the device; @param
+    /// use_select true for select, false for threads. @return the port.
+    FdHubPortInterface *create_device(HubFlow *hub, int fd, bool use_select)
+    {
+        if (use_select)
+        {
+            return new HubDeviceSelect<HubFlow>(hub, fd, this);
+        }
+        return new FdHubPort<HubFlow>(hub, fd, this);
+    }
+
+    /// Creates the device port for a shared-payload hub.
+    /// @param hub the gridconnect hub; @param fd the device. @return the
+    /// port.
+    FdHubPortInterface *create_device(SharedHubFlow *hub, int fd, bool)
+    {
+        // The packets are not coalesced by a BufferPort here; the queued
+        // packets are written together instead. Batching is turned on before
+        // the port is registered on the hub.
+        return new HubDeviceSelect<SharedHubFlow>(hub, fd, this,
+            HubDeviceSelect<SharedHubFlow>::DEFAULT_BATCH_BYTES);
+    }
+
     void run() OVERRIDE
     {
         if (!bridge_->shutdown() || !gcHub_.is_waiting())
@@ -467,5 +914,12 @@ struct GcHubPort : public Executable
 void create_gc_port_for_can_hub(
     CanHubFlow *can_hub, int fd, Notifiable *on_exit, bool use_select)
 {
-    new GcHubPort(can_hub, fd, on_exit, use_select);
+    if (use_select)
+    {
+        new GcHubPort<SharedHubFlow>(can_hub, fd, on_exit, true);
+    }
+    else
+    {
+        new GcHubPort<HubFlow>(can_hub, fd, on_exit, false);
+    }
 }
@@ -77,12 +77,18 @@ public:
        @param double_bytes if true, any frame rendered into the GC protocol
        will have their characters doubled.
 
+       @param share_format if true, the gridconnect rendering of each frame
+       will be shared with all other sharing adapters of the same can_side
+       and format, so that a frame going out on many ports is rendered only
+       once.
+
        @return a pointer to the created object. It can be deleted, which will
        terminate the link and unregister the link members from both pipes.
     */
     static GCAdapterBase *CreateGridConnectAdapter(HubFlow *gc_side,
                                                    CanHubFlow *can_side,
-                                                   bool double_bytes);
+                                                   bool double_bytes,
+                                                   bool share_format = false);
 
     /// Creates a gridconnect-CAN bridge with separate pipes for reading
     /// (parsing) from the GC side and writing (formatting) to the GC side. */
@@ -95,12 +101,30 @@ public:
     /// is done via.
     /// @param double_bytes  if true, any frame rendered into the GC protocol
     ///   will have their characters doubled.
+    /// @param share_format if true, the rendered gridconnect text is shared
+    ///   with all other sharing adapters of the same can_side and format.
     ///
     /// @return a pointer to the created object. It can be deleted, which will
     ///   terminate the link and unregister the link members from both pipes.
     ///
     static GCAdapterBase *CreateGridConnectAdapter(HubFlow *gc_side_read,
-        HubFlow *gc_side_write, CanHubFlow *can_side, bool double_bytes);
+        HubFlow *gc_side_write, CanHubFlow *can_side, bool double_bytes,
+        bool share_format = false);
+
+    /// Creates a gridconnect-CAN bridge to a shared-payload string hub. Each
+    /// CAN frame is rendered once, and all such bridges of the same can_side
+    /// send references to the same rendered buffer instead of copies.
+    ///
+    /// @param gc_side is the shared-payload hub that has the ASCII
+    /// GridConnect traffic.
+    /// @param can_side is the Hub that has the binary CAN traffic.
+    /// @param double_bytes if true, any frame rendered into the GC protocol
+    ///   will have their characters doubled.
+    ///
+    /// @return a pointer to the created object. It can be deleted, which will
+    ///   terminate the link and unregister the link members from both pipes.
+    static GCAdapterBase *CreateGridConnectAdapter(
+        SharedHubFlow *gc_side, CanHubFlow *can_side, bool double_bytes);
 };
 
 /** Create this port for a CAN hub and all packets will be written to stdout in
@@ -135,7 +159,10 @@ private:
  * @param on_exit is a notifiable (may be null) which will be called in case
  * an error is encountered on this port and the port is subsequently closed.
  * @param use_select when true, the FD will be used with select, when false,
- * separate threads will be started with blocking read and write calls. */
+ * separate threads will be started with blocking read and write calls. With
+ * select, the port shares the rendered text of each frame with the other
+ * such ports of the same CAN hub, and packets queued for the fd are written
+ * with one writev() call. */
 void create_gc_port_for_can_hub(CanHubFlow *can_hub, int fd,
     Notifiable *on_exit = nullptr, bool use_select = false);
 
@@ -132,6 +132,15 @@ typedef HubContainer<string> HubData;
  */
 typedef HubContainer<CanFrameContainer> CanHubData;
 
+/** This class can be sent via a Buffer to a shared-payload (string) hub.
+ *
+ * The data is held in a separate, reference counted buffer. When the hub
+ * sends a packet to multiple ports, every port gets its own small buffer with
+ * its own skipMember_, but the characters are not copied. Fill in the data
+ * via BufferView::alloc_payload() before sending the packet to the hub.
+ */
+typedef HubContainer<BufferView<string>> SharedHubData;
+
 /** All ports interfacing via a hub will have to derive from this flow. */
 typedef FlowInterface<Buffer<HubData>> HubPortInterface;
 /// Base class for a port to an ascii hub that is implemented as a stateflow.
@@ -140,6 +149,11 @@ typedef StateFlow<Buffer<HubData>, QList<1>> HubPort;
 typedef FlowInterface<Buffer<CanHubData>> CanHubPortInterface;
 /// Base class for a port to an CAN hub that is implemented as a stateflow.
 typedef StateFlow<Buffer<CanHubData>, QList<1>> CanHubPort;
+/// Interface class for a port to a shared-payload hub.
+typedef FlowInterface<Buffer<SharedHubData>> SharedHubPortInterface;
+/// Base class for a port to a shared-payload hub that is implemented as a
+/// stateflow.
+typedef StateFlow<Buffer<SharedHubData>, QList<1>> SharedHubPort;
 
 /// This should work for both 32 and 64-bit architectures.
 static const uintptr_t POINTER_MASK = UINTPTR_MAX;
@@ -181,6 +195,9 @@ public:
 typedef GenericHubFlow<HubData> HubFlow;
 /** A hub that proxies packets of CAN frames. */
 typedef GenericHubFlow<CanHubData> CanHubFlow;
+/** A hub that proxies packets of untyped data without copying the data for
+ * each port. */
+typedef GenericHubFlow<SharedHubData> SharedHubFlow;
 
 /** This port prints all traffic from a (string-typed) hub to stdout. */
 class DisplayPort : public HubPort
@@ -37,6 +37,13 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <fcntl.h>
+#if defined(__linux__) || defined(__MACH__)
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <memory>
+#include <vector>
+#endif
 
 #include "executor/StateFlow.hxx"
 #include "freertos/can_ioctl.h"
@@ -73,6 +80,31 @@ template <> struct SelectBufferInfo<HubFlow::buffer_type>
     }
 };
 
+/// Partial template specialization of buffer traits for shared-payload
+/// hubs. Every read goes to a freshly allocated payload buffer.
+template <> struct SelectBufferInfo<SharedHubFlow::buffer_type>
+{
+    /// Preps a buffer for receiving data. @param b is the buffer to prep.
+    static void resize_target(SharedHubFlow::buffer_type *b)
+    {
+        b->data()->alloc_payload()->resize(64);
+    }
+    /// Clears out all potential empty space left after a buffer has been
+    /// partially filled. @param b is the buffer, @param remaining is how many
+    /// bytes we did not fill.
+    static void check_target_size(SharedHubFlow::buffer_type *b, int remaining)
+    {
+        HASSERT(remaining >= 0);
+        HASSERT(remaining <= 64);
+        b->data()->mutable_payload()->resize(64 - remaining);
+    }
+    /// @return false because we can deal with a partial read.
+    static bool needs_read_fully()
+    {
+        return false;
+    }
+};
+
 /// Partial template specialization of buffer traits for struct-typed hubs.
 template <class T>
 struct SelectBufferInfo<Buffer<HubContainer<StructContainer<T>>>>
@@ -138,6 +170,13 @@ struct SelectBufferInfo<Buffer<CanHubData>> {
 /// hub: for string-typed hubs in 64 bytes units; for hubs of specific
 /// structures (such as CAN frame, dcc Packets or dcc Feedback structures) in
 /// the units ofthe size of the structure.
+///
+/// On Linux and Mac hosts the device can be created in batching mode by
+/// passing a byte budget to the constructor. In this mode all packets that
+/// are queued for the device are written with a single writev() call
+/// (sendmmsg() for datagram sockets, such as SocketCAN), and for the
+/// fixed-size packet types the read flow reads many packets with one read()
+/// (recvmmsg()) call.
 template <class HFlow>
 class HubDeviceSelect : public FdHubPortInterface, private Atomic, public Service
 {
@@ -157,6 +196,7 @@ public:
         HASSERT(fd_ >= 0);
         barrier_.new_child();
         hub_->register_port(write_port());
+        readFlow_.start();
     }
 #endif
 
@@ -167,7 +207,11 @@ public:
     /// @param fd the filedes to read/write data from/to.
     /// @param on_error notifiable that will be called when a write or read
     /// error is encountered.
-    HubDeviceSelect(HFlow *hub, int fd, Notifiable *on_error = nullptr)
+    /// @param batch_bytes if non-zero, the device is created in batching mode
+    /// with this byte budget (see enable_batching()). Ignored where batching
+    /// is not supported.
+    HubDeviceSelect(HFlow *hub, int fd, Notifiable *on_error = nullptr,
+        unsigned batch_bytes = 0)
         : FdHubPortInterface(fd)
         , Service(hub->service()->executor())
         , barrier_(on_error ? on_error : EmptyNotifiable::DefaultInstance())
@@ -182,30 +226,50 @@ public:
         ioctlsocket(fd_, FIONBIO, &par);
 #else
         ::fcntl(fd, F_SETFL, O_RDWR | O_NONBLOCK);
+#endif
+#if defined(__linux__) || defined(__MACH__)
+        if (batch_bytes)
+        {
+            enable_batching(batch_bytes);
+        }
+#else
+        (void)batch_bytes;
 #endif
         hub_->register_port(write_port());
+        readFlow_.start();
     }
 
     virtual ~HubDeviceSelect()
     {
-        if (fd_ >= 0) {
-            unregister_write_port();
-            int fd = -1;
-            executor()->sync_run([this, &fd]()
+        int fd = -1;
+        // The fd is checked on the executor, because a read or write error
+        // might be shutting down the port concurrently. The fd is cleared
+        // before the shutdown marker is queued, so that the marker (which is
+        // a full frame for fixed-size types) never gets written to the
+        // device.
+        executor()->sync_run([this, &fd]()
+                             {
+                                 if (fd_ < 0)
                                  {
-                                     fd = fd_;
-                                     fd_ = -1;
-                                     readFlow_.shutdown();
-                                     writeFlow_.shutdown();
-                                 });
+                                     // Already shut down due to an error.
+                                     return;
+                                 }
+                                 fd = fd_;
+                                 fd_ = -1;
+                                 readFlow_.shutdown();
+                                 writeFlow_.shutdown();
+                                 unregister_write_port();
+                             });
+        if (fd >= 0)
+        {
             ::close(fd);
-            bool completed = false;
-            while (!completed) {
-                executor()->sync_run([this, &completed]()
-                                 {
-                                     if (barrier_.is_done()) completed = true;
-                                 });
-            }
+        }
+        bool completed = false;
+        while (!completed) {
+            executor()->sync_run([this, &completed]()
+                             {
+                                 if (barrier_.is_done()) completed = true;
+                             });
         }
     }
 
@@ -215,6 +279,9 @@ public:
         return hub_;
     }
 
+    /// Default byte budget for batched I/O.
+    static constexpr unsigned DEFAULT_BATCH_BYTES = 2048;
+
     /// @return the write flow belonging to this device.
     typename HFlow::port_type *write_port()
     {
@@ -233,6 +300,35 @@ public:
         writeFlow_.send(b);
     }
 
+private:
+#if defined(__linux__) || defined(__MACH__)
+    /// Switches the device to batched reads and writes. Called from the
+    /// constructor, before the port is registered and the read flow is
+    /// started.
+    ///
+    /// @param max_bytes how many bytes to write in one syscall at most
+    /// (approximately; the last packet may go over), and how large the read
+    /// buffer should be.
+    void enable_batching(unsigned max_bytes = DEFAULT_BATCH_BYTES)
+    {
+        int type = SOCK_STREAM;
+        socklen_t len = sizeof(type);
+        // Pipes, ttys and character devices fail here; those are all streams.
+        bool datagram =
+            ::getsockopt(fd_, SOL_SOCKET, SO_TYPE, &type, &len) == 0 &&
+            type != SOCK_STREAM;
+#ifndef __linux__
+        if (datagram)
+        {
+            // No sendmmsg() and recvmmsg() here.
+            return;
+        }
+#endif
+        writeFlow_.enable_batching(max_bytes, datagram);
+        readFlow_.enable_batching(max_bytes, datagram);
+    }
+#endif
+
 protected:
     /// State flow implementing select-aware fd reads.
     class ReadFlow : public StateFlowBase
@@ -247,6 +343,12 @@ protected:
         ReadFlow(HubDeviceSelect *device)
             : StateFlowBase(device)
             , b_(nullptr)
+        {
+        }
+
+        /// Starts reading. Called when the fd is already non-blocking, because
+        /// the first read happens without waiting for select().
+        void start()
         {
             this->start_flow(STATE(allocate_buffer));
         }
@@ -281,6 +383,12 @@ protected:
             b_ = this->get_allocation_result(device()->hub());
             b_->data()->skipMember_ = device()->write_port();
             SelectBufferInfo<buffer_type>::resize_target(b_);
+#if defined(__linux__) || defined(__MACH__)
+            if (readBuf_)
+            {
+                return this->call_immediately(STATE(fill_from_batch));
+            }
+#endif
             if (SelectBufferInfo<buffer_type>::needs_read_fully())
             {
                 return this->read_repeated(&selectHelper_, device()->fd(),
@@ -312,6 +420,113 @@ protected:
             return this->call_immediately(STATE(allocate_buffer));
         }
 
+#if defined(__linux__) || defined(__MACH__)
+        /// Turns on batched reads. Only fixed-size packet types are
+        /// supported; string-typed hubs already take whatever a read returns.
+        ///
+        /// @param max_bytes size of the read buffer.
+        /// @param datagram true if every packet arrives in a separate
+        /// datagram.
+        void enable_batching(unsigned max_bytes, bool datagram)
+        {
+            if (!SelectBufferInfo<buffer_type>::needs_read_fully())
+            {
+                return;
+            }
+            readBufSize_ = max_bytes;
+            isDatagram_ = datagram;
+#ifdef __linux__
+            if (isDatagram_)
+            {
+                msgs_.resize(MAX_READ_MSGS);
+                iov_.resize(MAX_READ_MSGS);
+            }
+#endif
+            readBuf_.reset(new uint8_t[max_bytes]);
+        }
+
+        /// Fills the current buffer from the read buffer, or reads more data
+        /// from the fd into the read buffer. @return next state.
+        Action fill_from_batch()
+        {
+            unsigned size = b_->data()->size();
+            HASSERT(size <= readBufSize_);
+            if (readEnd_ - readStart_ >= size)
+            {
+                memcpy((void *)b_->data()->data(), readBuf_.get() + readStart_,
+                    size);
+                readStart_ += size;
+                device()->hub()->send(b_, 0);
+                b_ = nullptr;
+                return this->call_immediately(STATE(allocate_buffer));
+            }
+            // Moves the partial packet to the beginning of the buffer.
+            memmove(readBuf_.get(), readBuf_.get() + readStart_,
+                readEnd_ - readStart_);
+            readEnd_ -= readStart_;
+            readStart_ = 0;
+            int fd = device()->fd();
+            int count;
+#ifdef __linux__
+            if (isDatagram_)
+            {
+                uint8_t *dst = readBuf_.get() + readEnd_;
+                unsigned num = std::min(
+                    (readBufSize_ - readEnd_) / size, (unsigned)MAX_READ_MSGS);
+                for (unsigned i = 0; i < num; ++i)
+                {
+                    iov_[i].iov_base = dst + i * size;
+                    iov_[i].iov_len = size;
+                    memset(&msgs_[i], 0, sizeof(msgs_[i]));
+                    msgs_[i].msg_hdr.msg_iov = &iov_[i];
+                    msgs_[i].msg_hdr.msg_iovlen = 1;
+                }
+                count = ::recvmmsg(fd, msgs_.data(), num, 0, nullptr);
+                if (count > 0)
+                {
+                    // Drops datagrams that do not match the packet size.
+                    unsigned num_ok = 0;
+                    for (int i = 0; i < count; ++i)
+                    {
+                        if (msgs_[i].msg_len != size)
+                        {
+                            continue;
+                        }
+                        if (num_ok != (unsigned)i)
+                        {
+                            memmove(dst + num_ok * size, dst + i * size, size);
+                        }
+                        ++num_ok;
+                    }
+                    readEnd_ += num_ok * size;
+                    return this->again();
+                }
+            }
+            else
+#endif
+            {
+                count = ::read(
+                    fd, readBuf_.get() + readEnd_, readBufSize_ - readEnd_);
+                if (count > 0)
+                {
+                    readEnd_ += count;
+                    return this->again();
+                }
+            }
+            if (count < 0 &&
+                (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            {
+                selectHelper_.reset(Selectable::READ, fd, 0);
+                selectHelper_.set_wakeup(this);
+                this->service()->executor()->select(&selectHelper_);
+                return this->wait();
+            }
+            // Now: we are at an unknown error or EOF.
+            selectHelper_.hasError_ = 1;
+            return this->call_immediately(STATE(read_done));
+        }
+#endif
+
     private:
         /** Calls into the parent flow's barrier notify, but makes sure to
          * only do this once in the lifetime of *this. */
@@ -330,6 +545,26 @@ protected:
         StateFlowSelectHelper selectHelper_{this};
         /// Buffer that we are currently filling.
         buffer_type *b_;
+#if defined(__linux__) || defined(__MACH__)
+        /// How many datagrams to receive with one syscall at most.
+        static constexpr unsigned MAX_READ_MSGS = 64;
+        /// Buffer for batched reads, or nullptr if batching is off.
+        std::unique_ptr<uint8_t[]> readBuf_;
+        /// Allocated size of readBuf_.
+        unsigned readBufSize_{0};
+        /// Offset of the first byte in readBuf_ that was not yet consumed.
+        unsigned readStart_{0};
+        /// Offset of the end of the valid data in readBuf_.
+        unsigned readEnd_{0};
+        /// True if the fd is a datagram socket.
+        bool isDatagram_{false};
+#ifdef __linux__
+        /// Message headers for recvmmsg().
+        std::vector<struct mmsghdr> msgs_;
+        /// One entry for each message in msgs_.
+        std::vector<struct iovec> iov_;
+#endif
+#endif
     };
 
     /// Base stateflow for the WriteFlow.
@@ -338,6 +573,9 @@ protected:
     class WriteFlow : public WriteFlowBase
     {
     public:
+        /// Buffer type.
+        typedef typename HFlow::buffer_type buffer_type;
+
         /// Constructor. @param dev is the parent object.
         WriteFlow(HubDeviceSelect *dev)
             : WriteFlowBase(dev)
@@ -371,6 +609,12 @@ protected:
             if (device()->fd() < 0) {
                 return this->release_and_exit();
             }
+#if defined(__linux__) || defined(__MACH__)
+            if (maxBatchBytes_)
+            {
+                return this->call_immediately(STATE(collect_batch));
+            }
+#endif
             return this->write_repeated(&selectHelper_, device()->fd(),
                 this->message()->data()->data(),
                 this->message()->data()->size(), STATE(write_done),
@@ -386,9 +630,159 @@ protected:
             return this->release_and_exit();
         }
 
+#if defined(__linux__) || defined(__MACH__)
+        /// Turns on batched writes.
+        ///
+        /// @param max_bytes byte budget of one batch.
+        /// @param datagram true if every packet has to be sent as a separate
+        /// datagram.
+        void enable_batching(unsigned max_bytes, bool datagram)
+        {
+            maxBatchBytes_ = max_bytes;
+            isDatagram_ = datagram;
+            batch_.reserve(MAX_BATCH_PACKETS);
+            iov_.reserve(MAX_BATCH_PACKETS);
+#ifdef __linux__
+            if (isDatagram_)
+            {
+                msgs_.resize(MAX_BATCH_PACKETS);
+            }
+#endif
+        }
+
+        /// Takes the current message and the messages waiting in the queue
+        /// into the batch. @return next state.
+        StateFlowBase::Action collect_batch()
+        {
+            buffer_type *b = this->transfer_message();
+            unsigned bytes = 0;
+            while (true)
+            {
+                batch_.push_back(b);
+                unsigned size = b->data()->size();
+                if (size)
+                {
+                    struct iovec v;
+                    v.iov_base = const_cast<void *>(
+                        static_cast<const void *>(b->data()->data()));
+                    v.iov_len = size;
+                    iov_.push_back(v);
+                    bytes += size;
+                }
+                if (batch_.size() >= MAX_BATCH_PACKETS ||
+                    bytes >= maxBatchBytes_)
+                {
+                    break;
+                }
+                AtomicHolder h(this);
+                unsigned priority;
+                QMember *m = this->queue_next(&priority);
+                if (!m)
+                {
+                    break;
+                }
+                b = static_cast<buffer_type *>(m);
+            }
+            iovDone_ = 0;
+            return this->call_immediately(STATE(write_batch));
+        }
+
+        /// Writes the collected batch to the fd. @return next state.
+        StateFlowBase::Action write_batch()
+        {
+            int fd = device()->fd();
+            if (fd < 0 || iovDone_ >= iov_.size())
+            {
+                return finish_batch();
+            }
+            int count;
+            unsigned num = iov_.size() - iovDone_;
+#ifdef __linux__
+            if (isDatagram_)
+            {
+                for (unsigned i = 0; i < num; ++i)
+                {
+                    memset(&msgs_[i], 0, sizeof(msgs_[i]));
+                    msgs_[i].msg_hdr.msg_iov = &iov_[iovDone_ + i];
+                    msgs_[i].msg_hdr.msg_iovlen = 1;
+                }
+                count = ::sendmmsg(fd, msgs_.data(), num, 0);
+                if (count > 0)
+                {
+                    iovDone_ += count;
+                    return this->again();
+                }
+            }
+            else
+#endif
+            {
+                count = ::writev(fd, &iov_[iovDone_], num);
+                if (count > 0)
+                {
+                    // Skips over the data that was written.
+                    size_t written = count;
+                    while (written && written >= iov_[iovDone_].iov_len)
+                    {
+                        written -= iov_[iovDone_].iov_len;
+                        ++iovDone_;
+                    }
+                    if (written)
+                    {
+                        iov_[iovDone_].iov_base =
+                            (uint8_t *)iov_[iovDone_].iov_base + written;
+                        iov_[iovDone_].iov_len -= written;
+                    }
+                    return this->again();
+                }
+            }
+            if (count < 0 &&
+                (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            {
+                // Blocked.
+                selectHelper_.reset(Selectable::WRITE, fd, this->priority());
+                selectHelper_.set_wakeup(this);
+                this->service()->executor()->select(&selectHelper_);
+                return this->wait();
+            }
+            device()->report_write_error();
+            return finish_batch();
+        }
+
+        /// Releases all buffers of the batch. @return next state.
+        StateFlowBase::Action finish_batch()
+        {
+            for (auto *b : batch_)
+            {
+                b->unref();
+            }
+            batch_.clear();
+            iov_.clear();
+            return this->exit();
+        }
+#endif
+
     private:
         /// Helper class for asynchronous writes.
         StateFlowBase::StateFlowSelectHelper selectHelper_{this};
+#if defined(__linux__) || defined(__MACH__)
+        /// How many packets to write with one syscall at most.
+        static constexpr unsigned MAX_BATCH_PACKETS = 64;
+        /// Byte budget of a batch. 0 if batching is off.
+        unsigned maxBatchBytes_{0};
+        /// True if the fd is a datagram socket.
+        bool isDatagram_{false};
+        /// Index of the first entry in iov_ that was not completely written.
+        unsigned iovDone_{0};
+        /// Buffers taken from the queue into the current batch.
+        std::vector<buffer_type *> batch_;
+        /// Data to write from the buffers in batch_. Empty buffers are left
+        /// out.
+        std::vector<struct iovec> iov_;
+#ifdef __linux__
+        /// Message headers for sendmmsg().
+        std::vector<struct mmsghdr> msgs_;
+#endif
+#endif
     };
 
 protected:
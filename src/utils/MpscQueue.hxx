@@ -0,0 +1,152 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file MpscQueue.hxx
+ *
+ * Lock-free intrusive queue with many producer threads and one consumer
+ * thread.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+#ifndef _UTILS_MPSCQUEUE_HXX_
+#define _UTILS_MPSCQUEUE_HXX_
+
+#include <atomic>
+
+#include "utils/QMember.hxx"
+
+/// Intrusive queue that any number of threads may push into concurrently
+/// without taking a lock, and a single thread pops from. The entries are
+/// linked through QMember::next, so an entry may only be in one queue at a
+/// time. Entries come out in the order their push() calls completed; in
+/// particular entries pushed by the same thread stay in order.
+///
+/// This is the algorithm by Dmitry Vyukov. A push is a single atomic
+/// exchange; a pop is wait-free except that it returns nullptr while a push
+/// is halfway done. In that case the producer has not returned from push()
+/// yet, so it is the producer's job to wake up the consumer again.
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : head_(&stub_)
+        , tail_(&stub_)
+    {
+        stub_.next = nullptr;
+    }
+
+    /// Adds an entry to the end of the queue. Can be called from any
+    /// thread. @param item entry to add, must not be in any queue.
+    void push(QMember *item)
+    {
+        store_next(item, nullptr);
+        QMember *prev = head_.exchange(item, std::memory_order_acq_rel);
+        store_next(prev, item);
+    }
+
+    /// Removes the first entry from the queue. Must be called only from the
+    /// consumer thread. @return the entry or nullptr if the queue is empty
+    /// or a concurrent push is not done yet.
+    QMember *pop()
+    {
+        QMember *tail = tail_;
+        QMember *next = load_next(tail);
+        if (tail == &stub_)
+        {
+            if (!next)
+            {
+                return nullptr;
+            }
+            tail_ = next;
+            tail = next;
+            next = load_next(next);
+        }
+        if (next)
+        {
+            tail_ = next;
+            return unlink(tail);
+        }
+        if (tail != head_.load(std::memory_order_acquire))
+        {
+            // A producer is in the middle of a push.
+            return nullptr;
+        }
+        push(&stub_);
+        next = load_next(tail);
+        if (next)
+        {
+            tail_ = next;
+            return unlink(tail);
+        }
+        return nullptr;
+    }
+
+    /// @return true if there are no entries in the queue. Must be called only
+    /// from the consumer thread.
+    bool empty()
+    {
+        return tail_ == &stub_ && !load_next(&stub_);
+    }
+
+private:
+    /// Sets the link of an entry. @param item entry @param next new link.
+    static void store_next(QMember *item, QMember *next)
+    {
+        __atomic_store_n(&item->next, next, __ATOMIC_RELEASE);
+    }
+
+    /// Clears the link of an entry that was just removed, so that it can be
+    /// added to other queues. @param item entry. @return item.
+    static QMember *unlink(QMember *item)
+    {
+        item->next = nullptr;
+        return item;
+    }
+
+    /// @param item entry. @return the link of the entry.
+    static QMember *load_next(QMember *item)
+    {
+        return __atomic_load_n(&item->next, __ATOMIC_ACQUIRE);
+    }
+
+    /// Placeholder entry that keeps the queue non-empty for the producers.
+    struct Stub : public QMember
+    {
+    };
+
+    /// Last entry pushed. Producers contend on this.
+    std::atomic<QMember *> head_;
+    /// Next entry to pop. Only the consumer touches this.
+    QMember *tail_;
+    /// Placeholder entry.
+    Stub stub_;
+
+    DISALLOW_COPY_AND_ASSIGN(MpscQueue);
+};
+
+#endif // _UTILS_MPSCQUEUE_HXX_
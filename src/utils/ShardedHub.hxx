@@ -0,0 +1,276 @@
+/** \copyright
+ * Copyright (c) 2026, Balazs Racz
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file ShardedHub.hxx
+ *
+ * Spreads the ports of a hub across multiple executor threads.
+ *
+ * @author Balazs Racz
+ * @date 17 Oct 2026
+ */
+
+#ifndef _UTILS_SHARDEDHUB_HXX_
+#define _UTILS_SHARDEDHUB_HXX_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "executor/Executor.hxx"
+#include "executor/Service.hxx"
+#include "utils/Hub.hxx"
+#include "utils/MpscQueue.hxx"
+
+/// A set of hubs, each running on its own executor thread, that behave
+/// together like a single hub. Every message sent by a port of one shard is
+/// delivered to the ports of every other shard as well.
+///
+/// Ports should be registered with the hub returned by next_shard() (or
+/// shard()), and run on that hub's service; this way the per-port work
+/// (parsing, formatting, socket I/O) is spread across the executors.
+///
+/// Messages are handed between shards via a lock-free queue per shard. The
+/// messages sent by any given port arrive at every other port in the order
+/// they were sent.
+template <class HFlow> class ShardedHub
+{
+public:
+    /// Type of the messages being forwarded.
+    typedef typename HFlow::buffer_type buffer_type;
+    /// Base type of an individual port.
+    typedef typename HFlow::port_type port_type;
+
+    /// Constructor.
+    ///
+    /// @param main_hub will be shard 0. It keeps running on its own
+    /// executor.
+    /// @param num_shards total number of shards. A new executor thread will
+    /// be started for each of the num_shards - 1 additional shards.
+    ShardedHub(HFlow *main_hub, unsigned num_shards)
+    {
+        HASSERT(num_shards >= 1);
+        for (unsigned i = 0; i < num_shards; ++i)
+        {
+            shards_.emplace_back(new Shard(this, i, i ? nullptr : main_hub));
+        }
+        if (num_shards > 1)
+        {
+            for (auto &s : shards_)
+            {
+                s->hub_->register_port(&s->bridge_);
+            }
+        }
+    }
+
+    /// Destructor. All ports other than the ones on the main hub must have
+    /// been unregistered by the caller.
+    ~ShardedHub()
+    {
+        if (shards_.size() > 1)
+        {
+            for (auto &s : shards_)
+            {
+                s->hub_->unregister_port(&s->bridge_);
+            }
+        }
+        // Waits for in-flight messages to settle.
+        for (unsigned round = 0; round < 2; ++round)
+        {
+            for (auto &s : shards_)
+            {
+                s->hub_->service()->executor()->sync_run([]() {});
+            }
+        }
+        while (!shards_.empty())
+        {
+            shards_.pop_back();
+        }
+    }
+
+    /// @return the number of shards.
+    unsigned size()
+    {
+        return shards_.size();
+    }
+
+    /// @param i shard index, 0 <= i < size(). @return the hub of that shard.
+    HFlow *shard(unsigned i)
+    {
+        return shards_[i]->hub_;
+    }
+
+    /// Picks shards in a round-robin fashion. Safe to call from any thread.
+    /// @return the hub to which the next port should be added.
+    HFlow *next_shard()
+    {
+        return shard(nextShard_.fetch_add(1) % shards_.size());
+    }
+
+private:
+    class Shard;
+
+    /// Registered as a port on each shard's hub. Forwards everything that
+    /// the shard's own ports send to the other shards.
+    class BridgePort : public port_type
+    {
+    public:
+        /// @param parent owning sharded hub. @param index which shard this
+        /// port is registered on.
+        BridgePort(ShardedHub *parent, unsigned index)
+            : parent_(parent)
+            , index_(index)
+        {
+        }
+
+        void send(buffer_type *b, unsigned priority = UINT_MAX) override
+        {
+            parent_->forward(index_, b);
+        }
+
+    private:
+        /// Owning sharded hub.
+        ShardedHub *parent_;
+        /// Which shard we are on.
+        unsigned index_;
+    };
+
+    /// One hub with its executor. The Executable base drains the inbound
+    /// queue on the shard's executor.
+    class Shard : public Executable
+    {
+    public:
+        /// @param parent owning sharded hub. @param index which shard this
+        /// is. @param hub if not null, this hub is used instead of creating
+        /// a new executor and hub.
+        Shard(ShardedHub *parent, unsigned index, HFlow *hub)
+            : hub_(hub)
+            , bridge_(parent, index)
+            , scheduled_(false)
+        {
+            if (!hub_)
+            {
+                executor_.reset(new Executor<1>("hub_shard", 0, 2048));
+                service_.reset(new Service(executor_.get()));
+                ownedHub_.reset(new HFlow(service_.get()));
+                hub_ = ownedHub_.get();
+            }
+        }
+
+        ~Shard()
+        {
+            // Stops the thread first; the hub is idle by now.
+            executor_.reset();
+            ownedHub_.reset();
+            service_.reset();
+            while (QMember *m = inbox_.pop())
+            {
+                static_cast<buffer_type *>(m)->unref();
+            }
+        }
+
+        /// Enqueues a message for this shard. Can be called from any thread.
+        /// @param b message to deliver, ownership is transferred.
+        void deliver(buffer_type *b)
+        {
+            inbox_.push(b);
+            if (!scheduled_.exchange(true))
+            {
+                hub_->service()->executor()->add(this);
+            }
+        }
+
+        /// Moves all queued messages into the hub. Called on the shard's
+        /// executor.
+        void run() override
+        {
+            // Must be cleared before popping, so that a producer that is
+            // halfway in a push reschedules us.
+            scheduled_.store(false);
+            while (QMember *m = inbox_.pop())
+            {
+                hub_->send(static_cast<buffer_type *>(m));
+            }
+        }
+
+        /// Executor of this shard if we own it.
+        std::unique_ptr<Executor<1>> executor_;
+        /// Service of this shard if we own it.
+        std::unique_ptr<Service> service_;
+        /// Hub of this shard if we own it.
+        std::unique_ptr<HFlow> ownedHub_;
+        /// Hub of this shard.
+        HFlow *hub_;
+        /// Port that forwards local traffic to the other shards.
+        BridgePort bridge_;
+        /// Messages sent by other shards' ports, waiting to be dispatched
+        /// here.
+        MpscQueue inbox_;
+        /// True if this Executable is on the executor's queue.
+        std::atomic<bool> scheduled_;
+    };
+
+    /// Sends a message coming from one shard to all other shards.
+    /// @param from shard index where the message was sent. @param b message,
+    /// ownership is transferred.
+    void forward(unsigned from, buffer_type *b)
+    {
+        unsigned last = (from == shards_.size() - 1) ? from - 1
+                                                      : shards_.size() - 1;
+        for (unsigned i = 0; i < shards_.size(); ++i)
+        {
+            if (i == from)
+            {
+                continue;
+            }
+            buffer_type *copy;
+            if (i == last)
+            {
+                copy = b;
+            }
+            else
+            {
+                mainBufferPool->alloc(&copy);
+                *copy->data() = *b->data();
+                copy->set_done(b->new_child());
+            }
+            // Prevents the message from being bridged back.
+            copy->data()->skipMember_ = &shards_[i]->bridge_;
+            shards_[i]->deliver(copy);
+        }
+    }
+
+    /// All shards. Index 0 is the main hub.
+    std::vector<std::unique_ptr<Shard>> shards_;
+    /// Round-robin counter for next_shard().
+    std::atomic<unsigned> nextShard_{0};
+};
+
+/// Sharded version of a CAN hub.
+typedef ShardedHub<CanHubFlow> ShardedCanHub;
+/// Sharded version of a string hub.
+typedef ShardedHub<HubFlow> ShardedHubFlow;
+
+#endif // _UTILS_SHARDEDHUB_HXX_
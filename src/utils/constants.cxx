@@ -85,6 +85,19 @@
  * vs the overhead used by the framework.
  */
 
+/** @var _sym_executor_profile_entries
+ *
+ * @brief How many executables the executor profiler keeps separate counters
+ * for. Further executables are accounted together. Used only when compiled
+ * with -DEXECUTOR_PROFILE.
+ */
+
+/** @var _sym_async_log_ring_size
+ *
+ * @brief Size in bytes of the per-thread ring buffer of the asynchronous
+ * logger. Messages logged while the ring is full are dropped.
+ */
+
 /** @var _sym_can_tx_buffer_size
  * @brief default software buffer size for CAN transmission
  */
@@ -131,6 +144,8 @@ DEFAULT_CONST(main_thread_priority, 0xdefa01);
 DEFAULT_CONST(main_thread_stack_size, 2048);
 DEFAULT_CONST(executor_max_sleep_msec, 40);
 DEFAULT_CONST(executor_select_prescaler, 5);
+DEFAULT_CONST(executor_profile_entries, 128);
+DEFAULT_CONST(async_log_ring_size, 16384);
 
 DEFAULT_CONST(can_tx_buffer_size, 16);
 DEFAULT_CONST(can_rx_buffer_size, 16);
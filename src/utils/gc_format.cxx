@@ -34,26 +34,52 @@
 //#define LOGLEVEL VERBOSE
 
 #include <stdint.h>
+#include <string.h>
 #include "utils/logging.h"
 #include "utils/gc_format.h"
 #include "can_frame.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 extern "C" {
 
+/// Uppercase hex digits, indexed by the nibble value.
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+#define XX -1
+/// Nibble value of each character; -1 for characters that are not hex
+/// digits. Both upper and lowercase are accepted.
+static const int8_t HEX_VALUES[256] = {
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, XX, XX, XX, XX, XX, XX,
+    XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+#undef XX
+
 /** Build an ASCII character representation of a nibble value (uppercase hex).
  * @param nibble to convert
  * @return converted value
  */
 static char nibble_to_ascii(int nibble)
 {
-    nibble &= 0xf;
-
-    if (nibble < 10)
-    {
-        return ('0' + nibble);
-    }
-    
-    return ('A' + (nibble - 10));
+    return HEX_DIGITS[nibble & 0xf];
 }
 
 /** Tries to parse a hex character to a nibble. Understands both upper and
@@ -63,30 +89,130 @@ static char nibble_to_ascii(int nibble)
 */
 static int ascii_to_nibble(const char c)
 {
-    if ('0' <= c && '9' >= c)
+    return HEX_VALUES[(uint8_t)c];
+}
+
+/// Renders 16 bytes as 32 uppercase hex characters.
+///
+/// @param src the bytes to render.
+/// @param dst output buffer, 32 characters will be written.
+/// @param len the number of bytes the caller actually needs. The vector
+/// implementations render all 16 regardless.
+static void encode_hex16(const uint8_t *src, char *dst, unsigned len)
+{
+#if defined(__SSE2__)
+    (void)len;
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letter = _mm_set1_epi8('A' - '0' - 10);
+    __m128i x = _mm_loadu_si128((const __m128i *)src);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+    __m128i lo = _mm_and_si128(x, mask);
+    __m128i n[2] = {_mm_unpacklo_epi8(hi, lo), _mm_unpackhi_epi8(hi, lo)};
+    for (int i = 0; i < 2; ++i)
     {
-        return c - '0';
+        __m128i digits = _mm_add_epi8(n[i], zero);
+        __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(n[i], nine), letter);
+        _mm_storeu_si128(
+            (__m128i *)(dst + 16 * i), _mm_add_epi8(digits, letters));
     }
-    else if ('A' <= c && 'F' >= c)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    (void)len;
+    uint8x16_t x = vld1q_u8(src);
+    uint8x16x2_t n = vzipq_u8(vshrq_n_u8(x, 4), vandq_u8(x, vdupq_n_u8(0xf)));
+    for (int i = 0; i < 2; ++i)
     {
-        return c - 'A' + 10;
+        uint8x16_t digits = vaddq_u8(n.val[i], vdupq_n_u8('0'));
+        uint8x16_t letters = vandq_u8(vcgtq_u8(n.val[i], vdupq_n_u8(9)),
+            vdupq_n_u8('A' - '0' - 10));
+        vst1q_u8((uint8_t *)dst + 16 * i, vaddq_u8(digits, letters));
     }
-    else if ('a' <= c && 'f' >= c)
+#else
+    for (unsigned i = 0; i < len; ++i)
     {
-        return c - 'a' + 10;
+        dst[2 * i] = HEX_DIGITS[src[i] >> 4];
+        dst[2 * i + 1] = HEX_DIGITS[src[i] & 0xf];
     }
-    return -1;
+#endif
 }
 
+/// Parses 16 hex characters into 8 bytes.
+///
+/// @param src the characters to parse.
+/// @param dst output buffer, 8 bytes will be written.
+/// @return false if there was a character that is not a hex digit.
+static bool decode_hex16(const char *src, uint8_t *dst)
+{
+#if defined(__SSE2__)
+    __m128i c = _mm_loadu_si128((const __m128i *)src);
+    // Digits are 0..9 after subtracting '0'; letters (in either case) are
+    // 0..5 after subtracting 'a'. Everything else wraps around to large
+    // values, so an unsigned comparison catches them.
+    __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i is_digit =
+        _mm_cmpeq_epi8(_mm_max_epu8(d, _mm_set1_epi8(9)), _mm_set1_epi8(9));
+    __m128i a = _mm_sub_epi8(
+        _mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_letter =
+        _mm_cmpeq_epi8(_mm_max_epu8(a, _mm_set1_epi8(5)), _mm_set1_epi8(5));
+    if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xffff)
+    {
+        return false;
+    }
+    __m128i n = _mm_or_si128(_mm_and_si128(is_digit, d),
+        _mm_and_si128(is_letter, _mm_add_epi8(a, _mm_set1_epi8(10))));
+    // Each 16-bit lane has the high nibble in the low byte.
+    __m128i b = _mm_or_si128(
+        _mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0xff)), 4),
+        _mm_srli_epi16(n, 8));
+    _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(b, b));
+    return true;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint8x16_t c = vld1q_u8((const uint8_t *)src);
+    uint8x16_t d = vsubq_u8(c, vdupq_n_u8('0'));
+    uint8x16_t is_digit = vcleq_u8(d, vdupq_n_u8(9));
+    uint8x16_t a = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t is_letter = vcleq_u8(a, vdupq_n_u8(5));
+    uint8x16_t ok = vorrq_u8(is_digit, is_letter);
+    uint8x8_t all = vand_u8(vget_low_u8(ok), vget_high_u8(ok));
+    if (vget_lane_u64(vreinterpret_u64_u8(all), 0) != ~(uint64_t)0)
+    {
+        return false;
+    }
+    uint8x16_t n = vorrq_u8(vandq_u8(is_digit, d),
+        vandq_u8(is_letter, vaddq_u8(a, vdupq_n_u8(10))));
+    uint8x8x2_t u = vuzp_u8(vget_low_u8(n), vget_high_u8(n));
+    vst1_u8(dst, vorr_u8(vshl_n_u8(u.val[0], 4), u.val[1]));
+    return true;
+#else
+    int bad = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        int nh = ascii_to_nibble(src[2 * i]);
+        int nl = ascii_to_nibble(src[2 * i + 1]);
+        bad |= nh | nl;
+        dst[i] = ((nh & 0xf) << 4) | (nl & 0xf);
+    }
+    return bad >= 0;
+#endif
+}
 
 int gc_format_parse(const char* buf, struct can_frame* can_frame)
 {
+    return gc_format_parse_buffer(buf, strlen(buf), can_frame);
+}
+
+int gc_format_parse_buffer(
+    const char *buf, unsigned len, struct can_frame *can_frame)
+{
+    const char *end = buf + len;
     CLR_CAN_FRAME_ERR(*can_frame);
-    if (*buf == 'X')
+    if (len && *buf == 'X')
     {
         SET_CAN_FRAME_EFF(*can_frame);
     }
-    else if (*buf == 'S') 
+    else if (len && *buf == 'S')
     {
         CLR_CAN_FRAME_EFF(*can_frame);
     } else
@@ -99,6 +225,12 @@ int gc_format_parse(const char* buf, struct can_frame* can_frame)
     uint32_t id = 0;
     while (1)
     {
+        if (buf >= end)
+        {
+            // Frame ended in the middle of the ID.
+            SET_CAN_FRAME_ERR(*can_frame);
+            return -1;
+        }
         int nibble = ascii_to_nibble(*buf);
         if (nibble >= 0)
         {
@@ -135,19 +267,24 @@ int gc_format_parse(const char* buf, struct can_frame* can_frame)
     { 
         SET_CAN_FRAME_ID(*can_frame, id);
     }
-    int index = 0;
-    while (*buf)
+    unsigned data_len = end - buf;
+    if ((data_len & 1) || data_len > 16)
     {
-        int nh = ascii_to_nibble(*buf++);
-        int nl = ascii_to_nibble(*buf++);
-        if (nh < 0 || nl < 0)
-        {
-            SET_CAN_FRAME_ERR(*can_frame);
-            return -1;
-        }
-        can_frame->data[index++] = (nh << 4) | nl;
-    } // while parsing data
-    can_frame->can_dlc = index;
+        SET_CAN_FRAME_ERR(*can_frame);
+        return -1;
+    }
+    // Pads the data to 8 bytes with zeros so that it can be parsed in one go.
+    char hex[16];
+    memset(hex, '0', sizeof(hex));
+    memcpy(hex, buf, data_len);
+    uint8_t data[8];
+    if (!decode_hex16(hex, data))
+    {
+        SET_CAN_FRAME_ERR(*can_frame);
+        return -1;
+    }
+    memcpy(can_frame->data, data, data_len / 2);
+    can_frame->can_dlc = data_len / 2;
     CLR_CAN_FRAME_ERR(*can_frame);
     return 0;
 }
@@ -174,30 +311,17 @@ static void output_double(char*& dst, char value)
     *dst++ = value;
 }
 
-/** Formats a can frame in the GridConnect protocol.
-
-    If requested, it can create the double protocol with leading !!, trailing ;;
-    and all the characters doubled.
-
-    If the input frame is an error frame, then does not output anything and
-    returns the input pointer.
-
-    @param can_frame is the input frame.
-
-    @param buf is the output buffer. The caller must ensure this is big enough
-    to hold the resulting frame (28 or 56 bytes).
-
-    @param double_format if non-zero, the doubling format will be generated.
-
-    @return the pointer to the buffer character after the formatted can frame.
-*/
-char* gc_format_generate(const struct can_frame* can_frame, char* buf, int double_format)
+/// Formats a can frame in the GridConnect protocol one character at a
+/// time. Handles the double format and frames with invalid length.
+///
+/// @param can_frame is the input frame, not an error frame.
+/// @param buf is the output buffer.
+/// @param double_format if non-zero, the doubling format will be generated.
+///
+/// @return the pointer to the buffer character after the formatted can frame.
+static char *generate_slow(
+    const struct can_frame *can_frame, char *buf, int double_format)
 {
-    if (IS_CAN_FRAME_ERR(*can_frame))
-    {
-        LOG(VERBOSE, "GC generate: incoming frame ERR.");
-        return buf;
-    }
     void (*output)(char*& dst, char value);
     if (double_format)
     {
@@ -248,4 +372,120 @@ char* gc_format_generate(const struct can_frame* can_frame, char* buf, int doubl
     return buf;
 }
 
+/** Formats a valid (non-error, at most 8 bytes) can frame in the single
+    GridConnect format.
+
+    @param can_frame is the input frame.
+    @param buf is the output buffer.
+    @param newline if true, a newline will be appended.
+    @return the pointer to the buffer character after the formatted can frame.
+*/
+static inline char *generate_fast(
+    const struct can_frame *can_frame, char *buf, bool newline)
+{
+    unsigned dlc = can_frame->can_dlc;
+    // The ID (big-endian) and the payload are rendered together, then the
+    // pieces are copied to their place.
+    uint8_t bin[16];
+    uint32_t id;
+    if (IS_CAN_FRAME_EFF(*can_frame))
+    {
+        id = GET_CAN_FRAME_ID_EFF(*can_frame);
+    }
+    else
+    {
+        id = GET_CAN_FRAME_ID(*can_frame);
+    }
+    bin[0] = id >> 24;
+    bin[1] = id >> 16;
+    bin[2] = id >> 8;
+    bin[3] = id;
+    memcpy(bin + 4, can_frame->data, 8);
+    memset(bin + 12, 0, 4);
+    char hex[32];
+    encode_hex16(bin, hex, 4 + dlc);
+    *buf++ = ':';
+    if (IS_CAN_FRAME_EFF(*can_frame))
+    {
+        *buf++ = 'X';
+        memcpy(buf, hex, 8);
+        buf += 8;
+    }
+    else
+    {
+        *buf++ = 'S';
+        memcpy(buf, hex + 5, 3);
+        buf += 3;
+    }
+    *buf++ = IS_CAN_FRAME_RTR(*can_frame) ? 'R' : 'N';
+    memcpy(buf, hex + 8, 2 * dlc);
+    buf += 2 * dlc;
+    *buf++ = ';';
+    if (newline)
+    {
+        *buf++ = '\n';
+    }
+    return buf;
+}
+
+/** Formats a can frame in the GridConnect protocol.
+
+    If requested, it can create the double protocol with leading !!, trailing ;;
+    and all the characters doubled.
+
+    If the input frame is an error frame, then does not output anything and
+    returns the input pointer.
+
+    @param can_frame is the input frame.
+
+    @param buf is the output buffer. The caller must ensure this is big enough
+    to hold the resulting frame (28 or 56 bytes).
+
+    @param double_format if non-zero, the doubling format will be generated.
+
+    @return the pointer to the buffer character after the formatted can frame.
+*/
+char* gc_format_generate(const struct can_frame* can_frame, char* buf, int double_format)
+{
+    if (IS_CAN_FRAME_ERR(*can_frame))
+    {
+        LOG(VERBOSE, "GC generate: incoming frame ERR.");
+        return buf;
+    }
+    if (double_format || can_frame->can_dlc > 8)
+    {
+        return generate_slow(can_frame, buf, double_format);
+    }
+    return generate_fast(can_frame, buf, config_gc_generate_newlines());
+}
+
+char *gc_format_generate_frames(const struct can_frame *frames,
+    unsigned count, char *buf, int double_format)
+{
+    if (double_format)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            buf = gc_format_generate(frames + i, buf, double_format);
+        }
+        return buf;
+    }
+    bool newline = config_gc_generate_newlines();
+    const struct can_frame *end = frames + count;
+    for (const struct can_frame *f = frames; f < end; ++f)
+    {
+        if (IS_CAN_FRAME_ERR(*f))
+        {
+            continue;
+        }
+        if (f->can_dlc > 8)
+        {
+            buf = generate_slow(f, buf, 0);
+            continue;
+        }
+        buf = generate_fast(f, buf, newline);
+    }
+    return buf;
+}
+
 }
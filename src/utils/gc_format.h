@@ -60,6 +60,22 @@ DECLARE_CONST(gc_generate_newlines);
 */
 int gc_format_parse(const char* buf, struct can_frame* can_frame);
 
+/** Parses a GridConnect packet that is not zero-terminated.
+
+    @param buf points to the packet. The leading ":" and the trailing ";" must
+    be already removed.
+
+    @param len is the number of characters in the packet.
+
+    @param can_frame is the CAN frame that will be filled based on the source
+    packet.
+
+    @return 0 in case of success, -1 if there was a packet format error (in
+    this case the frame is set to an error frame).
+*/
+int gc_format_parse_buffer(
+    const char *buf, unsigned len, struct can_frame *can_frame);
+
 /** Formats a can frame in the GridConnect protocol.
 
     If requested, it can create the double protocol with leading !!, trailing ;;
@@ -79,6 +95,24 @@ int gc_format_parse(const char* buf, struct can_frame* can_frame);
 */
 char* gc_format_generate(const struct can_frame* can_frame, char* buf, int double_format);
 
+/** Formats a sequence of can frames in the GridConnect protocol, one after
+    the other, into one buffer. Faster than calling gc_format_generate() for
+    each frame, because the format options are only checked once.
+
+    @param frames is the input frames. Error frames are skipped.
+
+    @param count is the number of frames in the array.
+
+    @param buf is the output buffer. The caller must ensure this is big enough
+    to hold the resulting frames (28 or 56 bytes each).
+
+    @param double_format if non-zero, the doubling format will be generated.
+
+    @return the pointer to the buffer character after the last formatted frame.
+*/
+char *gc_format_generate_frames(const struct can_frame *frames,
+    unsigned count, char *buf, int double_format);
+
 #ifdef __cplusplus
 }
 #endif
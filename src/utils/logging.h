@@ -87,6 +87,19 @@ extern os_mutex_t g_log_mutex;
 #define LOG_MAYBE_DIE(level) 0
 #endif
 
+#if defined(__cplusplus) && defined(ASYNC_LOGGING) &&                         \
+    (defined(__linux__) || defined(__MACH__))
+template <typename F, typename... Args>
+bool async_log(int level, F &&fmt, Args... args);
+/// Hands the message to the AsyncLogger. Evaluates to false if the message
+/// needs to be rendered synchronously.
+#define LOG_ASYNC(level, message...) async_log(level, message)
+#else
+/// Asynchronous logging is only available in C++ code compiled with
+/// -DASYNC_LOGGING; everything else renders synchronously.
+#define LOG_ASYNC(level, message...) 0
+#endif
+
 /// Conditionally write a message to the logging output.
 /// @param level is the log level; if the confiugured loglevel is smaller, then
 /// the log is not printed, not rendered, and the rendering code is never even
@@ -106,7 +119,7 @@ extern os_mutex_t g_log_mutex;
             fprintf(stderr, message);                                          \
             abort();                                                           \
         }                                                                      \
-        else if (LOGLEVEL >= level)                                            \
+        else if (LOGLEVEL >= level && !LOG_ASYNC(level, message))             \
         {                                                                      \
             LOCK_LOG;                                                          \
             int sret = snprintf(logbuffer, sizeof(logbuffer), message);        \
@@ -175,4 +188,8 @@ void print_errno_and_exit(const char *where);
         }                                                                      \
     } while (0)
 
+#if defined(__cplusplus) && defined(ASYNC_LOGGING)
+#include "utils/AsyncLogging.hxx"
+#endif
+
 #endif // _UTILS_LOGGING_H_
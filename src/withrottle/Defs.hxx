@@ -28,6 +28,8 @@
 #ifndef _WITHROTTLE_DEFS_HXX_
 #define _WITHROTTLE_DEFS_HXX_
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 
 #include "openlcb/TractionThrottle.hxx"
@@ -121,18 +123,6 @@ public:
     };
 };
 
-/** Server state machine commands.
- */
-enum ServerState
-{
-    STATE_COMMAND = 0, /**< look for command */
-    STATE_MULTI_TYPE, /**< look for the multi-throttle type */
-    STATE_TRAIN, /**< look for the train */
-    STATE_SUBCOMMAND, /**< look for sub-command */
-    STATE_PAYLOAD, /**< look for data */
-    STATE_NEXT, /**< look for next command */
-};
-
 /** The interface definitions for WiThrottle.
  */
 struct Defs
@@ -200,8 +190,39 @@ struct Defs
         return status;
     }
 
+    /** Get the speed and direction status string.
+     * @param loco WiThrottle train handle string
+     * @param speed current speed of the locomotive
+     * @return speed and direction status string
+     */
+    static string get_speed_status_string(const char *loco,
+                                          openlcb::SpeedType speed)
+    {
+        int step = 0;
+        bool forward = true;
+        if (!std::isnan(speed.speed()))
+        {
+            /* one speed step per mph, same as the DCC 128 step mapping */
+            step = std::min((int)(speed.mph() + 0.5), 126);
+            forward = speed.direction() == openlcb::SpeedType::FORWARD;
+        }
+
+        string status("MTA");
+        status.append(loco);
+        status.append("<;>V");
+        status.append(std::to_string(step));
+        status.append("\n\nMTA");
+        status.append(loco);
+        status.append("<;>R");
+        status.append(1, forward ? '1' : '0');
+        status.append("\n\n");
+
+        return status;
+    }
+
     /** Get the locomotive status command string.
      * @param throttle OpenLCB assigned openLCB throttle
+     * @param loco WiThrottle train handle string
      * @return locomotive status string
      */
     static string get_loco_status_string(openlcb::TractionThrottle *throttle,
@@ -210,17 +231,16 @@ struct Defs
         string status("MT+");
         status.append(loco);
         status.append("<;>\n\n");
-        for (int i = 0; i <=28; ++i)
+        for (int i = 0; i <= openlcb::TractionThrottle::MAX_FN_QUERY; ++i)
         {
-            status.append(get_function_status_string(loco, i,
-                                                     throttle->get_fn(i)));
+            uint16_t value = throttle->get_fn(i);
+            status.append(get_function_status_string(
+                loco, i,
+                value != openlcb::TractionThrottle::FN_NOT_KNOWN && value));
         }
+        status.append(get_speed_status_string(loco, throttle->get_speed()));
         status.append("MTA");
         status.append(loco);
-        status.append("<;>V0\n\nMTA");
-        status.append(loco);
-        status.append("<;>R1\n\nMTA");
-        status.append(loco);
         status.append("<;>S1\n\n");
 #if 0
         string status("TL6915\n\nTF00\n\nTF01\n\nTF02\n\nTF03\n\nTF04\n\nTF05\n\n");
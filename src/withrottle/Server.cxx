@@ -27,27 +27,134 @@
 
 #include "withrottle/Server.hxx"
 
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/socket.h>
+
 namespace withrottle
 {
 
+/*
+ * ThrottlePool::acquire()
+ */
+openlcb::TractionThrottle *ThrottlePool::acquire()
+{
+    AtomicHolder h(this);
+    if (!freeList.empty())
+    {
+        openlcb::TractionThrottle *t = freeList.back();
+        freeList.pop_back();
+        return t;
+    }
+    if (throttles.size() >= maxSize)
+    {
+        return nullptr;
+    }
+    throttles.emplace_back(new openlcb::TractionThrottle(node));
+    return throttles.back().get();
+}
+
+/*
+ * ThrottlePool::release()
+ */
+void ThrottlePool::release(openlcb::TractionThrottle *throttle)
+{
+    AtomicHolder h(this);
+    freeList.push_back(throttle);
+}
+
 /** Constructor.
- * @param service service this flow belongs to
+ * @param name name of the bus
+ * @param port TCP port to listen for connections on, -1 for default.
+ * @param node reference to the OpenLCB Node that proxies our bus
+ * @param max_throttles maximum number of locomotives acquired at once
+ */
+Server::Server(const char *name, int port, openlcb::Node *node,
+               unsigned max_throttles)
+    : Service(&executor)
+    , executor(name, 0, 2048)
+    , node(node)
+    , throttlePool(node, max_throttles)
+    , tickTimer(this)
+    , listener((port >= 0 && port <= UINT16_MAX) ? port : Defs::DEFAULT_PORT,
+               std::bind(&Server::on_new_connection, this,
+               std::placeholders::_1))
+{
+    tickTimer.start(UPDATE_TICK_NSEC);
+}
+
+/*
+ * Server::~Server()
+ */
+Server::~Server()
+{
+    listener.shutdown();
+    executor.sync_run([this]()
+    {
+        tickTimer.cancel();
+        for (ThrottleFlow *c : connections)
+        {
+            ::shutdown(c->fd, SHUT_RDWR);
+        }
+    });
+    /* connections release their trains and delete themselves */
+    while (connection_count())
+    {
+        usleep(1000);
+    }
+}
+
+/*
+ * Server::connection_count()
+ */
+size_t Server::connection_count()
+{
+    size_t count;
+    executor.sync_run([this, &count]() { count = connections.size(); });
+    return count;
+}
+
+/*
+ * Server::tick()
+ */
+void Server::tick()
+{
+    for (ThrottleFlow *c : connections)
+    {
+        c->flush();
+    }
+}
+
+/** Constructor.
+ * @param server server this flow belongs to
  * @param fd socket descriptor of throttle connection.
- * @param node OpenLCB node that proxies our throttles
  */
-ThrottleFlow::ThrottleFlow(Server *server, int fd, openlcb::Node *node)
+ThrottleFlow::ThrottleFlow(Server *server, int fd)
     : StateFlowBase(server)
-    , olcbThrottle(node)
+    , olcbThrottle(nullptr)
     , server(server)
     , fd(fd)
-    , data()
-    , dataIndex(0)
-    , state(STATE_COMMAND)
+    , rxBegin(0)
+    , rxEnd(0)
+    , rxDiscard(false)
+    , txOverflow(false)
+    , dirtyFn(0)
+    , dirtySpeed(false)
     , selectHelper(this)
-    , dispatcher(server)
-    , command(dispatcher.alloc())
+    , timer(this)
+    , command(nullptr)
     , serverCommandLoco(this)
 {
+    command = serverCommandLoco.alloc();
+}
+
+/*
+ * ThrottleFlow::~ThrottleFlow()
+ */
+ThrottleFlow::~ThrottleFlow()
+{
+    close(fd);
+    command->unref();
 }
 
 /*
@@ -55,10 +162,12 @@ ThrottleFlow::ThrottleFlow(Server *server, int fd, openlcb::Node *node)
  */
 StateFlowBase::Action ThrottleFlow::entry()
 {
-    string init = Defs::get_init_string();
-
-    return write_repeated(&selectHelper, fd, init.data(), init.length(),
-                          STATE(data_sent));
+    /* all the connections share one thread, so reads must not block */
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    server->connections.push_back(this);
+    send(Defs::get_init_string());
+    flush();
+    return call_immediately(STATE(data_sent));
 }
 
 /*
@@ -66,8 +175,8 @@ StateFlowBase::Action ThrottleFlow::entry()
  */
 StateFlowBase::Action ThrottleFlow::data_sent()
 {
-    return read_single(&selectHelper, fd, readRaw, sizeof(readRaw),
-                      STATE(data_received));
+    return read_single(&selectHelper, fd, rx + rxEnd, RX_BUFFER_SIZE - rxEnd,
+                       STATE(data_received));
 }
 
 /*
@@ -75,212 +184,326 @@ StateFlowBase::Action ThrottleFlow::data_sent()
  */
 StateFlowBase::Action ThrottleFlow::data_received()
 {
-    if (selectHelper.hasError_)
+    if (selectHelper.hasError_ ||
+        selectHelper.remaining_ == RX_BUFFER_SIZE - rxEnd)
     {
         /* remote throttle has closed the connection */
-        printf("WiThrottle connection closed\n");
-        return delete_this();
+        LOG(INFO, "WiThrottle connection closed");
+        return call_immediately(STATE(shutdown));
     }
 
-    //printf("WiThrottle strraw: %.*s\n",
-    //       sizeof(readRaw) - selectHelper.remaining_, readRaw);
-
-    data.append(readRaw, sizeof(readRaw) - selectHelper.remaining_);
-    if (data.find('\n' != string::npos))
+    rxEnd = RX_BUFFER_SIZE - selectHelper.remaining_;
+    process_lines();
+    if (fd < 0)
     {
-        bool result;
-        do
-        {
-            result = parse();
-            if (result)
-            {
-                dispatcher.send(command);
-                command = dispatcher.alloc();
-            }
-        } while (result);
+        /* device sent quit */
+        return call_immediately(STATE(shutdown));
     }
+    /* send the replies without waiting for the next tick */
+    flush();
 
-    return read_single(&selectHelper, fd, readRaw, sizeof(readRaw),
-                       STATE(data_received));
+    return call_immediately(STATE(data_sent));
 }
 
 /*
- * ThrottleFlow::parse()
+ * ThrottleFlow::process_lines()
  */
-bool ThrottleFlow::parse()
+void ThrottleFlow::process_lines()
 {
-    const char *c_str = data.c_str();
-    printf("WiThrottle stream: %s\n", c_str + dataIndex);
-
-    do
+    char *nl;
+    while ((nl = (char*)memchr(rx + rxBegin, '\n', rxEnd - rxBegin)))
     {
-        switch (state)
+        size_t end = nl - rx;
+        size_t len = end - rxBegin;
+        if (len && rx[rxBegin + len - 1] == '\r')
         {
-            case STATE_COMMAND:
-                if (data.length() < 2)
-                {
-                    /* need more data first */
-                    return false;
-                }
-                parse_command();
-                break;
-            case STATE_MULTI_TYPE:
-                parse_multi_type();
-                break;
-            case STATE_TRAIN:
-                parse_train();
-                break;
-            case STATE_SUBCOMMAND:
-                if (parse_subcommand())
-                {
-                    return true;
-                }
-                break;
-            case STATE_PAYLOAD:
-            default:
-            case STATE_NEXT:
-                if (data[0] == '\n')
-                {
-                    dataIndex = 0;
-                    state = STATE_COMMAND;
-                }
-                data.erase(0, 1);
-                break;
+            --len;
         }
-    } while (data.length());
+        if (rxDiscard)
+        {
+            /* tail of an overlong line */
+            rxDiscard = false;
+        }
+        else if (len && parse_line(rx + rxBegin, len))
+        {
+            serverCommandLoco.send(command);
+            command = serverCommandLoco.alloc();
+        }
+        rxBegin = end + 1;
+        if (fd < 0)
+        {
+            return;
+        }
+    }
 
-    return false;
+    if (rxBegin == rxEnd)
+    {
+        /* the common case: everything consumed, no data to move */
+        rxBegin = rxEnd = 0;
+    }
+    else if (rxEnd == RX_BUFFER_SIZE)
+    {
+        if (rxBegin == 0)
+        {
+            /* line longer than the buffer, drop it */
+            LOG(WARNING, "WiThrottle line too long, dropped");
+            rxEnd = 0;
+            rxDiscard = true;
+        }
+        else
+        {
+            /* move the partial line to the front */
+            memmove(rx, rx + rxBegin, rxEnd - rxBegin);
+            rxEnd -= rxBegin;
+            rxBegin = 0;
+        }
+    }
 }
 
 /*
- * ThrottleFlow::parse_command()
+ * ThrottleFlow::parse_line()
  */
-void ThrottleFlow::parse_command()
+bool ThrottleFlow::parse_line(const char *line, size_t len)
 {
-    command->data()->commandType = (CommandType)data[0];
+    ThrottleCommand *c = command->data();
+    const char *end = line + len;
+    c->commandType = (CommandType)line[0];
 
-    switch (data[0])
+    switch (line[0])
     {
         default:
         case SECONDARY:
         case HEX_PACKET:
         case PANEL:
         case ROSTER:
+            return false;
         case QUIT:
-            state = STATE_NEXT;
-            return;
-        case MULTI:
-            state = data[1] == 'T' ? STATE_MULTI_TYPE : STATE_NEXT;
-            data.erase(0, 1);
-            break;
-        case PRIMARY:
-            state = STATE_SUBCOMMAND;
-            break;
+            /* signal the read loop to shut down */
+            ::shutdown(fd, SHUT_RDWR);
+            close(fd);
+            fd = -1;
+            return false;
         case HEARTBEAT:
+            send("*10\n\n");
+            return false;
         case SET_NAME:
-            write(fd, "*10\n\n", 5);
+            name.assign(line + 1, end);
+            send("*10\n\n");
+            return false;
         case SET_ID:
-            state = STATE_PAYLOAD;
-            break;
+            id.assign(line + 1, end);
+            return false;
+        case PRIMARY:
+            if (len < 2)
+            {
+                return false;
+            }
+            c->train.clear();
+            c->commandSubType = (CommandSubType)line[1];
+            c->payload.assign(line + 2, end);
+            return true;
+        case MULTI:
+        {
+            /* MT<type><train><;><subcommand><payload> */
+            if (len < 4 || line[1] != 'T')
+            {
+                return false;
+            }
+            switch (line[2])
+            {
+                default:
+                    return false;
+                case ACTION:
+                case ADD:
+                case REMOVE:
+                    c->commandMultiType = (CommandMultiType)line[2];
+                    break;
+            }
+            static const char SEPARATOR[] = "<;>";
+            const char *sep = std::search(line + 3, end, SEPARATOR,
+                                          SEPARATOR + 3);
+            if (sep == line + 3 || end - sep < 4)
+            {
+                /* invalid string */
+                return false;
+            }
+            c->train.assign(line + 3, sep);
+            c->commandSubType = (CommandSubType)sep[3];
+            c->payload.assign(sep + 4, end);
+            return true;
+        }
     }
-
-    data.erase(0, 1);
 }
 
 /*
- * ThrottleFlow::parse_multi_type()
+ * ThrottleFlow::mark_dirty()
  */
-void ThrottleFlow::parse_multi_type()
+void ThrottleFlow::mark_dirty(int fn)
 {
-    switch (data[0])
+    AtomicHolder h(this);
+    if (fn < 0)
     {
-        default:
-            state = STATE_NEXT;
-            return;
-        case ACTION:
-        case ADD:
-        case REMOVE:
-            state = STATE_TRAIN;
-            command->data()->commandMultiType = (CommandMultiType)data[0];
-            break;
+        dirtySpeed = true;
+    }
+    else if (fn <= openlcb::TractionThrottle::MAX_FN_QUERY)
+    {
+        dirtyFn |= 1UL << fn;
     }
-
-    data.erase(0, 1);
 }
 
 /*
- * ThrottleFlow::parse_train()
+ * ThrottleFlow::send()
  */
-void ThrottleFlow::parse_train()
+void ThrottleFlow::send(const string &data)
 {
-    size_t end = data.find("<;>");
+    if (fd < 0 || txOverflow)
+    {
+        return;
+    }
+    if (tx.size() + data.size() > TX_MAX_SIZE)
+    {
+        /* the device stopped reading; the read loop will see the error and
+         * shut down the connection */
+        LOG(WARNING, "WiThrottle device does not read its output, closing");
+        ::shutdown(fd, SHUT_RDWR);
+        txOverflow = true;
+        tx.clear();
+        return;
+    }
+    tx.append(data);
+}
 
-    switch (end)
+/*
+ * ThrottleFlow::flush()
+ */
+void ThrottleFlow::flush()
+{
+    uint32_t fns = 0;
+    bool speed = false;
+    if (tx.size() < TX_HIGH_WATER)
+    {
+        AtomicHolder h(this);
+        fns = dirtyFn;
+        speed = dirtySpeed;
+        dirtyFn = 0;
+        dirtySpeed = false;
+    }
+    if (olcbThrottle && !train.empty())
     {
-        case string::npos:
-        case 1:
-            if (data[0] == '*')
+        /* several changes of the same value within a tick result in a
+         * single status line */
+        for (int i = 0; fns; ++i, fns >>= 1)
+        {
+            if (fns & 1)
             {
-                break;
+                uint16_t value = olcbThrottle->get_fn(i);
+                send(Defs::get_function_status_string(
+                    train.c_str(), i,
+                    value != openlcb::TractionThrottle::FN_NOT_KNOWN &&
+                    value));
             }
-        case 0:
-            /* invalid string */
-            state = STATE_NEXT;
-            return;
+        }
+        if (speed)
+        {
+            send(Defs::get_speed_status_string(
+                train.c_str(), olcbThrottle->get_speed()));
+        }
+    }
+    if (tx.empty() || fd < 0)
+    {
+        return;
+    }
+    ssize_t count = ::send(fd, tx.data(), tx.size(),
+                           MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (count > 0)
+    {
+        tx.erase(0, count);
     }
-
-    command->data()->train.assign(data, 0, end);
-    data.erase(0, end + 3);
-    state = STATE_SUBCOMMAND;
 }
 
 /*
- * ThrottleFlow::parse_subcommand()
+ * ThrottleFlow::acquire_throttle()
  */
-bool ThrottleFlow::parse_subcommand()
+openlcb::TractionThrottle *ThrottleFlow::acquire_throttle()
 {
-    switch (data[0])
+    if (!olcbThrottle)
     {
-        default:
-        case VELOCITY:
-        case ESTOP:
-        case FUNCTION:
-        case FORCE:
-        case DIRECTION:
-        case RELEASE:
-        case DISPATCH:
-        case ADDR_SHORT:
-        case ADDR_ROSTER:
-        case CONSIST:
-        case CONSIST_LEAD:
-        case IDLE:
-        case SS_MODE:
-        case MOMENTARY:
-        case QUERY:
-            state = STATE_NEXT;
-            return false;
-        case ADDR_LONG:
-            state = STATE_PAYLOAD;
-            break;
+        olcbThrottle = server->throttlePool.acquire();
     }
+    return olcbThrottle;
+}
 
-    command->data()->commandSubType = (CommandSubType)data[0];
-    data.erase(0, 1);
+/*
+ * ThrottleFlow::listen_throttle()
+ */
+void ThrottleFlow::listen_throttle()
+{
+    /* the listener is called on the OpenLCB executor */
+    openlcb::TractionThrottle *t = olcbThrottle;
+    server->node->iface()->executor()->sync_run([this, t]()
+    {
+        t->set_throttle_listener(
+            std::bind(&ThrottleFlow::mark_dirty, this, std::placeholders::_1));
+    });
+}
 
-    size_t end = data.find('\n');
+/*
+ * ThrottleFlow::release_throttle()
+ */
+void ThrottleFlow::release_throttle()
+{
+    if (!olcbThrottle)
+    {
+        return;
+    }
+    /* the listener is called on the OpenLCB executor */
+    openlcb::TractionThrottle *t = olcbThrottle;
+    server->node->iface()->executor()->sync_run(
+        [t]() { t->set_throttle_listener(nullptr); });
+    server->throttlePool.release(olcbThrottle);
+    olcbThrottle = nullptr;
+    train.clear();
+}
 
-    switch (end)
+/*
+ * ThrottleFlow::shutdown()
+ */
+StateFlowBase::Action ThrottleFlow::shutdown()
+{
+    if (!serverCommandLoco.is_waiting())
     {
-        case string::npos:
-            /* invalid payload */
-            state = STATE_NEXT;
-            return false;
+        /* a command is still using the throttle */
+        return sleep_and_call(&timer, MSEC_TO_NSEC(10), STATE(shutdown));
+    }
+    return call_immediately(STATE(release_train));
+}
+
+/*
+ * ThrottleFlow::release_train()
+ */
+StateFlowBase::Action ThrottleFlow::release_train()
+{
+    if (!olcbThrottle)
+    {
+        return call_immediately(STATE(train_released));
     }
+    return invoke_subflow_and_wait(olcbThrottle, STATE(train_released),
+        openlcb::TractionThrottleCommands::RELEASE_TRAIN);
+}
 
-    command->data()->payload.assign(data, 0, end);
-    data.erase(0, end);
-    state = STATE_COMMAND;
-    return true;
+/*
+ * ThrottleFlow::train_released()
+ */
+StateFlowBase::Action ThrottleFlow::train_released()
+{
+    if (olcbThrottle)
+    {
+        full_allocation_result(olcbThrottle)->unref();
+        release_throttle();
+    }
+    auto &c = server->connections;
+    c.erase(std::remove(c.begin(), c.end(), this), c.end());
+    return delete_this();
 }
 
 } /* namespace withrottle */
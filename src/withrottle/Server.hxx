@@ -30,10 +30,13 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
-#include "executor/Dispatcher.hxx"
 #include "executor/Service.hxx"
+#include "executor/StateFlow.hxx"
+#include "executor/Timer.hxx"
 #include "openlcb/TractionThrottle.hxx"
+#include "utils/Atomic.hxx"
 #include "utils/socket_listener.hxx"
 #include "withrottle/Defs.hxx"
 #include "withrottle/ServerCommand.hxx"
@@ -44,32 +47,92 @@ namespace withrottle
 /* forward declaration */
 class ThrottleFlow;
 
+/** Pool of OpenLCB throttles shared by all the WiThrottle connections. A
+ * connection borrows a throttle only while it has a locomotive acquired, so
+ * connected but idle devices do not each hold a throttle stack.
+ */
+class ThrottlePool : private Atomic
+{
+public:
+    /** Constructor.
+     * @param node OpenLCB node that the throttles send their messages from
+     * @param max_size maximum number of throttles to create
+     */
+    ThrottlePool(openlcb::Node *node, unsigned max_size)
+        : node(node)
+        , maxSize(max_size)
+    {
+    }
+
+    /** Borrow a throttle from the pool. Throttles are created on demand.
+     * @return a throttle with no train assigned, or nullptr if all throttles
+     *         are in use
+     */
+    openlcb::TractionThrottle *acquire();
+
+    /** Return a throttle to the pool. The caller must have released the
+     * train and cleared the throttle listener.
+     * @param throttle throttle previously returned by acquire()
+     */
+    void release(openlcb::TractionThrottle *throttle);
+
+    /** @return number of throttles that have been created */
+    size_t size()
+    {
+        AtomicHolder h(this);
+        return throttles.size();
+    }
+
+    /** @return number of throttles currently lent out */
+    size_t in_use()
+    {
+        AtomicHolder h(this);
+        return throttles.size() - freeList.size();
+    }
+
+private:
+    /** node the throttles are created on */
+    openlcb::Node *node;
+
+    /** maximum number of throttles */
+    unsigned maxSize;
+
+    /** all throttles ever created */
+    std::vector<std::unique_ptr<openlcb::TractionThrottle>> throttles;
+
+    /** throttles not currently lent out */
+    std::vector<openlcb::TractionThrottle *> freeList;
+
+    DISALLOW_COPY_AND_ASSIGN(ThrottlePool);
+};
+
 /** WiThrottle server object.
  */
 class Server : public Service
 {
 public:
+    enum
+    {
+        /** default limit for the number of locomotives acquired at once */
+        DEFAULT_MAX_THROTTLES = 32,
+    };
+
+    /** Period of sending the coalesced state updates to the devices. */
+    static constexpr long long UPDATE_TICK_NSEC = MSEC_TO_NSEC(50);
+
     /** Constructor.
      * @param name name of the bus
      * @param port TCP port to listen for connections on, -1 for default.
      * @param node reference to the OpenLCB Node that proxies our bus
+     * @param max_throttles maximum number of locomotives that can be
+     *        acquired at the same time across all connections
      */
-    Server(const char *name, int port, openlcb::Node *node)
-        : Service(&executor)
-        , executor(name, 0, 2048)
-        , node(node)
-        , listener((port >= 0 || port <= UINT16_MAX) ? port : Defs::DEFAULT_PORT,
-                   std::bind(&Server::on_new_connection, this,
-                   std::placeholders::_1))
-    {
-    }
+    Server(const char *name, int port, openlcb::Node *node,
+           unsigned max_throttles = DEFAULT_MAX_THROTTLES);
 
-    /** Destructor.
+    /** Destructor. Closes all connections.
      */
-    ~Server()
-    {
-        listener.shutdown();
-    }
+    ~Server();
 
     /** Start the server.
      */
@@ -77,19 +140,80 @@ public:
     {
     }
 
+    /** @return true if the server is accepting connections */
+    bool is_started()
+    {
+        return listener.is_started();
+    }
+
+    /** @return number of open throttle connections */
+    size_t connection_count();
+
+    /** @return the throttle pool shared by the connections */
+    ThrottlePool *throttle_pool()
+    {
+        return &throttlePool;
+    }
+
 private:
+    /** Timer driving the coalesced state updates. */
+    class TickTimer : public ::Timer
+    {
+    public:
+        /** Constructor.
+         * @param server parent server
+         */
+        TickTimer(Server *server)
+            : ::Timer(server->executor.active_timers())
+            , server(server)
+        {
+        }
+
+        /** Timer callback.
+         * @return RESTART
+         */
+        long long timeout() override
+        {
+            if (is_triggered())
+            {
+                return NONE;
+            }
+            server->tick();
+            return RESTART;
+        }
+
+    private:
+        /** parent server */
+        Server *server;
+    };
+
     /** A new throttle connection is made.
      * @param fd socket descriptor
      */
     void on_new_connection(int fd);
 
+    /** Flushes the pending output of every connection. Called on the
+     * executor.
+     */
+    void tick();
+
     /** The executor that will run the WiThrottle flows. */
     Executor<1> executor;
 
     /** node reference */
     openlcb::Node* node;
 
-    /** listen socket for new connections */
+    /** throttles shared by the connections */
+    ThrottlePool throttlePool;
+
+    /** open connections; accessed on the executor only */
+    std::vector<ThrottleFlow *> connections;
+
+    /** periodic flush of the state updates */
+    TickTimer tickTimer;
+
+    /** listen socket for new connections; must be last, because it starts
+     * accepting connections from its constructor */
     SocketListener listener;
 
     /** allow access from ThrottleFlow */
@@ -100,23 +224,18 @@ private:
 
 /** State flow for handling a throttle instance.
  */
-class ThrottleFlow : public StateFlowBase
+class ThrottleFlow : public StateFlowBase, private Atomic
 {
 public:
     /** Constructor.
-     * @param service service this flow belongs to
+     * @param server server this flow belongs to
      * @param fd socket descriptor of throttle connection.
-     * @param node OpenLCB node that proxies our throttles
      */
-    ThrottleFlow(Server *server, int fd, openlcb::Node *node);
+    ThrottleFlow(Server *server, int fd);
 
     /** Destructor.
      */
-    ~ThrottleFlow()
-    {
-        close(fd);
-        command->unref();
-    }
+    ~ThrottleFlow();
 
     /** Start the service.
      */
@@ -125,28 +244,62 @@ public:
         start_flow(STATE(entry));
     }
 
-private:
-    /** Parse the incoming data.
-     * @return true if a fully parsed command has been found, else false
+    /** Queue data to be sent to the device. The data goes out at the next
+     * flush(). If the device does not read its output and the queue grows
+     * past TX_MAX_SIZE, the connection is closed instead.
+     * @param data data to send
      */
-    bool parse();
+    void send(const string &data);
 
-    /** Parse the incoming data. */
-    void parse_command();
+    /** Render the coalesced state updates and write the pending output to
+     * the socket without blocking. Must be called on the server executor.
+     */
+    void flush();
+
+    /** Borrow a throttle from the server's pool if we do not have one yet.
+     * @return the throttle, or nullptr if the pool is exhausted
+     */
+    openlcb::TractionThrottle *acquire_throttle();
+
+    /** Report the remote changes of the borrowed throttle's train to the
+     * device.
+     */
+    void listen_throttle();
 
-    /** Parse the incoming data. */
-    void parse_multi_type();
+    /** Stop listening to the throttle and return it to the pool. The train
+     * must already be released.
+     */
+    void release_throttle();
 
-    /** Parse the incoming data. */
-    void parse_train();
+    /** Record that a state value has changed and needs to be reported to
+     * the device at the next tick. May be called from any thread.
+     * @param fn function number changed, or -1 for speed and direction
+     */
+    void mark_dirty(int fn);
 
-    /** Parse the incoming data.
-     * @return true if a fully parsed command has been found, else false
+private:
+    enum
+    {
+        /** size of the receive buffer; also the longest accepted line */
+        RX_BUFFER_SIZE = 256,
+        /** while more output than this is waiting, the state updates are
+         * held back; the dirty bits keep them until the device catches up */
+        TX_HIGH_WATER = 1024,
+        /** the connection is closed when this much output is waiting */
+        TX_MAX_SIZE = 4096,
+    };
+
+    /** Parse all complete lines in the receive buffer and dispatch the
+     * commands found.
      */
-    bool parse_subcommand();
+    void process_lines();
 
-    /** Parse the incoming data. */
-    void parse_multi();
+    /** Parse a single line in place.
+     * @param line start of the line, not including the line terminator
+     * @param len number of characters in the line
+     * @return true if command has been filled in and needs to be dispatched
+     */
+    bool parse_line(const char *line, size_t len);
 
     /** Beginning of state flow.
      * @return next state is data_sent()
@@ -159,46 +312,71 @@ private:
     StateFlowBase::Action data_sent();
 
     /** Process read data.
-     * @return next state is data_received()
+     * @return next state is data_received(), or shutdown() on error
      */
     StateFlowBase::Action data_received();
 
-    /**< OpenLCB throttle instance */
-    openlcb::TractionThrottle olcbThrottle;
+    /** Connection is closed; wait for the command handler to go idle.
+     * @return next state is release_train() once idle
+     */
+    StateFlowBase::Action shutdown();
+
+    /** Release the train of the borrowed throttle, if any.
+     * @return next state is train_released()
+     */
+    StateFlowBase::Action release_train();
+
+    /** Return the throttle to the pool and delete this connection.
+     * @return delete_this()
+     */
+    StateFlowBase::Action train_released();
+
+    /**< OpenLCB throttle instance, borrowed from the server's pool */
+    openlcb::TractionThrottle *olcbThrottle;
 
     /** reference to parent server */
     Server *server;
 
     string name; /**< name of throttle */
     string id; /**< id of throttle */
+    string train; /**< WiThrottle handle of the acquired locomotive */
     LocoAddress address; /**< primary locomitve addres */
     LocoAddress secondaryAddress; /**< secondary locomotive address */
 
     /** socket descriptor of throttle connection */
     int fd;
 
-    /** read data buffer */
-    char readRaw[128];
+    /** receive buffer; lines are parsed in place */
+    char rx[RX_BUFFER_SIZE];
+
+    /** offset of the first unparsed character in rx */
+    size_t rxBegin;
+
+    /** offset of the end of the received data in rx */
+    size_t rxEnd;
 
-    /** agrigate pre-processed stream data */
-    string data;
+    /** true while skipping the rest of a line that did not fit in rx */
+    bool rxDiscard;
 
-    /** data index for parsing */
-    size_t dataIndex;
+    /** output waiting to be written to the socket */
+    string tx;
 
-    /** Current state of parsing the data */
-    ServerState state;
+    /** true if the connection was shut down for not reading its output */
+    bool txOverflow;
+
+    /** bit N set if function N changed since the last flush */
+    uint32_t dirtyFn;
+
+    /** true if speed or direction changed since the last flush */
+    bool dirtySpeed;
 
     /** Helper for waiting on data from a file descriptor */
     StateFlowSelectHelper selectHelper;
 
-    /** dispatch flow that will handle messages incoming from the cab */
-    typedef DispatchFlow<Buffer<ThrottleCommand>, 1> CommandDispatchFlow;
+    /** Helper for polling the command handler during shutdown */
+    StateFlowTimer timer;
 
-    /** flow responsible for routing incoming messages to handlers. */
-    CommandDispatchFlow dispatcher;
-
-    /** throttle command */
+    /** throttle command being filled in by the parser */
     Buffer<ThrottleCommand> *command;
 
     /** handler for locomotive commands */
@@ -209,6 +387,9 @@ private:
 
     /** allow access to private members from class ServerCommandLoco */
     friend class ServerCommandLoco;
+
+    /** allow access to private members from class Server */
+    friend class Server;
 };
 
 /*
@@ -216,7 +397,7 @@ private:
  */
 inline void Server::on_new_connection(int fd)
 {
-    ThrottleFlow *flow = new ThrottleFlow(this, fd, node);
+    ThrottleFlow *flow = new ThrottleFlow(this, fd);
     flow->start();
 }
 
@@ -35,11 +35,10 @@ namespace withrottle
 /*
  * ServerCommandBase::ServerCommandBase()
  */
-ServerCommandBase::ServerCommandBase(ThrottleFlow *throttle, CommandType type)
+ServerCommandBase::ServerCommandBase(ThrottleFlow *throttle)
     : StateFlow<Buffer<ThrottleCommand>, QList<1>>(throttle->service())
     , throttle(throttle)
 {
-    throttle->dispatcher.register_handler(this, type, TYPE_MASK);
 }
 
 /*
@@ -47,7 +46,6 @@ ServerCommandBase::ServerCommandBase(ThrottleFlow *throttle, CommandType type)
  */
 ServerCommandBase::~ServerCommandBase()
 {
-    throttle->dispatcher.unregister_handler_all(this);
 }
 
 } /* namespace withrottle */
@@ -28,7 +28,6 @@
 #ifndef _WITHROTTLE_SERVERCOMMAND_HXX_
 #define _WITHROTTLE_SERVERCOMMAND_HXX_
 
-#include "executor/Dispatcher.hxx"
 #include "executor/StateFlow.hxx"
 #include "withrottle/Defs.hxx"
 
@@ -45,9 +44,8 @@ class ServerCommandBase : public StateFlow<Buffer<ThrottleCommand>, QList<1>>
 protected:
     /** Constructor.
      * @param throttle parent throttle that this flow is acting on
-     * @param type the command type belonging to this handler.
      */
-    ServerCommandBase(ThrottleFlow *throttle, CommandType type);
+    ServerCommandBase(ThrottleFlow *throttle);
 
     /** Destructor.
      */
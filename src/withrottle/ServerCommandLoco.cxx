@@ -27,7 +27,11 @@
 
 #include "withrottle/ServerCommandLoco.hxx"
 
-#include <cstdio>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
 
 #include "openlcb/TractionDefs.hxx"
 #include "withrottle/Server.hxx"
@@ -35,23 +39,43 @@
 namespace withrottle
 {
 
+/** Parse the function number of a function command.
+ * @param payload command payload, "<1|0><number>"
+ * @return function number, or -1 if the number is missing, malformed or
+ *         out of range
+ */
+static int parse_fn(const string &payload)
+{
+    const char *begin = payload.c_str() + 1;
+    if (!isdigit((unsigned char)*begin))
+    {
+        /* strtoul would accept a sign or whitespace */
+        return -1;
+    }
+    char *end;
+    errno = 0;
+    unsigned long fn = strtoul(begin, &end, 10);
+    if (errno || *end || fn > openlcb::TractionThrottle::MAX_FN_QUERY)
+    {
+        return -1;
+    }
+    return fn;
+}
+
 /*
  * ServerCommandLoco::ServerCommandLoco()
  */
 ServerCommandLoco::ServerCommandLoco(ThrottleFlow *throttle)
-    : ServerCommandBase(throttle, PRIMARY)
+    : ServerCommandBase(throttle)
+    , nodeId(0)
 {
-    throttle->dispatcher.register_handler(this, SECONDARY, TYPE_MASK);
-    throttle->dispatcher.register_handler(this, MULTI, TYPE_MASK);
 }
 
 /*
- * ServerCommandLoco::ServerCommandLoco()
+ * ServerCommandLoco::~ServerCommandLoco()
  */
 ServerCommandLoco::~ServerCommandLoco()
 {
-    throttle->dispatcher.unregister_handler(this, SECONDARY, TYPE_MASK);
-    throttle->dispatcher.unregister_handler(this, MULTI, TYPE_MASK);
 }
 
 /*
@@ -61,33 +85,77 @@ StateFlowBase::Action ServerCommandLoco::entry()
 {
     switch (message()->data()->commandSubType)
     {
-        default:
-            return release_and_exit();
         case ADDR_LONG:
-            return call_immediately(STATE(address_long));
+        case ADDR_SHORT:
+            return call_immediately(STATE(address));
+        default:
+            break;
+    }
+
+    if (!throttle->olcbThrottle || throttle->train.empty())
+    {
+        /* no locomotive acquired */
+        return release_and_exit();
+    }
+
+    switch (message()->data()->commandSubType)
+    {
+        case RELEASE:
+        case DISPATCH:
+            return call_immediately(STATE(release_loco));
+        default:
+            return call_immediately(STATE(control));
     }
 }
 
 /*
- * ServerCommandLoco::address_long()
+ * ServerCommandLoco::address()
  */
-StateFlowBase::Action ServerCommandLoco::address_long()
+StateFlowBase::Action ServerCommandLoco::address()
 {
-    unsigned long value = strtoul(message()->data()->payload.c_str(), NULL, 0);
+    ThrottleCommand *c = message()->data();
+    errno = 0;
+    unsigned long value = strtoul(c->payload.c_str(), NULL, 10);
 
-    if ((value == 0 && errno == EINVAL) || value > 9999)
+    if (errno || value > 9999 ||
+        (c->commandSubType == ADDR_SHORT && value > 127))
     {
         return release_and_exit();
     }
 
-    printf("loco: %lu\n", value);
-
     /** @todo need to search for train */
-    openlcb::NodeID node_id = openlcb::TractionDefs::train_node_id_from_legacy(
-        dcc::TrainAddressType::DCC_LONG_ADDRESS, value);
+    nodeId = openlcb::TractionDefs::train_node_id_from_legacy(
+        c->commandSubType == ADDR_LONG ?
+            dcc::TrainAddressType::DCC_LONG_ADDRESS :
+            dcc::TrainAddressType::DCC_SHORT_ADDRESS, value);
+
+    if (throttle->olcbThrottle && !throttle->train.empty())
+    {
+        /* one locomotive per device, drop the previous one first */
+        return invoke_subflow_and_wait(throttle->olcbThrottle, STATE(assign),
+            openlcb::TractionThrottleCommands::RELEASE_TRAIN);
+    }
+    return call_immediately(STATE(assign));
+}
+
+/*
+ * ServerCommandLoco::assign()
+ */
+StateFlowBase::Action ServerCommandLoco::assign()
+{
+    if (throttle->olcbThrottle && !throttle->train.empty())
+    {
+        full_allocation_result(throttle->olcbThrottle)->unref();
+        throttle->release_throttle();
+    }
+
+    if (!throttle->acquire_throttle())
+    {
+        return alert("No free throttles");
+    }
 
-    return invoke_subflow_and_wait(&throttle->olcbThrottle, STATE(assign_train),
-        openlcb::TractionThrottleCommands::ASSIGN_TRAIN, node_id, 0);
+    return invoke_subflow_and_wait(throttle->olcbThrottle, STATE(assign_train),
+        openlcb::TractionThrottleCommands::ASSIGN_TRAIN, nodeId, true);
 }
 
 /*
@@ -95,19 +163,17 @@ StateFlowBase::Action ServerCommandLoco::address_long()
  */
 StateFlowBase::Action ServerCommandLoco::assign_train()
 {
-    auto *m = full_allocation_result(&throttle->olcbThrottle);
-    switch (m->data()->resultCode)
+    auto *m = full_allocation_result(throttle->olcbThrottle);
+    int result = m->data()->resultCode;
+    m->unref();
+
+    if (result != openlcb::Defs::ERROR_CODE_OK)
     {
-        //case openlcb::Defs::ERROR_CODE_OK:
-        //    break;
-        //case openlcb::Defs::ERROR_TIMEOUT:
-        //case openlcb::Defs::ERROR_REJECTED:
-        default:
-            break;
+        throttle->release_throttle();
+        return alert("Locomotive not available");
     }
-    m->unref();
 
-    return invoke_subflow_and_wait(&throttle->olcbThrottle, STATE(load_state), 
+    return invoke_subflow_and_wait(throttle->olcbThrottle, STATE(load_state),
                    openlcb::TractionThrottleCommands::LOAD_STATE);
 }
 
@@ -116,14 +182,157 @@ StateFlowBase::Action ServerCommandLoco::assign_train()
  */
 StateFlowBase::Action ServerCommandLoco::load_state()
 {
-    auto *m = full_allocation_result(&throttle->olcbThrottle);
+    auto *m = full_allocation_result(throttle->olcbThrottle);
     m->unref();
 
-    string status = Defs::get_loco_status_string(&throttle->olcbThrottle,
-                                                 message()->data()->train.c_str());
+    ThrottleCommand *c = message()->data();
+    throttle->train = c->train.empty() ? c->payload : c->train;
 
-    ::write(throttle->fd, status.c_str(), status.length());
-    printf("%s", status.c_str());
+    throttle->listen_throttle();
+    throttle->send(Defs::get_loco_status_string(throttle->olcbThrottle,
+                                                throttle->train.c_str()));
+    throttle->flush();
+
+    return release_and_exit();
+}
+
+/*
+ * ServerCommandLoco::release_loco()
+ */
+StateFlowBase::Action ServerCommandLoco::release_loco()
+{
+    return invoke_subflow_and_wait(throttle->olcbThrottle,
+        STATE(train_released),
+        openlcb::TractionThrottleCommands::RELEASE_TRAIN);
+}
+
+/*
+ * ServerCommandLoco::train_released()
+ */
+StateFlowBase::Action ServerCommandLoco::train_released()
+{
+    full_allocation_result(throttle->olcbThrottle)->unref();
+
+    string status("MT-");
+    status.append(throttle->train);
+    status.append("<;>\n\n");
+    throttle->release_throttle();
+    throttle->send(status);
+    throttle->flush();
+
+    return release_and_exit();
+}
+
+/*
+ * ServerCommandLoco::control()
+ */
+StateFlowBase::Action ServerCommandLoco::control()
+{
+    ThrottleCommand *c = message()->data();
+    openlcb::TractionThrottle *t = throttle->olcbThrottle;
+
+    switch (c->commandSubType)
+    {
+        default:
+            break;
+        case VELOCITY:
+        {
+            int value = atoi(c->payload.c_str());
+            if (value < 0)
+            {
+                t->set_emergencystop();
+                break;
+            }
+            openlcb::SpeedType speed = t->get_speed();
+            if (std::isnan(speed.speed()))
+            {
+                /* speed not known yet */
+                speed = 0;
+            }
+            speed.set_mph(std::min(value, 126));
+            t->set_speed(speed);
+            break;
+        }
+        case DIRECTION:
+        {
+            openlcb::SpeedType speed = t->get_speed();
+            if (std::isnan(speed.speed()))
+            {
+                speed = 0;
+            }
+            speed.set_direction(c->payload[0] == '0' ?
+                openlcb::SpeedType::REVERSE : openlcb::SpeedType::FORWARD);
+            t->set_speed(speed);
+            break;
+        }
+        case ESTOP:
+            t->set_emergencystop();
+            break;
+        case IDLE:
+        {
+            openlcb::SpeedType speed = t->get_speed();
+            if (std::isnan(speed.speed()))
+            {
+                speed = 0;
+            }
+            speed.set_mph(0);
+            t->set_speed(speed);
+            break;
+        }
+        case FUNCTION:
+        {
+            /* F<1|0><number>: the button is pressed or released; toggle on
+             * press */
+            if (c->payload.size() < 2)
+            {
+                break;
+            }
+            int fn = parse_fn(c->payload);
+            if (fn < 0)
+            {
+                break;
+            }
+            if (c->payload[0] == '1')
+            {
+                t->toggle_fn(fn);
+            }
+            throttle->mark_dirty(fn);
+            break;
+        }
+        case FORCE:
+        {
+            /* f<1|0><number>: set the function state */
+            if (c->payload.size() < 2)
+            {
+                break;
+            }
+            int fn = parse_fn(c->payload);
+            if (fn < 0)
+            {
+                break;
+            }
+            t->set_fn(fn, c->payload[0] == '1' ? 1 : 0);
+            throttle->mark_dirty(fn);
+            break;
+        }
+        case QUERY:
+            throttle->mark_dirty(-1);
+            break;
+    }
+
+    return release_and_exit();
+}
+
+/*
+ * ServerCommandLoco::alert()
+ */
+StateFlowBase::Action ServerCommandLoco::alert(const char *text)
+{
+    string msg("HM");
+    msg.append(text);
+    msg.append("\n\n");
+    throttle->send(msg);
+    throttle->flush();
 
     return release_and_exit();
 }
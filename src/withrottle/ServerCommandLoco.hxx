@@ -28,6 +28,7 @@
 #ifndef _WITHROTTLE_SERVERCOMMANDLOCO_HXX_
 #define _WITHROTTLE_SERVERCOMMANDLOCO_HXX_
 
+#include "openlcb/Defs.hxx"
 #include "withrottle/ServerCommand.hxx"
 
 namespace withrottle
@@ -54,10 +55,15 @@ private:
      */
     StateFlowBase::Action entry() override;
 
-    /** Handle a DCC long address sub-command.
-     * @return next state assign_train
+    /** Handle a DCC long or short address sub-command.
+     * @return next state assign()
      */
-    StateFlowBase::Action address_long();
+    StateFlowBase::Action address();
+
+    /** Borrow a throttle and assign the requested train to it.
+     * @return next state assign_train()
+     */
+    StateFlowBase::Action assign();
 
     /** Handle succes or failure of assigning the train, including getting the
      * latest train state.
@@ -65,11 +71,36 @@ private:
      */
     StateFlowBase::Action assign_train();
 
-    /** Update the LCD display with the trains current state.
+    /** Report the trains current state to the device.
      * @return next state release_and_exit()
      */
     StateFlowBase::Action load_state();
 
+    /** Handle a release or dispatch sub-command.
+     * @return next state train_released()
+     */
+    StateFlowBase::Action release_loco();
+
+    /** Return the throttle to the pool and confirm the release.
+     * @return next state release_and_exit()
+     */
+    StateFlowBase::Action train_released();
+
+    /** Handle a sub-command that acts on the acquired locomotive
+     * synchronously.
+     * @return next state release_and_exit()
+     */
+    StateFlowBase::Action control();
+
+    /** Send a message to the device and end the command.
+     * @param text alert text to show to the user
+     * @return next state release_and_exit()
+     */
+    StateFlowBase::Action alert(const char *text);
+
+    /** node ID of the train being acquired */
+    openlcb::NodeID nodeId;
+
     DISALLOW_COPY_AND_ASSIGN(ServerCommandLoco);
 };
 